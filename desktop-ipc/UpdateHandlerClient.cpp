@@ -121,14 +121,22 @@ void UpdateHandlerClient::extract(UpdateContainer *updateContainer)
       readFrameBuffer(&m_backupFrameBuffer, &r, m_forwGate);
     }
 
-    // Get "copyrect"
-    unsigned char hasCopyRect = m_forwGate->readUInt8();
-    if (hasCopyRect) {
-      m_log->info(_T("UpdateHandlerClient: has \"CopyRect\""));
-      updCont.copySrc = readPoint(m_forwGate);
-      Rect r = readRect(m_forwGate);
-      updCont.copiedRegion.addRect(&r);
-      readFrameBuffer(&m_backupFrameBuffer, &r, m_forwGate);
+    // Get "copyrect" moves
+    unsigned int countCopyMoves = m_forwGate->readUInt32();
+    if (countCopyMoves != 0) {
+      m_log->info(_T("UpdateHandlerClient: count \"CopyRect\" moves = %u"),
+                  countCopyMoves);
+    }
+    for (unsigned int i = 0; i < countCopyMoves; i++) {
+      CopyMove move;
+      move.srcOffset = readPoint(m_forwGate);
+      unsigned int countCopyRect = m_forwGate->readUInt32();
+      for (unsigned int j = 0; j < countCopyRect; j++) {
+        Rect r = readRect(m_forwGate);
+        move.dstRegion.addRect(&r);
+        readFrameBuffer(&m_backupFrameBuffer, &r, m_forwGate);
+      }
+      updCont.copyMoves.push_back(move);
     }
 
     // Get cursor position if it has been changed.
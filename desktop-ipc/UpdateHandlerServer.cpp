@@ -128,15 +128,18 @@ void UpdateHandlerServer::extractReply(BlockingGate *backGate)
     sendFrameBuffer(fb, rect, backGate);
   }
 
-  // Send "copyrect"
-  bool hasCopyRect = !updCont.copiedRegion.isEmpty();
-  backGate->writeUInt8(hasCopyRect);
-  if (hasCopyRect) {
-    sendPoint(&updCont.copySrc, backGate);
-    updCont.copiedRegion.getRectVector(&rects);
-    iRect = rects.begin();
-    sendRect(&(*iRect), backGate);
-    sendFrameBuffer(fb, &(*iRect), backGate);
+  // Send "copyrect" moves
+  unsigned int countCopyMoves = (unsigned int)updCont.copyMoves.size();
+  backGate->writeUInt32(countCopyMoves);
+  for (unsigned int i = 0; i < countCopyMoves; i++) {
+    const CopyMove *move = &updCont.copyMoves[i];
+    sendPoint(&move->srcOffset, backGate);
+    move->dstRegion.getRectVector(&rects);
+    backGate->writeUInt32((unsigned int)rects.size());
+    for (iRect = rects.begin(); iRect < rects.end(); iRect++) {
+      sendRect(&(*iRect), backGate);
+      sendFrameBuffer(fb, &(*iRect), backGate);
+    }
   }
 
   // Send cursor position if it has been changed.
@@ -0,0 +1,470 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#include "BlockHashDetector.h"
+#include "util/CommonHeader.h"
+#include "util/CpuFeatures.h"
+
+#include <crtdbg.h>
+
+#if defined(_M_IX86) || defined(_M_X64)
+#define BLOCK_HASH_DETECTOR_SSE2
+#include <emmintrin.h>
+#endif
+
+// The hash processes each row of a block in 16-byte chunks, two 64-bit
+// lanes per chunk. Each lane of a chunk is mixed with its own key and added
+// to the accumulators, the accumulators are scrambled after each row, so
+// the hash depends on the position of every byte. All the operations used
+// have SSE2 equivalents.
+static const int CHUNK_SIZE = 16;
+static const int MAX_CHUNKS_PER_ROW = BlockHashDetector::BLOCK_SIZE * 4 /
+                                      CHUNK_SIZE;
+
+static const UINT64 CHUNK_KEYS[MAX_CHUNKS_PER_ROW * 2] = {
+  0xBE4BA423396CFEB8ULL, 0x1CAD21F72C81017CULL,
+  0xDB979083E96DD4DEULL, 0x1F67B3B7A4A44072ULL,
+  0x78E5C0CC4EE679CBULL, 0x2172FFCC7DD05A82ULL,
+  0x8E2443F7744608B8ULL, 0x4C263A81E69035E0ULL,
+  0xCB00C391BB52283CULL, 0xA32E531B8B65D088ULL,
+  0x4EF90DA297486471ULL, 0xD8ACDEA946EF1938ULL,
+  0x3F349CE33F76FAA8ULL, 0x1D4F0BC7C7BBDCF9ULL,
+  0x3159B4CD4BE0518AULL, 0x647378D9C97E9FC8ULL
+};
+
+static const UINT64 SCRAMBLE_KEYS[2] = {
+  0xC3EBD33483ACC5EAULL, 0xEB6313FAFFA081C5ULL
+};
+
+static const UINT64 HASH_SEEDS[2] = {
+  0x9E3779B185EBCA87ULL, 0xC2B2AE3D27D4EB4FULL
+};
+
+static const UINT32 SCRAMBLE_PRIME = 0x9E3779B1;
+
+BlockHashDetector::BlockHashDetector()
+: m_useSse2(CpuFeatures::hasSse2()),
+  m_blocksPerRow(0),
+  m_blocksPerColumn(0)
+{
+}
+
+BlockHashDetector::~BlockHashDetector()
+{
+}
+
+void BlockHashDetector::detectChanges(const Region *region,
+                                      const FrameBuffer *screenFb,
+                                      const FrameBuffer *backupFb,
+                                      Region *changedRegion)
+{
+  Dimension dim = backupFb->getDimension();
+  PixelFormat pf = backupFb->getPixelFormat();
+  setProperties(&dim, &pf);
+
+  // Mark the blocks to check.
+  std::vector<Rect> rects;
+  region->getRectVector(&rects);
+  if (rects.empty()) {
+    return;
+  }
+  m_checkedBlocks.assign(m_checkedBlocks.size(), false);
+  int minBlockY = m_blocksPerColumn;
+  int maxBlockY = -1;
+  Rect fbRect = dim.getRect();
+  for (std::vector<Rect>::iterator iRect = rects.begin();
+       iRect < rects.end(); iRect++) {
+    Rect rect = iRect->intersection(&fbRect);
+    if (rect.isEmpty()) {
+      continue;
+    }
+    int left = rect.left / BLOCK_SIZE;
+    int right = (rect.right - 1) / BLOCK_SIZE;
+    int top = rect.top / BLOCK_SIZE;
+    int bottom = (rect.bottom - 1) / BLOCK_SIZE;
+    for (int by = top; by <= bottom; by++) {
+      for (int bx = left; bx <= right; bx++) {
+        m_checkedBlocks[by * m_blocksPerRow + bx] = true;
+      }
+    }
+    minBlockY = min(minBlockY, top);
+    maxBlockY = max(maxBlockY, bottom);
+  }
+
+  // Check the marked blocks, row by row, joining horizontal runs of changed
+  // blocks into single rectangles.
+  std::vector<Rect> runs;
+  for (int by = minBlockY; by <= maxBlockY; by++) {
+    Rect runRect;
+    bool inRun = false;
+    for (int bx = 0; bx < m_blocksPerRow; bx++) {
+      size_t index = by * m_blocksPerRow + bx;
+      bool changed = false;
+      if (m_checkedBlocks[index]) {
+        Rect blockRect = getBlockRect(bx, by);
+        Rect changedRect;
+        changed = checkBlock(index, &blockRect, screenFb, backupFb,
+                             &changedRect);
+        if (changed) {
+          if (inRun) {
+            runRect.setRect(min(runRect.left, changedRect.left),
+                            min(runRect.top, changedRect.top),
+                            max(runRect.right, changedRect.right),
+                            max(runRect.bottom, changedRect.bottom));
+          } else {
+            runRect = changedRect;
+            inRun = true;
+          }
+        }
+        // The whole block is equal to the screen after the changes are
+        // copied, checkBlock() has stored the hashes of the screen rows.
+        m_validHashes[index] = true;
+      }
+      if (!changed && inRun) {
+        runs.push_back(runRect);
+        inRun = false;
+      }
+    }
+    if (inRun) {
+      runs.push_back(runRect);
+    }
+  }
+
+  Region runRegion;
+  runRegion.setRects(&runs);
+  changedRegion->add(&runRegion);
+}
+
+void BlockHashDetector::invalidate(const Region *region)
+{
+  std::vector<Rect> rects;
+  region->getRectVector(&rects);
+  Rect fbRect = m_dimension.getRect();
+  for (std::vector<Rect>::iterator iRect = rects.begin();
+       iRect < rects.end(); iRect++) {
+    Rect rect = iRect->intersection(&fbRect);
+    if (rect.isEmpty()) {
+      continue;
+    }
+    for (int by = rect.top / BLOCK_SIZE;
+         by <= (rect.bottom - 1) / BLOCK_SIZE; by++) {
+      for (int bx = rect.left / BLOCK_SIZE;
+           bx <= (rect.right - 1) / BLOCK_SIZE; bx++) {
+        m_validHashes[by * m_blocksPerRow + bx] = false;
+      }
+    }
+  }
+}
+
+void BlockHashDetector::invalidateAll()
+{
+  m_validHashes.assign(m_validHashes.size(), false);
+}
+
+void BlockHashDetector::setProperties(const Dimension *dim,
+                                      const PixelFormat *pf)
+{
+  if (m_dimension.isEqualTo(dim) && m_pixelFormat.isEqualTo(pf)) {
+    return;
+  }
+  m_dimension = *dim;
+  m_pixelFormat = *pf;
+  m_blocksPerRow = (dim->width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  m_blocksPerColumn = (dim->height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  size_t numBlocks = (size_t)m_blocksPerRow * m_blocksPerColumn;
+  m_rowHashes.assign(numBlocks * BLOCK_SIZE, 0);
+  m_validHashes.assign(numBlocks, false);
+  m_checkedBlocks.assign(numBlocks, false);
+}
+
+Rect BlockHashDetector::getBlockRect(int blockX, int blockY) const
+{
+  Rect rect(blockX * BLOCK_SIZE, blockY * BLOCK_SIZE,
+            min((blockX + 1) * BLOCK_SIZE, m_dimension.width),
+            min((blockY + 1) * BLOCK_SIZE, m_dimension.height));
+  return rect;
+}
+
+UINT64 BlockHashDetector::hashRow(const UINT8 *ptr, int length) const
+{
+  UINT64 acc[2] = { HASH_SEEDS[0], HASH_SEEDS[1] };
+  if (m_useSse2) {
+    hashRowsSse2(acc, ptr, 0, length, 1);
+  } else {
+    hashRows(acc, ptr, 0, length, 1);
+  }
+
+  // Final mixing of the accumulators.
+  UINT64 hash = acc[0] ^ (acc[1] * 0xC2B2AE3D27D4EB4FULL);
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDULL;
+  hash ^= hash >> 33;
+  hash *= 0xC4CEB9FE1A85EC53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+bool BlockHashDetector::checkBlock(size_t index, const Rect *blockRect,
+                                   const FrameBuffer *screenFb,
+                                   const FrameBuffer *backupFb,
+                                   Rect *changedRect)
+{
+  _ASSERT(blockRect->getWidth() <= BLOCK_SIZE);
+  _ASSERT(blockRect->getHeight() <= BLOCK_SIZE);
+
+  const int bytesPerPixel = screenFb->getBytesPerPixel();
+  const int stride = screenFb->getBytesPerRow();
+  const int length = blockRect->getWidth() * bytesPerPixel;
+  const UINT8 *screenPtr =
+    (const UINT8 *)screenFb->getBufferPtr(blockRect->left, blockRect->top);
+  const UINT8 *backupPtr =
+    (const UINT8 *)backupFb->getBufferPtr(blockRect->left, blockRect->top);
+  const int height = blockRect->getHeight();
+  UINT64 *hashes = &m_rowHashes[index * BLOCK_SIZE];
+  // If the stored hashes are valid, they are the hashes of the backup rows,
+  // so a row with another hash certainly differs from the backup.
+  const bool validHashes = m_validHashes[index];
+
+  int top = -1;
+  int bottom = -1;
+  int first = length;
+  int last = -1;
+  for (int y = 0; y < height; y++) {
+    const UINT8 *s = screenPtr + y * stride;
+    const UINT8 *b = backupPtr + y * stride;
+    UINT64 hash = hashRow(s, length);
+    if (validHashes && hashes[y] == hash) {
+      continue;
+    }
+    hashes[y] = hash;
+
+    // Compare the row while it is in the cache.
+    if (validHashes && last != -1) {
+      // The row is known to differ. Only the bytes outside of
+      // [first, last] can extend the changed area.
+      if (first > 0) {
+        int rowFirst = findFirstDifference(s, b, first);
+        if (rowFirst != -1) {
+          first = rowFirst;
+        }
+      }
+      if (last < length - 1) {
+        int rowLast = findLastDifference(s + last + 1, b + last + 1,
+                                         length - last - 1);
+        if (rowLast != -1) {
+          last += rowLast + 1;
+        }
+      }
+    } else {
+      int rowFirst = findFirstDifference(s, b, length);
+      if (rowFirst == -1) {
+        continue;
+      }
+      first = min(first, rowFirst);
+      last = max(last, findLastDifference(s, b, length));
+    }
+    if (top == -1) {
+      top = y;
+    }
+    bottom = y;
+  }
+  if (top == -1) {
+    return false;
+  }
+
+  changedRect->setRect(blockRect->left + first / bytesPerPixel,
+                       blockRect->top + top,
+                       blockRect->left + last / bytesPerPixel + 1,
+                       blockRect->top + bottom + 1);
+  return true;
+}
+
+int BlockHashDetector::findFirstDifference(const UINT8 *a, const UINT8 *b,
+                                           int length) const
+{
+  int i = 0;
+  if (m_useSse2) {
+    i = findFirstDifferenceSse2(a, b, length);
+    if (i != length) {
+      return i;
+    }
+    i = length & ~(CHUNK_SIZE - 1);
+  }
+  for (; i < length; i++) {
+    if (a[i] != b[i]) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int BlockHashDetector::findLastDifference(const UINT8 *a, const UINT8 *b,
+                                          int length) const
+{
+  int i = length - 1;
+  if (m_useSse2) {
+    i = findLastDifferenceSse2(a, b, length);
+    if (i != -1) {
+      return i;
+    }
+    i = (length & (CHUNK_SIZE - 1)) - 1;
+  }
+  for (; i >= 0; i--) {
+    if (a[i] != b[i]) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void BlockHashDetector::hashRows(UINT64 acc[2], const UINT8 *ptr, int stride,
+                                 int length, int height)
+{
+  _ASSERT(length <= MAX_CHUNKS_PER_ROW * CHUNK_SIZE);
+
+  for (int y = 0; y < height; y++, ptr += stride) {
+    UINT8 tail[CHUNK_SIZE];
+    const UINT64 *key = CHUNK_KEYS;
+    for (int i = 0; i < length; i += CHUNK_SIZE, key += 2) {
+      const UINT8 *chunk = ptr + i;
+      if (length - i < CHUNK_SIZE) {
+        memset(tail, 0, CHUNK_SIZE);
+        memcpy(tail, chunk, length - i);
+        chunk = tail;
+      }
+      UINT64 data[2];
+      memcpy(data, chunk, CHUNK_SIZE);
+      UINT64 v0 = data[0] ^ key[0];
+      UINT64 v1 = data[1] ^ key[1];
+      acc[0] += (v0 & 0xFFFFFFFF) * (v0 >> 32) + data[1];
+      acc[1] += (v1 & 0xFFFFFFFF) * (v1 >> 32) + data[0];
+    }
+    for (int i = 0; i < 2; i++) {
+      acc[i] ^= acc[i] >> 47;
+      acc[i] ^= SCRAMBLE_KEYS[i];
+      acc[i] *= SCRAMBLE_PRIME;
+    }
+  }
+}
+
+#ifdef BLOCK_HASH_DETECTOR_SSE2
+
+void BlockHashDetector::hashRowsSse2(UINT64 acc[2], const UINT8 *ptr,
+                                     int stride, int length, int height)
+{
+  _ASSERT(length <= MAX_CHUNKS_PER_ROW * CHUNK_SIZE);
+
+  const __m128i scrambleKey = _mm_loadu_si128((const __m128i *)SCRAMBLE_KEYS);
+  const __m128i prime = _mm_set1_epi32(SCRAMBLE_PRIME);
+  const int fullLength = length & ~(CHUNK_SIZE - 1);
+
+  __m128i a = _mm_loadu_si128((const __m128i *)acc);
+  for (int y = 0; y < height; y++, ptr += stride) {
+    UINT8 tail[CHUNK_SIZE];
+    const UINT64 *key = CHUNK_KEYS;
+    for (int i = 0; i < length; i += CHUNK_SIZE, key += 2) {
+      __m128i data;
+      if (i < fullLength) {
+        data = _mm_loadu_si128((const __m128i *)(ptr + i));
+      } else {
+        memset(tail, 0, CHUNK_SIZE);
+        memcpy(tail, ptr + i, length - i);
+        data = _mm_loadu_si128((const __m128i *)tail);
+      }
+      __m128i v = _mm_xor_si128(data, _mm_loadu_si128((const __m128i *)key));
+      __m128i product = _mm_mul_epu32(v, _mm_srli_epi64(v, 32));
+      __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+      a = _mm_add_epi64(a, _mm_add_epi64(product, swapped));
+    }
+    a = _mm_xor_si128(a, _mm_srli_epi64(a, 47));
+    a = _mm_xor_si128(a, scrambleKey);
+    // 64 x 32-bit multiplication modulo 2^64.
+    __m128i lo = _mm_mul_epu32(a, prime);
+    __m128i hi = _mm_mul_epu32(_mm_srli_epi64(a, 32), prime);
+    a = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+  }
+  _mm_storeu_si128((__m128i *)acc, a);
+}
+
+int BlockHashDetector::findFirstDifferenceSse2(const UINT8 *a, const UINT8 *b,
+                                               int length)
+{
+  for (int i = 0; i + CHUNK_SIZE <= length; i += CHUNK_SIZE) {
+    __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i)),
+                                _mm_loadu_si128((const __m128i *)(b + i)));
+    int mask = ~_mm_movemask_epi8(eq) & 0xFFFF;
+    if (mask != 0) {
+      while ((mask & 1) == 0) {
+        mask >>= 1;
+        i++;
+      }
+      return i;
+    }
+  }
+  return length;
+}
+
+int BlockHashDetector::findLastDifferenceSse2(const UINT8 *a, const UINT8 *b,
+                                              int length)
+{
+  for (int i = length - CHUNK_SIZE; i >= 0; i -= CHUNK_SIZE) {
+    __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i)),
+                                _mm_loadu_si128((const __m128i *)(b + i)));
+    int mask = ~_mm_movemask_epi8(eq) & 0xFFFF;
+    if (mask != 0) {
+      int last = i + CHUNK_SIZE - 1;
+      while ((mask & 0x8000) == 0) {
+        mask <<= 1;
+        last--;
+      }
+      return last;
+    }
+  }
+  return -1;
+}
+
+#else // BLOCK_HASH_DETECTOR_SSE2
+
+// The functions below are never called because m_useSse2 is always false.
+
+void BlockHashDetector::hashRowsSse2(UINT64 acc[2], const UINT8 *ptr,
+                                     int stride, int length, int height)
+{
+  hashRows(acc, ptr, stride, length, height);
+}
+
+int BlockHashDetector::findFirstDifferenceSse2(const UINT8 *a, const UINT8 *b,
+                                               int length)
+{
+  return 0;
+}
+
+int BlockHashDetector::findLastDifferenceSse2(const UINT8 *a, const UINT8 *b,
+                                              int length)
+{
+  return length - 1;
+}
+
+#endif // BLOCK_HASH_DETECTOR_SSE2
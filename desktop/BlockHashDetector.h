@@ -0,0 +1,129 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#ifndef __BLOCKHASHDETECTOR_H__
+#define __BLOCKHASHDETECTOR_H__
+
+#include "util/inttypes.h"
+#include "rfb/FrameBuffer.h"
+#include "region/Region.h"
+
+#include <vector>
+
+// BlockHashDetector finds changed pixels of the screen frame buffer by
+// comparing it with the backup frame buffer (the copy of the screen
+// content sent to the clients). The frame buffer is divided into blocks of
+// BLOCK_SIZE x BLOCK_SIZE pixels, and a 64-bit hash of the backup content
+// is kept for each row of each block. A row whose screen content hashes to
+// the stored value is considered unchanged, so for the most of the screen
+// only the screen frame buffer is read. Other rows are compared with the
+// backup frame buffer in the same pass, right after hashing, and the
+// changed area is narrowed to the differing pixels.
+//
+// The hashing and comparison use SSE2 instructions when available. The
+// hash values do not depend on whether SSE2 is used.
+//
+// The class is not thread-safe, it must be used under the lock of the
+// backup frame buffer.
+class BlockHashDetector
+{
+public:
+  BlockHashDetector();
+  virtual ~BlockHashDetector();
+
+  // Finds the pixels of screenFb that differ from backupFb in the blocks
+  // intersecting the region and adds them to changedRegion, one rectangle
+  // per horizontal run of changed blocks. Whole blocks are checked, so the
+  // changes found may lie outside of the region.
+  // The hashes are updated as if the caller copied changedRegion from
+  // screenFb to backupFb afterwards, which it must do.
+  // Both frame buffers must have the same dimension and pixel format.
+  void detectChanges(const Region *region,
+                     const FrameBuffer *screenFb,
+                     const FrameBuffer *backupFb,
+                     Region *changedRegion);
+
+  // Forgets the hashes of the blocks intersecting the region. Must be
+  // called when pixels of the backup frame buffer are changed other way
+  // than described in detectChanges().
+  void invalidate(const Region *region);
+
+  // Forgets the hashes of all blocks.
+  void invalidateAll();
+
+  static const int BLOCK_SIZE = 32;
+
+protected:
+  // Prepares the block arrays for the frame buffer properties, forgetting
+  // all the hashes if the properties have changed.
+  void setProperties(const Dimension *dim, const PixelFormat *pf);
+
+  // Returns the rectangle of the block at the specified block coordinates,
+  // clipped to the frame buffer.
+  Rect getBlockRect(int blockX, int blockY) const;
+
+  // Returns the hash of a row of pixels, not longer than BLOCK_SIZE
+  // pixels.
+  UINT64 hashRow(const UINT8 *ptr, int length) const;
+
+  // Hashes the rows of the block in screenFb, compares the rows whose
+  // hashes differ from the stored ones with backupFb and stores the new
+  // hashes. Finds the bounding rectangle of the differing pixels, returns
+  // false if the pixels of the block are equal.
+  bool checkBlock(size_t index, const Rect *blockRect,
+                  const FrameBuffer *screenFb, const FrameBuffer *backupFb,
+                  Rect *changedRect);
+
+  // Return the index of the first (last) differing byte in the two arrays,
+  // or -1 if the arrays are equal.
+  int findFirstDifference(const UINT8 *a, const UINT8 *b, int length) const;
+  int findLastDifference(const UINT8 *a, const UINT8 *b, int length) const;
+
+  // Implementations of the above functions.
+  static void hashRows(UINT64 acc[2], const UINT8 *ptr, int stride,
+                       int length, int height);
+  static void hashRowsSse2(UINT64 acc[2], const UINT8 *ptr, int stride,
+                           int length, int height);
+  static int findFirstDifferenceSse2(const UINT8 *a, const UINT8 *b,
+                                     int length);
+  static int findLastDifferenceSse2(const UINT8 *a, const UINT8 *b,
+                                    int length);
+
+  bool m_useSse2;
+
+  Dimension m_dimension;
+  PixelFormat m_pixelFormat;
+  int m_blocksPerRow;
+  int m_blocksPerColumn;
+
+  // Hashes of the backup content of the block rows, BLOCK_SIZE per block,
+  // valid only where m_validHashes is true for the block.
+  std::vector<UINT64> m_rowHashes;
+  std::vector<bool> m_validHashes;
+  // Marks of the blocks to be checked, used inside detectChanges() only.
+  std::vector<bool> m_checkedBlocks;
+};
+
+#endif // __BLOCKHASHDETECTOR_H__
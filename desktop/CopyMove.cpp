@@ -0,0 +1,81 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#include "CopyMove.h"
+#include <algorithm>
+
+// Sorts rectangles of a region so that bands and rectangles within a band
+// go towards the source, i.e. the pixels are moved away from their sources
+// first.
+class CopyOrderLess
+{
+public:
+  CopyOrderLess(const Point *srcOffset)
+  : m_upward(srcOffset->y > 0),
+    m_leftward(srcOffset->x > 0)
+  {
+  }
+
+  bool operator()(const Rect &a, const Rect &b) const
+  {
+    if (a.top != b.top) {
+      return m_upward ? a.top < b.top : a.top > b.top;
+    }
+    return m_leftward ? a.left < b.left : a.left > b.left;
+  }
+
+private:
+  bool m_upward;
+  bool m_leftward;
+};
+
+CopyMove::CopyMove()
+{
+}
+
+CopyMove::CopyMove(const Region *dst, const Point *offset)
+: dstRegion(*dst),
+  srcOffset(*offset)
+{
+}
+
+void CopyMove::getSrcRegion(Region *srcRegion) const
+{
+  *srcRegion = dstRegion;
+  srcRegion->translate(srcOffset.x, srcOffset.y);
+}
+
+void CopyMove::getOrderedRects(std::vector<Rect> *rects) const
+{
+  std::vector<Rect> dstRects;
+  dstRegion.getRectVector(&dstRects);
+  std::sort(dstRects.begin(), dstRects.end(), CopyOrderLess(&srcOffset));
+  rects->insert(rects->end(), dstRects.begin(), dstRects.end());
+}
+
+Point CopyMove::getSource(const Rect *dstRect) const
+{
+  return Point(dstRect->left + srcOffset.x, dstRect->top + srcOffset.y);
+}
@@ -0,0 +1,59 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#ifndef __COPYMOVE_H__
+#define __COPYMOVE_H__
+
+#include <vector>
+
+#include "region/Region.h"
+#include "region/Point.h"
+
+// CopyMove describes one CopyRect operation: each pixel of the destination
+// region is copied from the pixel at the same position shifted by the
+// source offset.
+class CopyMove
+{
+public:
+  CopyMove();
+  CopyMove(const Region *dst, const Point *offset);
+
+  Region dstRegion;
+  Point srcOffset;
+
+  // Sets srcRegion to the destination region shifted by the source offset.
+  void getSrcRegion(Region *srcRegion) const;
+
+  // Appends the rectangles of the destination region to the vector in the
+  // order they should be copied one by one: if the source and destination
+  // regions overlap, no rectangle overwrites source pixels of the following
+  // ones.
+  void getOrderedRects(std::vector<Rect> *rects) const;
+
+  // Returns the source point of a rectangle of the destination region.
+  Point getSource(const Rect *dstRect) const;
+};
+
+#endif // __COPYMOVE_H__
@@ -30,6 +30,7 @@
 #include "region/Region.h"
 #include "rfb/PixelFormat.h"
 #include "rfb/FrameBuffer.h"
+#include "SharedFrameBuffer.h"
 #include "fb-update-sender/UpdateRequestListener.h"
 
 // This class is a public interface to a desktop.
@@ -61,10 +62,12 @@ public:
   virtual void setMouseEvent(UINT16 x, UINT16 y, UINT8 buttonMask) = 0;
   virtual void setNewClipText(const StringStorage *newClipboard) = 0;
 
-  // Updates external frame buffer pixels only for the region from view port
-  // located at the place in a central frame buffer.
-  // If view port is out of central frame buffer bounds the function will return false.
-  virtual bool updateExternalFrameBuffer(FrameBuffer *fb, const Region *region,
+  // Brings the snapshot up to date with the central frame buffer. The
+  // snapshot will contain the part of the central frame buffer located at the
+  // view port.
+  // If view port is out of central frame buffer bounds or the snapshot
+  // dimension or pixel format have changed the function will return false.
+  virtual bool updateFrameBufferSnapshot(FrameBufferSnapshot *snapshot,
                                          const Rect *viewPort) = 0;
 };
 
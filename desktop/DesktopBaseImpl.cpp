@@ -242,6 +242,7 @@ void DesktopBaseImpl::sendUpdate()
 
     m_log->info(_T("extracting updates from UpdateHandler"));
     m_updateHandler->extract(&updCont);
+    m_updateHandler->invalidateSnapshots(&updCont);
   } catch (Exception &e) {
     m_log->info(_T("WinDesktop::sendUpdate() failed with error:%s"),
                e.getMessage());
@@ -300,8 +301,8 @@ void DesktopBaseImpl::onConfigReload(ServerConfig *serverConfig)
   applyNewConfiguration();
 }
 
-bool DesktopBaseImpl::updateExternalFrameBuffer(FrameBuffer *fb, const Region *region,
-                                           const Rect *viewPort)
+bool DesktopBaseImpl::updateFrameBufferSnapshot(FrameBufferSnapshot *snapshot,
+                                                const Rect *viewPort)
 {
-  return m_updateHandler->updateExternalFrameBuffer(fb, region, viewPort);
+  return m_updateHandler->updateFrameBufferSnapshot(snapshot, viewPort);
 }
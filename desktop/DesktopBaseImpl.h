@@ -84,7 +84,7 @@ protected:
   // This is an auxiliary function which determines that
   virtual bool isRemoteInputTempBlocked() = 0;
 
-  virtual bool updateExternalFrameBuffer(FrameBuffer *fb, const Region *region,
+  virtual bool updateFrameBufferSnapshot(FrameBufferSnapshot *snapshot,
                                          const Rect *viewPort);
 
   void sendUpdate();
@@ -39,7 +39,6 @@ Poller::Poller(UpdateKeeper *updateKeeper,
   m_fbMutex(frameBufferCriticalSection),
   m_log(log)
 {
-  m_pollingRect.setRect(0, 0, 16, 16);
 }
 
 Poller::~Poller()
@@ -76,27 +75,30 @@ void Poller::execute()
       if (!screenFrameBuffer->isEqualTo(m_backupFrameBuffer)) {
         m_updateKeeper->setScreenSizeChanged();
       } else {
-        m_log->info(_T("grabbing screen for polling"));
-        m_screenGrabber->grab();
+        Dimension screenDimension = screenFrameBuffer->getDimension();
+        std::vector<int> tiles;
+        std::vector<Rect> grabRects;
+        m_scheduler.startCycle(&screenDimension, &tiles, &grabRects);
+
+        m_log->info(_T("grabbing screen for polling, %d rectangles"),
+                    (int)grabRects.size());
+        std::vector<Rect>::iterator iRect;
+        for (iRect = grabRects.begin(); iRect < grabRects.end(); iRect++) {
+          m_screenGrabber->grab(&(*iRect));
+        }
         m_log->info(_T("end of grabbing screen for polling"));
 
         // Polling
-        int pollingWidth = m_pollingRect.getWidth();
-        int pollingHeight = m_pollingRect.getHeight();
-        int screenWidth = screenFrameBuffer->getDimension().width;
-        int screenHeight = screenFrameBuffer->getDimension().height;
-
         Rect scanRect;
-        for (int iRow = 0; iRow < screenHeight; iRow += pollingHeight) {
-          for (int iCol = 0; iCol < screenWidth; iCol += pollingWidth) {
-            scanRect.setRect(iCol, iRow, min(iCol + pollingWidth, screenWidth),
-                             min(iRow + pollingHeight, screenHeight));
-            if (!screenFrameBuffer->cmpFrom(&scanRect, m_backupFrameBuffer,
-                                            scanRect.left, scanRect.top)) {
-              region.addRect(&scanRect);
-            }
+        std::vector<int>::iterator iTile;
+        for (iTile = tiles.begin(); iTile < tiles.end(); iTile++) {
+          scanRect = m_scheduler.getTileRect(*iTile);
+          if (!screenFrameBuffer->cmpFrom(&scanRect, m_backupFrameBuffer,
+                                          scanRect.left, scanRect.top)) {
+            m_scheduler.onTileChanged(*iTile);
           }
         }
+        m_scheduler.getChangedRegion(&region);
 
         m_updateKeeper->addChangedRegion(&region);
       }
@@ -109,6 +111,7 @@ void Poller::execute()
 
     unsigned int pollInterval = Configurator::getInstance()->
                                 getServerConfig()->getPollingInterval();
-    m_intervalWaiter.waitForEvent(pollInterval);
+    m_intervalWaiter.waitForEvent(pollInterval /
+                                  PollingScheduler::CYCLES_PER_INTERVAL);
   }
 }
@@ -31,6 +31,7 @@
 #include "region/Rect.h"
 #include "win-system/WindowsEvent.h"
 #include "log-writer/LogWriter.h"
+#include "PollingScheduler.h"
 
 #define DEFAULT_SLEEP_TIME 1000
 
@@ -54,7 +55,7 @@ private:
   ScreenGrabber *m_screenGrabber;
   FrameBuffer *m_backupFrameBuffer;
   LocalMutex *m_fbMutex;
-  Rect m_pollingRect;
+  PollingScheduler m_scheduler;
   WindowsEvent m_intervalWaiter;
 
   LogWriter *m_log;
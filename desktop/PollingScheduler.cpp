@@ -0,0 +1,135 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#include "PollingScheduler.h"
+#include "util/CommonHeader.h"
+
+PollingScheduler::PollingScheduler()
+: m_tilesPerRow(0),
+  m_tilesPerColumn(0),
+  m_cycle(0)
+{
+}
+
+PollingScheduler::~PollingScheduler()
+{
+}
+
+void PollingScheduler::startCycle(const Dimension *dim,
+                                  std::vector<int> *tiles,
+                                  std::vector<Rect> *grabRects)
+{
+  if (!m_dimension.isEqualTo(dim)) {
+    reset(dim);
+  }
+  m_cycle++;
+
+  tiles->clear();
+  grabRects->clear();
+
+  Rect band;
+  for (int row = 0; row < m_tilesPerColumn; row++) {
+    int left = m_tilesPerRow;
+    int right = -1;
+    for (int col = 0; col < m_tilesPerRow; col++) {
+      int index = row * m_tilesPerRow + col;
+      UINT8 *idleCycles = &m_idleCycles[index];
+      if (isScheduled(*idleCycles, row)) {
+        tiles->push_back(index);
+        left = min(left, col);
+        right = col;
+      }
+      if (*idleCycles < WARM_CYCLES) {
+        (*idleCycles)++;
+      }
+    }
+
+    if (right != -1) {
+      Rect rowRect(left * TILE_SIZE, row * TILE_SIZE,
+                   min((right + 1) * TILE_SIZE, m_dimension.width),
+                   min((row + 1) * TILE_SIZE, m_dimension.height));
+      if (band.isEmpty()) {
+        band = rowRect;
+      } else {
+        band.setRect(min(band.left, rowRect.left), band.top,
+                     max(band.right, rowRect.right), rowRect.bottom);
+      }
+    } else if (!band.isEmpty()) {
+      grabRects->push_back(band);
+      band.clear();
+    }
+  }
+  if (!band.isEmpty()) {
+    grabRects->push_back(band);
+  }
+}
+
+Rect PollingScheduler::getTileRect(int index) const
+{
+  int col = index % m_tilesPerRow;
+  int row = index / m_tilesPerRow;
+  return Rect(col * TILE_SIZE, row * TILE_SIZE,
+              min((col + 1) * TILE_SIZE, m_dimension.width),
+              min((row + 1) * TILE_SIZE, m_dimension.height));
+}
+
+void PollingScheduler::onTileChanged(int index)
+{
+  m_idleCycles[index] = 0;
+}
+
+void PollingScheduler::getChangedRegion(Region *region) const
+{
+  std::vector<bool> changedTiles(m_idleCycles.size());
+  for (size_t i = 0; i < m_idleCycles.size(); i++) {
+    changedTiles[i] = m_idleCycles[i] == 0;
+  }
+  Rect bounds = m_dimension.getRect();
+  region->setTiles(&changedTiles, m_tilesPerRow, TILE_SIZE, TILE_SIZE,
+                   &bounds);
+}
+
+void PollingScheduler::reset(const Dimension *dim)
+{
+  m_dimension = *dim;
+  m_tilesPerRow = (dim->width + TILE_SIZE - 1) / TILE_SIZE;
+  m_tilesPerColumn = (dim->height + TILE_SIZE - 1) / TILE_SIZE;
+  m_idleCycles.assign((size_t)m_tilesPerRow * m_tilesPerColumn,
+                      (UINT8)WARM_CYCLES);
+  m_cycle = 0;
+}
+
+bool PollingScheduler::isScheduled(int idleCycles, int tileRow) const
+{
+  if (idleCycles < HOT_CYCLES) {
+    return true;
+  }
+  if (idleCycles < WARM_CYCLES) {
+    return m_cycle % WARM_PERIOD == 0;
+  }
+  // The cold tiles are scanned by bands of adjacent tile rows.
+  int band = tileRow * COLD_SWEEP_CYCLES / m_tilesPerColumn;
+  return band == (int)(m_cycle % COLD_SWEEP_CYCLES);
+}
@@ -0,0 +1,104 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#ifndef __POLLINGSCHEDULER_H__
+#define __POLLINGSCHEDULER_H__
+
+#include "util/inttypes.h"
+#include "region/Rect.h"
+#include "region/Dimension.h"
+#include "region/Region.h"
+
+#include <vector>
+
+// PollingScheduler decides which tiles of the screen the Poller should
+// compare with the backup frame buffer in each polling cycle. The screen
+// is divided into TILE_SIZE x TILE_SIZE tiles, and each tile is scheduled
+// by the time since its last change:
+//   - hot tiles, changed within HOT_CYCLES cycles, are scanned every cycle;
+//   - warm tiles, changed within WARM_CYCLES cycles, every WARM_PERIOD
+//     cycles;
+//   - cold tiles are scanned in a round-robin sweep, one band of tile rows
+//     per cycle, so that the whole screen is covered every
+//     COLD_SWEEP_CYCLES cycles.
+// The Poller runs CYCLES_PER_INTERVAL cycles per polling interval. The
+// sweep takes no more cycles than that, so a change anywhere on the screen
+// is detected within one polling interval, as with a full scan per
+// interval, while actively changing areas are detected faster and each
+// cycle grabs and compares only a part of the static screen.
+//
+// The class is not thread-safe.
+class PollingScheduler
+{
+public:
+  PollingScheduler();
+  virtual ~PollingScheduler();
+
+  // Starts a new polling cycle for the screen of the specified dimension.
+  // Returns the indices of the tiles to scan in tiles and the areas of the
+  // screen that must be grabbed before the scan in grabRects, one per
+  // band of adjacent tile rows having tiles to scan.
+  void startCycle(const Dimension *dim,
+                  std::vector<int> *tiles,
+                  std::vector<Rect> *grabRects);
+
+  // Returns the rectangle of the tile clipped to the screen.
+  Rect getTileRect(int index) const;
+
+  // Marks the tile as changed in the current cycle.
+  void onTileChanged(int index);
+
+  // Replaces the region with the tiles marked as changed in the current
+  // cycle.
+  void getChangedRegion(Region *region) const;
+
+  static const int TILE_SIZE = 16;
+  static const int CYCLES_PER_INTERVAL = 2;
+
+protected:
+  // Forgets the history of all the tiles for a new screen dimension.
+  void reset(const Dimension *dim);
+
+  // Returns true if a tile idle for the number of cycles should be scanned
+  // in the current cycle. tileRow is the row of the tile.
+  bool isScheduled(int idleCycles, int tileRow) const;
+
+  static const int HOT_CYCLES = 8;
+  static const int WARM_CYCLES = 120;
+  static const int WARM_PERIOD = 2;
+  // Must not exceed CYCLES_PER_INTERVAL, see above.
+  static const int COLD_SWEEP_CYCLES = CYCLES_PER_INTERVAL;
+
+  Dimension m_dimension;
+  int m_tilesPerRow;
+  int m_tilesPerColumn;
+  unsigned int m_cycle;
+
+  // Number of cycles since the last change of each tile, saturated at
+  // WARM_CYCLES.
+  std::vector<UINT8> m_idleCycles;
+};
+
+#endif // __POLLINGSCHEDULER_H__
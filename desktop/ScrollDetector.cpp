@@ -0,0 +1,255 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#include "ScrollDetector.h"
+#include <algorithm>
+
+// Constants of the line hash function.
+static const UINT64 HASH_SEED = 0x9E3779B97F4A7C15ULL;
+static const UINT64 HASH_PRIME = 0x100000001B3ULL;
+
+ScrollDetector::ScrollDetector()
+: m_linesLeft(0)
+{
+}
+
+ScrollDetector::~ScrollDetector()
+{
+}
+
+void ScrollDetector::detect(const Region *region,
+                            const FrameBuffer *newFb,
+                            const FrameBuffer *oldFb,
+                            std::vector<CopyMove> *moves)
+{
+  _ASSERT(newFb->getDimension().isEqualTo(&oldFb->getDimension()));
+  _ASSERT(newFb->getBytesPerPixel() == oldFb->getBytesPerPixel());
+
+  std::vector<Rect> rects;
+  region->getRectVector(&rects);
+
+  Dimension dim = newFb->getDimension();
+  INT64 area = 0;
+  for (size_t i = 0; i < rects.size(); i++) {
+    area += (INT64)rects[i].getWidth() * rects[i].getHeight();
+  }
+  if (area * 100 > (INT64)dim.width * dim.height * MAX_AREA_PERCENT) {
+    return;
+  }
+
+  m_linesLeft = MAX_LINES_PER_CALL;
+  for (size_t i = 0; i < rects.size() && m_linesLeft >= MIN_RECT_SIZE; i++) {
+    if (rects[i].getWidth() < MIN_RECT_SIZE ||
+        rects[i].getHeight() < MIN_RECT_SIZE ||
+        rects[i].getHeight() > m_linesLeft) {
+      continue;
+    }
+    CopyMove move;
+    if (detectInRect(&rects[i], newFb, oldFb, &move)) {
+      moves->push_back(move);
+    }
+  }
+}
+
+bool ScrollDetector::detectInRect(const Rect *rect,
+                                  const FrameBuffer *newFb,
+                                  const FrameBuffer *oldFb,
+                                  CopyMove *move)
+{
+  std::vector<std::pair<int, int> > runs;
+
+  m_linesLeft -= rect->getHeight();
+  hashRows(newFb, rect, &m_newHashes);
+  hashRows(oldFb, rect, &m_oldHashes);
+  int shift = findShift();
+  if (shift != 0) {
+    findRuns(shift, &runs);
+    if (!runs.empty()) {
+      move->dstRegion.clear();
+      for (size_t i = 0; i < runs.size(); i++) {
+        Rect dstRect(rect->left, rect->top + runs[i].first,
+                     rect->right, rect->top + runs[i].second);
+        move->dstRegion.addRect(&dstRect);
+      }
+      move->srcOffset.setPoint(0, shift);
+      return true;
+    }
+  }
+
+  if (rect->getHeight() > m_linesLeft) {
+    return false;
+  }
+  m_linesLeft -= rect->getHeight();
+  hashColumns(newFb, rect, &m_newHashes);
+  hashColumns(oldFb, rect, &m_oldHashes);
+  shift = findShift();
+  if (shift != 0) {
+    runs.clear();
+    findRuns(shift, &runs);
+    if (!runs.empty()) {
+      move->dstRegion.clear();
+      for (size_t i = 0; i < runs.size(); i++) {
+        Rect dstRect(rect->left + runs[i].first, rect->top,
+                     rect->left + runs[i].second, rect->bottom);
+        move->dstRegion.addRect(&dstRect);
+      }
+      move->srcOffset.setPoint(shift, 0);
+      return true;
+    }
+  }
+  return false;
+}
+
+void ScrollDetector::hashRows(const FrameBuffer *fb, const Rect *rect,
+                              std::vector<UINT64> *hashes)
+{
+  const int stride = fb->getBytesPerRow();
+  const int length = rect->getWidth() * fb->getBytesPerPixel();
+  const UINT8 *row = (const UINT8 *)fb->getBufferPtr(rect->left, rect->top);
+
+  hashes->resize(rect->getHeight());
+  for (int y = 0; y < rect->getHeight(); y++, row += stride) {
+    // Four independent lanes let multiplications of a row overlap.
+    UINT64 lane[4] = { HASH_SEED, HASH_SEED + 1, HASH_SEED + 2, HASH_SEED + 3 };
+    int i = 0;
+    for (; i + 32 <= length; i += 32) {
+      UINT64 words[4];
+      memcpy(words, row + i, 32);
+      for (int j = 0; j < 4; j++) {
+        lane[j] = (lane[j] ^ words[j]) * HASH_PRIME;
+        lane[j] ^= lane[j] >> 29;
+      }
+    }
+    UINT64 hash = lane[0];
+    for (int j = 1; j < 4; j++) {
+      hash = (hash ^ lane[j]) * HASH_PRIME;
+    }
+    for (; i < length; i++) {
+      hash = (hash ^ row[i]) * HASH_PRIME;
+    }
+    (*hashes)[y] = hash;
+  }
+}
+
+void ScrollDetector::hashColumns(const FrameBuffer *fb, const Rect *rect,
+                                 std::vector<UINT64> *hashes)
+{
+  switch (fb->getBytesPerPixel()) {
+  case 1:
+    hashColumns<UINT8>(fb, rect, hashes);
+    break;
+  case 2:
+    hashColumns<UINT16>(fb, rect, hashes);
+    break;
+  default:
+    _ASSERT(fb->getBytesPerPixel() == 4);
+    hashColumns<UINT32>(fb, rect, hashes);
+    break;
+  }
+}
+
+template <class PIXEL_T>
+void ScrollDetector::hashColumns(const FrameBuffer *fb, const Rect *rect,
+                                 std::vector<UINT64> *hashes)
+{
+  const int stride = fb->getBytesPerRow();
+  const int width = rect->getWidth();
+  const UINT8 *row = (const UINT8 *)fb->getBufferPtr(rect->left, rect->top);
+
+  // Rows are read one by one, updating the hashes of all columns.
+  hashes->assign(width, HASH_SEED);
+  UINT64 *hash = &hashes->front();
+  for (int y = 0; y < rect->getHeight(); y++, row += stride) {
+    const PIXEL_T *pixels = (const PIXEL_T *)row;
+    for (int x = 0; x < width; x++) {
+      hash[x] = (hash[x] ^ pixels[x]) * HASH_PRIME;
+    }
+  }
+}
+
+int ScrollDetector::findShift()
+{
+  const int numLines = (int)m_newHashes.size();
+  _ASSERT(m_oldHashes.size() == m_newHashes.size());
+
+  m_oldLines.resize(numLines);
+  for (int i = 0; i < numLines; i++) {
+    m_oldLines[i] = std::make_pair(m_oldHashes[i], i);
+  }
+  std::sort(m_oldLines.begin(), m_oldLines.end());
+
+  m_votes.assign(2 * numLines, 0);
+  for (int i = 0; i < numLines; i++) {
+    UINT64 hash = m_newHashes[i];
+    // Unchanged lines tell nothing about the shift.
+    if (hash == m_oldHashes[i]) {
+      continue;
+    }
+    std::vector<std::pair<UINT64, int> >::const_iterator found =
+      std::lower_bound(m_oldLines.begin(), m_oldLines.end(),
+                       std::make_pair(hash, 0));
+    if (found == m_oldLines.end() || found->first != hash) {
+      continue;
+    }
+    // Repeating lines, such as empty ones, are ambiguous.
+    std::vector<std::pair<UINT64, int> >::const_iterator next = found + 1;
+    if (next != m_oldLines.end() && next->first == hash) {
+      continue;
+    }
+    m_votes[found->second - i + numLines]++;
+  }
+
+  int bestShift = 0;
+  int bestVotes = MIN_VOTES - 1;
+  for (int i = 0; i < (int)m_votes.size(); i++) {
+    if (m_votes[i] > bestVotes) {
+      bestVotes = m_votes[i];
+      bestShift = i - numLines;
+    }
+  }
+  return bestShift;
+}
+
+void ScrollDetector::findRuns(int shift,
+                              std::vector<std::pair<int, int> > *runs) const
+{
+  const int numLines = (int)m_newHashes.size();
+  // Destination lines whose sources lie within the rectangle.
+  int first = max(0, -shift);
+  int last = min(numLines, numLines - shift);
+
+  int runStart = -1;
+  for (int i = first; i <= last; i++) {
+    bool matches = i < last && m_newHashes[i] == m_oldHashes[i + shift];
+    if (matches && runStart < 0) {
+      runStart = i;
+    } else if (!matches && runStart >= 0) {
+      if (i - runStart >= MIN_RUN_LENGTH) {
+        runs->push_back(std::make_pair(runStart, i));
+      }
+      runStart = -1;
+    }
+  }
+}
@@ -0,0 +1,136 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#ifndef __SCROLLDETECTOR_H__
+#define __SCROLLDETECTOR_H__
+
+#include "util/inttypes.h"
+#include "rfb/FrameBuffer.h"
+#include "region/Region.h"
+#include "CopyMove.h"
+
+#include <vector>
+#include <utility>
+
+// ScrollDetector finds content of the old frame buffer which appears in
+// the new one shifted vertically or horizontally, as it happens on
+// scrolling in a browser or a terminal window. It works on the pixels only
+// and does not depend on the windowing system.
+//
+// Each rectangle of the region to check is processed separately. Hashes of
+// its rows in both frame buffers are compared, and the shift most of the
+// rows agree on is taken. The runs of rows which match with this shift
+// form the destination region of a move. If no vertical shift is found,
+// the same is done with columns.
+//
+// Hash collisions are possible, so the caller should apply the moves to
+// the old frame buffer and then compare it with the new one to find the
+// remaining changes, i.e. the exposed strips.
+//
+// The work per call is bounded. A region covering nearly the whole frame
+// buffer is skipped, as such a change is a desktop switch or a full
+// redraw rather than scrolling, and no more than MAX_LINES_PER_CALL rows
+// are hashed in total.
+//
+// The class is not thread-safe.
+class ScrollDetector
+{
+public:
+  ScrollDetector();
+  virtual ~ScrollDetector();
+
+  // Appends the moves found within the region to the vector. Sources and
+  // destinations of the moves lie within the same rectangle of the region,
+  // and the destinations of different moves do not intersect, so the moves
+  // may be applied in any order.
+  // Both frame buffers must have the same dimension and pixel format.
+  void detect(const Region *region,
+              const FrameBuffer *newFb,
+              const FrameBuffer *oldFb,
+              std::vector<CopyMove> *moves);
+
+  // Minimum width and height of a rectangle to look for scrolling in.
+  static const int MIN_RECT_SIZE = 32;
+  // Minimum number of consecutive matching rows (columns) in a move.
+  static const int MIN_RUN_LENGTH = 16;
+  // Minimum number of distinct rows (columns) supporting a shift.
+  static const int MIN_VOTES = 8;
+  // Regions covering more than this percentage of the frame buffer are
+  // skipped.
+  static const int MAX_AREA_PERCENT = 90;
+  // Maximum number of rectangle rows hashed by one detect() call. Each
+  // pass over a rectangle, by rows or by columns, reads all of its rows in
+  // both frame buffers and counts as its height. Rectangles exceeding the
+  // rest of the budget are skipped.
+  static const int MAX_LINES_PER_CALL = 4096;
+
+protected:
+  // Looks for a vertical, then for a horizontal shift in the rectangle,
+  // taking the hashed rows from m_linesLeft. Returns false if neither is
+  // found.
+  bool detectInRect(const Rect *rect,
+                    const FrameBuffer *newFb,
+                    const FrameBuffer *oldFb,
+                    CopyMove *move);
+
+  // Set hashes to the hashes of the rows (columns) of the rectangle.
+  static void hashRows(const FrameBuffer *fb, const Rect *rect,
+                       std::vector<UINT64> *hashes);
+  static void hashColumns(const FrameBuffer *fb, const Rect *rect,
+                          std::vector<UINT64> *hashes);
+  template <class PIXEL_T>
+    static void hashColumns(const FrameBuffer *fb, const Rect *rect,
+                            std::vector<UINT64> *hashes);
+
+  // Returns the shift (the source line index minus the destination one)
+  // which most of the changed lines agree on, or 0 if there is no such
+  // shift. Lines which occur more than once in the old content do not vote.
+  int findShift();
+
+  // Appends to runs the [first, last) index ranges of at least
+  // MIN_RUN_LENGTH lines matching with the shift.
+  void findRuns(int shift, std::vector<std::pair<int, int> > *runs) const;
+
+  // Line hashes of the current rectangle in the new and in the old frame
+  // buffer.
+  std::vector<UINT64> m_newHashes;
+  std::vector<UINT64> m_oldHashes;
+
+  // Work storage of findShift(), kept between calls to avoid reallocations:
+  // (hash, index) pairs of the old lines sorted by hash, and the number of
+  // votes for each shift, offset by the number of lines.
+  std::vector<std::pair<UINT64, int> > m_oldLines;
+  std::vector<int> m_votes;
+
+  // Rows left to hash in the current detect() call.
+  int m_linesLeft;
+
+private:
+  // Do not allow copying objects.
+  ScrollDetector(const ScrollDetector &other);
+  ScrollDetector &operator=(const ScrollDetector &other);
+};
+
+#endif // __SCROLLDETECTOR_H__
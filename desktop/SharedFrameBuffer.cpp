@@ -0,0 +1,395 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#include "SharedFrameBuffer.h"
+
+#include <crtdbg.h>
+
+#include "thread/AutoLock.h"
+
+SnapshotFrame::SnapshotFrame()
+: tilesPerRow(0),
+  generation(0),
+  numUsers(0)
+{
+}
+
+//--------------------------------------------------------------------------//
+
+FrameBufferSnapshot::FrameBufferSnapshot()
+: m_owner(0),
+  m_sharedFrame(0),
+  m_privateFrame(0),
+  m_blackFrame(0)
+{
+}
+
+FrameBufferSnapshot::~FrameBufferSnapshot()
+{
+  release();
+  releaseBlackFrameBuffer();
+  deletePrivateFrame();
+}
+
+const FrameBuffer *FrameBufferSnapshot::getFrameBuffer() const
+{
+  if (m_sharedFrame != 0) {
+    return &m_sharedFrame->frameBuffer;
+  }
+  if (m_privateFrame != 0) {
+    return &m_privateFrame->frameBuffer;
+  }
+  return 0;
+}
+
+bool FrameBufferSnapshot::isPrivate() const
+{
+  return m_sharedFrame == 0 && m_privateFrame != 0;
+}
+
+const FrameBuffer *FrameBufferSnapshot::getBlackFrameBuffer()
+{
+  const FrameBuffer *fb = getFrameBuffer();
+  if (fb == 0) {
+    return 0;
+  }
+  Dimension dim = fb->getDimension();
+  PixelFormat pf = fb->getPixelFormat();
+  if (m_blackFrame != 0 &&
+      (!m_blackFrame->frameBuffer.getDimension().isEqualTo(&dim) ||
+       !m_blackFrame->frameBuffer.getPixelFormat().isEqualTo(&pf))) {
+    releaseBlackFrameBuffer();
+  }
+  if (m_blackFrame == 0) {
+    m_blackFrame = m_owner->acquireBlackFrame(&dim, &pf);
+  }
+  return &m_blackFrame->frameBuffer;
+}
+
+void FrameBufferSnapshot::releaseBlackFrameBuffer()
+{
+  if (m_blackFrame != 0) {
+    m_owner->releaseBlackFrame(m_blackFrame);
+    m_blackFrame = 0;
+  }
+}
+
+UINT64 FrameBufferSnapshot::getContentStamp(const Rect *rect) const
+{
+  if (m_sharedFrame == 0) {
+    return 0;
+  }
+  const SnapshotFrame *frame = m_sharedFrame;
+  // Shared frames always cover the whole desktop.
+  Rect area = rect->intersection(&frame->viewPort);
+  if (area.isEmpty() || frame->tilesPerRow == 0) {
+    return 0;
+  }
+  const int tileSize = SharedFrameBuffer::TILE_SIZE;
+  UINT32 generation = 0;
+  for (int ty = area.top / tileSize; ty * tileSize < area.bottom; ty++) {
+    const UINT32 *gens = &frame->tileGenerations[ty * frame->tilesPerRow];
+    for (int tx = area.left / tileSize; tx * tileSize < area.right; tx++) {
+      generation = max(generation, gens[tx]);
+    }
+  }
+  return (UINT64)m_owner->m_instanceId << 32 | generation;
+}
+
+void FrameBufferSnapshot::release()
+{
+  if (m_sharedFrame != 0) {
+    m_owner->releaseFrame(m_sharedFrame);
+    m_sharedFrame = 0;
+  }
+}
+
+void FrameBufferSnapshot::deletePrivateFrame()
+{
+  if (m_privateFrame != 0) {
+    delete m_privateFrame;
+    m_privateFrame = 0;
+  }
+}
+
+//--------------------------------------------------------------------------//
+
+UINT32 SharedFrameBuffer::m_lastInstanceId = 0;
+LocalMutex SharedFrameBuffer::m_instanceIdMutex;
+
+SharedFrameBuffer::SharedFrameBuffer()
+: m_tilesPerRow(0),
+  m_tilesPerColumn(0),
+  m_generation(1),
+  m_latestFrame(0)
+{
+  AutoLock l(&m_instanceIdMutex);
+  m_instanceId = ++m_lastInstanceId;
+}
+
+SharedFrameBuffer::~SharedFrameBuffer()
+{
+  // All the snapshots must have released their frames by now.
+  for (std::list<SnapshotFrame *>::iterator it = m_frames.begin();
+       it != m_frames.end(); it++) {
+    _ASSERT((*it)->numUsers == 0);
+    delete *it;
+  }
+  // Unused black frames are deleted at once.
+  _ASSERT(m_blackFrames.empty());
+}
+
+void SharedFrameBuffer::invalidate(const Region *region)
+{
+  AutoLock l(&m_lock);
+
+  if (m_tileGenerations.empty() || region->isEmpty()) {
+    return;
+  }
+  m_generation++;
+
+  Rect fbRect = m_dim.getRect();
+  std::vector<Rect> rects;
+  region->getRectVector(&rects);
+  for (size_t i = 0; i < rects.size(); i++) {
+    Rect rect = rects[i].intersection(&fbRect);
+    if (rect.isEmpty()) {
+      continue;
+    }
+    for (int ty = rect.top / TILE_SIZE; ty * TILE_SIZE < rect.bottom; ty++) {
+      for (int tx = rect.left / TILE_SIZE; tx * TILE_SIZE < rect.right; tx++) {
+        m_tileGenerations[ty * m_tilesPerRow + tx] = m_generation;
+      }
+    }
+  }
+}
+
+bool SharedFrameBuffer::updateSnapshot(FrameBufferSnapshot *snapshot,
+                                       const FrameBuffer *srcFb,
+                                       const Rect *viewPort)
+{
+  AutoLock l(&m_lock);
+
+  _ASSERT(snapshot->m_owner == 0 || snapshot->m_owner == this);
+  snapshot->m_owner = this;
+  // Unlike FrameBufferSnapshot::release(), unused frames are deleted only
+  // after the new frame is chosen, so that the previous frame can be reused.
+  if (snapshot->m_sharedFrame != 0) {
+    snapshot->m_sharedFrame->numUsers--;
+    snapshot->m_sharedFrame = 0;
+  }
+
+  checkSourceProperties(srcFb);
+
+  Rect srcFbRect = m_dim.getRect();
+  Rect resultViewPort = srcFbRect.intersection(viewPort);
+
+  SnapshotFrame *frame;
+  if (!resultViewPort.isEqualTo(&srcFbRect)) {
+    if (snapshot->m_privateFrame == 0) {
+      snapshot->m_privateFrame = new SnapshotFrame;
+    }
+    frame = snapshot->m_privateFrame;
+    syncFrame(frame, srcFb, &resultViewPort);
+  } else {
+    // The private frame is not needed any more.
+    snapshot->deletePrivateFrame();
+    frame = getSharedFrame(srcFb);
+    frame->numUsers++;
+    snapshot->m_sharedFrame = frame;
+  }
+  deleteUnusedFrames();
+
+  Dimension dim = frame->frameBuffer.getDimension();
+  bool propertiesKept = dim.isEqualTo(&snapshot->m_lastDim) &&
+                        m_pf.isEqualTo(&snapshot->m_lastPf);
+  snapshot->m_lastDim = dim;
+  snapshot->m_lastPf = m_pf;
+  return propertiesKept && resultViewPort.isEqualTo(viewPort);
+}
+
+void SharedFrameBuffer::releaseFrame(SnapshotFrame *frame)
+{
+  AutoLock l(&m_lock);
+
+  _ASSERT(frame->numUsers > 0);
+  frame->numUsers--;
+  if (frame->numUsers == 0) {
+    deleteUnusedFrames();
+  }
+}
+
+SnapshotFrame *SharedFrameBuffer::acquireBlackFrame(const Dimension *dim,
+                                                    const PixelFormat *pf)
+{
+  AutoLock l(&m_lock);
+
+  for (std::list<SnapshotFrame *>::iterator it = m_blackFrames.begin();
+       it != m_blackFrames.end(); it++) {
+    SnapshotFrame *frame = *it;
+    if (frame->frameBuffer.getDimension().isEqualTo(dim) &&
+        frame->frameBuffer.getPixelFormat().isEqualTo(pf)) {
+      frame->numUsers++;
+      return frame;
+    }
+  }
+
+  SnapshotFrame *frame = new SnapshotFrame;
+  frame->frameBuffer.setProperties(dim, pf);
+  frame->viewPort = dim->getRect();
+  frame->frameBuffer.fillRect(&frame->viewPort, 0);
+  frame->numUsers = 1;
+  m_blackFrames.push_back(frame);
+  return frame;
+}
+
+void SharedFrameBuffer::releaseBlackFrame(SnapshotFrame *frame)
+{
+  AutoLock l(&m_lock);
+
+  _ASSERT(frame->numUsers > 0);
+  frame->numUsers--;
+  if (frame->numUsers == 0) {
+    m_blackFrames.remove(frame);
+    delete frame;
+  }
+}
+
+void SharedFrameBuffer::checkSourceProperties(const FrameBuffer *srcFb)
+{
+  Dimension dim = srcFb->getDimension();
+  PixelFormat pf = srcFb->getPixelFormat();
+  if (dim.isEqualTo(&m_dim) && pf.isEqualTo(&m_pf)) {
+    return;
+  }
+  m_dim = dim;
+  m_pf = pf;
+  m_tilesPerRow = (dim.width + TILE_SIZE - 1) / TILE_SIZE;
+  m_tilesPerColumn = (dim.height + TILE_SIZE - 1) / TILE_SIZE;
+  m_generation++;
+  m_tileGenerations.assign(m_tilesPerRow * m_tilesPerColumn, m_generation);
+
+  // Frames still used by snapshots will be deleted on release because of
+  // the size or format mismatch.
+  m_latestFrame = 0;
+  deleteUnusedFrames();
+}
+
+SnapshotFrame *SharedFrameBuffer::getSharedFrame(const FrameBuffer *srcFb)
+{
+  if (m_latestFrame != 0 && m_latestFrame->generation == m_generation) {
+    return m_latestFrame;
+  }
+
+  // The latest frame cannot be updated if somebody uses it. Then take any
+  // other unused frame, it also has most of the tiles up to date.
+  SnapshotFrame *frame = 0;
+  if (m_latestFrame != 0 && m_latestFrame->numUsers == 0) {
+    frame = m_latestFrame;
+  } else {
+    for (std::list<SnapshotFrame *>::iterator it = m_frames.begin();
+         it != m_frames.end(); it++) {
+      if ((*it)->numUsers == 0) {
+        frame = *it;
+        break;
+      }
+    }
+  }
+  if (frame == 0) {
+    frame = new SnapshotFrame;
+    m_frames.push_back(frame);
+  }
+
+  Rect srcFbRect = m_dim.getRect();
+  syncFrame(frame, srcFb, &srcFbRect);
+  m_latestFrame = frame;
+  return frame;
+}
+
+void SharedFrameBuffer::syncFrame(SnapshotFrame *frame,
+                                  const FrameBuffer *srcFb,
+                                  const Rect *viewPort)
+{
+  Dimension viewPortDim(viewPort);
+  if (!frame->frameBuffer.getDimension().isEqualTo(&viewPortDim) ||
+      !frame->frameBuffer.getPixelFormat().isEqualTo(&m_pf) ||
+      !frame->viewPort.isEqualTo(viewPort) ||
+      frame->tileGenerations.size() != m_tileGenerations.size()) {
+    frame->frameBuffer.setProperties(&viewPortDim, &m_pf);
+    frame->viewPort = *viewPort;
+    frame->tileGenerations.assign(m_tileGenerations.size(), 0);
+    frame->tilesPerRow = m_tilesPerRow;
+  }
+
+  // Copy outdated tiles, joining adjacent tiles of a row to larger
+  // rectangles.
+  for (int ty = 0; ty < m_tilesPerColumn; ty++) {
+    UINT32 *srcGens = &m_tileGenerations[ty * m_tilesPerRow];
+    UINT32 *dstGens = &frame->tileGenerations[ty * m_tilesPerRow];
+    int runStart = -1;
+    for (int tx = 0; tx <= m_tilesPerRow; tx++) {
+      bool outdated = tx < m_tilesPerRow && dstGens[tx] != srcGens[tx];
+      if (outdated) {
+        dstGens[tx] = srcGens[tx];
+        if (runStart < 0) {
+          runStart = tx;
+        }
+      } else if (runStart >= 0) {
+        Rect run(runStart * TILE_SIZE, ty * TILE_SIZE,
+                 tx * TILE_SIZE, (ty + 1) * TILE_SIZE);
+        run = run.intersection(viewPort);
+        if (!run.isEmpty()) {
+          Rect dstRect(run);
+          dstRect.move(-viewPort->left, -viewPort->top);
+          frame->frameBuffer.copyFrom(&dstRect, srcFb, run.left, run.top);
+        }
+        runStart = -1;
+      }
+    }
+  }
+  frame->generation = m_generation;
+}
+
+void SharedFrameBuffer::deleteUnusedFrames()
+{
+  size_t numSpare = 0;
+  std::list<SnapshotFrame *>::iterator it = m_frames.begin();
+  while (it != m_frames.end()) {
+    SnapshotFrame *frame = *it;
+    bool obsolete = !frame->frameBuffer.getDimension().isEqualTo(&m_dim) ||
+                    !frame->frameBuffer.getPixelFormat().isEqualTo(&m_pf);
+    bool keep = frame->numUsers > 0 || frame == m_latestFrame;
+    if (!keep && !obsolete && numSpare < MAX_SPARE_FRAMES) {
+      numSpare++;
+      keep = true;
+    }
+    if (keep) {
+      it++;
+    } else {
+      delete frame;
+      it = m_frames.erase(it);
+    }
+  }
+}
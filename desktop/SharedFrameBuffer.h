@@ -0,0 +1,231 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#ifndef __SHAREDFRAMEBUFFER_H__
+#define __SHAREDFRAMEBUFFER_H__
+
+#include <list>
+#include <vector>
+
+#include "util/CommonHeader.h"
+#include "region/Region.h"
+#include "rfb/FrameBuffer.h"
+#include "thread/LocalMutex.h"
+
+class SharedFrameBuffer;
+
+// A complete copy of the desktop frame buffer (or its part limited by a view
+// port), with the generation numbers of the copied tiles. The same structure
+// keeps black frame buffers (see FrameBufferSnapshot::getBlackFrameBuffer()),
+// these have no tiles.
+struct SnapshotFrame
+{
+  SnapshotFrame();
+
+  FrameBuffer frameBuffer;
+  // Desktop area copied to the frame buffer.
+  Rect viewPort;
+  // Generation of each desktop tile the pixels correspond to, 0 means that
+  // the tile has not been copied yet. Tiles go row by row, tilesPerRow in
+  // each row.
+  std::vector<UINT32> tileGenerations;
+  int tilesPerRow;
+  // The value of the global generation counter after the last
+  // synchronization.
+  UINT32 generation;
+  // Number of snapshots using the frame (for shared and black frames only).
+  int numUsers;
+};
+
+// FrameBufferSnapshot gives a client access to the desktop pixels as they
+// were at the moment of the last SharedFrameBuffer::updateSnapshot() call.
+// Normally the snapshot refers to a frame shared with other clients. A client
+// which sees only a part of the desktop (a view port) gets a private frame,
+// and only the tiles changed on the desktop are copied to it on the next
+// update. Pixels of the snapshot must never be modified, neither in a shared
+// nor in a private frame. A client drawing something over the desktop keeps
+// the pixels it draws apart from the snapshot: a cursor image in a
+// PatchFrameBuffer holding a copy of the pixels under the cursor only, black
+// areas out of a shared application in the black frame buffer shared by all
+// clients (see getBlackFrameBuffer()).
+//
+// The object is not thread-safe, it should be used only by one thread.
+class FrameBufferSnapshot
+{
+public:
+  FrameBufferSnapshot();
+  virtual ~FrameBufferSnapshot();
+
+  // Returns the frame buffer of the snapshot or 0 if the snapshot has never
+  // been updated or has been released.
+  const FrameBuffer *getFrameBuffer() const;
+
+  // Returns true if the current frame belongs to this snapshot only.
+  bool isPrivate() const;
+
+  // Returns a frame buffer of the snapshot dimension and pixel format filled
+  // with black, or 0 if the snapshot has never been updated or has been
+  // released. The frame buffer is shared by all the snapshots of the same
+  // size and format, its pixels must not be modified. It stays valid until
+  // the snapshot is destroyed or releaseBlackFrameBuffer() is called, even
+  // if the snapshot is updated meanwhile.
+  const FrameBuffer *getBlackFrameBuffer();
+  // Lets the black frame buffer be freed when no other snapshot uses it.
+  void releaseBlackFrameBuffer();
+
+  // Returns a stamp of the pixels within the rectangle (given in the frame
+  // buffer coordinates), or 0 if the snapshot is private or has not been
+  // updated. Equal stamps of the same rectangle mean equal pixels, in any
+  // snapshot of any SharedFrameBuffer object. The stamp holds the highest
+  // generation of the tiles under the rectangle, and a change gives a tile
+  // a generation higher than all the existing ones.
+  // Pixels copied from the desktop just before the invalidate() call for
+  // them are stamped with the old generation. That is harmless, because the
+  // change is reported to the clients after the invalidate() call, and the
+  // pixels are sent again with the new stamp.
+  // May be called by several threads at once.
+  UINT64 getContentStamp(const Rect *rect) const;
+
+  // Releases the shared frame, so that it can be reused for other snapshots.
+  // The private frame and the black frame buffer are kept.
+  void release();
+
+protected:
+  void deletePrivateFrame();
+
+  SharedFrameBuffer *m_owner;
+  SnapshotFrame *m_sharedFrame;
+  SnapshotFrame *m_privateFrame;
+  SnapshotFrame *m_blackFrame;
+
+  // Properties of the frame buffer given by the last update, for the
+  // detection of changes.
+  Dimension m_lastDim;
+  PixelFormat m_lastPf;
+
+  friend class SharedFrameBuffer;
+
+private:
+  // Do not allow copying objects.
+  FrameBufferSnapshot(const FrameBufferSnapshot &other);
+  FrameBufferSnapshot &operator=(const FrameBufferSnapshot &other);
+};
+
+// SharedFrameBuffer provides snapshots of the desktop frame buffer to the
+// clients, instead of each client keeping a full copy of the desktop. The
+// desktop is divided into tiles, each tile has a generation number which is
+// advanced every time the tile pixels are changed. Snapshots share frames
+// (complete copies of the desktop), and a frame is brought up to date by
+// copying only the tiles whose generation has changed since the frame was
+// synchronized last time. A frame is never changed while it is used by a
+// snapshot; if the latest frame is still used by other clients and is
+// outdated, an unused frame is synchronized or a new one is allocated.
+//
+// Frames are contiguous frame buffers rather than separate tiles, so that
+// encoders can address pixels the usual way. All functions are thread-safe.
+//
+// The object also keeps black frame buffers for the clients sharing only an
+// application, so that the areas out of the application are encoded from
+// one black frame buffer instead of being painted by each client.
+class SharedFrameBuffer
+{
+public:
+  SharedFrameBuffer();
+  virtual ~SharedFrameBuffer();
+
+  // Advances the generation of the tiles intersecting the region. Must be
+  // called each time pixels of the desktop frame buffer have been changed
+  // within the region. Snapshots taken before the call may already contain
+  // the new pixels, so it is not required to call it under the frame buffer
+  // lock.
+  void invalidate(const Region *region);
+
+  // Brings the snapshot up to date with srcFb. The caller must guarantee
+  // that srcFb is not changed during the call. The snapshot will contain
+  // the part of srcFb limited by viewPort.
+  // Returns false if the dimension or the pixel format of the snapshot has
+  // changed since the previous call, or if the view port is out of the srcFb
+  // bounds.
+  bool updateSnapshot(FrameBufferSnapshot *snapshot, const FrameBuffer *srcFb,
+                      const Rect *viewPort);
+
+protected:
+  // Called by FrameBufferSnapshot::release().
+  void releaseFrame(SnapshotFrame *frame);
+
+  // Return a black frame of the specified size and format with its number
+  // of users incremented, and decrement the number of users of a black
+  // frame, deleting the frame if it is not used any more.
+  SnapshotFrame *acquireBlackFrame(const Dimension *dim,
+                                   const PixelFormat *pf);
+  void releaseBlackFrame(SnapshotFrame *frame);
+
+  // Resets the tile generations and forgets all unused frames if the
+  // properties of the source frame buffer have changed.
+  void checkSourceProperties(const FrameBuffer *srcFb);
+  // Returns an up to date frame for a shared snapshot.
+  SnapshotFrame *getSharedFrame(const FrameBuffer *srcFb);
+  // Copies tiles with changed generations from srcFb to the frame. If the
+  // frame properties do not match srcFb and the view port, the frame is
+  // reallocated.
+  void syncFrame(SnapshotFrame *frame, const FrameBuffer *srcFb,
+                 const Rect *viewPort);
+  void deleteUnusedFrames();
+
+  // Size of tiles in pixels.
+  static const int TILE_SIZE = 32;
+  // Number of unused frames kept for reuse, besides the latest one.
+  static const size_t MAX_SPARE_FRAMES = 1;
+
+  // Unique number of the object, it makes the content stamps of different
+  // objects different.
+  UINT32 m_instanceId;
+  static UINT32 m_lastInstanceId;
+  static LocalMutex m_instanceIdMutex;
+
+  Dimension m_dim;
+  PixelFormat m_pf;
+  int m_tilesPerRow;
+  int m_tilesPerColumn;
+  std::vector<UINT32> m_tileGenerations;
+  UINT32 m_generation;
+
+  std::list<SnapshotFrame *> m_frames;
+  // The most recently synchronized shared frame.
+  SnapshotFrame *m_latestFrame;
+  // Black frames of all the sizes and formats in use, normally one.
+  std::list<SnapshotFrame *> m_blackFrames;
+
+  LocalMutex m_lock;
+
+  friend class FrameBufferSnapshot;
+
+private:
+  // Do not allow copying objects.
+  SharedFrameBuffer(const SharedFrameBuffer &other);
+  SharedFrameBuffer &operator=(const SharedFrameBuffer &other);
+};
+
+#endif // __SHAREDFRAMEBUFFER_H__
@@ -35,25 +35,23 @@ UpdateContainer::~UpdateContainer(void)
 
 void UpdateContainer::clear()
 {
-  copiedRegion.clear();
+  copyMoves.clear();
   changedRegion.clear();
   videoRegion.clear();
   screenSizeChanged = false;
   cursorPosChanged = false;
   cursorShapeChanged = false;
-  copySrc.clear();
   //cursorPos.clear();
 }
 
 UpdateContainer& UpdateContainer::operator=(const UpdateContainer& src)
 {
-  copiedRegion        = src.copiedRegion;
+  copyMoves           = src.copyMoves;
   changedRegion       = src.changedRegion;
   videoRegion         = src.videoRegion;
   screenSizeChanged   = src.screenSizeChanged;
   cursorPosChanged    = src.cursorPosChanged;
   cursorShapeChanged  = src.cursorShapeChanged;
-  copySrc             = src.copySrc;
   cursorPos           = src.cursorPos;
 
   return *this;
@@ -61,10 +59,125 @@ UpdateContainer& UpdateContainer::operator=(const UpdateContainer& src)
 
 bool UpdateContainer::isEmpty() const
 {
-  return copiedRegion.isEmpty() &&
+  return copyMoves.empty() &&
          changedRegion.isEmpty() &&
          videoRegion.isEmpty() &&
          !screenSizeChanged &&
          !cursorPosChanged &&
          !cursorShapeChanged;
 }
+
+void UpdateContainer::addCopyMove(const Region *dstRegion,
+                                  const Point *srcOffset)
+{
+  if (dstRegion->isEmpty() || (srcOffset->x == 0 && srcOffset->y == 0)) {
+    return;
+  }
+  CopyMove move(dstRegion, srcOffset);
+
+  // The client has outdated pixels in changedRegion, so copying them would
+  // give outdated pixels again.
+  Region staleRegion;
+  move.getSrcRegion(&staleRegion);
+  staleRegion.intersect(&changedRegion);
+  staleRegion.translate(-srcOffset->x, -srcOffset->y);
+
+  changedRegion.subtract(dstRegion);
+  changedRegion.add(&staleRegion);
+  move.dstRegion.subtract(&staleRegion);
+  if (move.dstRegion.isEmpty()) {
+    return;
+  }
+  copyMoves.push_back(move);
+
+  if (copyMoves.size() > MAX_COPY_MOVES) {
+    Region staleRegion = copyMoves.front().dstRegion;
+    changedRegion.add(&staleRegion);
+    copyMoves.erase(copyMoves.begin());
+    declineCopies(&staleRegion, 0, 0);
+  }
+}
+
+void UpdateContainer::declineCopies(const Region *region)
+{
+  Region staleRegion;
+  declineCopies(&staleRegion, region, 0);
+}
+
+void UpdateContainer::cropCopies(const Region *area)
+{
+  Region staleRegion;
+  declineCopies(&staleRegion, 0, area);
+}
+
+void UpdateContainer::declineAllCopies()
+{
+  for (size_t i = 0; i < copyMoves.size(); i++) {
+    changedRegion.add(&copyMoves[i].dstRegion);
+  }
+  copyMoves.clear();
+}
+
+void UpdateContainer::declineCopies(Region *staleRegion,
+                                    const Region *region,
+                                    const Region *area)
+{
+  std::vector<CopyMove>::iterator move = copyMoves.begin();
+  while (move != copyMoves.end()) {
+    // Pixels copied from stale ones are stale too.
+    Region declinedRegion = *staleRegion;
+    declinedRegion.translate(-move->srcOffset.x, -move->srcOffset.y);
+    if (region != 0) {
+      declinedRegion.add(region);
+    }
+    declinedRegion.intersect(&move->dstRegion);
+    if (area != 0) {
+      // Both the destination and the source pixels should be inside.
+      Region validRegion = *area;
+      validRegion.translate(-move->srcOffset.x, -move->srcOffset.y);
+      validRegion.intersect(area);
+      Region outsideRegion = move->dstRegion;
+      outsideRegion.subtract(&validRegion);
+      declinedRegion.add(&outsideRegion);
+    }
+
+    staleRegion->subtract(&move->dstRegion);
+    if (!declinedRegion.isEmpty()) {
+      staleRegion->add(&declinedRegion);
+      changedRegion.add(&declinedRegion);
+      move->dstRegion.subtract(&declinedRegion);
+    }
+    if (move->dstRegion.isEmpty()) {
+      move = copyMoves.erase(move);
+    } else {
+      move++;
+    }
+  }
+}
+
+bool UpdateContainer::hasCopies() const
+{
+  return !copyMoves.empty();
+}
+
+void UpdateContainer::getCopiedRegion(Region *copiedRegion) const
+{
+  copiedRegion->clear();
+  for (size_t i = 0; i < copyMoves.size(); i++) {
+    copiedRegion->add(&copyMoves[i].dstRegion);
+  }
+}
+
+void UpdateContainer::getCopyRects(std::vector<Rect> *rects,
+                                   std::vector<Point> *sources) const
+{
+  rects->clear();
+  sources->clear();
+  for (size_t i = 0; i < copyMoves.size(); i++) {
+    size_t first = rects->size();
+    copyMoves[i].getOrderedRects(rects);
+    for (size_t j = first; j < rects->size(); j++) {
+      sources->push_back(copyMoves[i].getSource(&(*rects)[j]));
+    }
+  }
+}
@@ -25,8 +25,11 @@
 #ifndef __UPDATECONTAINER_H__
 #define __UPDATECONTAINER_H__
 
+#include <vector>
+
 #include "region/Region.h"
 #include "region/Point.h"
+#include "CopyMove.h"
 
 class UpdateContainer
 {
@@ -37,17 +40,55 @@ public:
   UpdateContainer(const UpdateContainer& updateContainer) { *this = updateContainer; }
   UpdateContainer &operator=(const UpdateContainer& src);
 
-  Region copiedRegion;
+  // CopyRect operations in the order they should be applied. Each of them
+  // reads the pixels as they are after the previous ones. Destination
+  // regions of different moves may overlap, the later move wins. Pixels
+  // read by a move never belong to changedRegion at the time it is added.
+  std::vector<CopyMove> copyMoves;
   Region changedRegion;
   Region videoRegion;
   bool screenSizeChanged;
   bool cursorPosChanged;
   bool cursorShapeChanged;
-  Point copySrc;
   Point cursorPos;
 
   void clear();
   bool isEmpty() const;
+
+  // Appends a move after the existing ones. The destination pixels whose
+  // sources are in changedRegion are left to changedRegion, the rest of the
+  // destination region is removed from it.
+  void addCopyMove(const Region *dstRegion, const Point *srcOffset);
+
+  // Converts the specified part of the moves destinations to changed
+  // pixels. Parts of the following moves which read the declined pixels
+  // are declined as well.
+  void declineCopies(const Region *region);
+  // Declines parts of the moves which read or write pixels outside of the
+  // area.
+  void cropCopies(const Region *area);
+  // Converts all the moves to changed pixels.
+  void declineAllCopies();
+
+  bool hasCopies() const;
+  // Sets copiedRegion to the union of the moves destinations.
+  void getCopiedRegion(Region *copiedRegion) const;
+  // Sets rects to the destination rectangles of all the moves and sources to
+  // their source points, in the order they should be copied.
+  void getCopyRects(std::vector<Rect> *rects,
+                    std::vector<Point> *sources) const;
+
+private:
+  // Declines the region and the parts of the moves reading or writing
+  // pixels outside of the area, each one if it is not 0. staleRegion
+  // specifies pixels which are already wrong on the client before the
+  // first move, the moves reading them are declined too.
+  void declineCopies(Region *staleRegion, const Region *region,
+                     const Region *area);
+
+  // Maximum number of moves. If a new move exceeds it, the oldest one is
+  // declined.
+  static const size_t MAX_COPY_MOVES = 16;
 };
 
 #endif // __UPDATECONTAINER_H__
@@ -24,8 +24,7 @@
 
 #include "UpdateFilter.h"
 #include "util/CommonHeader.h"
-
-static const int BLOCK_SIZE = 32;
+#include "server-config-lib/Configurator.h"
 
 UpdateFilter::UpdateFilter(ScreenDriver *screenDriver,
                            FrameBuffer *frameBuffer,
@@ -54,19 +53,24 @@ void UpdateFilter::filter(UpdateContainer *updateContainer)
     return;
   }
 
+  Region copiedRegion;
+  updateContainer->getCopiedRegion(&copiedRegion);
+
   Region toCheck = updateContainer->changedRegion;
-  toCheck.add(&updateContainer->copiedRegion);
+  toCheck.add(&copiedRegion);
   toCheck.add(&updateContainer->videoRegion);
 
   std::vector<Rect> rects;
   std::vector<Rect>::iterator iRect;
 
-  // Reproduce CopyRect operations in m_frameBuffer.
-  updateContainer->copiedRegion.getRectVector(&rects);
-  Point *src = &updateContainer->copySrc;
-  for (iRect = rects.begin(); iRect < rects.end(); iRect++) {
-    m_frameBuffer->move(&(*iRect), src->x, src->y);
+  // Reproduce CopyRect operations in m_frameBuffer, in the same order as
+  // clients will do.
+  std::vector<Point> sources;
+  updateContainer->getCopyRects(&rects, &sources);
+  for (size_t i = 0; i < rects.size(); i++) {
+    m_frameBuffer->move(&rects[i], sources[i].x, sources[i].y);
   }
+  m_changeDetector.invalidate(&copiedRegion);
 
 
   toCheck.getRectVector(&rects);
@@ -79,204 +83,65 @@ void UpdateFilter::filter(UpdateContainer *updateContainer)
   }
   m_log->debug(_T("end of grabbing region"));
 
-  // Filtering
+  // Filtering. Scrolled content becomes CopyRect moves, so that only the
+  // exposed strips remain changed. Video changes every frame and is not
+  // worth looking for scrolling in.
+  ServerConfig *config = Configurator::getInstance()->getServerConfig();
+  Region scrollCandidates = updateContainer->changedRegion;
   updateContainer->changedRegion.clear();
-  Rect *rect;
-  for (iRect = rects.begin(); iRect < rects.end(); iRect++) {
-    rect = &(*iRect);
-    getChangedRegion(&updateContainer->changedRegion, rect);
+  if (config->isScrollDetectionEnabled()) {
+    Region videoRegion;
+    m_videoDetector.getVideoRegion(&videoRegion);
+    scrollCandidates.subtract(&videoRegion);
+    scrollCandidates.subtract(&updateContainer->videoRegion);
+    detectScrolling(&scrollCandidates, screenFrameBuffer, updateContainer);
   }
+  m_changeDetector.detectChanges(&toCheck, screenFrameBuffer, m_frameBuffer,
+                                 &updateContainer->changedRegion);
 
   // Copy actually changed pixels into m_frameBuffer.
   updateContainer->changedRegion.getRectVector(&rects);
   for (iRect = rects.begin(); iRect < rects.end(); iRect++) {
-    rect = &(*iRect);
+    Rect *rect = &(*iRect);
     m_frameBuffer->copyFrom(rect, screenFrameBuffer, rect->left, rect->top);
   }
-}
-
-void UpdateFilter::getChangedRegion(Region *rgn, const Rect *rect)
-{
-  
-  const UINT bytesPerPixel = m_frameBuffer->getBytesPerPixel();
-  const int bytes_per_scanline = (rect->right - rect->left) * bytesPerPixel;
-
-  const int bytesPerRow = m_frameBuffer->getBytesPerRow();
-  const int offset = rect->top * bytesPerRow + rect->left * bytesPerPixel;
-  unsigned char *o_ptr = (unsigned char *)m_frameBuffer->getBuffer() + offset;
-  unsigned char *n_ptr = (unsigned char *)m_screenDriver->getScreenBuffer()->getBuffer() + offset;
-
-  Rect new_rect = rect;
-
-  // Fast processing for small rectangles
-  if ( rect->right - rect->left <= BLOCK_SIZE &&
-       rect->bottom - rect->top <= BLOCK_SIZE ) {
-      for (int y = rect->top; y < rect->bottom; y++) {
-        if (memcmp(o_ptr, n_ptr, bytes_per_scanline) != 0) {
-          new_rect.top = y;
-          updateChangedSubRect(rgn, &new_rect);
-          break;
-        }
-        o_ptr += bytesPerRow;
-        n_ptr += bytesPerRow;
-      }
-      return;
-  }
 
-  // Process bigger rectangles
-  new_rect.top = -1;
-  for (int y = rect->top; y < rect->bottom; y++) {
-    if (memcmp(o_ptr, n_ptr, bytes_per_scanline) != 0) {
-      if (new_rect.top == -1) {
-        new_rect.top = y;
-      }
-      // Skip a number of lines after a non-matched one
-      int n = BLOCK_SIZE / 2 - 1;
-      y += n;
-      o_ptr += n * bytesPerRow;
-      n_ptr += n * bytesPerRow;
-    } else {
-      if (new_rect.top != -1) {
-        new_rect.bottom = y;
-        updateChangedRect(rgn, &new_rect);
-        new_rect.top = -1;
-      }
-    }
-    o_ptr += bytesPerRow;
-    n_ptr += bytesPerRow;
-  }
-  if (new_rect.top != -1) {
-    new_rect.bottom = rect->bottom;
-    updateChangedRect(rgn, &new_rect);
+  // Areas changing like video are sent as video.
+  if (config->isAutoVideoDetectionEnabled()) {
+    m_videoDetector.update(&updateContainer->changedRegion, m_frameBuffer);
+    Region videoRegion;
+    m_videoDetector.getVideoRegion(&videoRegion);
+    updateContainer->videoRegion.add(&videoRegion);
   }
 }
 
-void UpdateFilter::updateChangedRect(Region *rgn, const Rect *rect)
+void UpdateFilter::detectScrolling(const Region *region,
+                                   const FrameBuffer *screenFrameBuffer,
+                                   UpdateContainer *updateContainer)
 {
-  // Pass small rectangles directly to updateChangedSubRect
-  if ( rect->right - rect->left <= BLOCK_SIZE &&
-       rect->bottom - rect->top <= BLOCK_SIZE ) {
-      updateChangedSubRect(rgn, rect);
-      return;
-  }
-
-  const UINT bytesPerPixel = m_frameBuffer->getBytesPerPixel();
-
-  Rect new_rect;
-  int x, y, ay;
-
-  // Scan down the rectangle
-  const int bytesPerRow = m_frameBuffer->getBytesPerRow();
-  const int offset = rect->top * bytesPerRow + rect->left * bytesPerPixel;
-  unsigned char *o_topleft_ptr = (unsigned char *)m_frameBuffer->getBuffer() + offset;
-  unsigned char *n_topleft_ptr = (unsigned char *)m_screenDriver->getScreenBuffer()->getBuffer() + offset;
-
-  for (y = rect->top; y < rect->bottom; y += BLOCK_SIZE)
-  {
-    // Work out way down the bitmap
-    unsigned char *o_row_ptr = o_topleft_ptr;
-    unsigned char *n_row_ptr = n_topleft_ptr;
+  std::vector<CopyMove> moves;
+  m_scrollDetector.detect(region, screenFrameBuffer, m_frameBuffer, &moves);
 
-    const int blockbottom = min(y + BLOCK_SIZE, rect->bottom);
-    new_rect.bottom = blockbottom;
-    new_rect.left = -1;
-
-    for (x = rect->left; x < rect->right; x += BLOCK_SIZE)
-    {
-      // Work our way across the row
-      unsigned char *n_block_ptr = n_row_ptr;
-      unsigned char *o_block_ptr = o_row_ptr;
-
-      const UINT blockright = min(x + BLOCK_SIZE, rect->right);
-      const UINT bytesPerBlockRow = (blockright-x) * bytesPerPixel;
-
-      // Scan this block
-      for (ay = y; ay < blockbottom; ay++) {
-        if (memcmp(n_block_ptr, o_block_ptr, bytesPerBlockRow) != 0)
-          break;
-        n_block_ptr += bytesPerRow;
-        o_block_ptr += bytesPerRow;
-      }
-      if (ay < blockbottom) {
-        // There were changes, so this block will need to be updated
-        if (new_rect.left == -1) {
-          new_rect.left = x;
-          new_rect.top = ay;
-        } else if (ay < new_rect.top) {
-          new_rect.top = ay;
-        }
-      } else {
-        // No changes in this block, process previous changed blocks if any
-        if (new_rect.left != -1) {
-          new_rect.right = x;
-          updateChangedSubRect(rgn, &new_rect);
-          new_rect.left = -1;
-        }
-      }
-
-      o_row_ptr += bytesPerBlockRow;
-      n_row_ptr += bytesPerBlockRow;
-    }
-
-    if (new_rect.left != -1) {
-      new_rect.right = rect->right;
-      updateChangedSubRect(rgn, &new_rect);
+  std::vector<Rect> rects;
+  for (size_t i = 0; i < moves.size(); i++) {
+    const CopyMove *move = &moves[i];
+    rects.clear();
+    move->getOrderedRects(&rects);
+    for (size_t j = 0; j < rects.size(); j++) {
+      Point src = move->getSource(&rects[j]);
+      m_frameBuffer->move(&rects[j], src.x, src.y);
     }
-
-    o_topleft_ptr += bytesPerRow * BLOCK_SIZE;
-    n_topleft_ptr += bytesPerRow * BLOCK_SIZE;
+    m_changeDetector.invalidate(&move->dstRegion);
+    // The changed region is empty here, so the whole move is kept.
+    updateContainer->addCopyMove(&move->dstRegion, &move->srcOffset);
+  }
+  if (!moves.empty()) {
+    m_log->debug(_T("Detected %d scrolled areas"), (int)moves.size());
   }
 }
 
-void UpdateFilter::updateChangedSubRect(Region *rgn, const Rect *rect)
+void UpdateFilter::onFrameBufferReplaced()
 {
-  const UINT bytesPerPixel = m_frameBuffer->getBytesPerPixel();
-  int bytes_in_row = (rect->right - rect->left) * bytesPerPixel;
-  int y, i;
-
-  // Exclude unchanged scan lines at the bottom
-  const int bytesPerRow = m_frameBuffer->getBytesPerRow();
-  int offset = (rect->bottom - 1) * bytesPerRow + rect->left * bytesPerPixel;
-  unsigned char *o_ptr = (unsigned char *)m_frameBuffer->getBuffer() + offset;
-  unsigned char *n_ptr = (unsigned char *)m_screenDriver->getScreenBuffer()->getBuffer() + offset;
-  Rect final_rect = rect;
-  final_rect.bottom = rect->top + 1;
-  for (y = rect->bottom - 1; y > rect->top; y--) {
-    if (memcmp(o_ptr, n_ptr, bytes_in_row) != 0) {
-      final_rect.bottom = y + 1;
-      break;
-    }
-    n_ptr -= bytesPerRow;
-    o_ptr -= bytesPerRow;
-  }
-
-  // Exclude unchanged pixels at left and right sides
-  offset = final_rect.top * bytesPerRow + final_rect.left * bytesPerPixel;
-  o_ptr = (unsigned char *)m_frameBuffer->getBuffer() + offset;
-  n_ptr = (unsigned char *)m_screenDriver->getScreenBuffer()->getBuffer() + offset;
-  int left_delta = bytes_in_row - 1;
-  int right_delta = 0;
-  for (y = final_rect.top; y < final_rect.bottom; y++) {
-    for (i = 0; i < bytes_in_row - 1; i++) {
-      if (n_ptr[i] != o_ptr[i]) {
-        if (i < left_delta)
-          left_delta = i;
-        break;
-      }
-    }
-    for (i = bytes_in_row - 1; i > 0; i--) {
-      if (n_ptr[i] != o_ptr[i]) {
-        if (i > right_delta)
-          right_delta = i;
-        break;
-      }
-    }
-    n_ptr += bytesPerRow;
-    o_ptr += bytesPerRow;
-  }
-  final_rect.right = final_rect.left + right_delta / bytesPerPixel + 1;
-  final_rect.left += left_delta / bytesPerPixel;
-
-  // Update the rectangle
-  rgn->addRect(&final_rect);
+  m_changeDetector.invalidateAll();
+  m_videoDetector.reset();
 }
@@ -31,6 +31,9 @@
 #include "thread/LocalMutex.h"
 #include "UpdateContainer.h"
 #include "GrabOptimizator.h"
+#include "BlockHashDetector.h"
+#include "ScrollDetector.h"
+#include "VideoRegionDetector.h"
 
 class UpdateFilter
 {
@@ -43,10 +46,11 @@ public:
 
   void filter(UpdateContainer *updateContainer);
 
+  // Must be called under the frame buffer lock after the frame buffer has
+  // been changed by other means than filter().
+  void onFrameBufferReplaced();
+
 private:
-  void getChangedRegion(Region *rgn, const Rect *rect);
-  void updateChangedRect(Region *rgn, const Rect *rect);
-  void updateChangedSubRect(Region *rgn, const Rect *rect);
 
   // This function update the screen grabber frame buffer.
   // If success the function returns the true.
@@ -54,10 +58,19 @@ private:
   // the whole screen grabbing or 
   bool grab();
 
+  // Finds scrolled areas within the region, applies the moves to
+  // m_frameBuffer and appends them to the update container.
+  void detectScrolling(const Region *region,
+                       const FrameBuffer *screenFrameBuffer,
+                       UpdateContainer *updateContainer);
+
   ScreenDriver *m_screenDriver;
   FrameBuffer *m_frameBuffer;
   LocalMutex *m_fbMutex;
   GrabOptimizator m_grabOptimizator;
+  BlockHashDetector m_changeDetector;
+  ScrollDetector m_scrollDetector;
+  VideoRegionDetector m_videoDetector;
 
   LogWriter *m_log;
 };
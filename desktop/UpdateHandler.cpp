@@ -36,40 +36,23 @@ void UpdateHandler::initFrameBuffer(const FrameBuffer *newFb)
 {
   AutoLock al(&m_fbLocMut);
   m_backupFrameBuffer.clone(newFb);
+  Region fbRegion(&m_backupFrameBuffer.getDimension().getRect());
+  m_sharedFrameBuffer.invalidate(&fbRegion);
 }
 
-bool UpdateHandler::updateExternalFrameBuffer(FrameBuffer *fb, const Region *region,
+bool UpdateHandler::updateFrameBufferSnapshot(FrameBufferSnapshot *snapshot,
                                               const Rect *viewPort)
 {
   AutoLock al(&m_fbLocMut);
-  return updateExternalFrameBuffer(fb, &m_backupFrameBuffer, region, viewPort);
+  return m_sharedFrameBuffer.updateSnapshot(snapshot, &m_backupFrameBuffer,
+                                            viewPort);
 }
 
-bool UpdateHandler::updateExternalFrameBuffer(FrameBuffer *dstFb, FrameBuffer *srcFb,
-                                              const Region *region,
-                                              const Rect *viewPort)
+void UpdateHandler::invalidateSnapshots(const UpdateContainer *updateContainer)
 {
-  PixelFormat dstPf = dstFb->getPixelFormat();
-  PixelFormat srcPf = srcFb->getPixelFormat();
-  Dimension dstFbDim = dstFb->getDimension();
-  Rect srcFbRect = srcFb->getDimension().getRect();
-  Rect resultViewPort = srcFbRect.intersection(viewPort);
-
-  if (!dstPf.isEqualTo(&srcPf) || !dstFbDim.isEqualTo(&Dimension(&resultViewPort)) ||
-      !resultViewPort.isEqualTo(viewPort)) {
-    dstFb->setProperties(&resultViewPort, &srcPf);
-    return false;
-  }
-
-  std::vector<Rect> rects;
-  std::vector<Rect>::iterator iRect;
-  region->getRectVector(&rects);
-
-  for (iRect = rects.begin(); iRect < rects.end(); iRect++) {
-    Rect *rect = &(*iRect);
-    dstFb->copyFrom(rect, srcFb,
-                           rect->left + viewPort->left,
-                           rect->top + viewPort->top);
-  }
-  return true;
+  Region changes;
+  updateContainer->getCopiedRegion(&changes);
+  changes.add(&updateContainer->changedRegion);
+  changes.add(&updateContainer->videoRegion);
+  m_sharedFrameBuffer.invalidate(&changes);
 }
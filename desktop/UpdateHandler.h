@@ -31,6 +31,7 @@
 #include "ScreenGrabber.h"
 #include "WindowsCursorShapeGrabber.h"
 #include "rfb/FrameBuffer.h"
+#include "SharedFrameBuffer.h"
 #include "thread/AutoLock.h"
 #include "UpdateListener.h"
 #include "UpdateDetector.h"
@@ -61,7 +62,7 @@ public:
 
   // This function unconventionally set to update pending of the frame buffer
   // in the next time call of the extract() function. All found changes
-  // saves to the changedRegion and copiedRegion.
+  // saves to the changedRegion and copyMoves.
   virtual void setFullUpdateRequested(const Region *region) = 0;
 
   // Checking a region for updates.
@@ -71,7 +72,7 @@ public:
   virtual bool checkForUpdates(Region *region) = 0;
 
   // Set a region excluded from the region that updates detects.
-  // excludedRegion will never be present in changedRegion or copiedRegion.
+  // excludedRegion will never be present in changedRegion or copyMoves.
   virtual void setExcludedRegion(const Region *excludedRegion) = 0;
 
   // The function provides access to FrameBuffer data.
@@ -89,23 +90,29 @@ public:
     *pf = m_backupFrameBuffer.getPixelFormat();
   }
 
-  void initFrameBuffer(const FrameBuffer *newFb);
+  virtual void initFrameBuffer(const FrameBuffer *newFb);
 
-  virtual bool updateExternalFrameBuffer(FrameBuffer *fb, const Region *region,
+  // Brings the snapshot up to date with the frame buffer, see
+  // SharedFrameBuffer::updateSnapshot().
+  virtual bool updateFrameBufferSnapshot(FrameBufferSnapshot *snapshot,
                                          const Rect *viewPort);
 
+  // Marks the changes of an update container returned by extract() in the
+  // snapshots of the frame buffer. Must be called after each extract()
+  // call, before the updates are given to the clients.
+  void invalidateSnapshots(const UpdateContainer *updateContainer);
+
   // FIXME: It's no good idea to place this function to here.
   // Because it uses only for the UpdateHandlerClient class.
   virtual void sendInit(BlockingGate *gate) {}
 
 protected:
-  virtual bool updateExternalFrameBuffer(FrameBuffer *dstFb, FrameBuffer *srcFb,
-                                         const Region *region,
-                                         const Rect *viewPort);
-
   FrameBuffer m_backupFrameBuffer;
   LocalMutex m_fbLocMut;
 
+  // Snapshots of m_backupFrameBuffer shared by the clients.
+  SharedFrameBuffer m_sharedFrameBuffer;
+
   // m_cursorShape not thread safed
   CursorShape m_cursorShape;
 };
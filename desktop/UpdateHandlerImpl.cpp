@@ -101,9 +101,10 @@ void UpdateHandlerImpl::extract(UpdateContainer *updateContainer)
       // may be invoked from other threads and then it shall cover by the mutex.
       AutoLock al(&m_fbLocMut);
       m_backupFrameBuffer.clone(m_screenDriver->getScreenBuffer());
+      m_updateFilter->onFrameBufferReplaced();
     }
     updateContainer->changedRegion.clear();
-    updateContainer->copiedRegion.clear();
+    updateContainer->copyMoves.clear();
     m_absoluteRect = m_backupFrameBuffer.getDimension().getRect();
     m_updateKeeper.setBorderRect(&m_absoluteRect);
   }
@@ -121,6 +122,13 @@ void UpdateHandlerImpl::extract(UpdateContainer *updateContainer)
   }
 }
 
+void UpdateHandlerImpl::initFrameBuffer(const FrameBuffer *newFb)
+{
+  AutoLock al(&m_fbLocMut);
+  UpdateHandler::initFrameBuffer(newFb);
+  m_updateFilter->onFrameBufferReplaced();
+}
+
 void UpdateHandlerImpl::applyNewScreenProperties()
 {
   int applyTryCount = 3;
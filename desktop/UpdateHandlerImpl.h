@@ -43,6 +43,8 @@ public:
 
   virtual void setExcludedRegion(const Region *excludedRegion);
 
+  virtual void initFrameBuffer(const FrameBuffer *newFb);
+
 private:
   virtual void executeDetectors();
   virtual void terminateDetectors();
@@ -41,9 +41,8 @@ void UpdateKeeper::addChangedRegion(const Region *changedRegion)
 {
   AutoLock al(&m_updContLocMut);
 
-  // FIXME: Calling subtract() function is correct if use
-  // copy region instead of copy rectangle.
-  //m_updateContainer.copiedRegion.subtract(changedRegion);
+  // Changed pixels are sent after the moves, so the moves need no
+  // correction here.
   m_updateContainer.changedRegion.add(changedRegion);
   m_updateContainer.changedRegion.crop(&m_borderRect);
 }
@@ -62,72 +61,15 @@ void UpdateKeeper::addCopyRect(const Rect *copyRect, const Point *src)
     return;
   }
 
-  Region *changedRegion = &m_updateContainer.changedRegion;
-  Region *copiedRegion = &m_updateContainer.copiedRegion;
-  Point *copySrc = &m_updateContainer.copySrc;
-  Rect dstCopyRect(copyRect);
-
-  // Create copy of copyRect in the source coordinates.
-  Rect srcCopyRect(copyRect);
-  srcCopyRect.setLocation(src->x, src->y);
-
-  // Clipping dstCopyRect
-  dstCopyRect = dstCopyRect.intersection(&m_borderRect);
-  // Correcting source coordinates
-  srcCopyRect.left    += dstCopyRect.left - copyRect->left;
-  srcCopyRect.top     += dstCopyRect.top - copyRect->top;
-  srcCopyRect.right   += dstCopyRect.right - copyRect->right;
-  srcCopyRect.bottom  += dstCopyRect.bottom - copyRect->bottom;
-  // Clipping srcCopyRect
-  Rect dummySrcCopyRect(&srcCopyRect);
-  srcCopyRect = srcCopyRect.intersection(&m_borderRect);
-  // Correcting destination coordinates
-  dstCopyRect.left    += srcCopyRect.left - dummySrcCopyRect.left;
-  dstCopyRect.top     += srcCopyRect.top - dummySrcCopyRect.top;
-  dstCopyRect.right   += srcCopyRect.right - dummySrcCopyRect.right;
-  dstCopyRect.bottom  += srcCopyRect.bottom - dummySrcCopyRect.bottom;
-
-  if (dstCopyRect.isEmpty()) {
-    return;
-  }
-
-  copySrc->x = srcCopyRect.left;
-  copySrc->y = srcCopyRect.top;
-
-  // Adding difference between clipped dstCopyRect and original copyRect
-  // to changedRegion. Because without update detectors this information
-  // loses irretrievably.
-  Region diff(copyRect);
-  Region dstCopyRegion(&dstCopyRect);
-  diff.subtract(&dstCopyRegion);
-  addChangedRegion(&diff);
-
-  // Old copiedRegion must be added to changedRegion - (?)
-  if (!copiedRegion->isEmpty()) {
-    changedRegion->add(copiedRegion);
-    copiedRegion->clear();
-    addChangedRect(copyRect);
-    return;
-  }
-
-  copiedRegion->clear();
-  copiedRegion->addRect(&dstCopyRect);
-
-  // copiedRegion must be substracted from changedRegion
-  changedRegion->subtract(copiedRegion);
-
-  // Create region that is intersection of changedRegion and srcCopyRect.
-  Region addonChangedRegion(&srcCopyRect);
-  addonChangedRegion.intersect(changedRegion);
-
-  // Move addonChangedRegion and add it to changedRegion.
-  addonChangedRegion.translate(dstCopyRect.left - copySrc->x,
-                               dstCopyRect.top - copySrc->y);
-  changedRegion->add(&addonChangedRegion);
+  Region dstRegion(copyRect);
+  Point srcOffset(src->x - copyRect->left, src->y - copyRect->top);
+  m_updateContainer.addCopyMove(&dstRegion, &srcOffset);
 
-  // Clipping regions
+  // Parts of the move reading or writing pixels outside the border are
+  // converted to changed pixels.
+  Region borderRegion(&m_borderRect);
+  m_updateContainer.cropCopies(&borderRegion);
   m_updateContainer.changedRegion.crop(&m_borderRect);
-  m_updateContainer.copiedRegion.crop(&m_borderRect);
 }
 
 void UpdateKeeper::setBorderRect(const Rect *borderRect)
@@ -165,15 +107,15 @@ void UpdateKeeper::addUpdateContainer(const UpdateContainer *updateContainer)
 {
   AutoLock al(&m_updContLocMut);
 
-  // FIXME: Use addCopyRegion instead of addCopyRect
-  // Add copied region
-  std::vector<Rect> rects;
-  std::vector<Rect>::iterator iRect;
-  updateContainer->copiedRegion.getRectVector(&rects);
-  size_t numRects = rects.size();
-  if (numRects > 0) {
-    iRect = rects.begin();
-    addCopyRect(&(*iRect), &updateContainer->copySrc);
+  // Add moves in their order, they precede the changed region.
+  const std::vector<CopyMove> *moves = &updateContainer->copyMoves;
+  if (!moves->empty()) {
+    for (size_t i = 0; i < moves->size(); i++) {
+      m_updateContainer.addCopyMove(&(*moves)[i].dstRegion,
+                                    &(*moves)[i].srcOffset);
+    }
+    Region borderRegion(&m_borderRect);
+    m_updateContainer.cropCopies(&borderRegion);
   }
 
   // Add changed region
@@ -206,8 +148,9 @@ bool UpdateKeeper::checkForUpdates(const Region *region)
   UpdateContainer updateContainer;
   getUpdateContainer(&updateContainer);
 
-  Region resultRegion = updateContainer.changedRegion;
-  resultRegion.add(&updateContainer.copiedRegion);
+  Region resultRegion;
+  updateContainer.getCopiedRegion(&resultRegion);
+  resultRegion.add(&updateContainer.changedRegion);
   resultRegion.intersect(region);
 
   bool result = updateContainer.cursorPosChanged ||
@@ -224,16 +167,17 @@ void UpdateKeeper::extract(UpdateContainer *updateContainer)
     AutoLock al(&m_updContLocMut);
 
     // Clipping regions
+    Region borderRegion(&m_borderRect);
+    m_updateContainer.cropCopies(&borderRegion);
     m_updateContainer.changedRegion.crop(&m_borderRect);
-    m_updateContainer.copiedRegion.crop(&m_borderRect);
 
     *updateContainer = m_updateContainer;
     m_updateContainer.clear();
   }
   {
     AutoLock al(&m_exclRegLocMut);
+    updateContainer->declineCopies(&m_excludedRegion);
     updateContainer->changedRegion.subtract(&m_excludedRegion);
-    updateContainer->copiedRegion.subtract(&m_excludedRegion);
   }
 }
 
@@ -0,0 +1,187 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#include "VideoRegionDetector.h"
+
+VideoRegionDetector::VideoRegionDetector()
+: m_tilesPerRow(0),
+  m_tilesPerColumn(0),
+  m_numVideoTiles(0),
+  m_hasLastUpdate(false)
+{
+}
+
+VideoRegionDetector::~VideoRegionDetector()
+{
+}
+
+void VideoRegionDetector::update(const Region *changedRegion,
+                                 const FrameBuffer *fb)
+{
+  Dimension dim = fb->getDimension();
+  setDimension(&dim);
+  Rect fbRect = dim.getRect();
+
+  DateTime now = DateTime::now();
+  int elapsed = 0;
+  if (m_hasLastUpdate) {
+    elapsed = (int)min((now - m_lastUpdateTime).getTime(),
+                       (UINT64)TIME_CONSTANT);
+  }
+  m_lastUpdateTime = now;
+  m_hasLastUpdate = true;
+
+  // Mark the tiles touched by the changed region.
+  m_changedTiles.assign(m_rates.size(), false);
+  std::vector<Rect> rects;
+  changedRegion->getRectVector(&rects);
+  for (size_t i = 0; i < rects.size(); i++) {
+    Rect rect = rects[i].intersection(&fbRect);
+    if (rect.isEmpty()) {
+      continue;
+    }
+    for (int ty = rect.top / TILE_SIZE; ty <= (rect.bottom - 1) / TILE_SIZE; ty++) {
+      for (int tx = rect.left / TILE_SIZE; tx <= (rect.right - 1) / TILE_SIZE; tx++) {
+        m_changedTiles[ty * m_tilesPerRow + tx] = true;
+      }
+    }
+  }
+
+  // Each change adds 1 / TIME_CONSTANT to the rate, and the rate decays
+  // exponentially, so it approximates the number of changes per second.
+  const int changeWeight = RATE_SCALE * 1000 / TIME_CONSTANT;
+  for (size_t i = 0; i < m_rates.size(); i++) {
+    int rate = m_rates[i];
+    rate -= (int)((INT64)rate * elapsed / TIME_CONSTANT);
+    if (m_changedTiles[i]) {
+      rate += changeWeight;
+    }
+    m_rates[i] = rate;
+
+    if (m_videoTiles[i]) {
+      if (rate < LEAVE_RATE * RATE_SCALE) {
+        m_videoTiles[i] = false;
+        m_numVideoTiles--;
+      }
+    } else if (m_changedTiles[i] && rate >= ENTER_RATE * RATE_SCALE) {
+      int index = (int)i;
+      Rect tileRect(index % m_tilesPerRow * TILE_SIZE,
+                    index / m_tilesPerRow * TILE_SIZE,
+                    index % m_tilesPerRow * TILE_SIZE + TILE_SIZE,
+                    index / m_tilesPerRow * TILE_SIZE + TILE_SIZE);
+      tileRect = tileRect.intersection(&fbRect);
+      if (isPhotographic(fb, &tileRect)) {
+        m_videoTiles[i] = true;
+        m_numVideoTiles++;
+      }
+    }
+  }
+}
+
+void VideoRegionDetector::getVideoRegion(Region *videoRegion) const
+{
+  if (m_numVideoTiles < MIN_VIDEO_TILES) {
+    videoRegion->clear();
+    return;
+  }
+  Rect bounds = m_dimension.getRect();
+  videoRegion->setTiles(&m_videoTiles, m_tilesPerRow, TILE_SIZE, TILE_SIZE,
+                        &bounds);
+}
+
+void VideoRegionDetector::reset()
+{
+  m_rates.assign(m_rates.size(), 0);
+  m_videoTiles.assign(m_videoTiles.size(), false);
+  m_numVideoTiles = 0;
+  m_hasLastUpdate = false;
+}
+
+void VideoRegionDetector::setDimension(const Dimension *dim)
+{
+  if (m_dimension.isEqualTo(dim) && !m_rates.empty()) {
+    return;
+  }
+  m_dimension = *dim;
+  m_tilesPerRow = (dim->width + TILE_SIZE - 1) / TILE_SIZE;
+  m_tilesPerColumn = (dim->height + TILE_SIZE - 1) / TILE_SIZE;
+  size_t numTiles = (size_t)m_tilesPerRow * m_tilesPerColumn;
+  m_rates.assign(numTiles, 0);
+  m_videoTiles.assign(numTiles, false);
+  m_numVideoTiles = 0;
+}
+
+bool VideoRegionDetector::isPhotographic(const FrameBuffer *fb,
+                                         const Rect *tileRect) const
+{
+  switch (fb->getBytesPerPixel()) {
+  case 1:
+    // Palette colors are not photographic.
+    return false;
+  case 2:
+    return isPhotographic<UINT16>(fb, tileRect);
+  default:
+    _ASSERT(fb->getBytesPerPixel() == 4);
+    return isPhotographic<UINT32>(fb, tileRect);
+  }
+}
+
+template <class PIXEL_T>
+bool VideoRegionDetector::isPhotographic(const FrameBuffer *fb,
+                                         const Rect *tileRect) const
+{
+  // The left neighbour of each sample should be inside the tile.
+  int width = tileRect->getWidth() - 1;
+  int height = tileRect->getHeight();
+  if (width < SAMPLES_PER_SIDE || height < SAMPLES_PER_SIDE) {
+    return false;
+  }
+
+  PIXEL_T colors[SAMPLES_PER_SIDE * SAMPLES_PER_SIDE];
+  int numColors = 0;
+  int numEqual = 0;
+  for (int sy = 0; sy < SAMPLES_PER_SIDE; sy++) {
+    int y = tileRect->top + sy * height / SAMPLES_PER_SIDE;
+    for (int sx = 0; sx < SAMPLES_PER_SIDE; sx++) {
+      int x = tileRect->left + 1 + sx * width / SAMPLES_PER_SIDE;
+      const PIXEL_T *ptr = (const PIXEL_T *)fb->getBufferPtr(x, y);
+      PIXEL_T color = ptr[0];
+      if (color == ptr[-1]) {
+        numEqual++;
+      }
+      int i = 0;
+      while (i < numColors && colors[i] != color) {
+        i++;
+      }
+      if (i == numColors) {
+        colors[numColors++] = color;
+      }
+    }
+  }
+
+  const int numSamples = SAMPLES_PER_SIDE * SAMPLES_PER_SIDE;
+  return numColors >= PHOTO_MIN_COLORS &&
+         numEqual * 100 <= numSamples * PHOTO_MAX_EQUAL_PERCENT;
+}
@@ -0,0 +1,116 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#ifndef __VIDEOREGIONDETECTOR_H__
+#define __VIDEOREGIONDETECTOR_H__
+
+#include "util/inttypes.h"
+#include "util/DateTime.h"
+#include "rfb/FrameBuffer.h"
+#include "region/Region.h"
+
+#include <vector>
+
+// VideoRegionDetector finds screen areas playing video without knowing
+// the player window. The screen is divided into TILE_SIZE x TILE_SIZE
+// tiles, and the change rate of each tile (changes per second, averaged
+// over about TIME_CONSTANT milliseconds) is updated from the changed
+// regions found by UpdateFilter.
+//
+// A tile becomes video if its rate reaches ENTER_RATE and its content
+// looks photographic: many distinct colors and few equal neighbouring
+// pixels, unlike text and UI elements. It stops being video when the rate
+// falls below LEAVE_RATE. The gap between the two rates keeps the region
+// stable. Small sets of video tiles, such as animated icons, are ignored.
+//
+// The class is not thread-safe.
+class VideoRegionDetector
+{
+public:
+  VideoRegionDetector();
+  virtual ~VideoRegionDetector();
+
+  // Registers the changed region found in the frame buffer now. The frame
+  // buffer must contain the new pixels.
+  void update(const Region *changedRegion, const FrameBuffer *fb);
+
+  // Replaces the region with the tiles considered video.
+  void getVideoRegion(Region *videoRegion) const;
+
+  // Forgets the history of all the tiles.
+  void reset();
+
+  static const int TILE_SIZE = 32;
+
+protected:
+  // Prepares the tile arrays for the frame buffer dimension, forgetting
+  // the history if the dimension has changed.
+  void setDimension(const Dimension *dim);
+
+  // Returns true if the pixels of the tile look like a photo or a video
+  // frame. Only a sample of SAMPLES_PER_SIDE x SAMPLES_PER_SIDE pixels and
+  // their left neighbours is read.
+  bool isPhotographic(const FrameBuffer *fb, const Rect *tileRect) const;
+  template <class PIXEL_T>
+    bool isPhotographic(const FrameBuffer *fb, const Rect *tileRect) const;
+
+  Dimension m_dimension;
+  int m_tilesPerRow;
+  int m_tilesPerColumn;
+
+  // Change rates of the tiles, in changes per second multiplied by
+  // RATE_SCALE.
+  std::vector<int> m_rates;
+  std::vector<bool> m_videoTiles;
+  int m_numVideoTiles;
+  // Tiles changed in the current update, kept to avoid reallocations.
+  std::vector<bool> m_changedTiles;
+
+  DateTime m_lastUpdateTime;
+  bool m_hasLastUpdate;
+
+  // Fixed-point scale of the change rates.
+  static const int RATE_SCALE = 256;
+  // Time in milliseconds over which the change rates are averaged.
+  static const int TIME_CONSTANT = 1000;
+  // Change rates (per second) to enter and to leave the video state.
+  static const int ENTER_RATE = 10;
+  static const int LEAVE_RATE = 4;
+  // Minimum number of video tiles for the region to be reported.
+  static const int MIN_VIDEO_TILES = 6;
+  // Photographic content criteria for the sampled pixels: the minimum
+  // number of distinct colors and the maximum percentage of pixels equal
+  // to their left neighbours.
+  static const int SAMPLES_PER_SIDE = 8;
+  static const int PHOTO_MIN_COLORS = 24;
+  static const int PHOTO_MAX_EQUAL_PERCENT = 25;
+
+private:
+  // Do not allow copying objects.
+  VideoRegionDetector(const VideoRegionDetector &other);
+  VideoRegionDetector &operator=(const VideoRegionDetector &other);
+};
+
+#endif // __VIDEOREGIONDETECTOR_H__
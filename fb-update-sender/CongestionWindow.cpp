@@ -0,0 +1,165 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#include "CongestionWindow.h"
+#include "util/DateTime.h"
+
+CongestionWindow::CongestionWindow()
+: m_nextPingId(0),
+  m_lastPosition(0),
+  m_ackedPosition(0),
+  m_window(INITIAL_WINDOW),
+  m_slowStart(true),
+  m_baseRtt(0),
+  m_lastRtt(0)
+{
+}
+
+CongestionWindow::~CongestionWindow()
+{
+}
+
+UINT32 CongestionWindow::sentPing(UINT64 position)
+{
+  Ping ping;
+  ping.id = m_nextPingId++;
+  ping.position = position;
+  ping.sendTime = getCurrentTime();
+  ping.inFlight = position - m_ackedPosition;
+  m_pings.push_back(ping);
+  if (m_pings.size() > MAX_PINGS) {
+    m_pings.pop_front();
+  }
+  m_lastPosition = position;
+  return ping.id;
+}
+
+bool CongestionWindow::gotPong(UINT32 id)
+{
+  // Identifiers of the registered pings are consecutive, so an unknown
+  // identifier (or one of a forgotten ping) is outside of the range. Such
+  // pongs are ignored without touching the list. Identifiers wrap around,
+  // hence the serial number comparison.
+  if (m_pings.empty() ||
+      (INT32)(id - m_pings.front().id) < 0 ||
+      (INT32)(m_pings.back().id - id) < 0) {
+    return false;
+  }
+
+  // Pings are answered in order, so all the pings before the answered one
+  // are either lost or answered already.
+  while (m_pings.front().id != id) {
+    m_pings.pop_front();
+  }
+  Ping ping = m_pings.front();
+  m_pings.pop_front();
+
+  UINT64 now = getCurrentTime();
+  unsigned int rtt = now > ping.sendTime ?
+                     (unsigned int)(now - ping.sendTime) : 0;
+  if (ping.position > m_ackedPosition) {
+    m_ackedPosition = ping.position;
+  }
+  updateBaseRtt(rtt, now);
+  updateWindow(&ping, rtt);
+  return true;
+}
+
+void CongestionWindow::updateBaseRtt(unsigned int rtt, UINT64 now)
+{
+  if (m_rttHistory.empty() ||
+      now - m_rttHistory.back().startTime >= BASE_RTT_PERIOD) {
+    RttBucket bucket;
+    bucket.startTime = now;
+    bucket.minRtt = rtt;
+    m_rttHistory.push_back(bucket);
+    if (m_rttHistory.size() > BASE_RTT_HISTORY) {
+      m_rttHistory.pop_front();
+    }
+  } else if (rtt < m_rttHistory.back().minRtt) {
+    m_rttHistory.back().minRtt = rtt;
+  }
+
+  m_baseRtt = rtt;
+  for (size_t i = 0; i < m_rttHistory.size(); i++) {
+    m_baseRtt = min(m_baseRtt, m_rttHistory[i].minRtt);
+  }
+}
+
+void CongestionWindow::updateWindow(const Ping *ping, unsigned int rtt)
+{
+  m_lastRtt = rtt;
+
+  unsigned int delay = rtt - m_baseRtt;
+  if (delay > SHRINK_MIN_DELAY) {
+    // The data is queued on the way, reduce the window to the amount that
+    // can be delivered within the base round-trip time plus the allowed
+    // delay.
+    UINT64 window = (UINT64)m_window * (m_baseRtt + GROW_MAX_DELAY) / rtt;
+    m_window = (size_t)max(window, (UINT64)MIN_WINDOW);
+    m_slowStart = false;
+  } else if (delay < GROW_MAX_DELAY) {
+    // Grow only if the window has really limited the sending, otherwise
+    // the measurement tells nothing about the link capacity.
+    if (ping->inFlight * 2 >= m_window) {
+      if (m_slowStart) {
+        m_window *= 2;
+      } else {
+        m_window += max(m_window / 8, MIN_WINDOW);
+      }
+      m_window = min(m_window, MAX_WINDOW);
+    }
+  } else {
+    m_slowStart = false;
+  }
+}
+
+bool CongestionWindow::isCongested() const
+{
+  if (m_pings.empty()) {
+    return false;
+  }
+  return m_lastPosition - m_ackedPosition >= m_window;
+}
+
+size_t CongestionWindow::getWindowSize() const
+{
+  return m_window;
+}
+
+unsigned int CongestionWindow::getBaseRtt() const
+{
+  return m_baseRtt;
+}
+
+unsigned int CongestionWindow::getLastRtt() const
+{
+  return m_lastRtt;
+}
+
+UINT64 CongestionWindow::getCurrentTime() const
+{
+  return DateTime::now().getTime();
+}
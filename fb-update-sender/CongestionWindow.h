@@ -0,0 +1,122 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#ifndef __CONGESTIONWINDOW_H__
+#define __CONGESTIONWINDOW_H__
+
+#include "util/CommonHeader.h"
+#include <deque>
+
+// The CongestionWindow class limits the amount of data sent to the client
+// but not yet received by it. Round-trip times are measured with "pings",
+// i.e. Fence messages sent after framebuffer updates and echoed back by the
+// client. While the round-trip time stays close to the minimal one observed
+// recently (the base one), the window grows. When it grows noticeably, the
+// data is queued somewhere on the way to the client, so the window is
+// shrunk proportionally.
+// All positions are byte offsets in the output stream of the connection.
+// This class is not thread-safe.
+class CongestionWindow
+{
+public:
+  CongestionWindow();
+  virtual ~CongestionWindow();
+
+  // Registers a ping written to the output stream, position is the offset
+  // just after the ping. Returns the identifier to be sent with the ping.
+  UINT32 sentPing(UINT64 position);
+
+  // Processes an echoed ping. Returns false if the ping is unknown.
+  bool gotPong(UINT32 id);
+
+  // Returns true if the data written up to the last ping and not yet
+  // acknowledged fills the whole window.
+  bool isCongested() const;
+
+  // Returns the window size in bytes.
+  size_t getWindowSize() const;
+
+  // Returns the base (minimal recent) and the last measured round-trip
+  // times, in milliseconds, or 0 if no round trip has been measured yet.
+  unsigned int getBaseRtt() const;
+  unsigned int getLastRtt() const;
+
+protected:
+  struct Ping
+  {
+    UINT32 id;
+    UINT64 position;
+    UINT64 sendTime;
+    // Amount of unacknowledged data at the moment the ping was sent.
+    UINT64 inFlight;
+  };
+
+  // The minimal round-trip time measured during a period of time.
+  struct RttBucket
+  {
+    UINT64 startTime;
+    unsigned int minRtt;
+  };
+
+  // Adds a measured round-trip time to m_rttHistory and recomputes
+  // m_baseRtt as the minimum over the history.
+  void updateBaseRtt(unsigned int rtt, UINT64 now);
+
+  void updateWindow(const Ping *ping, unsigned int rtt);
+
+  // Returns the current time in milliseconds. The flow control test
+  // overrides it to run the class on a simulated clock.
+  virtual UINT64 getCurrentTime() const;
+
+  static const size_t INITIAL_WINDOW = 16384;
+  static const size_t MIN_WINDOW = 4096;
+  static const size_t MAX_WINDOW = 4 * 1024 * 1024;
+  // Round-trip time excess over the base one (in milliseconds) below which
+  // the window grows and above which it shrinks.
+  static const unsigned int GROW_MAX_DELAY = 20;
+  static const unsigned int SHRINK_MIN_DELAY = 50;
+  // Pings older than the newest MAX_PINGS ones are forgotten, so a client
+  // that does not answer cannot make this list grow infinitely.
+  static const size_t MAX_PINGS = 64;
+  // The base round-trip time is the minimum over the last BASE_RTT_HISTORY
+  // periods of BASE_RTT_PERIOD milliseconds, so it follows a route change
+  // to a slower path within a minute.
+  static const unsigned int BASE_RTT_PERIOD = 10000;
+  static const size_t BASE_RTT_HISTORY = 6;
+
+  std::deque<Ping> m_pings;
+  UINT32 m_nextPingId;
+  UINT64 m_lastPosition;
+  UINT64 m_ackedPosition;
+
+  size_t m_window;
+  bool m_slowStart;
+
+  std::deque<RttBucket> m_rttHistory;
+  unsigned int m_baseRtt;
+  unsigned int m_lastRtt;
+};
+
+#endif // __CONGESTIONWINDOW_H__
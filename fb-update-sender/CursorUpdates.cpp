@@ -27,6 +27,7 @@
 
 CursorUpdates::CursorUpdates(LogWriter *log)
 : m_blockCurPosTime(0),
+  m_cursorDrawn(false),
   m_isDrawCursorMethod(false),
   m_log(log)
 {
@@ -42,9 +43,14 @@ void CursorUpdates::update(const EncodeOptions *encodeOptions,
                            const Rect *viewPort,
                            bool shareOnlyApp,
                            const Region *shareAppRegion,
-                           FrameBuffer *fb,
+                           const FrameBuffer *fb,
                            CursorShape *cursorShape)
 {
+  {
+    AutoLock al(&m_curPosLocMut);
+    m_cursorDrawn = false;
+  }
+
   // Check cursor events. If they are outside of shared region then ignore they.
   if (shareOnlyApp) {
     bool inside = shareAppRegion->isPointInside(updCont->cursorPos.x, updCont->cursorPos.y);
@@ -87,10 +93,9 @@ void CursorUpdates::update(const EncodeOptions *encodeOptions,
       methodWasChanged = m_isDrawCursorMethod;
       if (methodWasChanged) {
         m_isDrawCursorMethod = false;
-        // Restore background under the cursor shape
-        restoreFrameBuffer(fb);
-        Rect backgroundRect = getBackgroundRect();
-        updCont->changedRegion.addRect(&backgroundRect);
+        // Send the pixels which were under the cursor shape.
+        AutoLock al(&m_curPosLocMut);
+        updCont->changedRegion.addRect(&m_cursorRect);
       }
     }
     if (m_isDrawCursorMethod) {
@@ -126,39 +131,31 @@ void CursorUpdates::update(const EncodeOptions *encodeOptions,
   }
 }
 
-void CursorUpdates::restoreFrameBuffer(FrameBuffer *fb)
+const PatchFrameBuffer *CursorUpdates::getCursorPatch()
 {
   AutoLock al(&m_curPosLocMut);
-  Rect dstRect = m_shapeBackground.getDimension().getRect();
-  dstRect.setLocation(m_backgroundPos.x, m_backgroundPos.y);
-  fb->copyFrom(&dstRect, &m_shapeBackground, 0, 0);
-  // m_shapeBackground.setDimension(&Dimension(0, 0));
+  return m_cursorDrawn ? &m_cursorPatch : 0;
 }
 
-void CursorUpdates::drawCursor(UpdateContainer *updCont, FrameBuffer *fb)
+void CursorUpdates::drawCursor(UpdateContainer *updCont, const FrameBuffer *fb)
 {
   AutoLock al(&m_curPosLocMut);
-  // Add previous background rectangle to the changed region.
-  Rect rect(&m_shapeBackground.getDimension().getRect());
-  rect.setLocation(m_backgroundPos.x, m_backgroundPos.y);
-  updCont->changedRegion.addRect(&rect);
-  // Keep the current background rectangle.
+  // Add previous cursor rectangle to the changed region.
+  updCont->changedRegion.addRect(&m_cursorRect);
+  // Keep the current cursor rectangle.
   Point hotSpot = m_cursorShape.getHotSpot();
-  m_backgroundPos.setPoint(m_cursorPos.x - hotSpot.x,
+  m_cursorRect.setRect(&m_cursorShape.getDimension().getRect());
+  m_cursorRect.setLocation(m_cursorPos.x - hotSpot.x,
                            m_cursorPos.y - hotSpot.y);
-  m_shapeBackground.setProperties(&m_cursorShape.getDimension(),
-                                  &m_cursorShape.getPixelFormat());
-  // Keep background under cursor shape to can reconstruct full image.
-  m_shapeBackground.copyFrom(fb,
-                             m_backgroundPos.x,
-                             m_backgroundPos.y);
-  // Draw the cursor shape on the frame buffer
-  rect.setRect(&m_cursorShape.getDimension().getRect());
-  rect.setLocation(m_backgroundPos.x, m_backgroundPos.y);
-
-  fb->overlay(&rect,
-              m_cursorShape.getPixels(), 0, 0,
-              m_cursorShape.getMask());
+  // Copy the pixels under the cursor shape and draw the shape over them.
+  m_cursorPatch.setProperties(&m_cursorRect, &fb->getDimension(),
+                              &fb->getPixelFormat());
+  m_cursorPatch.copyFrom(&m_cursorRect, fb,
+                         m_cursorRect.left, m_cursorRect.top);
+  m_cursorPatch.overlay(&m_cursorRect,
+                        m_cursorShape.getPixels(), 0, 0,
+                        m_cursorShape.getMask());
+  m_cursorDrawn = true;
 }
 
 bool CursorUpdates::checkCursorPos(UpdateContainer *updCont,
@@ -216,14 +213,6 @@ Point CursorUpdates::getCurPos()
   return m_cursorPos;
 }
 
-Rect CursorUpdates::getBackgroundRect()
-{
-  AutoLock al(&m_curPosLocMut);
-  Rect rect(&m_shapeBackground.getDimension().getRect());
-  rect.setLocation(m_backgroundPos.x, m_backgroundPos.y);
-  return rect;
-}
-
 void CursorUpdates::updateCursorShape(const CursorShape *curShape)
 {
   AutoLock al(&m_curPosLocMut);
@@ -27,6 +27,7 @@
 
 #include "rfb-sconn/EncodeOptions.h"
 #include "rfb/CursorShape.h"
+#include "rfb/PatchFrameBuffer.h"
 #include "desktop/UpdateContainer.h"
 #include "util/DateTime.h"
 #include "thread/LocalMutex.h"
@@ -38,10 +39,10 @@ public:
   CursorUpdates(LogWriter *log);
   virtual ~CursorUpdates();
 
-  // Important: After calling the update() function frame buffer
-  // may contain a cursor image to send it as a frame buffer update.
-  // After sending the frame buffer updates the user code must at sight
-  // call the restoreFrameBuffer() function. Also function clones
+  // Important: After calling the update() function the cursor image may
+  // have to be sent as a part of the frame buffer update. In this case
+  // getCursorPatch() returns the pixels of fb under the cursor with the
+  // cursor drawn on them, fb itself is never modified. Also function clones
   // actual cursor shape to the cursorShape argument (Only when after call
   // the updCont->cursorShapeChanged flag is raised).
   void update(const EncodeOptions *encodeOptions,
@@ -50,16 +51,18 @@ public:
               const Rect *viewPort,
               bool shareOnlyApp,
               const Region *shareAppRegion,
-              FrameBuffer *fb,
+              const FrameBuffer *fb,
               CursorShape *cursorShape);
-  void restoreFrameBuffer(FrameBuffer *fb);
+
+  // Returns the frame buffer with the cursor drawn by the last update()
+  // call, or 0 if the cursor has not been drawn. The pixels out of the
+  // patch rectangle of the returned object must be taken from the frame
+  // buffer given to update().
+  const PatchFrameBuffer *getCursorPatch();
 
   // Returns current cursor position. Beetween
   Point getCurPos();
 
-  // Returns background rectangle.
-  Rect getBackgroundRect();
-
   // Block cursor pos sending by this
   // connection to a client. Unblocking will
   // be automaticly for a time.
@@ -78,8 +81,9 @@ private:
                       const Rect *viewPort,
                       bool curPosBlockingIsIgnored);
 
-  // Shortcut function to draw cursor on the frame buffer directly.
-  void drawCursor(UpdateContainer *updCont, FrameBuffer *fb);
+  // Shortcut function to draw cursor over the pixels of the frame buffer
+  // copied to m_cursorPatch.
+  void drawCursor(UpdateContainer *updCont, const FrameBuffer *fb);
 
   // Check for cursor blocking state and
   // return true if it is blocked and false
@@ -90,8 +94,13 @@ private:
   Point m_cursorPos;
   DateTime m_blockCurPosTime;
   CursorShape m_cursorShape;
-  FrameBuffer m_shapeBackground;
-  Point m_backgroundPos;
+  // The cursor image over the frame buffer pixels and its rectangle (not
+  // cropped by the frame buffer bounds), the rectangle must be updated on
+  // the client when the cursor moves away.
+  PatchFrameBuffer m_cursorPatch;
+  Rect m_cursorRect;
+  // Whether the cursor has been drawn by the last update() call.
+  bool m_cursorDrawn;
   LocalMutex m_curPosLocMut;
   // Uses when the rich enabled but pointer pos disabled to determine
   // the last send method: by a cursor shape update or drawing on the
@@ -0,0 +1,151 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#include "LinkEstimator.h"
+#include "thread/AutoLock.h"
+#include <limits.h>
+
+LinkEstimator::LinkEstimator()
+: m_bandwidth(0),
+  m_rtt(0),
+  m_sendTime(0),
+  m_updateSize(0),
+  m_hasFenceRtt(false),
+  m_updateIsPending(false),
+  m_level(INITIAL_LEVEL)
+{
+}
+
+LinkEstimator::~LinkEstimator()
+{
+}
+
+void LinkEstimator::onUpdateSent(UINT64 bytes, unsigned int sendTime,
+                                 UINT64 blockedBytes, UINT64 blockedTime)
+{
+  AutoLock al(&m_lock);
+
+  m_updateIsPending = true;
+  m_updateSentTime = getCurrentTime();
+
+  if (blockedTime >= MIN_SAMPLE_BLOCKED_TIME) {
+    UINT64 bandwidth = blockedBytes * 1000000 / blockedTime;
+    m_bandwidth = smooth(m_bandwidth,
+                         (unsigned int)min(bandwidth, (UINT64)UINT_MAX));
+  }
+  if (bytes < MIN_SAMPLE_BYTES) {
+    return;
+  }
+  m_sendTime = smooth(m_sendTime, max(sendTime, 1U));
+  m_updateSize = smooth(m_updateSize,
+                        (unsigned int)min(bytes, (UINT64)UINT_MAX));
+}
+
+void LinkEstimator::onUpdateRequest()
+{
+  AutoLock al(&m_lock);
+
+  if (m_updateIsPending && !m_hasFenceRtt) {
+    unsigned int rtt =
+      (unsigned int)(getCurrentTime() - m_updateSentTime).getTime();
+    m_rtt = smooth(m_rtt, max(rtt, 1U));
+  }
+  m_updateIsPending = false;
+}
+
+void LinkEstimator::onFenceRoundTrip(unsigned int rtt)
+{
+  AutoLock al(&m_lock);
+
+  if (!m_hasFenceRtt) {
+    // Fence round trips are more precise, forget the old estimate.
+    m_hasFenceRtt = true;
+    m_rtt = 0;
+  }
+  m_rtt = smooth(m_rtt, max(rtt, 1U));
+}
+
+unsigned int LinkEstimator::getBandwidth()
+{
+  AutoLock al(&m_lock);
+  return m_bandwidth;
+}
+
+unsigned int LinkEstimator::getRtt()
+{
+  AutoLock al(&m_lock);
+  return m_rtt;
+}
+
+unsigned int LinkEstimator::getUpdateLatency()
+{
+  AutoLock al(&m_lock);
+  if (m_sendTime == 0) {
+    return 0;
+  }
+  return m_sendTime + m_rtt / 2;
+}
+
+int LinkEstimator::getLevel(unsigned int targetLatency)
+{
+  unsigned int latency = getUpdateLatency();
+
+  AutoLock al(&m_lock);
+  if (latency == 0 ||
+      (getCurrentTime() - m_levelChangeTime).getTime() < ADJUST_INTERVAL) {
+    return m_level;
+  }
+
+  if (latency > targetLatency) {
+    if (m_level < MAX_LEVEL) {
+      m_level++;
+      m_levelChangeTime = getCurrentTime();
+    }
+  } else if (latency < targetLatency / 2 && m_level > 0) {
+    // Less compression makes updates bigger, so make sure the link can
+    // carry an update at least twice as big as the average one within the
+    // target latency.
+    UINT64 capacity = (UINT64)m_bandwidth * targetLatency / 1000;
+    if (m_bandwidth == 0 || capacity >= 2 * (UINT64)m_updateSize) {
+      m_level--;
+      m_levelChangeTime = getCurrentTime();
+    }
+  }
+  return m_level;
+}
+
+unsigned int LinkEstimator::smooth(unsigned int average, unsigned int sample)
+{
+  if (average == 0) {
+    return sample;
+  }
+  return (unsigned int)(((UINT64)average * (SMOOTHING_FACTOR - 1) + sample) /
+                        SMOOTHING_FACTOR);
+}
+
+DateTime LinkEstimator::getCurrentTime() const
+{
+  return DateTime::now();
+}
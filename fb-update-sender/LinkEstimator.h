@@ -0,0 +1,117 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#ifndef __LINKESTIMATOR_H__
+#define __LINKESTIMATOR_H__
+
+#include "util/CommonHeader.h"
+#include "util/DateTime.h"
+#include "thread/LocalMutex.h"
+
+// The LinkEstimator class estimates the bandwidth and the round-trip time of
+// the connection to one client, and chooses the amount of compression that
+// keeps framebuffer updates within a target latency.
+//
+// The bandwidth is measured with the socket writes that waited for the
+// network all the time (see BufferedOutputStream): if such writes of N bytes
+// took T seconds, the link carries about N / T bytes per second. A link that
+// never makes the writes wait has an unknown bandwidth and is taken for a
+// fast one. The round-trip time comes from Fence
+// messages if the client supports them, otherwise from the time between
+// sending an update and receiving the next update request.
+//
+// All functions are thread-safe.
+class LinkEstimator
+{
+public:
+  LinkEstimator();
+  virtual ~LinkEstimator();
+
+  // Registers a framebuffer update: the number of bytes sent, the time in
+  // milliseconds from the beginning of its preparation till the end of
+  // sending, and the amount and the time in microseconds of its writes that
+  // waited for the network all the time.
+  void onUpdateSent(UINT64 bytes, unsigned int sendTime,
+                    UINT64 blockedBytes, UINT64 blockedTime);
+
+  // Registers an update request. If an update has been sent and not yet
+  // answered with a request, the time since sending it is taken as a
+  // round-trip time sample unless fences are available.
+  void onUpdateRequest();
+
+  // Registers a round-trip time measured with a Fence message.
+  void onFenceRoundTrip(unsigned int rtt);
+
+  // Estimated values, zero if unknown. The bandwidth is in bytes per
+  // second, times are in milliseconds. The update latency is the expected
+  // time for a big update to be prepared and to reach the client.
+  unsigned int getBandwidth();
+  unsigned int getRtt();
+  unsigned int getUpdateLatency();
+
+  // Returns the link "slowness" level from 0 (fast link, the least
+  // compression) to MAX_LEVEL (slow link, the most compression). The level
+  // is moved one step at a time, at most once per ADJUST_INTERVAL
+  // milliseconds, to keep the update latency between the half of the target
+  // and the target (in milliseconds).
+  int getLevel(unsigned int targetLatency);
+
+  static const int MAX_LEVEL = 9;
+
+protected:
+  // Exponential moving average with the weight of the new sample of
+  // 1 / SMOOTHING_FACTOR. Zero means no samples yet.
+  static unsigned int smooth(unsigned int average, unsigned int sample);
+
+  // Returns the current time. The flow control test overrides it to run
+  // the class on a simulated clock.
+  virtual DateTime getCurrentTime() const;
+
+  // Updates smaller than this are not used to adjust the level: their
+  // latency is dominated by fixed costs.
+  static const UINT64 MIN_SAMPLE_BYTES = 16384;
+  // Blocked writes shorter than this in total (in microseconds) are not
+  // precise enough to measure the bandwidth.
+  static const UINT64 MIN_SAMPLE_BLOCKED_TIME = 2000;
+  static const unsigned int SMOOTHING_FACTOR = 4;
+  static const unsigned int ADJUST_INTERVAL = 1000;
+  static const int INITIAL_LEVEL = 5;
+
+  unsigned int m_bandwidth;
+  unsigned int m_rtt;
+  unsigned int m_sendTime;
+  unsigned int m_updateSize;
+
+  bool m_hasFenceRtt;
+  bool m_updateIsPending;
+  DateTime m_updateSentTime;
+
+  int m_level;
+  DateTime m_levelChangeTime;
+
+  LocalMutex m_lock;
+};
+
+#endif // __LINKESTIMATOR_H__
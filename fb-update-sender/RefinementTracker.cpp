@@ -0,0 +1,149 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#include "RefinementTracker.h"
+
+#include <vector>
+
+RefinementTracker::RefinementTracker()
+{
+}
+
+RefinementTracker::~RefinementTracker()
+{
+}
+
+void RefinementTracker::onCopyRect(const Rect *dstRect, const Point *source)
+{
+  Rect srcRect = *dstRect;
+  srcRect.setLocation(source->x, source->y);
+
+  Region moved;
+  std::list<Generation>::iterator i;
+  for (i = m_generations.begin(); i != m_generations.end(); i++) {
+    Region part = i->region;
+    part.crop(&srcRect);
+    moved.add(&part);
+  }
+  moved.translate(dstRect->left - source->x, dstRect->top - source->y);
+
+  Region dstRegion(dstRect);
+  removeRegion(&dstRegion);
+  addLossyRegion(&moved);
+}
+
+void RefinementTracker::onUpdateSent(const Region *sentRegion,
+                                     const Region *lossyRegion)
+{
+  removeRegion(sentRegion);
+  addLossyRegion(lossyRegion);
+}
+
+bool RefinementTracker::isEmpty() const
+{
+  return m_generations.empty();
+}
+
+unsigned int RefinementTracker::getTimeToRefinement(unsigned int idleTime) const
+{
+  _ASSERT(!m_generations.empty());
+  DateTime oldestTime = m_generations.front().time;
+  UINT64 staticTime = (DateTime::now() - oldestTime).getTime();
+  if (staticTime >= idleTime) {
+    return 0;
+  }
+  return idleTime - (unsigned int)staticTime;
+}
+
+void RefinementTracker::takeRefinement(Region *refinedRegion,
+                                       const Region *bounds,
+                                       unsigned int idleTime, int maxArea)
+{
+  refinedRegion->clear();
+  DateTime now = DateTime::now();
+
+  std::vector<Rect> rects;
+  int area = 0;
+  std::list<Generation>::iterator i;
+  for (i = m_generations.begin(); i != m_generations.end() && area < maxArea;
+       i++) {
+    if ((now - i->time).getTime() < idleTime) {
+      break;
+    }
+    Region candidates = i->region;
+    candidates.intersect(bounds);
+    rects.clear();
+    candidates.getRectVector(&rects);
+    for (size_t j = 0; j < rects.size() && area < maxArea; j++) {
+      Rect rect = rects[j];
+      // Take whole rows of a rectangle exceeding the limit, at least one.
+      int width = rect.getWidth();
+      int maxHeight = max((maxArea - area) / width, 1);
+      if (rect.getHeight() > maxHeight) {
+        rect.bottom = rect.top + maxHeight;
+      }
+      refinedRegion->addRect(&rect);
+      area += rect.area();
+    }
+  }
+  removeRegion(refinedRegion);
+}
+
+void RefinementTracker::reset()
+{
+  m_generations.clear();
+}
+
+void RefinementTracker::addLossyRegion(const Region *lossyRegion)
+{
+  if (lossyRegion->isEmpty()) {
+    return;
+  }
+  DateTime now = DateTime::now();
+  if (m_generations.empty() ||
+      (now - m_generations.back().time).getTime() >= GENERATION_PERIOD) {
+    m_generations.push_back(Generation());
+  }
+  // The generation becomes static only when its latest part does.
+  Generation *newest = &m_generations.back();
+  newest->region.add(lossyRegion);
+  newest->time = now;
+}
+
+void RefinementTracker::removeRegion(const Region *region)
+{
+  if (region->isEmpty()) {
+    return;
+  }
+  std::list<Generation>::iterator i = m_generations.begin();
+  while (i != m_generations.end()) {
+    i->region.subtract(region);
+    if (i->region.isEmpty()) {
+      i = m_generations.erase(i);
+    } else {
+      i++;
+    }
+  }
+}
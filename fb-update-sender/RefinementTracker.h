@@ -0,0 +1,107 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#ifndef __REFINEMENTTRACKER_H__
+#define __REFINEMENTTRACKER_H__
+
+#include <list>
+
+#include "region/Point.h"
+#include "region/Region.h"
+#include "util/DateTime.h"
+
+// The RefinementTracker class keeps track of the screen areas a client has
+// received with lossy compression (JPEG), so that they could be sent again
+// losslessly once they stop changing. Without that, compression artifacts
+// of a paused video or a photo stay on the client screen till something
+// else repaints the area.
+//
+// Lossy areas are grouped by the time they were sent, with a granularity
+// of GENERATION_PERIOD milliseconds. An area sent again in any way stops
+// being tracked, or moves to the newest group if it is lossy again.
+//
+// The class is not thread-safe.
+class RefinementTracker
+{
+public:
+  RefinementTracker();
+  virtual ~RefinementTracker();
+
+  // Registers a CopyRect rectangle sent to the client: lossy pixels of the
+  // source become lossy pixels of the destination. CopyRect rectangles must
+  // be registered in the order the client applies them, before the normal
+  // rectangles of the same update.
+  void onCopyRect(const Rect *dstRect, const Point *source);
+
+  // Registers the normal rectangles of an update: the pixels of sentRegion
+  // have been replaced on the client side, those of lossyRegion (a part of
+  // sentRegion) with lossy compression.
+  void onUpdateSent(const Region *sentRegion, const Region *lossyRegion);
+
+  // Returns true if the client has no lossy pixels.
+  bool isEmpty() const;
+
+  // Returns the number of milliseconds left till some lossy area has been
+  // static for idleTime milliseconds, or 0 if there is such an area now.
+  // Must not be called if isEmpty() returns true.
+  unsigned int getTimeToRefinement(unsigned int idleTime) const;
+
+  // Moves to refinedRegion the lossy areas which have been static for
+  // idleTime milliseconds and lie within the bounds region, taking no more
+  // than about maxArea pixels. The caller is supposed to send the result
+  // losslessly. The oldest areas are taken first.
+  void takeRefinement(Region *refinedRegion, const Region *bounds,
+                      unsigned int idleTime, int maxArea);
+
+  // Forgets all the lossy areas, e.g. after the client has received the
+  // whole screen.
+  void reset();
+
+protected:
+  // Lossy areas sent within one period, and the time of the most recent of
+  // them.
+  struct Generation
+  {
+    Region region;
+    DateTime time;
+  };
+
+  // Adds the lossy region to the newest generation, creating it if needed.
+  void addLossyRegion(const Region *lossyRegion);
+  // Removes the region from all generations, dropping the empty ones.
+  void removeRegion(const Region *region);
+
+  // Generations in the order of time, the oldest first.
+  std::list<Generation> m_generations;
+
+  static const unsigned int GENERATION_PERIOD = 250;
+
+private:
+  // Do not allow copying objects.
+  RefinementTracker(const RefinementTracker &other);
+  RefinementTracker &operator=(const RefinementTracker &other);
+};
+
+#endif // __REFINEMENTTRACKER_H__
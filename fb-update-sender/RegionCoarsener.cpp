@@ -0,0 +1,134 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#include "RegionCoarsener.h"
+
+RegionCoarsener::RegionCoarsener()
+{
+}
+
+RegionCoarsener::~RegionCoarsener()
+{
+}
+
+int RegionCoarsener::coarsen(Region *region, int rectOverhead,
+                             const Region *excluded)
+{
+  if (rectOverhead <= 0) {
+    return 0;
+  }
+  region->getRectVector(&m_rects);
+  size_t numRects = m_rects.size();
+  if (numRects < 2) {
+    return 0;
+  }
+  m_excludedRects.clear();
+  if (excluded != 0) {
+    excluded->getRectVector(&m_excludedRects);
+  }
+
+  m_srcBoxes.resize(numRects);
+  for (size_t i = 0; i < numRects; i++) {
+    m_srcBoxes[i].rect = m_rects[i];
+    m_srcBoxes[i].coveredArea = m_rects[i].area();
+  }
+  for (int pass = 0; pass < NUM_PASSES; pass++) {
+    mergeBoxes(&m_srcBoxes, &m_dstBoxes, rectOverhead);
+    if (m_dstBoxes.size() == m_srcBoxes.size()) {
+      break;
+    }
+    m_srcBoxes.swap(m_dstBoxes);
+  }
+  if (m_srcBoxes.size() == numRects) {
+    return 0;
+  }
+
+  // Merged boxes may overlap, so let the region split them into bands.
+  // This may give more rectangles than there are boxes, thus compare the
+  // final counts.
+  m_rects.resize(m_srcBoxes.size());
+  for (size_t i = 0; i < m_srcBoxes.size(); i++) {
+    m_rects[i] = m_srcBoxes[i].rect;
+  }
+  Region coarsened;
+  coarsened.setRects(&m_rects);
+  size_t newNumRects = coarsened.getCount();
+  if (newNumRects >= numRects) {
+    return 0;
+  }
+  *region = coarsened;
+  return (int)(numRects - newNumRects);
+}
+
+void RegionCoarsener::mergeBoxes(const std::vector<Box> *src,
+                                 std::vector<Box> *dst,
+                                 int rectOverhead)
+{
+  dst->clear();
+  for (size_t i = 0; i < src->size(); i++) {
+    const Box *box = &(*src)[i];
+
+    // Find the candidate whose bounding rectangle with the box adds the
+    // fewest pixels not covered by the original region.
+    size_t firstCandidate = dst->size() > MAX_CANDIDATES ?
+                            dst->size() - MAX_CANDIDATES : 0;
+    Box *best = 0;
+    Rect bestRect;
+    int bestExtraArea = rectOverhead + 1;
+    for (size_t j = dst->size(); j-- > firstCandidate;) {
+      Box *candidate = &(*dst)[j];
+      Rect merged(min(candidate->rect.left, box->rect.left),
+                  min(candidate->rect.top, box->rect.top),
+                  max(candidate->rect.right, box->rect.right),
+                  max(candidate->rect.bottom, box->rect.bottom));
+      // Merged boxes of the second pass may overlap, so the difference may
+      // be negative.
+      int extraArea = merged.area() - candidate->coveredArea - box->coveredArea;
+      if (extraArea < bestExtraArea && !isExcluded(&merged)) {
+        best = candidate;
+        bestRect = merged;
+        bestExtraArea = extraArea;
+      }
+    }
+
+    if (best != 0) {
+      best->rect = bestRect;
+      best->coveredArea = min(best->coveredArea + box->coveredArea,
+                              bestRect.area());
+    } else {
+      dst->push_back(*box);
+    }
+  }
+}
+
+bool RegionCoarsener::isExcluded(const Rect *rect) const
+{
+  for (size_t i = 0; i < m_excludedRects.size(); i++) {
+    if (!rect->intersection(&m_excludedRects[i]).isEmpty()) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,93 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#ifndef __REGIONCOARSENER_H__
+#define __REGIONCOARSENER_H__
+
+#include <vector>
+
+#include "region/Region.h"
+
+// The RegionCoarsener class reduces the number of rectangles in an update
+// region by replacing groups of nearby rectangles with their bounding
+// rectangles. Each rectangle costs a fixed amount of data and encoder work
+// (its header, a compressed stream flush, the analysis of its pixels), so
+// sending some unchanged pixels is cheaper than sending many slivers.
+//
+// The cost of a rectangle is given in pixels: two rectangles are merged if
+// the bounding rectangle adds no more unchanged pixels than that. The value
+// comes from Encoder::getRectOverhead() so that each encoder may weigh it
+// differently.
+//
+// The object keeps its work buffers between calls, so one instance should
+// be reused for all updates of a client. It is not thread-safe.
+class RegionCoarsener
+{
+public:
+  RegionCoarsener();
+  virtual ~RegionCoarsener();
+
+  // Coarsens the region in place. Merged rectangles never intersect the
+  // excluded region, which may be 0. Returns the number of rectangles
+  // removed from the region; the region is left untouched if merging does
+  // not reduce the number of its rectangles.
+  int coarsen(Region *region, int rectOverhead, const Region *excluded);
+
+private:
+  // A rectangle being built, and the number of pixels of the original
+  // region in it.
+  struct Box
+  {
+    Rect rect;
+    int coveredArea;
+  };
+
+  // Greedily merges the boxes of src, taken in order, into dst. Each box is
+  // merged with the cheapest of the last MAX_CANDIDATES boxes of dst.
+  void mergeBoxes(const std::vector<Box> *src, std::vector<Box> *dst,
+                  int rectOverhead);
+
+  // Returns true if the rectangle intersects some of m_excludedRects.
+  bool isExcluded(const Rect *rect) const;
+
+  std::vector<Rect> m_rects;
+  std::vector<Rect> m_excludedRects;
+  std::vector<Box> m_srcBoxes;
+  std::vector<Box> m_dstBoxes;
+
+  // Number of recently built boxes a rectangle may be merged with. Boxes
+  // are built in the top-down order of the region bands, so recent ones are
+  // the neighbours.
+  static const size_t MAX_CANDIDATES = 16;
+  // Number of merging passes. The second pass joins boxes which grew next
+  // to each other during the first one.
+  static const int NUM_PASSES = 2;
+
+  // Do not allow copying objects.
+  RegionCoarsener(const RegionCoarsener &other);
+  RegionCoarsener &operator=(const RegionCoarsener &other);
+};
+
+#endif // __REGIONCOARSENER_H__
@@ -25,3 +25,8 @@
 #include "UpdSenderMsgDefs.h"
 
 const char UpdSenderClientMsgDefs::RFB_VIDEO_FREEZE_SIG[] = "VD_FREEZ";
+const char UpdSenderClientMsgDefs::ENABLE_CONTINUOUS_UPDATES_SIG[] = "CU_ENABL";
+const char UpdSenderClientMsgDefs::FENCE_SIG[] = "FENCE___";
+
+const char UpdSenderServerMsgDefs::END_OF_CONTINUOUS_UPDATES_SIG[] = "CU_END__";
+const char UpdSenderServerMsgDefs::FENCE_SIG[] = "FENCE___";
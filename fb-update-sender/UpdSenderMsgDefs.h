@@ -32,6 +32,36 @@ class UpdSenderClientMsgDefs
 public:
   static const UINT32 RFB_VIDEO_FREEZE = 152;
   const static char RFB_VIDEO_FREEZE_SIG[];
+
+  // Signatures of the standard EnableContinuousUpdates and Fence messages,
+  // codes are defined in the ClientMsgDefs class.
+  const static char ENABLE_CONTINUOUS_UPDATES_SIG[];
+  const static char FENCE_SIG[];
+};
+
+class UpdSenderServerMsgDefs
+{
+public:
+  // Signatures of the standard EndOfContinuousUpdates and Fence messages,
+  // codes are defined in the ServerMsgDefs class.
+  const static char END_OF_CONTINUOUS_UPDATES_SIG[];
+  const static char FENCE_SIG[];
+};
+
+// Flags of the Fence message.
+class FenceDefs
+{
+public:
+  static const UINT32 BLOCK_BEFORE = 0x00000001;
+  static const UINT32 BLOCK_AFTER = 0x00000002;
+  static const UINT32 SYNC_NEXT = 0x00000004;
+  static const UINT32 REQUEST = 0x80000000;
+
+  // Mask of the flags supported by this implementation.
+  static const UINT32 SUPPORTED_FLAGS = BLOCK_BEFORE | BLOCK_AFTER | REQUEST;
+
+  // Maximal length of the Fence message payload.
+  static const UINT8 MAX_PAYLOAD_LENGTH = 64;
 };
 
 #endif // __UPDSENDERMSGDEFS_H__
@@ -29,13 +29,26 @@
 #include <vector>
 #include "util/inttypes.h"
 #include "util/Exception.h"
+#include "server-config-lib/Configurator.h"
 #include "UpdSenderMsgDefs.h"
 
+// Compression levels and JPEG quality levels used by the automatic
+// encoding tuning for each LinkEstimator level, from the fastest link to
+// the slowest one.
+static const int AUTO_COMPRESSION_LEVELS[LinkEstimator::MAX_LEVEL + 1] =
+  { 1, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+static const int AUTO_JPEG_QUALITY_LEVELS[LinkEstimator::MAX_LEVEL + 1] =
+  { 9, 9, 8, 8, 7, 6, 5, 4, 3, 2 };
+// Video regions are sent losslessly on levels up to this one.
+static const int AUTO_LOSSLESS_VIDEO_MAX_LEVEL = 1;
+
 UpdateSender::UpdateSender(RfbCodeRegistrator *codeRegtor,
                            UpdateRequestListener *updReqListener,
                            SenderControlInformationInterface *senderControlInformation,
                            RfbOutputGate *output, int id,
                            Desktop *desktop,
+                           EncodedRectCache *rectCache,
+                           ConvertedFrameBufferStore *convertedFbStore,
                            LogWriter *log)
 : m_updReqListener(updReqListener),
   m_desktop(desktop),
@@ -43,9 +56,14 @@ UpdateSender::UpdateSender(RfbCodeRegistrator *codeRegtor,
   m_busy(false),
   m_incrUpdIsReq(false),
   m_fullUpdIsReq(false),
+  m_continuousUpdates(false),
+  m_fenceAnnounced(false),
+  m_continuousUpdatesAnnounced(false),
+  m_losslessVideo(false),
   m_setColorMapEntr(false),
   m_output(output),
-  m_enbox(&m_pixelConverter, m_output),
+  m_pixelConverter(convertedFbStore),
+  m_enbox(&m_pixelConverter, m_output, rectCache),
   m_id(id),
   m_videoFrozen(false),
   m_shareOnlyApp(false),
@@ -72,16 +90,36 @@ UpdateSender::UpdateSender(RfbCodeRegistrator *codeRegtor,
                         PseudoEncDefs::SIG_POINTER_POS);
   codeRegtor->addEncCap(PseudoEncDefs::DESKTOP_SIZE,     VendorDefs::TIGHTVNC,
                         PseudoEncDefs::SIG_DESKTOP_SIZE);
+  codeRegtor->addEncCap(PseudoEncDefs::LAST_RECT,        VendorDefs::TIGHTVNC,
+                        PseudoEncDefs::SIG_LAST_RECT);
+  codeRegtor->addEncCap(PseudoEncDefs::FENCE,            VendorDefs::STANDARD,
+                        PseudoEncDefs::SIG_FENCE);
+  codeRegtor->addEncCap(PseudoEncDefs::CONTINUOUS_UPDATES, VendorDefs::STANDARD,
+                        PseudoEncDefs::SIG_CONTINUOUS_UPDATES);
 
   codeRegtor->addClToSrvCap(UpdSenderClientMsgDefs::RFB_VIDEO_FREEZE,
                             VendorDefs::TIGHTVNC,
                             UpdSenderClientMsgDefs::RFB_VIDEO_FREEZE_SIG);
+  codeRegtor->addClToSrvCap(ClientMsgDefs::ENABLE_CONTINUOUS_UPDATES,
+                            VendorDefs::STANDARD,
+                            UpdSenderClientMsgDefs::ENABLE_CONTINUOUS_UPDATES_SIG);
+  codeRegtor->addClToSrvCap(ClientMsgDefs::FENCE,
+                            VendorDefs::STANDARD,
+                            UpdSenderClientMsgDefs::FENCE_SIG);
+  codeRegtor->addSrvToClCap(ServerMsgDefs::END_OF_CONTINUOUS_UPDATES,
+                            VendorDefs::STANDARD,
+                            UpdSenderServerMsgDefs::END_OF_CONTINUOUS_UPDATES_SIG);
+  codeRegtor->addSrvToClCap(ServerMsgDefs::FENCE,
+                            VendorDefs::STANDARD,
+                            UpdSenderServerMsgDefs::FENCE_SIG);
 
   // Request codes
   codeRegtor->regCode(UpdSenderClientMsgDefs::RFB_VIDEO_FREEZE, this);
   codeRegtor->regCode(ClientMsgDefs::FB_UPDATE_REQUEST, this);
   codeRegtor->regCode(ClientMsgDefs::SET_PIXEL_FORMAT, this);
   codeRegtor->regCode(ClientMsgDefs::SET_ENCODINGS, this);
+  codeRegtor->regCode(ClientMsgDefs::ENABLE_CONTINUOUS_UPDATES, this);
+  codeRegtor->regCode(ClientMsgDefs::FENCE, this);
 
   resume();
 }
@@ -90,6 +128,7 @@ UpdateSender::~UpdateSender()
 {
   terminate();
   wait();
+  logEncoderStatistics();
 }
 
 void UpdateSender::onTerminate()
@@ -113,6 +152,12 @@ void UpdateSender::onRequest(UINT32 reqCode, RfbInputGate *input)
   case UpdSenderClientMsgDefs::RFB_VIDEO_FREEZE:
     readVideoFreeze(input);
     break;
+  case ClientMsgDefs::ENABLE_CONTINUOUS_UPDATES:
+    readEnableContinuousUpdates(input);
+    break;
+  case ClientMsgDefs::FENCE:
+    readFence(input);
+    break;
   default:
     StringStorage errMess;
     errMess.format(_T("Unknown %d protocol code received"), (int)reqCode);
@@ -155,8 +200,9 @@ void UpdateSender::addUpdateContainer(const UpdateContainer *updateContainer)
 
   updCont.videoRegion.translate(-viewPort.left, -viewPort.top);
   updCont.changedRegion.translate(-viewPort.left, -viewPort.top);
-  updCont.copiedRegion.translate(-viewPort.left, -viewPort.top);
-  updCont.copySrc.move(-viewPort.left, -viewPort.top);
+  for (size_t i = 0; i < updCont.copyMoves.size(); i++) {
+    updCont.copyMoves[i].dstRegion.translate(-viewPort.left, -viewPort.top);
+  }
 
   m_updateKeeper->addUpdateContainer(&updCont);
 }
@@ -175,7 +221,11 @@ Rect UpdateSender::getViewPort()
 bool UpdateSender::clientIsReady()
 {
   AutoLock al(&m_reqRectLocMut);
-  return (m_incrUpdIsReq || m_fullUpdIsReq) && !m_busy;
+  if (m_busy) {
+    return false;
+  }
+  return m_incrUpdIsReq || m_fullUpdIsReq ||
+         (m_continuousUpdates && !isCongested());
 }
 
 void UpdateSender::sendRectHeader(const Rect *rect, INT32 encodingType)
@@ -263,22 +313,87 @@ void UpdateSender::sendCursorPosUpdate()
   sendRectHeader(pos.x, pos.y, 0, 0, PseudoEncDefs::POINTER_POS);
 }
 
-void UpdateSender::sendCopyRect(const std::vector<Rect> *rects, const Point *source)
+void UpdateSender::sendCopyRect(const std::vector<Rect> *rects,
+                                const std::vector<Point> *sources)
 {
-  std::vector<Rect>::const_iterator iRect;
+  _ASSERT(rects->size() == sources->size());
+  for (size_t i = 0; i < rects->size(); i++) {
+    sendRectHeader(&(*rects)[i], EncodingDefs::COPYRECT);
 
-  for (iRect = rects->begin(); iRect != rects->end(); iRect++) {
-    const Rect *rect = &(*iRect);
+    // Send copyRect data
+    m_output->writeUInt16((*sources)[i].x);
+    m_output->writeUInt16((*sources)[i].y);
+  }
+}
 
-    sendRectHeader(rect, EncodingDefs::COPYRECT);
+void UpdateSender::sendEndOfContinuousUpdates()
+{
+  m_output->writeUInt8(ServerMsgDefs::END_OF_CONTINUOUS_UPDATES);
+}
 
-    // Send copyRect data
-    // FIXME: Each dest rect should have own source point
-    m_output->writeUInt16(source->x);
-    m_output->writeUInt16(source->y);
+void UpdateSender::sendFence(UINT32 flags, const UINT8 *payload, UINT8 length)
+{
+  _ASSERT(length <= FenceDefs::MAX_PAYLOAD_LENGTH);
+  m_output->writeUInt8(ServerMsgDefs::FENCE);
+  m_output->writeUInt8(0); // padding
+  m_output->writeUInt16(0); // padding
+  m_output->writeUInt32(flags);
+  m_output->writeUInt8(length);
+  if (length != 0) {
+    m_output->writeFully(payload, length);
   }
 }
 
+void UpdateSender::sendPing()
+{
+  // The ping identifier is sent as the payload in the network byte order.
+  // The position registered is the end of the ping, so the window covers
+  // the ping itself too.
+  const UINT8 length = 4;
+  const UINT64 pingSize = 1 + 3 + 4 + 1 + length;
+  UINT64 position = m_output->getBytesWritten() + pingSize;
+  UINT32 pingId;
+  {
+    AutoLock al(&m_congestionLocMut);
+    pingId = m_congestion.sentPing(position);
+  }
+  UINT8 payload[length];
+  payload[0] = (UINT8)(pingId >> 24);
+  payload[1] = (UINT8)(pingId >> 16);
+  payload[2] = (UINT8)(pingId >> 8);
+  payload[3] = (UINT8)pingId;
+  // BlockBefore makes the client answer only after it has processed the
+  // preceding update.
+  sendFence(FenceDefs::REQUEST | FenceDefs::BLOCK_BEFORE, payload, length);
+}
+
+bool UpdateSender::isCongested()
+{
+  AutoLock al(&m_congestionLocMut);
+  return m_congestion.isCongested();
+}
+
+void UpdateSender::requestContinuousUpdates(const Rect *rect)
+{
+  Region region(rect);
+  notifyUpdateRequest(&region, rect, true);
+}
+
+void UpdateSender::notifyUpdateRequest(const Region *waitingRegion,
+                                       const Rect *reqRect,
+                                       bool incremental)
+{
+  _ASSERT(m_updReqListener != 0);
+
+  // The updates already stored would otherwise wait for the next change on
+  // the desktop.
+  if (m_updateKeeper->checkForUpdates(waitingRegion)) {
+    m_newUpdatesEvent.notify();
+    m_log->debug(_T("Client #%d is waking up"), m_id);
+  }
+  m_updReqListener->onUpdateRequest(reqRect, incremental);
+}
+
 void UpdateSender::sendPalette(PixelFormat *pf)
 {
   m_output->writeUInt8(1); // type
@@ -295,18 +410,45 @@ void UpdateSender::sendPalette(PixelFormat *pf)
 void UpdateSender::sendUpdate()
 {
   m_log->debug(_T("Entered to the sendUpdate() function"));
+  DateTime startTime = DateTime::now();
 
   // Check requested regions and immediately return if the client did not
   // request anything.
   Region requestedFullReg, requestedIncrReg;
   bool incrUpdIsReq, fullUpdIsReq;
   DateTime reqTimePoint;
-  if (!extractReqRegions(&requestedIncrReg, &requestedFullReg,
-                         &incrUpdIsReq, &fullUpdIsReq,
-                         &reqTimePoint)) {
+  bool requested = extractReqRegions(&requestedIncrReg, &requestedFullReg,
+                                     &incrUpdIsReq, &fullUpdIsReq,
+                                     &reqTimePoint);
+  // In the continuous updates mode, changes are sent as if the client
+  // requested them incrementally, unless the client is not keeping up. In
+  // the latter case the updates stay in the update keeper till the client
+  // answers the pings.
+  Region continuousReg;
+  bool continuous = getContinuousRegion(&continuousReg);
+  if (!requested && !continuous) {
     m_log->debug(_T("No request, exiting from the sendUpdate()"));
     return;
   }
+
+  // The output is locked before the updates are taken from the update
+  // keeper. EndOfContinuousUpdates is sent under the same lock, so an
+  // unrequested update may not follow it, and nothing is lost on exit.
+  AutoLock l(m_output);
+  if (continuous) {
+    AutoLock al(&m_reqRectLocMut);
+    if (!m_continuousUpdates) {
+      continuous = false;
+      continuousReg.clear();
+    }
+  }
+  if (!requested && !continuous) {
+    m_log->debug(_T("Continuous updates disabled, exiting from the")
+                 _T(" sendUpdate()"));
+    return;
+  }
+  Region incrReg = requestedIncrReg;
+  incrReg.add(&continuousReg);
   m_log->debug(_T("A request has been made, continuing"));
   m_log->debug(_T("The incremental region has %d rectangles"),
              (int)requestedIncrReg.getCount());
@@ -327,10 +469,15 @@ void UpdateSender::sendUpdate()
   bool viewPortChanged = updateViewPort(&viewPort, &shareOnlyApp, &prevShareAppRegion,
                                         &shareAppRegion);
 
-  updateFrameBuffer(&updCont, shareOnlyApp, &prevShareAppRegion, &shareAppRegion);
-  FrameBuffer *frameBuffer = &m_frameBuffer;
+  updateFrameBuffer(&updCont, shareOnlyApp,
+                    &prevShareAppRegion, &shareAppRegion);
+  const FrameBuffer *frameBuffer = m_snapshot.getFrameBuffer();
 
-  AutoLock l(m_output);
+  // Amounts of written data and of blocked writes before the update, for
+  // the link estimation.
+  UINT64 startPosition = m_output->getBytesWritten();
+  UINT64 startBlockedBytes = m_output->getBlockedBytes();
+  UINT64 startBlockedTime = m_output->getBlockedTime();
 
   Dimension clientDim, lastViewPortDim;
   {
@@ -353,7 +500,8 @@ void UpdateSender::sendUpdate()
     updCont.screenSizeChanged = true;
   }
   if (dimensionChanged || viewPortChanged) {
-    updCont.copiedRegion.clear();
+    updCont.copyMoves.clear();
+    m_refinement.reset();
 
     AutoLock al(&m_viewPortMut);
     m_lastViewPortDim.setDim(&viewPort);
@@ -388,6 +536,7 @@ void UpdateSender::sendUpdate()
     sendPalette(&clientPixelFormat);
   }
   m_pixelConverter.setPixelFormats(&clientPixelFormat, &serverPixelFormat);
+  m_pixelConverter.setSnapshot(&m_snapshot);
 
   // Send updates
   if (updCont.screenSizeChanged || (!requestedFullReg.isEmpty() &&
@@ -397,6 +546,9 @@ void UpdateSender::sendUpdate()
       m_log->debug(_T("Desktop resize is enabled, sending NewFBSize %dx%d"),
                  lastViewPortDim.width, lastViewPortDim.height);
       sendNewFBSize(&lastViewPortDim);
+      if (encodeOptions.fenceEnabled()) {
+        sendPing();
+      }
       // FIXME: "Dazzle" does not seem like a good word here.
       m_log->debug(_T("Dazzle changed region"));
       m_updateKeeper->dazzleChangedReg();
@@ -404,6 +556,9 @@ void UpdateSender::sendUpdate()
       m_log->debug(_T("Desktop resize is disabled, sending blank screen"));
       sendFbInClientDim(&encodeOptions, frameBuffer, &clientDim,
                         &frameBuffer->getPixelFormat());
+      if (encodeOptions.fenceEnabled()) {
+        sendPing();
+      }
       m_log->debug(_T("Dazzle changed region"));
       m_updateKeeper->dazzleChangedReg();
     }
@@ -421,8 +576,7 @@ void UpdateSender::sendUpdate()
 
     if (!encodeOptions.copyRectEnabled() || getVideoFrozen()) {
       m_log->debug(_T("CopyRect is disabled, converting to normal updates"));
-      updCont.changedRegion.add(&updCont.copiedRegion);
-      updCont.copiedRegion.clear();
+      updCont.declineAllCopies();
     }
 
     updCont.changedRegion.add(&m_prevVideoRegion); // This line updates rid video places when
@@ -442,107 +596,101 @@ void UpdateSender::sendUpdate()
     shareAppRegion.crop(&frameBufferRect);
     prevShareAppRegion.crop(&frameBufferRect);
 
-    // If Tight encoding is not supported by the client, convert video updates
-    // to normal updates so that the preferred encoding will be used.
-    if (!encodeOptions.encodingEnabled(EncodingDefs::TIGHT)) {
+    // If Tight encoding is not supported by the client or the link is fast
+    // enough for lossless video, convert video updates to normal updates so
+    // that the preferred encoding will be used.
+    if (!encodeOptions.encodingEnabled(EncodingDefs::TIGHT) || m_losslessVideo) {
       updCont.changedRegion.add(&updCont.videoRegion);
       updCont.videoRegion.clear();
     }
 
     // Crop changed and video region by requested regions.
-    cropUpdContForReqRegions(&updCont, &requestedIncrReg, &requestedFullReg);
+    cropUpdContForReqRegions(&updCont, &incrReg, &requestedFullReg);
 
     Region videoRegion = updCont.videoRegion;
     Region changedRegion = updCont.changedRegion;
 
+    // Areas out of the shared application are sent from the black frame
+    // buffer rather than painted black over the snapshot.
+    Region blackRegion;
+    const FrameBuffer *blackFb = 0;
     if (shareOnlyApp) {
       Region newOpeningAppRegion = shareAppRegion;
       newOpeningAppRegion.subtract(&prevShareAppRegion);
 
-      Region blackRegion = changedRegion;
+      blackRegion = changedRegion;
       blackRegion.add(&videoRegion);
       blackRegion.add(&prevShareAppRegion);
       blackRegion.subtract(&shareAppRegion);
       changedRegion.add(&blackRegion);
       changedRegion.add(&newOpeningAppRegion);
-      // Paint black in the framebuffer for the black region.
-      paintBlack(frameBuffer, &blackRegion);
+      blackFb = m_snapshot.getBlackFrameBuffer();
     }
 
     //
     // At this point, we've got final regions in changedRegion and videoRegion.
     //
 
-    // Convert changedRegion to the final list of rectangles.
-    m_log->debug(_T("Number of normal rectangles before splitting: %d"),
-               changedRegion.getCount());
-    std::vector<Rect> normalRects;
-    splitRegion(m_enbox.getEncoder(), &changedRegion, &normalRects,
-                frameBuffer, &encodeOptions);
-
-    // Do the same for the videoRegion.
-    std::vector<Rect> videoRects;
-    if (!videoRegion.isEmpty()) {
-      m_log->debug(_T("Video region is not empty"));
-      m_enbox.validateJpegEncoder(); // make sure JpegEncoder is allocated
-      splitRegion(m_enbox.getJpegEncoder(), &videoRegion, &videoRects,
-                  frameBuffer, &encodeOptions);
-    }
-
     // Get the final list of CopyRect rectangles.
     std::vector<Rect> copyRects;
-    updCont.copiedRegion.getRectVector(&copyRects);
-
-    // Calculate the total number of rectangles and pseudo-rectangles.
-    m_log->debug(_T("Number of normal rectangles: %d"), normalRects.size());
-    m_log->debug(_T("Number of video rectangles: %d"), videoRects.size());
-    m_log->debug(_T("Number of CopyRect rectangles: %d"), copyRects.size());
-    size_t numTotalRects =
-      normalRects.size() + videoRects.size() + copyRects.size();
-
-    if (updCont.cursorPosChanged) {
-      numTotalRects++;
-      m_log->debug(_T("Adding a pseudo-rectangle for cursor position update"));
+    std::vector<Point> copySources;
+    updCont.getCopyRects(&copyRects, &copySources);
+
+    // Pixels outside the shared application must not be sent, so the
+    // changed region may not grow in that mode.
+    if (!shareOnlyApp) {
+      Region excludedRegion;
+      updCont.getCopiedRegion(&excludedRegion);
+      excludedRegion.add(&videoRegion);
+      coarsenRegion(&changedRegion, &excludedRegion, &encodeOptions);
     }
-    if (updCont.cursorShapeChanged) {
-      numTotalRects++;
-      m_log->debug(_T("Adding a pseudo-rectangle for cursor shape update"));
-    }
-    m_log->debug(_T("Total number of rectangles and pseudo-rectangles: %d"),
-               numTotalRects);
-
-    // FIXME: Handle this better, e.g. send first 65534 rectangles.
-    _ASSERT(numTotalRects <= 65534);
-
-    if (numTotalRects != 0) {
-      m_log->debug(_T("Sending FramebufferUpdate message header"));
-      // FIXME: Use constant for FramebufferUpdate message type.
-      m_output->writeUInt8(0); // message type
-      m_output->writeUInt8(0); // padding
-      m_output->writeUInt16((UINT16)numTotalRects);
-
-      if (updCont.cursorPosChanged) {
-        m_log->debug(_T("Sending cursor position update"));
-        sendCursorPosUpdate();
-      }
-      if (updCont.cursorShapeChanged) {
-        m_log->debug(_T("Sending cursor shape update"));
-        sendCursorShapeUpdate(&clientPixelFormat,
-                              &cursorShape);
+
+    bool hasUpdates = !changedRegion.isEmpty() || !videoRegion.isEmpty() ||
+                      !copyRects.empty() ||
+                      updCont.cursorPosChanged || updCont.cursorShapeChanged;
+
+    // Lossy areas which have stopped changing are sent again losslessly,
+    // but only if there is nothing else to send.
+    ServerConfig *config = Configurator::getInstance()->getServerConfig();
+    unsigned int refinementDelay = config->getLosslessRefinementDelay();
+    if (!hasUpdates && refinementDelay != 0 && !m_refinement.isEmpty()) {
+      Region bounds = incrReg;
+      bounds.add(&requestedFullReg);
+      bounds.crop(&frameBufferRect);
+      if (shareOnlyApp) {
+        bounds.intersect(&shareAppRegion);
       }
-      if (copyRects.size() > 0) {
-        m_log->debug(_T("Sending CopyRect rectangles"));
-        sendCopyRect(&copyRects, &updCont.copySrc);
+      takeRefinement(&changedRegion, &bounds, &clientPixelFormat,
+                     refinementDelay);
+      if (!changedRegion.isEmpty()) {
+        m_log->debug(_T("Sending lossless refinement, %d rectangles"),
+                     (int)changedRegion.getCount());
+        encodeOptions.disableJpeg();
+        hasUpdates = true;
       }
+    }
 
-      m_log->debug(_T("Time between request and a point before send and coding (in milliseconds): %u"),
-                 (unsigned int)(DateTime::now() - reqTimePoint).getTime());
-      m_log->debug(_T("Sending video rectangles"));
-      sendRectangles(m_enbox.getJpegEncoder(), &videoRects, frameBuffer, &encodeOptions);
-      m_log->debug(_T("Sending normal rectangles"));
-      sendRectangles(m_enbox.getEncoder(), &normalRects, frameBuffer, &encodeOptions);
-      m_log->debug(_T("Time between request and answer is (in milliseconds): %u"),
-                 (unsigned int)(DateTime::now() - reqTimePoint).getTime());
+    if (hasUpdates) {
+      const PatchFrameBuffer *cursorPatch = m_cursorUpdates.getCursorPatch();
+      RegionSources videoSources, changedSources;
+      getRegionSources(&videoRegion, frameBuffer, cursorPatch,
+                       &blackRegion, blackFb, &videoSources);
+      getRegionSources(&changedRegion, frameBuffer, cursorPatch,
+                       &blackRegion, blackFb, &changedSources);
+      if (encodeOptions.lastRectEnabled()) {
+        sendStreamedUpdate(&updCont, &copyRects, &copySources, &cursorShape,
+                           &clientPixelFormat, &videoSources, &changedSources,
+                           &encodeOptions, &reqTimePoint);
+      } else {
+        sendCountedUpdate(&updCont, &copyRects, &copySources, &cursorShape,
+                          &clientPixelFormat, &videoSources, &changedSources,
+                          &encodeOptions, &reqTimePoint);
+      }
+      trackLossyAreas(&copyRects, &copySources, &videoRegion, &changedRegion,
+                      refinementDelay);
+      if (encodeOptions.fenceEnabled()) {
+        sendPing();
+      }
     } else {
       m_log->debug(_T("Nothing to send, restoring requested regions"));
       AutoLock al(&m_reqRectLocMut);
@@ -551,20 +699,357 @@ void UpdateSender::sendUpdate()
       m_incrUpdIsReq = incrUpdIsReq;
       m_fullUpdIsReq = fullUpdIsReq;
     }
-    m_cursorUpdates.restoreFrameBuffer(frameBuffer);
-
   }
+  // Let other clients reuse the frame and the converted pixels.
+  m_pixelConverter.releaseSharedPixels();
+  m_snapshot.release();
 
   m_log->debug(_T("Flushing output"));
   m_output->flush();
+
+  UINT64 bytesSent = m_output->getBytesWritten() - startPosition;
+  if (bytesSent != 0) {
+    unsigned int sendTime =
+      (unsigned int)(DateTime::now() - startTime).getTime();
+    m_linkEstimator.onUpdateSent(bytesSent, sendTime,
+                                 m_output->getBlockedBytes() - startBlockedBytes,
+                                 m_output->getBlockedTime() - startBlockedTime);
+  }
+}
+
+void UpdateSender::sendFbUpdateHeader(UINT16 numRects)
+{
+  m_output->writeUInt8(ServerMsgDefs::FB_UPDATE); // message type
+  m_output->writeUInt8(0); // padding
+  m_output->writeUInt16(numRects);
+}
+
+void UpdateSender::sendPseudoRects(const UpdateContainer *updCont,
+                                   const std::vector<Rect> *copyRects,
+                                   const std::vector<Point> *copySources,
+                                   const CursorShape *cursorShape,
+                                   const PixelFormat *clientPixelFormat)
+{
+  if (updCont->cursorPosChanged) {
+    m_log->debug(_T("Sending cursor position update"));
+    sendCursorPosUpdate();
+  }
+  if (updCont->cursorShapeChanged) {
+    m_log->debug(_T("Sending cursor shape update"));
+    sendCursorShapeUpdate(clientPixelFormat, cursorShape);
+  }
+  if (copyRects->size() > 0) {
+    m_log->debug(_T("Sending CopyRect rectangles"));
+    sendCopyRect(copyRects, copySources);
+  }
+}
+
+void UpdateSender::sendCountedUpdate(const UpdateContainer *updCont,
+                                     const std::vector<Rect> *copyRects,
+                                     const std::vector<Point> *copySources,
+                                     const CursorShape *cursorShape,
+                                     const PixelFormat *clientPixelFormat,
+                                     const RegionSources *videoSources,
+                                     const RegionSources *changedSources,
+                                     const EncodeOptions *encodeOptions,
+                                     const DateTime *reqTimePoint)
+{
+  // Convert the changed region to the final list of rectangles, keeping the
+  // source frame buffer of each rectangle.
+  std::vector<Rect> normalRects;
+  std::vector<const FrameBuffer *> normalFbs;
+  RegionSources::const_iterator si;
+  for (si = changedSources->begin(); si != changedSources->end(); si++) {
+    m_log->debug(_T("Number of normal rectangles before splitting: %d"),
+               si->region.getCount());
+    splitRegion(m_enbox.getEncoder(), &si->region, &normalRects,
+                si->frameBuffer, encodeOptions);
+    normalFbs.resize(normalRects.size(), si->frameBuffer);
+  }
+
+  // Do the same for the video region.
+  std::vector<Rect> videoRects;
+  std::vector<const FrameBuffer *> videoFbs;
+  if (!videoSources->empty()) {
+    m_log->debug(_T("Video region is not empty"));
+    m_enbox.validateJpegEncoder(); // make sure JpegEncoder is allocated
+    for (si = videoSources->begin(); si != videoSources->end(); si++) {
+      splitRegion(m_enbox.getJpegEncoder(), &si->region, &videoRects,
+                  si->frameBuffer, encodeOptions);
+      videoFbs.resize(videoRects.size(), si->frameBuffer);
+    }
+  }
+
+  // Calculate the total number of rectangles and pseudo-rectangles.
+  m_log->debug(_T("Number of normal rectangles: %d"), normalRects.size());
+  m_log->debug(_T("Number of video rectangles: %d"), videoRects.size());
+  m_log->debug(_T("Number of CopyRect rectangles: %d"), copyRects->size());
+  size_t numFixedRects = videoRects.size() + copyRects->size();
+  if (updCont->cursorPosChanged) {
+    numFixedRects++;
+    m_log->debug(_T("Adding a pseudo-rectangle for cursor position update"));
+  }
+  if (updCont->cursorShapeChanged) {
+    numFixedRects++;
+    m_log->debug(_T("Adding a pseudo-rectangle for cursor shape update"));
+  }
+  m_log->debug(_T("Total number of rectangles and pseudo-rectangles: %d"),
+             numFixedRects + normalRects.size());
+
+  // Normal rectangles not fitting into the first message are sent in
+  // additional FramebufferUpdate messages.
+  if (numFixedRects > MAX_RECTS_PER_UPDATE) {
+    throw Exception(_T("Too many rectangles in a framebuffer update"));
+  }
+  size_t numFirstNormalRects = min(normalRects.size(),
+                                   MAX_RECTS_PER_UPDATE - numFixedRects);
+
+  m_log->debug(_T("Sending FramebufferUpdate message header"));
+  sendFbUpdateHeader((UINT16)(numFixedRects + numFirstNormalRects));
+  sendPseudoRects(updCont, copyRects, copySources, cursorShape,
+                  clientPixelFormat);
+
+  m_log->debug(_T("Time between request and a point before send and coding (in milliseconds): %u"),
+             (unsigned int)(DateTime::now() - *reqTimePoint).getTime());
+  m_log->debug(_T("Sending video rectangles"));
+  sendRectangles(m_enbox.getJpegEncoder(), &videoRects, &videoFbs,
+                 0, videoRects.size(), encodeOptions);
+  m_log->debug(_T("Sending normal rectangles"));
+  size_t chunkBegin = 0;
+  size_t chunkSize = numFirstNormalRects;
+  while (chunkBegin != normalRects.size()) {
+    sendRectangles(m_enbox.getEncoder(), &normalRects, &normalFbs,
+                   chunkBegin, chunkBegin + chunkSize, encodeOptions);
+    chunkBegin += chunkSize;
+
+    chunkSize = min(normalRects.size() - chunkBegin, MAX_RECTS_PER_UPDATE);
+    if (chunkSize != 0) {
+      m_log->debug(_T("Sending additional FramebufferUpdate message header"));
+      sendFbUpdateHeader((UINT16)chunkSize);
+    }
+  }
+  m_log->debug(_T("Time between request and answer is (in milliseconds): %u"),
+             (unsigned int)(DateTime::now() - *reqTimePoint).getTime());
+}
+
+void UpdateSender::sendStreamedUpdate(const UpdateContainer *updCont,
+                                      const std::vector<Rect> *copyRects,
+                                      const std::vector<Point> *copySources,
+                                      const CursorShape *cursorShape,
+                                      const PixelFormat *clientPixelFormat,
+                                      const RegionSources *videoSources,
+                                      const RegionSources *changedSources,
+                                      const EncodeOptions *encodeOptions,
+                                      const DateTime *reqTimePoint)
+{
+  size_t numRects = copyRects->size();
+  if (updCont->cursorPosChanged) {
+    numRects++;
+  }
+  if (updCont->cursorShapeChanged) {
+    numRects++;
+  }
+  if (numRects > MAX_STREAMED_RECTS) {
+    throw Exception(_T("Too many rectangles in a framebuffer update"));
+  }
+
+  // The number of rectangles is not known in advance, the end of the
+  // update is marked with the LastRect pseudo-rectangle.
+  m_log->debug(_T("Sending FramebufferUpdate message header (LastRect mode)"));
+  sendFbUpdateHeader(LAST_RECT_NUM_RECTS);
+
+  // Pseudo-rectangles and CopyRect ones are cheap, so let the client apply
+  // them while the rest of the update is being encoded.
+  sendPseudoRects(updCont, copyRects, copySources, cursorShape,
+                  clientPixelFormat);
+  m_output->flush();
+
+  m_log->debug(_T("Time between request and a point before send and coding (in milliseconds): %u"),
+             (unsigned int)(DateTime::now() - *reqTimePoint).getTime());
+  RegionSources::const_iterator si;
+  if (!videoSources->empty()) {
+    m_log->debug(_T("Sending video rectangles"));
+    m_enbox.validateJpegEncoder(); // make sure JpegEncoder is allocated
+    for (si = videoSources->begin(); si != videoSources->end(); si++) {
+      sendRegionInBatches(m_enbox.getJpegEncoder(), &si->region,
+                          si->frameBuffer, encodeOptions, &numRects);
+    }
+  }
+  m_log->debug(_T("Sending normal rectangles"));
+  for (si = changedSources->begin(); si != changedSources->end(); si++) {
+    sendRegionInBatches(m_enbox.getEncoder(), &si->region,
+                        si->frameBuffer, encodeOptions, &numRects);
+  }
+
+  sendRectHeader(0, 0, 0, 0, PseudoEncDefs::LAST_RECT);
+  m_log->debug(_T("Time between request and answer is (in milliseconds): %u"),
+             (unsigned int)(DateTime::now() - *reqTimePoint).getTime());
+}
+
+void UpdateSender::sendRegionInBatches(Encoder *encoder,
+                                       const Region *region,
+                                       const FrameBuffer *frameBuffer,
+                                       const EncodeOptions *encodeOptions,
+                                       size_t *numRects)
+{
+  std::vector<Rect> baseRects;
+  region->getRectVector(&baseRects);
+
+  std::vector<Rect> batch;
+  size_t batchArea = 0;
+  std::vector<Rect>::iterator i;
+  for (i = baseRects.begin(); i != baseRects.end(); i++) {
+    encoder->splitRectangle(&*i, &batch, frameBuffer, encodeOptions);
+    batchArea += (size_t)i->area();
+    if (batchArea >= STREAMING_BATCH_AREA) {
+      sendStreamedBatch(encoder, &batch, frameBuffer, encodeOptions,
+                        numRects);
+      m_output->flush();
+      batch.clear();
+      batchArea = 0;
+    }
+  }
+  sendStreamedBatch(encoder, &batch, frameBuffer, encodeOptions, numRects);
+}
+
+void UpdateSender::sendStreamedBatch(Encoder *encoder,
+                                     const std::vector<Rect> *batch,
+                                     const FrameBuffer *frameBuffer,
+                                     const EncodeOptions *encodeOptions,
+                                     size_t *numRects)
+{
+  size_t first = 0;
+  while (batch->size() - first > MAX_STREAMED_RECTS - *numRects) {
+    size_t last = first + (MAX_STREAMED_RECTS - *numRects);
+    std::vector<Rect> part(batch->begin() + first, batch->begin() + last);
+    sendRectangles(encoder, &part, frameBuffer, encodeOptions);
+    sendRectHeader(0, 0, 0, 0, PseudoEncDefs::LAST_RECT);
+    m_log->debug(_T("Sending additional FramebufferUpdate message header")
+                 _T(" (LastRect mode)"));
+    sendFbUpdateHeader(LAST_RECT_NUM_RECTS);
+    *numRects = 0;
+    first = last;
+  }
+  if (first == 0) {
+    sendRectangles(encoder, batch, frameBuffer, encodeOptions);
+  } else {
+    std::vector<Rect> rest(batch->begin() + first, batch->end());
+    sendRectangles(encoder, &rest, frameBuffer, encodeOptions);
+  }
+  *numRects += batch->size() - first;
+}
+
+void UpdateSender::coarsenRegion(Region *changedRegion,
+                                 const Region *excludedRegion,
+                                 const EncodeOptions *encodeOptions)
+{
+  size_t numRects = changedRegion->getCount();
+  int rectOverhead = m_enbox.getEncoder()->getRectOverhead(encodeOptions);
+  int numRemoved = m_regionCoarsener.coarsen(changedRegion, rectOverhead,
+                                             excludedRegion);
+  m_log->debug(_T("Region coarsening removed %d of %d rectangles")
+               _T(" (rectangle overhead is %d pixels)"),
+               numRemoved, (int)numRects, rectOverhead);
 }
 
-void UpdateSender::paintBlack(FrameBuffer *frameBuffer, const Region *blackRegion)
+void UpdateSender::takeRefinement(Region *refinedRegion,
+                                  const Region *bounds,
+                                  const PixelFormat *clientPixelFormat,
+                                  unsigned int idleTime)
 {
-  std::vector<Rect> blackRects;
-  blackRegion->getRectVector(&blackRects);
-  for (size_t i = 0; i < blackRects.size(); i++) {
-    frameBuffer->fillRect(&blackRects[i], 0);
+  int maxArea = DEFAULT_REFINEMENT_AREA;
+  unsigned int bandwidth = m_linkEstimator.getBandwidth();
+  if (bandwidth != 0) {
+    // Raw pixel size is a safe estimate of the lossless data size.
+    UINT64 bytes = (UINT64)bandwidth * REFINEMENT_SLICE / 1000;
+    UINT64 area = bytes / max(clientPixelFormat->bitsPerPixel / 8, 1);
+    area = max(area, (UINT64)MIN_REFINEMENT_AREA);
+    maxArea = (int)min(area, (UINT64)MAX_REFINEMENT_AREA);
+  }
+  m_refinement.takeRefinement(refinedRegion, bounds, idleTime, maxArea);
+}
+
+void UpdateSender::trackLossyAreas(const std::vector<Rect> *copyRects,
+                                   const std::vector<Point> *copySources,
+                                   const Region *videoRegion,
+                                   const Region *changedRegion,
+                                   unsigned int refinementDelay)
+{
+  // Only Tight may compress with losses (JpegEncoder works via Tight too).
+  std::vector<Rect> lossyRects;
+  TightEncoder *tight = m_enbox.getTightEncoder();
+  if (tight != 0) {
+    tight->takeLossyRects(&lossyRects);
+  }
+  if (refinementDelay == 0) {
+    m_refinement.reset();
+    return;
+  }
+
+  for (size_t i = 0; i < copyRects->size(); i++) {
+    m_refinement.onCopyRect(&(*copyRects)[i], &(*copySources)[i]);
+  }
+  Region sentRegion = *changedRegion;
+  sentRegion.add(videoRegion);
+  Region lossyRegion;
+  lossyRegion.setRects(&lossyRects);
+  m_refinement.onUpdateSent(&sentRegion, &lossyRegion);
+}
+
+DWORD UpdateSender::getRefinementWaitTime()
+{
+  ServerConfig *config = Configurator::getInstance()->getServerConfig();
+  unsigned int refinementDelay = config->getLosslessRefinementDelay();
+  if (refinementDelay == 0 || m_refinement.isEmpty()) {
+    return INFINITE;
+  }
+  return max(m_refinement.getTimeToRefinement(refinementDelay),
+             REFINEMENT_POLL_INTERVAL);
+}
+
+void UpdateSender::getRegionSources(const Region *region,
+                                    const FrameBuffer *frameBuffer,
+                                    const PatchFrameBuffer *cursorPatch,
+                                    const Region *blackRegion,
+                                    const FrameBuffer *blackFb,
+                                    RegionSources *sources)
+{
+  sources->clear();
+  RegionSource source;
+
+  // Pixels of the snapshot.
+  source.region = *region;
+  source.frameBuffer = frameBuffer;
+  if (blackFb != 0) {
+    source.region.subtract(blackRegion);
+  }
+  Region cursorRegion;
+  if (cursorPatch != 0) {
+    Rect patchRect = cursorPatch->getPatchRect();
+    cursorRegion = source.region;
+    cursorRegion.crop(&patchRect);
+    Region patchRegion(&patchRect);
+    source.region.subtract(&patchRegion);
+  }
+  if (!source.region.isEmpty()) {
+    sources->push_back(source);
+  }
+
+  // The cursor image.
+  if (!cursorRegion.isEmpty()) {
+    source.region = cursorRegion;
+    source.frameBuffer = cursorPatch;
+    sources->push_back(source);
+  }
+
+  // Black areas.
+  if (blackFb != 0) {
+    source.region = *region;
+    source.region.intersect(blackRegion);
+    source.frameBuffer = blackFb;
+    if (!source.region.isEmpty()) {
+      sources->push_back(source);
+    }
   }
 }
 
@@ -587,10 +1072,31 @@ void UpdateSender::sendRectangles(Encoder *encoder,
                                   const FrameBuffer *frameBuffer,
                                   const EncodeOptions *encodeOptions)
 {
-  std::vector<Rect>::const_iterator i;
-  for (i = rects->begin(); i != rects->end(); i++) {
-    sendRectHeader(&*i, encoder->getCode());
-    encoder->sendRectangle(&*i, frameBuffer, encodeOptions);
+  if (rects->empty()) {
+    return;
+  }
+  encoder->sendRectangles(rects, frameBuffer, encodeOptions);
+  m_log->debug(_T("Encoded %d rectangles, parallel encoding speedup: %.2f"),
+               (int)rects->size(), encoder->getParallelSpeedup());
+}
+
+void UpdateSender::sendRectangles(Encoder *encoder,
+                                  const std::vector<Rect> *rects,
+                                  const std::vector<const FrameBuffer *> *frameBuffers,
+                                  size_t first, size_t last,
+                                  const EncodeOptions *encodeOptions)
+{
+  // Rectangles of the same frame buffer go one after another, so they are
+  // sent by runs.
+  while (first < last) {
+    const FrameBuffer *frameBuffer = (*frameBuffers)[first];
+    size_t runEnd = first + 1;
+    while (runEnd < last && (*frameBuffers)[runEnd] == frameBuffer) {
+      runEnd++;
+    }
+    std::vector<Rect> run(rects->begin() + first, rects->begin() + runEnd);
+    sendRectangles(encoder, &run, frameBuffer, encodeOptions);
+    first = runEnd;
   }
 }
 
@@ -599,7 +1105,7 @@ void UpdateSender::execute()
   m_log->info(_T("Starting update sender thread for client #%d"), m_id);
 
   while(!isTerminating()) {
-    m_newUpdatesEvent.waitForEvent();
+    m_newUpdatesEvent.waitForEvent(getRefinementWaitTime());
     m_busy = true;
     m_log->debug(_T("Update sender thread of client #%d is awake"), m_id);
     if (!isTerminating()) {
@@ -648,17 +1154,8 @@ void UpdateSender::readUpdateRequest(RfbInputGate *io)
               reqRect.getWidth(), reqRect.getHeight(), (int)incremental,
               m_id);
 
-  _ASSERT(m_updReqListener != 0);
-
-  bool alreadyHasUpdates = m_updateKeeper->checkForUpdates(&combinedReqRegions);
-  if (alreadyHasUpdates) {
-    // We should initiaite send update to avoid it skipping on no updates from a desktop
-    // FIXME: Code duplication, see the newUpdates() function.
-    m_newUpdatesEvent.notify();
-    m_log->debug(_T("Client #%d is waking up"), m_id);
-  }
-
-  m_updReqListener->onUpdateRequest(&reqRect, incremental);
+  m_linkEstimator.onUpdateRequest();
+  notifyUpdateRequest(&combinedReqRegions, &reqRect, incremental);
 }
 
 void UpdateSender::readSetPixelFormat(RfbInputGate *io)
@@ -725,8 +1222,31 @@ void UpdateSender::readSetEncodings(RfbInputGate *io)
     list.push_back(code);
   }
 
-  AutoLock lock(&m_newEncodeOptionsLocker);
-  m_newEncodeOptions.setEncodings(&list);
+  bool announceFence, announceContinuousUpdates;
+  {
+    AutoLock lock(&m_newEncodeOptionsLocker);
+    m_newEncodeOptions.setEncodings(&list);
+    announceFence = m_newEncodeOptions.fenceEnabled() && !m_fenceAnnounced;
+    // Continuous updates depend on fences for flow control.
+    announceContinuousUpdates = m_newEncodeOptions.fenceEnabled() &&
+                                m_newEncodeOptions.continuousUpdatesEnabled() &&
+                                !m_continuousUpdatesAnnounced;
+  }
+
+  // The first Fence request tells the client that fences are supported,
+  // the first EndOfContinuousUpdates does the same for continuous updates.
+  if (announceFence || announceContinuousUpdates) {
+    AutoLock l(m_output);
+    if (announceFence) {
+      sendPing();
+      m_fenceAnnounced = true;
+    }
+    if (announceContinuousUpdates) {
+      sendEndOfContinuousUpdates();
+      m_continuousUpdatesAnnounced = true;
+    }
+    m_output->flush();
+  }
 }
 
 void UpdateSender::setVideoFrozen(bool value)
@@ -746,6 +1266,117 @@ void UpdateSender::readVideoFreeze(RfbInputGate *io)
   setVideoFrozen(io->readUInt8() != 0);
 }
 
+void UpdateSender::readEnableContinuousUpdates(RfbInputGate *io)
+{
+  bool enable = io->readUInt8() != 0;
+  Rect rect;
+  rect.left = io->readUInt16();
+  rect.top = io->readUInt16();
+  rect.setWidth(io->readUInt16());
+  rect.setHeight(io->readUInt16());
+
+  if (!m_continuousUpdatesAnnounced) {
+    throw Exception(_T("Continuous updates enabled by the client")
+                    _T(" without support announced by the server"));
+  }
+
+  m_log->detail(_T("continuous updates %s (%d, %d, %dx%d) by client")
+                _T(" (client #%d)"), enable ? _T("enabled") : _T("disabled"),
+                rect.left, rect.top, rect.getWidth(), rect.getHeight(), m_id);
+
+  if (enable) {
+    {
+      AutoLock al(&m_reqRectLocMut);
+      m_continuousUpdates = true;
+      m_continuousRect = rect;
+    }
+    requestContinuousUpdates(&rect);
+  } else {
+    // The client must be told that no more unrequested updates will come.
+    // The flag is cleared under the output lock, so an update being sent
+    // by the sender thread at the moment is written before this message,
+    // and the next one will see the mode disabled.
+    AutoLock l(m_output);
+    {
+      AutoLock al(&m_reqRectLocMut);
+      m_continuousUpdates = false;
+      m_continuousRect = rect;
+    }
+    sendEndOfContinuousUpdates();
+    m_output->flush();
+  }
+}
+
+void UpdateSender::readFence(RfbInputGate *io)
+{
+  // Read padding
+  io->readUInt16();
+  io->readUInt8();
+
+  UINT32 flags = io->readUInt32();
+  UINT8 length = io->readUInt8();
+  if (length > FenceDefs::MAX_PAYLOAD_LENGTH) {
+    throw Exception(_T("Too long payload of the Fence message"));
+  }
+  UINT8 payload[FenceDefs::MAX_PAYLOAD_LENGTH];
+  if (length != 0) {
+    io->readFully(payload, length);
+  }
+
+  if ((flags & FenceDefs::REQUEST) != 0) {
+    // Client messages are processed one by one and the reply is sent after
+    // all the preceding server messages, so BlockBefore and BlockAfter are
+    // satisfied by just echoing the request. SyncNext is not supported.
+    AutoLock l(m_output);
+    sendFence(flags & FenceDefs::SUPPORTED_FLAGS & ~FenceDefs::REQUEST,
+              payload, length);
+    m_output->flush();
+  } else if (length == 4) {
+    UINT32 pingId = ((UINT32)payload[0] << 24) | ((UINT32)payload[1] << 16) |
+                    ((UINT32)payload[2] << 8) | (UINT32)payload[3];
+    onPong(pingId);
+  } else {
+    m_log->debug(_T("Unknown Fence response ignored (client #%d)"), m_id);
+  }
+}
+
+void UpdateSender::onPong(UINT32 pingId)
+{
+  bool wasCongested, congested;
+  unsigned int rtt;
+  {
+    AutoLock al(&m_congestionLocMut);
+    wasCongested = m_congestion.isCongested();
+    if (!m_congestion.gotPong(pingId)) {
+      m_log->debug(_T("Unknown ping %u answered (client #%d)"),
+                   (unsigned int)pingId, m_id);
+      return;
+    }
+    congested = m_congestion.isCongested();
+    rtt = m_congestion.getLastRtt();
+    m_log->debug(_T("Round-trip time is %u ms (base %u ms), congestion")
+                 _T(" window is %u bytes (client #%d)"),
+                 m_congestion.getLastRtt(), m_congestion.getBaseRtt(),
+                 (unsigned int)m_congestion.getWindowSize(), m_id);
+  }
+
+  m_linkEstimator.onFenceRoundTrip(rtt);
+
+  // The updates held back by the full window can be sent now.
+  if (wasCongested && !congested) {
+    bool continuous;
+    Rect contRect;
+    {
+      AutoLock al(&m_reqRectLocMut);
+      continuous = m_continuousUpdates;
+      contRect = m_continuousRect;
+    }
+    if (continuous) {
+      requestContinuousUpdates(&contRect);
+    }
+  }
+}
+
 bool UpdateSender::extractReqRegions(Region *incrReqReg,
                                      Region *fullReqReg,
                                      bool *incrUpdIsReq,
@@ -769,6 +1400,16 @@ bool UpdateSender::extractReqRegions(Region *incrReqReg,
   return *incrUpdIsReq || *fullUpdIsReq;
 }
 
+bool UpdateSender::getContinuousRegion(Region *contReg)
+{
+  AutoLock al(&m_reqRectLocMut);
+  if (!m_continuousUpdates || isCongested()) {
+    return false;
+  }
+  contReg->addRect(&m_continuousRect);
+  return true;
+}
+
 void UpdateSender::extractUpdates(UpdateContainer *updCont)
 {
   m_updateKeeper->extract(updCont);
@@ -778,15 +1419,16 @@ void UpdateSender::cropUpdContForReqRegions(UpdateContainer *updCont,
                                             const Region *incrReqReg,
                                             const Region *fullReqReg)
 {
-  // Crop by requested region
-  Region backRegion = updCont->changedRegion;
-  backRegion.add(&updCont->videoRegion);
-
   Region combinedReqRegion = *incrReqReg;
   combinedReqRegion.add(fullReqReg);
 
+  // Declined copies become changed pixels, so do it before cropping.
   inscribeCopiedRegionToReqRegion(updCont, &combinedReqRegion);
 
+  // Crop by requested region
+  Region backRegion = updCont->changedRegion;
+  backRegion.add(&updCont->videoRegion);
+
   backRegion.subtract(&combinedReqRegion);
   updCont->changedRegion.intersect(&combinedReqRegion);
   updCont->videoRegion.intersect(&combinedReqRegion);
@@ -798,29 +1440,10 @@ void UpdateSender::cropUpdContForReqRegions(UpdateContainer *updCont,
 void UpdateSender::inscribeCopiedRegionToReqRegion(UpdateContainer *updCont,
                                                    const Region *requestRegion)
 {
-  // Test copied region. If it is fully inside in the requested region then
-  // there is no to change. Otherwise, simply decline copied region.
-  if (!updCont->copiedRegion.isEmpty()) {
-    Region dstCopiedRegion = updCont->copiedRegion;
-    dstCopiedRegion.subtract(requestRegion);
-
-    bool copiedRegionFullyInscribed = dstCopiedRegion.isEmpty();
-    if (copiedRegionFullyInscribed) {
-      // Then see the same at source coordinates.
-      Region copiedRegion = updCont->copiedRegion;
-      Rect dstBounds = copiedRegion.getBounds();
-      int dx = updCont->copySrc.x - dstBounds.left;
-      int dy = updCont->copySrc.y - dstBounds.top;
-      copiedRegion.translate(dx, dy);
-      copiedRegion.subtract(requestRegion);
-      copiedRegionFullyInscribed = copiedRegion.isEmpty();
-    }
-    if (!copiedRegionFullyInscribed) {
-      // Convert copied region to changed region.
-      updCont->changedRegion.add(&updCont->copiedRegion);
-      updCont->copiedRegion.clear();
-    }
-  }
+  // Only the parts of the moves with both destination and source pixels in
+  // the requested region are sent as CopyRect. The rest is converted to
+  // changed pixels.
+  updCont->cropCopies(requestRegion);
 }
 
 void UpdateSender::selectEncoder(EncodeOptions *encodeOptions)
@@ -834,6 +1457,56 @@ void UpdateSender::selectEncoder(EncodeOptions *encodeOptions)
   // Make sure the encoder object corresponds to the preferred encoding
   // requested in the most recent SetEncodings client message.
   m_enbox.selectEncoder(encodeOptions->getPreferredEncoding());
+  // Apply the current number of encoder threads from the server settings.
+  ServerConfig *config = Configurator::getInstance()->getServerConfig();
+  m_enbox.setNumThreads(config->getEncoderThreads());
+
+  m_losslessVideo = false;
+  if (config->isAutoEncodingTuningEnabled()) {
+    applyAutoEncodingTuning(encodeOptions, config->getTargetUpdateLatency());
+  }
+}
+
+void UpdateSender::logEncoderStatistics()
+{
+  TightEncoder *tight = m_enbox.getTightEncoder();
+  if (tight == 0) {
+    return;
+  }
+  TightEncoder::Statistics stats;
+  tight->getStatistics(&stats);
+
+  const TCHAR *names[TightEncoder::NUM_SUBENC_TYPES] = {
+    _T("fill"), _T("mono"), _T("indexed"), _T("full color"), _T("gradient"),
+    _T("JPEG")
+  };
+  for (int i = 0; i < TightEncoder::NUM_SUBENC_TYPES; i++) {
+    m_log->info(_T("Tight %s rectangles sent to client #%d: %llu")
+                _T(" (%llu pixels)"), names[i], m_id, stats.rects[i],
+                stats.pixels[i]);
+  }
+  m_log->info(_T("Content classifier for client #%d: %llu rectangles")
+              _T(" analyzed, %llu sent with JPEG"), m_id,
+              stats.classifiedRects, stats.classifiedJpegRects);
+}
+
+void UpdateSender::applyAutoEncodingTuning(EncodeOptions *encodeOptions,
+                                           unsigned int targetLatency)
+{
+  int level = m_linkEstimator.getLevel(targetLatency);
+
+  encodeOptions->setCompressionLevel(AUTO_COMPRESSION_LEVELS[level]);
+  // JPEG is used only if the client has requested it.
+  if (encodeOptions->jpegEnabled()) {
+    encodeOptions->setJpegQualityLevel(AUTO_JPEG_QUALITY_LEVELS[level]);
+  }
+  m_losslessVideo = level <= AUTO_LOSSLESS_VIDEO_MAX_LEVEL;
+
+  m_log->debug(_T("Auto tuning level %d for client #%d: bandwidth %u B/s,")
+               _T(" RTT %u ms, update latency %u ms (target %u ms)"),
+               level, m_id, m_linkEstimator.getBandwidth(),
+               m_linkEstimator.getRtt(), m_linkEstimator.getUpdateLatency(),
+               targetLatency);
 }
 
 void UpdateSender::updateFrameBuffer(UpdateContainer *updCont,
@@ -844,8 +1517,7 @@ void UpdateSender::updateFrameBuffer(UpdateContainer *updCont,
 
   Region newOpeningPixels;
   if (shareOnlyApp) {
-    updCont->changedRegion.add(&updCont->copiedRegion);
-    updCont->copiedRegion.clear();
+    updCont->declineAllCopies();
     m_appRegion = *shareAppRegion;
     newOpeningPixels = m_appRegion;
     newOpeningPixels.subtract(&m_prevAppRegion);
@@ -857,17 +1529,13 @@ void UpdateSender::updateFrameBuffer(UpdateContainer *updCont,
   // for example, appears when alien application creep on the shared application.
   updCont->changedRegion.add(&newOpeningPixels);
 
-  // Frame buffers synchronizing
-  Region changedAndCopyRgns = updCont->changedRegion;
-  changedAndCopyRgns.add(&updCont->copiedRegion);
-  changedAndCopyRgns.add(&updCont->videoRegion);
-  changedAndCopyRgns.addRect(&m_cursorUpdates.getBackgroundRect());
-  {
-    AutoLock al(&m_reqRectLocMut);
-    changedAndCopyRgns.add(&m_requestedFullReg);
+  // The black frame buffer is needed only while an application is shared.
+  if (!shareOnlyApp) {
+    m_snapshot.releaseBlackFrameBuffer();
   }
 
-  updCont->screenSizeChanged = !m_desktop->updateExternalFrameBuffer(&m_frameBuffer, &changedAndCopyRgns, &viewPort) ||
+  // Frame buffers synchronizing.
+  updCont->screenSizeChanged = !m_desktop->updateFrameBufferSnapshot(&m_snapshot, &viewPort) ||
                                updCont->screenSizeChanged;
 }
 
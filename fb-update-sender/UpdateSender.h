@@ -38,8 +38,13 @@
 #include "rfb-sconn/JpegEncoder.h"
 #include "rfb-sconn/EncoderStore.h"
 #include "rfb-sconn/RfbCodeRegistrator.h"
+#include "rfb-sconn/SharedPixelConverter.h"
 #include "util/DateTime.h"
 #include "CursorUpdates.h"
+#include "CongestionWindow.h"
+#include "LinkEstimator.h"
+#include "RegionCoarsener.h"
+#include "RefinementTracker.h"
 #include "SenderControlInformationInterface.h"
 
 class UpdateSender : public Thread, public RfbDispatcherListener
@@ -47,12 +52,17 @@ class UpdateSender : public Thread, public RfbDispatcherListener
 public:
   // updReqListener - pointer to the out listener for retranslate
   // update reqest to out.
+  // rectCache - cache of encoded rectangles shared by all clients (may be 0).
+  // convertedFbStore - pixels converted to client pixel formats, shared by
+  // all clients (may be 0).
   // FIXME: Document all the arguments properly.
   UpdateSender(RfbCodeRegistrator *codeRegtor,
                UpdateRequestListener *updReqListener,
                SenderControlInformationInterface *senderControlInformation,
                RfbOutputGate *output,
-               int id, Desktop *desktop, LogWriter *log);
+               int id, Desktop *desktop,
+               EncodedRectCache *rectCache,
+               ConvertedFrameBufferStore *convertedFbStore, LogWriter *log);
   virtual ~UpdateSender();
 
   // The sendServerInit() function sends first rfb init message to a client
@@ -76,6 +86,8 @@ public:
 
   // Check requsted regions to determine if the client is ready.
   // Return true if the client is ready, false otherwise.
+  // In the continuous updates mode the client is always ready unless the
+  // congestion window is full.
   bool clientIsReady();
 
 protected:
@@ -89,6 +101,11 @@ protected:
   void readSetPixelFormat(RfbInputGate *io);
   void readSetEncodings(RfbInputGate *io);
   void readVideoFreeze(RfbInputGate *io);
+  void readEnableContinuousUpdates(RfbInputGate *io);
+  void readFence(RfbInputGate *io);
+
+  // Processes the client answer to a ping sent by sendPing().
+  void onPong(UINT32 pingId);
 
   // The addUpdateContainer() function adds all updates from the first
   // updateContainer parameter to the own UpdateContainer object.
@@ -120,6 +137,9 @@ protected:
                          bool *incrUpdIsReq,
                          bool *fullUpdIsReq,
                          DateTime *reqTimePoint);
+  // Gets the region to be updated in the continuous updates mode.
+  // Returns false if the mode is disabled or the congestion window is full.
+  bool getContinuousRegion(Region *contReg);
   void extractUpdates(UpdateContainer *updCont);
   void cropUpdContForReqRegions(UpdateContainer *updCont,
                                 const Region *incrReqReg,
@@ -128,8 +148,14 @@ protected:
                                        const Region *requestRegion);
 
   void selectEncoder(EncodeOptions *encodeOptions);
-
-  // Updates pixels in the internal frame buffer.
+  // Writes statistics of the Tight encoder subencodings to the log.
+  void logEncoderStatistics();
+  // Overrides compression and JPEG quality levels in encodeOptions and
+  // decides on video handling according to the link estimates.
+  void applyAutoEncodingTuning(EncodeOptions *encodeOptions,
+                               unsigned int targetLatency);
+
+  // Updates the frame buffer snapshot.
   void updateFrameBuffer(UpdateContainer *updCont,
                          bool shareOnlyApp, const Region *prevSharedRegion,
                          const Region *shareAppRegion);
@@ -158,16 +184,120 @@ protected:
   void sendCursorShapeUpdate(const PixelFormat *fmt,
                              const CursorShape *cursorShape);
   void sendCursorPosUpdate();
-  void sendCopyRect(const std::vector<Rect> *rects, const Point *source);
+  // Sends CopyRect rectangles, each one with its own source point.
+  void sendCopyRect(const std::vector<Rect> *rects,
+                    const std::vector<Point> *sources);
+
+  // Writers of the FramebufferUpdate message parts. sendPseudoRects() sends
+  // cursor pseudo-rectangles and CopyRect rectangles which must precede
+  // normal rectangles.
+  void sendFbUpdateHeader(UINT16 numRects);
+  void sendPseudoRects(const UpdateContainer *updCont,
+                       const std::vector<Rect> *copyRects,
+                       const std::vector<Point> *copySources,
+                       const CursorShape *cursorShape,
+                       const PixelFormat *clientPixelFormat);
+
+  // A part of an update region with the frame buffer its pixels are taken
+  // from. The snapshot gives most of the pixels, the cursor image and black
+  // areas out of a shared application are sent from their own frame buffers.
+  struct RegionSource
+  {
+    Region region;
+    const FrameBuffer *frameBuffer;
+  };
+  typedef std::vector<RegionSource> RegionSources;
+
+  // Splits the region into the parts to be sent from frameBuffer, from the
+  // cursor patch (may be 0) and from blackFb (may be 0, then blackRegion is
+  // ignored). Black areas override the cursor. Empty parts are omitted.
+  void getRegionSources(const Region *region,
+                        const FrameBuffer *frameBuffer,
+                        const PatchFrameBuffer *cursorPatch,
+                        const Region *blackRegion,
+                        const FrameBuffer *blackFb,
+                        RegionSources *sources);
+
+  // Sends an update with the number of rectangles in the message header, so
+  // all rectangles are split before sending. If the number does not fit in
+  // the header, the rest of rectangles goes in additional messages.
+  void sendCountedUpdate(const UpdateContainer *updCont,
+                         const std::vector<Rect> *copyRects,
+                         const std::vector<Point> *copySources,
+                         const CursorShape *cursorShape,
+                         const PixelFormat *clientPixelFormat,
+                         const RegionSources *videoSources,
+                         const RegionSources *changedSources,
+                         const EncodeOptions *encodeOptions,
+                         const DateTime *reqTimePoint);
+  // Sends an update terminated by the LastRect pseudo-rectangle. Rectangles
+  // are split, encoded and flushed in batches, so the client receives the
+  // first ones while the rest are being encoded.
+  void sendStreamedUpdate(const UpdateContainer *updCont,
+                          const std::vector<Rect> *copyRects,
+                          const std::vector<Point> *copySources,
+                          const CursorShape *cursorShape,
+                          const PixelFormat *clientPixelFormat,
+                          const RegionSources *videoSources,
+                          const RegionSources *changedSources,
+                          const EncodeOptions *encodeOptions,
+                          const DateTime *reqTimePoint);
+
+  // Message writers for continuous updates and flow control. The output
+  // gate must be locked by the caller.
+  void sendEndOfContinuousUpdates();
+  void sendFence(UINT32 flags, const UINT8 *payload, UINT8 length);
+  // Sends a Fence request to be echoed by the client and registers it in
+  // the congestion window.
+  void sendPing();
+
+  // Returns true if the client has not yet received enough of sent data.
+  bool isCongested();
+
+  // Makes the desktop and the sender thread provide updates for the
+  // continuous updates area, as if the client requested it.
+  void requestContinuousUpdates(const Rect *rect);
+  // Wakes the sender thread up if there are stored updates in the
+  // waitingRegion and tells the listener about the requested rectangle.
+  void notifyUpdateRequest(const Region *waitingRegion, const Rect *reqRect,
+                           bool incremental);
 
   // Encode and send a list of rectangles via the specified encoder.
   void sendRectangles(Encoder *encoder,
                       const std::vector<Rect> *rects,
                       const FrameBuffer *frameBuffer,
                       const EncodeOptions *encodeOptions);
+  // Sends the rectangles from first to last (exclusive), each one from the
+  // frame buffer at the same index in frameBuffers.
+  void sendRectangles(Encoder *encoder,
+                      const std::vector<Rect> *rects,
+                      const std::vector<const FrameBuffer *> *frameBuffers,
+                      size_t first, size_t last,
+                      const EncodeOptions *encodeOptions);
 
-  // This function paints black region in framebuffer.
-  void paintBlack(FrameBuffer *frameBuffer, const Region *blackRegion);
+  // Merges nearby rectangles of the changed region when sending the extra
+  // pixels costs less than sending separate rectangles with the current
+  // encoder. Rectangles are never extended into the excluded region.
+  void coarsenRegion(Region *changedRegion,
+                     const Region *excludedRegion,
+                     const EncodeOptions *encodeOptions);
+
+  // Moves to refinedRegion the lossy areas within bounds which have not
+  // changed for idleTime milliseconds, as much as the link can carry in
+  // about REFINEMENT_SLICE milliseconds.
+  void takeRefinement(Region *refinedRegion, const Region *bounds,
+                      const PixelFormat *clientPixelFormat,
+                      unsigned int idleTime);
+  // Registers an update in m_refinement, with the lossy rectangles reported
+  // by the Tight encoder.
+  void trackLossyAreas(const std::vector<Rect> *copyRects,
+                       const std::vector<Point> *copySources,
+                       const Region *videoRegion,
+                       const Region *changedRegion,
+                       unsigned int refinementDelay);
+  // Returns the time the sender thread may sleep without missing a lossless
+  // refinement, INFINITE if there is nothing to refine.
+  DWORD getRefinementWaitTime();
 
   // This function is used to split a region into a list of rectangles,
   // where actual splitting is performed by the specified encoder object.
@@ -179,6 +309,48 @@ protected:
                    const FrameBuffer *frameBuffer,
                    const EncodeOptions *encodeOptions);
 
+  // Splits the region and sends the rectangles by batches covering about
+  // STREAMING_BATCH_AREA pixels each, flushing the output after each batch
+  // except the last one. numRects is the number of rectangles sent in the
+  // current message so far.
+  void sendRegionInBatches(Encoder *encoder,
+                           const Region *region,
+                           const FrameBuffer *frameBuffer,
+                           const EncodeOptions *encodeOptions,
+                           size_t *numRects);
+  // Sends a batch of rectangles in the LastRect mode. When the current
+  // message cannot take more rectangles, terminates it and continues in an
+  // additional message.
+  void sendStreamedBatch(Encoder *encoder,
+                         const std::vector<Rect> *batch,
+                         const FrameBuffer *frameBuffer,
+                         const EncodeOptions *encodeOptions,
+                         size_t *numRects);
+
+  // Maximum number of rectangles in a FramebufferUpdate message header.
+  static const size_t MAX_RECTS_PER_UPDATE = 65535;
+  // Number of rectangles in the header of an update terminated by the
+  // LastRect pseudo-rectangle. Viewers still read at most that many
+  // rectangles, the LastRect one included, so a message may have at most
+  // MAX_STREAMED_RECTS other ones.
+  static const UINT16 LAST_RECT_NUM_RECTS = 0xFFFF;
+  static const size_t MAX_STREAMED_RECTS = LAST_RECT_NUM_RECTS - 1;
+  // Area in pixels of the rectangles encoded between output flushes in the
+  // LastRect mode. Batches should be big enough to keep all encoder threads
+  // busy.
+  static const size_t STREAMING_BATCH_AREA = 512 * 1024;
+  // Share of the link time (in milliseconds) one lossless refinement may
+  // take, and the refinement areas (in pixels) used when the bandwidth is
+  // unknown and at least.
+  static const unsigned int REFINEMENT_SLICE = 50;
+  static const int DEFAULT_REFINEMENT_AREA = 256 * 256;
+  static const int MIN_REFINEMENT_AREA = 64 * 64;
+  static const int MAX_REFINEMENT_AREA = 4096 * 4096;
+  // While a refinement is due, the sender thread checks for update requests
+  // at this interval (in milliseconds), since requests coming when there is
+  // nothing else to send do not wake it up.
+  static const unsigned int REFINEMENT_POLL_INTERVAL = 100;
+
   LogWriter *m_log;
 
   WindowsEvent m_newUpdatesEvent;
@@ -191,8 +363,38 @@ protected:
   bool m_busy;
   // Property for perfomance measurements. It uses with the regions mutex.
   DateTime m_requestTimePoint;
+  // Continuous updates mode (enabled by the EnableContinuousUpdates message)
+  // sends changes in m_continuousRect without waiting for update requests.
+  // These members are protected by m_reqRectLocMut too.
+  bool m_continuousUpdates;
+  Rect m_continuousRect;
   LocalMutex m_reqRectLocMut;
 
+  // Flow control for the continuous updates mode, the window is measured by
+  // Fence messages sent after each update.
+  CongestionWindow m_congestion;
+  LocalMutex m_congestionLocMut;
+
+  // Support of Fence and continuous updates is announced to the client only
+  // once, on the first SetEncodings message listing them. These flags are
+  // used only by the dispatcher thread.
+  bool m_fenceAnnounced;
+  bool m_continuousUpdatesAnnounced;
+
+  // Bandwidth and latency estimates for the automatic encoding tuning.
+  LinkEstimator m_linkEstimator;
+
+  // Merges slivers of the changed region before it is split for encoding.
+  // It should be used only by the sender thread.
+  RegionCoarsener m_regionCoarsener;
+  // If true, video regions are sent as normal updates instead of JPEG
+  // (a fast link is detected by the automatic encoding tuning). Used only
+  // by the sender thread.
+  bool m_losslessVideo;
+  // Areas the client has received with lossy compression, to be refreshed
+  // losslessly when they stop changing. Used only by the sender thread.
+  RefinementTracker m_refinement;
+
   SenderControlInformationInterface *m_senderControlInformation;
 
   Rect m_viewPort;
@@ -205,7 +407,10 @@ protected:
 
   UpdateKeeper *m_updateKeeper;
 
-  FrameBuffer m_frameBuffer;
+  // Pixels of the desktop, usually shared with other clients. The frame
+  // buffer is held only while an update is being sent. It should be used
+  // only by the sender thread.
+  FrameBufferSnapshot m_snapshot;
   Desktop *m_desktop;
 
   CursorUpdates m_cursorUpdates;
@@ -245,8 +450,10 @@ protected:
   RfbOutputGate *m_output;
 
   // PixelConverter can convert from one pixel format to another using fast
-  // table lookups. It should be used only in the sender thread.
-  PixelConverter m_pixelConverter;
+  // table lookups. Pixels of m_snapshot are converted only once for all
+  // clients with the same pixel format. It should be configured only in the
+  // sender thread.
+  SharedPixelConverter m_pixelConverter;
 
   // All encoders are encapsulated in EncoderStore. It allocates new encoders
   // on request and maintains a pointer to the preferred encoder. This object
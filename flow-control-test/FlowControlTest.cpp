@@ -0,0 +1,319 @@
+// Copyright (C) 2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#include "FlowControlTest.h"
+#include "SimulatedCongestionWindow.h"
+#include "SimulatedLinkEstimator.h"
+#include "SimulatedLink.h"
+#include "SimulatedOutputStream.h"
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+
+const double FlowControlTest::MIN_UTILIZATION = 0.6;
+const double FlowControlTest::MAX_BANDWIDTH_ERROR = 0.25;
+
+FlowControlTest::FlowControlTest()
+: m_now(0)
+{
+}
+
+FlowControlTest::~FlowControlTest()
+{
+}
+
+int FlowControlTest::run()
+{
+  // The updates take longer on the link than the preparation, so the link
+  // is the bottleneck. On the WAN and mobile links an update takes longer
+  // than the round trip, so the window holds one update at most and the
+  // link idles while its ping returns. The compressed updates for the
+  // mobile link fit in the socket buffer.
+  static const Link links[] = {
+    { _T("LAN"), 12500, 1, 200000, 0, 0, true },
+    { _T("DSL"), 1250, 40, 100000, 1, 5, true },
+    { _T("WAN"), 625, 150, 100000, LinkEstimator::MAX_LEVEL,
+      LinkEstimator::MAX_LEVEL, true },
+    { _T("Mobile"), 125, 300, 50000, LinkEstimator::MAX_LEVEL,
+      LinkEstimator::MAX_LEVEL, false }
+  };
+  static const size_t linkCount = sizeof(links) / sizeof(links[0]);
+
+  int failures = 0;
+  for (size_t i = 0; i < linkCount; i++) {
+    failures += testLink(&links[i], 1) ? 0 : 1;
+    // The system time read by DateTime::now() advances in ticks of about
+    // 16 ms.
+    failures += testLink(&links[i], 16) ? 0 : 1;
+  }
+  failures += testNoWindow(&links[1]) ? 0 : 1;
+  for (size_t i = 0; i < linkCount; i++) {
+    failures += testEstimator(&links[i]) ? 0 : 1;
+  }
+  failures += testUnknownPongs() ? 0 : 1;
+  failures += testWrappedIds() ? 0 : 1;
+  return failures;
+}
+
+bool FlowControlTest::testLink(const Link *link, unsigned int clockTick)
+{
+  Result result;
+  simulate(link, clockTick, BIG_SOCKET_BUFFER, true, false, &result);
+
+  unsigned int maxQueueDelay = getMaxQueueDelay(link);
+  if (result.maxQueueDelay > maxQueueDelay) {
+    _tprintf(_T("%s, %u ms clock: FAILED, queue delay %u ms exceeds %u ms\n"),
+             link->name, clockTick, result.maxQueueDelay, maxQueueDelay);
+    return false;
+  }
+  if (result.utilization < MIN_UTILIZATION) {
+    _tprintf(_T("%s, %u ms clock: FAILED, utilization %.2f is below %.2f\n"),
+             link->name, clockTick, result.utilization, MIN_UTILIZATION);
+    return false;
+  }
+  _tprintf(_T("%s, %u ms clock: passed, utilization %.2f, ")
+           _T("queue delay %u ms (at most %u ms)\n"),
+           link->name, clockTick, result.utilization, result.maxQueueDelay,
+           maxQueueDelay);
+  return true;
+}
+
+bool FlowControlTest::testNoWindow(const Link *link)
+{
+  Result result;
+  simulate(link, 1, BIG_SOCKET_BUFFER, false, false, &result);
+
+  unsigned int maxQueueDelay = getMaxQueueDelay(link);
+  if (result.maxQueueDelay <= maxQueueDelay) {
+    _tprintf(_T("%s without window: FAILED, queue delay %u ms is within ")
+             _T("%u ms\n"), link->name, result.maxQueueDelay, maxQueueDelay);
+    return false;
+  }
+  _tprintf(_T("%s without window: passed, queue delay %u ms\n"),
+           link->name, result.maxQueueDelay);
+  return true;
+}
+
+bool FlowControlTest::testEstimator(const Link *link)
+{
+  Result result;
+  simulate(link, 16, SOCKET_BUFFER, true, true, &result);
+
+  unsigned int bandwidth = link->bandwidth * 1000;
+  double error = fabs((double)result.bandwidth - bandwidth) / bandwidth;
+  if (!link->writesBlock) {
+    // An unknown bandwidth is taken for a high one, which does not hurt
+    // as long as the level follows the latency.
+    if (result.bandwidth != 0) {
+      _tprintf(_T("%s estimator: FAILED, bandwidth %u bytes/s instead of ")
+               _T("unknown\n"), link->name, result.bandwidth);
+      return false;
+    }
+  } else if (error > MAX_BANDWIDTH_ERROR) {
+    _tprintf(_T("%s estimator: FAILED, bandwidth %u bytes/s instead of %u\n"),
+             link->name, result.bandwidth, bandwidth);
+    return false;
+  }
+  if (result.level < link->minLevel || result.level > link->maxLevel) {
+    _tprintf(_T("%s estimator: FAILED, level %d is out of %d..%d\n"),
+             link->name, result.level, link->minLevel, link->maxLevel);
+    return false;
+  }
+  _tprintf(_T("%s estimator: passed, bandwidth %u bytes/s (link %u), ")
+           _T("level %d\n"), link->name, result.bandwidth, bandwidth,
+           result.level);
+  return true;
+}
+
+bool FlowControlTest::testUnknownPongs()
+{
+  SimulatedCongestionWindow window(&m_now, 1);
+  if (window.gotPong(0)) {
+    _tprintf(_T("Unknown pongs: FAILED, a pong is accepted before pings\n"));
+    return false;
+  }
+  for (UINT32 i = 0; i < 3; i++) {
+    window.sentPing((i + 1) * 100000);
+  }
+  if (window.gotPong(3) || window.gotPong(0xFFFFFFFF)) {
+    _tprintf(_T("Unknown pongs: FAILED, a pong of no ping is accepted\n"));
+    return false;
+  }
+  if (window.getLastRtt() != 0) {
+    _tprintf(_T("Unknown pongs: FAILED, an unknown pong is measured\n"));
+    return false;
+  }
+  m_now += 10000;
+  if (!window.gotPong(1)) {
+    _tprintf(_T("Unknown pongs: FAILED, a pong of a ping is rejected\n"));
+    return false;
+  }
+  // Pings are answered in order, so the first one is lost.
+  if (window.gotPong(0)) {
+    _tprintf(_T("Unknown pongs: FAILED, a pong of a skipped ping is ")
+             _T("accepted\n"));
+    return false;
+  }
+  if (!window.gotPong(2) || window.isCongested()) {
+    _tprintf(_T("Unknown pongs: FAILED, the last ping is not answered\n"));
+    return false;
+  }
+  // A client that does not answer makes the window forget old pings.
+  UINT32 firstId = 0;
+  UINT32 lastId = 0;
+  for (UINT32 i = 0; i < 1000; i++) {
+    lastId = window.sentPing((i + 4) * 100000);
+    if (i == 0) {
+      firstId = lastId;
+    }
+  }
+  if (window.gotPong(firstId)) {
+    _tprintf(_T("Unknown pongs: FAILED, a pong of a forgotten ping is ")
+             _T("accepted\n"));
+    return false;
+  }
+  if (!window.gotPong(lastId)) {
+    _tprintf(_T("Unknown pongs: FAILED, a pong of the last ping is ")
+             _T("rejected\n"));
+    return false;
+  }
+  _tprintf(_T("Unknown pongs: passed\n"));
+  return true;
+}
+
+bool FlowControlTest::testWrappedIds()
+{
+  SimulatedCongestionWindow window(&m_now, 1);
+  window.setNextPingId(0xFFFFFFFE);
+  UINT32 lastId = 0;
+  for (UINT32 i = 0; i < 4; i++) {
+    lastId = window.sentPing((i + 1) * 100000);
+  }
+  if (lastId != 1) {
+    _tprintf(_T("Wrapped ids: FAILED, the last id is %u instead of 1\n"),
+             lastId);
+    return false;
+  }
+  m_now += 10000;
+  if (!window.gotPong(0)) {
+    _tprintf(_T("Wrapped ids: FAILED, a pong after the wrap-around is ")
+             _T("rejected\n"));
+    return false;
+  }
+  if (window.gotPong(0xFFFFFFFF)) {
+    _tprintf(_T("Wrapped ids: FAILED, a pong of a skipped ping is ")
+             _T("accepted\n"));
+    return false;
+  }
+  if (window.gotPong(2)) {
+    _tprintf(_T("Wrapped ids: FAILED, a pong of no ping is accepted\n"));
+    return false;
+  }
+  if (!window.gotPong(1) || window.isCongested()) {
+    _tprintf(_T("Wrapped ids: FAILED, the last ping is not answered\n"));
+    return false;
+  }
+  _tprintf(_T("Wrapped ids: passed\n"));
+  return true;
+}
+
+void FlowControlTest::simulate(const Link *link, unsigned int clockTick,
+                               size_t socketBuffer, bool useWindow,
+                               bool tuneLevel, Result *result)
+{
+  m_now = 1000000000;
+  SimulatedCongestionWindow window(&m_now, clockTick);
+  SimulatedLinkEstimator estimator(&m_now, clockTick);
+  SimulatedLink network(&m_now, link->bandwidth, link->rtt, socketBuffer,
+                        &window, &estimator);
+  SimulatedOutputStream output(&network, &m_now);
+  std::vector<char> rect(RECT_SIZE);
+
+  UINT64 measureStart = m_now + (UINT64)WARM_UP_TIME * 1000;
+  UINT64 measureEnd = measureStart + (UINT64)MEASURE_TIME * 1000;
+  bool measuring = false;
+  UINT64 measuredFrom = 0;
+  int level = 0;
+  result->maxQueueDelay = 0;
+
+  while (m_now < measureEnd) {
+    if (!measuring && m_now >= measureStart) {
+      measuring = true;
+      measureStart = m_now;
+      measuredFrom = network.getSentBytes();
+    }
+    if (useWindow && window.isCongested()) {
+      network.step();
+      continue;
+    }
+
+    // The send time is measured with the coarse clock, as in UpdateSender.
+    UINT64 startTime = m_now / 1000 / clockTick * clockTick;
+    unsigned int updateSize = link->updateSize;
+    unsigned int prepareTime = PREPARE_TIME;
+    if (tuneLevel) {
+      level = estimator.getLevel(TARGET_LATENCY);
+      updateSize = updateSize * (LEVEL_COUNT - level) / LEVEL_COUNT;
+      prepareTime += LEVEL_PREPARE_TIME * level;
+    }
+    UINT64 prepareEnd = m_now + prepareTime * 1000;
+    while (m_now < prepareEnd) {
+      network.step();
+    }
+
+    UINT64 startBlockedBytes = output.getBlockedBytes();
+    UINT64 startBlockedTime = output.getBlockedTime();
+    for (unsigned int offset = 0; offset < updateSize; offset += RECT_SIZE) {
+      output.write(&rect.front(), min(RECT_SIZE, updateSize - offset));
+    }
+    UINT32 pingId = window.sentPing(output.getBytesWritten() + PING_SIZE);
+    output.write(&rect.front(), PING_SIZE);
+    output.flush();
+    network.sendPing(pingId);
+
+    UINT64 endTime = m_now / 1000 / clockTick * clockTick;
+    estimator.onUpdateSent(updateSize + PING_SIZE,
+                           (unsigned int)(endTime - startTime),
+                           output.getBlockedBytes() - startBlockedBytes,
+                           output.getBlockedTime() - startBlockedTime);
+    if (measuring) {
+      UINT64 queued = network.getWrittenBytes() - network.getSentBytes();
+      unsigned int queueDelay = (unsigned int)(queued / link->bandwidth);
+      result->maxQueueDelay = max(result->maxQueueDelay, queueDelay);
+    }
+  }
+  result->utilization = (double)(network.getSentBytes() - measuredFrom) *
+                        1000 / link->bandwidth / (m_now - measureStart);
+  result->bandwidth = estimator.getBandwidth();
+  result->level = level;
+}
+
+unsigned int FlowControlTest::getMaxQueueDelay(const Link *link) const
+{
+  // An update is written whole when the window has room, so the queue may
+  // exceed the window by one update. The window itself is measured with
+  // an update in flight, so it holds at least one more.
+  return 2 * link->updateSize / link->bandwidth + MAX_EXTRA_DELAY;
+}
@@ -0,0 +1,132 @@
+// Copyright (C) 2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#pragma once
+
+#include "util/CommonHeader.h"
+
+// Runs the flow control of the update sender on simulated links. The
+// sender prepares framebuffer updates and writes each one followed by a
+// ping while the congestion window allows, and the link estimator measures
+// the link with the blocked writes and the pongs. Time is simulated, so
+// the cases take no real time and give the same results on each run.
+class FlowControlTest
+{
+public:
+  FlowControlTest();
+  virtual ~FlowControlTest();
+
+  // Runs all the cases and prints the results. Returns the number of the
+  // failed cases.
+  int run();
+
+private:
+  struct Link
+  {
+    const TCHAR *name;
+    // Bytes per millisecond.
+    unsigned int bandwidth;
+    // Round-trip propagation time in milliseconds.
+    unsigned int rtt;
+    // Size of each update in bytes, without compression for the level.
+    unsigned int updateSize;
+    // Range of the levels the estimator is expected to choose.
+    int minLevel;
+    int maxLevel;
+    // False if the window keeps the queue shorter than the socket buffer,
+    // so that the writes never block and the bandwidth stays unknown.
+    bool writesBlock;
+  };
+
+  struct Result
+  {
+    // The data sent over the link during the measurement divided by the
+    // data it could send.
+    double utilization;
+    // The longest time a ping waited in the queue before the link, in
+    // milliseconds.
+    unsigned int maxQueueDelay;
+    // The bandwidth and the level from the link estimator at the end.
+    unsigned int bandwidth;
+    int level;
+  };
+
+  // Runs the sender with the window and checks the queue delay and the
+  // utilization of the link. The clock the window sees advances in ticks
+  // of clockTick milliseconds.
+  bool testLink(const Link *link, unsigned int clockTick);
+  // Runs the sender ignoring the window and checks that the queue delay
+  // exceeds the bound then, so that the bound means something.
+  bool testNoWindow(const Link *link);
+  // Runs the sender with the level chosen by the link estimator and checks
+  // the estimated bandwidth and the level.
+  bool testEstimator(const Link *link);
+  // Checks that pongs of unknown, forgotten and skipped pings are ignored.
+  bool testUnknownPongs();
+  // Checks the pongs around the wrap-around of the ping identifiers.
+  bool testWrappedIds();
+
+  // Runs the sender on the link. If tuneLevel is true, the updates are
+  // compressed with the level chosen by the link estimator, otherwise all
+  // of them are of the link update size.
+  void simulate(const Link *link, unsigned int clockTick,
+                size_t socketBuffer, bool useWindow, bool tuneLevel,
+                Result *result);
+  // Returns the queue delay allowed on the link.
+  unsigned int getMaxQueueDelay(const Link *link) const;
+
+  // Preparation time of an update in milliseconds, short enough for the
+  // sender to keep every link busy. With the level tuning, each level adds
+  // LEVEL_PREPARE_TIME to the preparation and takes a LEVEL_COUNT-th of
+  // the update size away.
+  static const unsigned int PREPARE_TIME = 10;
+  static const unsigned int LEVEL_PREPARE_TIME = 4;
+  static const unsigned int LEVEL_COUNT = 12;
+  // The update latency the level tuning keeps, as the default
+  // TargetUpdateLatency of the server.
+  static const unsigned int TARGET_LATENCY = 100;
+  // Updates are written in rectangles of this size.
+  static const unsigned int RECT_SIZE = 16384;
+  // The socket buffer for the window cases is big, as with the buffer
+  // auto-tuning of the modern systems, so only the window limits the
+  // queue. The estimator cases need the writes to block.
+  static const size_t BIG_SOCKET_BUFFER = 4 * 1024 * 1024;
+  static const size_t SOCKET_BUFFER = 65536;
+  // Size of the Fence message carrying a ping.
+  static const unsigned int PING_SIZE = 13;
+  // Times in milliseconds.
+  static const unsigned int WARM_UP_TIME = 10000;
+  static const unsigned int MEASURE_TIME = 30000;
+  // The queue delay allowed over the time two updates take on the link.
+  // The window lets the data wait up to 50 ms more than the base round
+  // trip before it shrinks, the rest is a margin for the clock ticks.
+  static const unsigned int MAX_EXTRA_DELAY = 100;
+  static const double MIN_UTILIZATION;
+  // The allowed error of the estimated bandwidth.
+  static const double MAX_BANDWIDTH_ERROR;
+
+  // The simulated time in microseconds.
+  UINT64 m_now;
+};
@@ -0,0 +1,108 @@
+// Copyright (C) 2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#include "SimulatedLink.h"
+
+SimulatedLink::SimulatedLink(UINT64 *now, unsigned int bandwidth,
+                             unsigned int rtt, size_t socketBuffer,
+                             CongestionWindow *window,
+                             LinkEstimator *estimator)
+: m_now(now),
+  m_bandwidth(bandwidth),
+  m_oneWayDelay(rtt * 1000 / 2),
+  m_socketBuffer(socketBuffer),
+  m_window(window),
+  m_estimator(estimator),
+  m_written(0),
+  m_sent(0),
+  m_received(0),
+  m_credit(0)
+{
+}
+
+SimulatedLink::~SimulatedLink()
+{
+}
+
+size_t SimulatedLink::write(const void *buffer, size_t len)
+{
+  while (m_written - m_sent >= m_socketBuffer) {
+    step();
+  }
+  size_t chunk = min(len, m_socketBuffer - (size_t)(m_written - m_sent));
+  m_written += chunk;
+  return chunk;
+}
+
+void SimulatedLink::step()
+{
+  *m_now += STEP;
+
+  // The capacity of an idle link is not saved for later.
+  UINT64 stepCredit = (UINT64)m_bandwidth * STEP;
+  m_credit += stepCredit;
+  UINT64 sent = min(m_written - m_sent, m_credit / 1000);
+  m_sent += sent;
+  m_credit -= sent * 1000;
+  if (m_sent == m_written) {
+    m_credit = min(m_credit, stepCredit);
+  }
+  if (sent != 0) {
+    Arrival arrival = { *m_now + m_oneWayDelay, m_sent };
+    m_dataArrivals.push_back(arrival);
+  }
+
+  while (!m_dataArrivals.empty() && m_dataArrivals.front().time <= *m_now) {
+    m_received = m_dataArrivals.front().value;
+    m_dataArrivals.pop_front();
+  }
+  while (!m_pings.empty() && m_pings.front().position <= m_received) {
+    Arrival arrival = { *m_now + m_oneWayDelay, m_pings.front().id };
+    m_pongArrivals.push_back(arrival);
+    m_pings.pop_front();
+  }
+  while (!m_pongArrivals.empty() && m_pongArrivals.front().time <= *m_now) {
+    if (m_window->gotPong((UINT32)m_pongArrivals.front().value)) {
+      m_estimator->onFenceRoundTrip(m_window->getLastRtt());
+    }
+    m_pongArrivals.pop_front();
+  }
+}
+
+void SimulatedLink::sendPing(UINT32 id)
+{
+  Ping ping = { m_written, id };
+  m_pings.push_back(ping);
+}
+
+UINT64 SimulatedLink::getWrittenBytes() const
+{
+  return m_written;
+}
+
+UINT64 SimulatedLink::getSentBytes() const
+{
+  return m_sent;
+}
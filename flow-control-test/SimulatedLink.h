@@ -0,0 +1,99 @@
+// Copyright (C) 2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#pragma once
+
+#include "io-lib/OutputStream.h"
+#include "fb-update-sender/CongestionWindow.h"
+#include "fb-update-sender/LinkEstimator.h"
+#include <deque>
+
+// A network link from the server to the client on a simulated clock. The
+// data written to the link waits in the socket buffer, goes over the link
+// at its bandwidth and arrives at the client after a half of the round
+// trip. The client echoes each ping when the data before it has arrived,
+// and the server passes the pong to the congestion window and the link
+// estimator when it arrives, as UpdateSender::onPong() does.
+// The clock counts microseconds and advances by STEP at a time.
+class SimulatedLink : public OutputStream
+{
+public:
+  // The bandwidth is in bytes per millisecond, the round-trip time is in
+  // milliseconds.
+  SimulatedLink(UINT64 *now, unsigned int bandwidth, unsigned int rtt,
+                size_t socketBuffer, CongestionWindow *window,
+                LinkEstimator *estimator);
+  virtual ~SimulatedLink();
+
+  // Copies the data to the socket buffer. While the buffer is full, the
+  // clock runs as if the call was blocked.
+  virtual size_t write(const void *buffer, size_t len);
+
+  // Advances the clock by one step.
+  void step();
+
+  // Makes the client echo the ping when the data written so far arrives.
+  void sendPing(UINT32 id);
+
+  // Returns the amounts of data written to the socket and sent over the
+  // link.
+  UINT64 getWrittenBytes() const;
+  UINT64 getSentBytes() const;
+
+  static const unsigned int STEP = 10;
+
+private:
+  // Data or a pong arriving at the other end of the link.
+  struct Arrival
+  {
+    UINT64 time;
+    // The stream position up to which the data has arrived, or the ping
+    // identifier.
+    UINT64 value;
+  };
+
+  // A ping not yet echoed by the client.
+  struct Ping
+  {
+    UINT64 position;
+    UINT32 id;
+  };
+
+  UINT64 *m_now;
+  unsigned int m_bandwidth;
+  unsigned int m_oneWayDelay;
+  size_t m_socketBuffer;
+  CongestionWindow *m_window;
+  LinkEstimator *m_estimator;
+
+  UINT64 m_written;
+  UINT64 m_sent;
+  UINT64 m_received;
+  // Bytes the link can send now, multiplied by 1000.
+  UINT64 m_credit;
+  std::deque<Arrival> m_dataArrivals;
+  std::deque<Arrival> m_pongArrivals;
+  std::deque<Ping> m_pings;
+};
@@ -25,8 +25,18 @@
 #include "BufferedOutputStream.h"
 
 BufferedOutputStream::BufferedOutputStream(OutputStream *output)
-: m_dataLength(0)
+: m_dataLength(0),
+  m_bytesWritten(0),
+  m_blockedBytes(0),
+  m_blockedTime(0),
+  m_lastWriteBlocked(false),
+  m_lastWriteEnd(0),
+  m_timerFrequency(0)
 {
+  LARGE_INTEGER frequency;
+  if (QueryPerformanceFrequency(&frequency) != 0) {
+    m_timerFrequency = frequency.QuadPart;
+  }
   m_output = new DataOutputStream(output);
 }
 
@@ -42,10 +52,12 @@ BufferedOutputStream::~BufferedOutputStream()
 
 size_t BufferedOutputStream::write(const void *buffer, size_t len)
 {
+  m_bytesWritten += len;
+
   if (m_dataLength + len >= sizeof(m_buffer)) {
     flush();
 
-    m_output->writeFully(buffer, len);
+    writeThrough(buffer, len);
   } else {
     memcpy(&m_buffer[m_dataLength], buffer, len);
 
@@ -57,7 +69,60 @@ size_t BufferedOutputStream::write(const void *buffer, size_t len)
 
 void BufferedOutputStream::flush()
 {
-  m_output->writeFully(&m_buffer[0], m_dataLength);
+  if (m_dataLength != 0) {
+    writeThrough(&m_buffer[0], m_dataLength);
+  }
 
   m_dataLength = 0;
 }
+
+UINT64 BufferedOutputStream::getBytesWritten() const
+{
+  return m_bytesWritten;
+}
+
+UINT64 BufferedOutputStream::getBlockedBytes() const
+{
+  return m_blockedBytes;
+}
+
+UINT64 BufferedOutputStream::getBlockedTime() const
+{
+  return m_blockedTime;
+}
+
+void BufferedOutputStream::writeThrough(const void *buffer, size_t len)
+{
+  UINT64 start = getCurrentTime();
+
+  m_output->writeFully(buffer, len);
+
+  UINT64 end = getCurrentTime();
+  if (start == 0 || end < start) {
+    m_lastWriteBlocked = false;
+    return;
+  }
+  bool blocked = end - start >= MIN_BLOCKED_TIME;
+  // The first blocked write of a series has filled the free part of the
+  // socket buffer at once, and a write after a pause has found the buffer
+  // partly sent. Both would show the network faster than it is.
+  if (blocked && m_lastWriteBlocked &&
+      start - m_lastWriteEnd < MIN_BLOCKED_TIME) {
+    m_blockedBytes += len;
+    m_blockedTime += end - start;
+  }
+  m_lastWriteBlocked = blocked;
+  m_lastWriteEnd = end;
+}
+
+UINT64 BufferedOutputStream::getCurrentTime() const
+{
+  LARGE_INTEGER counter;
+  if (m_timerFrequency == 0 || QueryPerformanceCounter(&counter) == 0) {
+    return 0;
+  }
+  // Split the conversion so that it does not overflow.
+  UINT64 ticks = (UINT64)counter.QuadPart;
+  UINT64 frequency = (UINT64)m_timerFrequency;
+  return ticks / frequency * 1000000 + ticks % frequency * 1000000 / frequency;
+}
@@ -59,12 +59,55 @@ public:
    */
   void flush() throw(IOException);
 
+  /**
+   * Returns total number of bytes passed to write() since the stream
+   * creation, including data that is still in the inner buffer.
+   */
+  UINT64 getBytesWritten() const;
+
+  /**
+   * getBlockedBytes() and getBlockedTime() return the total amount and the
+   * total time in microseconds of the writes to the real output stream
+   * that waited for the network all the time. Such a write blocks right
+   * after another blocked one, which has left the socket buffer full, so
+   * its bytes divided by its time give the rate of the network.
+   */
+  UINT64 getBlockedBytes() const;
+  UINT64 getBlockedTime() const;
+
 protected:
+  /**
+   * Writes data to the real output stream measuring the write time.
+   */
+  void writeThrough(const void *buffer, size_t len) throw(IOException);
+
+  /**
+   * Returns the current time in microseconds, or zero if the performance
+   * counter is not available. The flow control test overrides it to run
+   * the stream on a simulated clock.
+   */
+  virtual UINT64 getCurrentTime() const;
+
+  /**
+   * Writes shorter than this (in microseconds) have not blocked. Copying
+   * the whole buffer to the socket takes a few microseconds only.
+   */
+  static const UINT64 MIN_BLOCKED_TIME = 100;
+
   DataOutputStream *m_output;
 
   char m_buffer[1400];
 
   size_t m_dataLength;
+
+  UINT64 m_bytesWritten;
+
+  UINT64 m_blockedBytes;
+  UINT64 m_blockedTime;
+  bool m_lastWriteBlocked;
+  UINT64 m_lastWriteEnd;
+  // Performance counter frequency, zero if the counter is not available.
+  INT64 m_timerFrequency;
 };
 
 #endif
@@ -87,3 +87,8 @@ const char *ByteArrayOutputStream::toByteArray() const
 {
   return m_buffer;
 }
+
+void ByteArrayOutputStream::reset()
+{
+  m_size = 0;
+}
@@ -70,6 +70,11 @@ public:
    */
   const char *toByteArray() const;
 
+  /**
+   * Discards all written data. Allocated memory is kept for reuse.
+   */
+  void reset();
+
 protected:
   bool m_ownMemory;
   char *m_buffer;
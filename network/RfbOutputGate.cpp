@@ -44,3 +44,18 @@ void RfbOutputGate::flush()
 {
   m_tunnel->flush();
 }
+
+UINT64 RfbOutputGate::getBytesWritten() const
+{
+  return m_tunnel->getBytesWritten();
+}
+
+UINT64 RfbOutputGate::getBlockedBytes() const
+{
+  return m_tunnel->getBlockedBytes();
+}
+
+UINT64 RfbOutputGate::getBlockedTime() const
+{
+  return m_tunnel->getBlockedTime();
+}
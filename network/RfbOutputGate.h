@@ -59,6 +59,22 @@ public:
    */
   virtual void flush() throw(IOException);
 
+  /**
+   * Returns total number of bytes written to the gate since its creation.
+   * Can be used to track position of sent messages in the output stream.
+   * @remark: gate must be locked by caller.
+   */
+  UINT64 getBytesWritten() const;
+
+  /**
+   * getBlockedBytes() and getBlockedTime() return the total amount and the
+   * total time in microseconds of the writes that waited for the network
+   * all the time, see BufferedOutputStream.
+   * @remark: gate must be locked by caller.
+   */
+  UINT64 getBlockedBytes() const;
+  UINT64 getBlockedTime() const;
+
 private:
   /**
    * Tunnel that adds buffering.
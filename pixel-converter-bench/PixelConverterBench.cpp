@@ -0,0 +1,250 @@
+// Copyright (C) 2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+#include "PixelConverterBench.h"
+#include "util/Exception.h"
+#include <stdio.h>
+
+void PixelConverterBench::TablePixelConverter::setPixelFormats(
+  const PixelFormat *dstPf, const PixelFormat *srcPf)
+{
+  PixelConverter::setPixelFormats(dstPf, srcPf);
+  m_useSse2 = false;
+}
+
+PixelConverterBench::PixelConverterBench(int width, int height,
+                                         int iterations)
+: m_iterations(iterations),
+  m_randomState(1)
+{
+  if (width <= 0 || height <= 0 || iterations <= 0) {
+    throw Exception(_T("The frame size and the number of iterations")
+                    _T(" should be positive"));
+  }
+  // The usual server pixel format.
+  PixelFormat srcPf;
+  srcPf.bitsPerPixel = 32;
+  srcPf.colorDepth = 24;
+  srcPf.redMax = srcPf.greenMax = srcPf.blueMax = 255;
+  srcPf.redShift = 16;
+  srcPf.greenShift = 8;
+  srcPf.blueShift = 0;
+  srcPf.bigEndian = false;
+
+  Dimension dim(width, height);
+  if (!m_srcFb.setProperties(&dim, &srcPf)) {
+    throw Exception(_T("Cannot allocate the source frame buffer"));
+  }
+}
+
+PixelConverterBench::~PixelConverterBench()
+{
+}
+
+int PixelConverterBench::run()
+{
+  PixelFormat rgb565;
+  rgb565.bitsPerPixel = 16;
+  rgb565.colorDepth = 16;
+  rgb565.redMax = 31;
+  rgb565.greenMax = 63;
+  rgb565.blueMax = 31;
+  rgb565.redShift = 11;
+  rgb565.greenShift = 5;
+  rgb565.blueShift = 0;
+
+  PixelFormat rgb555 = rgb565;
+  rgb555.colorDepth = 15;
+  rgb555.greenMax = 31;
+  rgb555.redShift = 10;
+
+  PixelFormat bgr233;
+  bgr233.bitsPerPixel = 8;
+  bgr233.colorDepth = 8;
+  bgr233.redMax = 7;
+  bgr233.greenMax = 7;
+  bgr233.blueMax = 3;
+  bgr233.redShift = 0;
+  bgr233.greenShift = 3;
+  bgr233.blueShift = 6;
+
+  PixelFormat swapped32 = m_srcFb.getPixelFormat();
+  swapped32.bigEndian = !swapped32.bigEndian;
+
+  Dimension dim = m_srcFb.getDimension();
+  _tprintf(_T("Frame %dx%d, %d iterations\n"), dim.width, dim.height,
+           m_iterations);
+
+  int failures = 0;
+  failures += runFormat(_T("RGB565"), &rgb565) ? 0 : 1;
+  failures += runFormat(_T("RGB555"), &rgb555) ? 0 : 1;
+  failures += runFormat(_T("BGR233"), &bgr233) ? 0 : 1;
+  failures += runFormat(_T("32-bit byte swap"), &swapped32) ? 0 : 1;
+  return failures;
+}
+
+bool PixelConverterBench::runFormat(const TCHAR *name,
+                                    const PixelFormat *dstPf)
+{
+  PixelFormat srcPf = m_srcFb.getPixelFormat();
+  if (!PixelConverterSse2::isApplicable(dstPf, &srcPf)) {
+    _tprintf(_T("%s: SSE2 conversion is not available, skipped\n"), name);
+    return true;
+  }
+
+  PixelConverter sse2Conv;
+  sse2Conv.setPixelFormats(dstPf, &srcPf);
+  TablePixelConverter tableConv;
+  tableConv.setPixelFormats(dstPf, &srcPf);
+
+  Dimension dim = m_srcFb.getDimension();
+  FrameBuffer sse2Fb;
+  FrameBuffer tableFb;
+  if (!sse2Fb.setProperties(&dim, dstPf) ||
+      !tableFb.setProperties(&dim, dstPf)) {
+    throw Exception(_T("Cannot allocate the destination frame buffers"));
+  }
+
+  if (!check(&sse2Conv, &sse2Fb, &tableConv, &tableFb)) {
+    _tprintf(_T("%s: MISMATCH\n"), name);
+    reportMismatch(&sse2Fb, &tableFb);
+    return false;
+  }
+
+  double tableTime = measure(&tableConv, &tableFb);
+  double sse2Time = measure(&sse2Conv, &sse2Fb);
+  _tprintf(_T("%s: identical, table %.3f ms, SSE2 %.3f ms, %.2fx\n"),
+           name, tableTime, sse2Time,
+           sse2Time > 0 ? tableTime / sse2Time : 0.0);
+  return true;
+}
+
+bool PixelConverterBench::check(PixelConverter *sse2Conv, FrameBuffer *sse2Fb,
+                                PixelConverter *tableConv,
+                                FrameBuffer *tableFb)
+{
+  Rect frameRect = m_srcFb.getDimension().getRect();
+  size_t bufferSize = sse2Fb->getBufferSize();
+
+  fillRandom(&m_srcFb);
+  sse2Conv->convert(&frameRect, sse2Fb, &m_srcFb);
+  tableConv->convert(&frameRect, tableFb, &m_srcFb);
+  if (memcmp(sse2Fb->getBuffer(), tableFb->getBuffer(), bufferSize) != 0) {
+    return false;
+  }
+
+  // Both destination frames hold the old pixels out of the rectangles, so
+  // the whole frames can be compared at the end.
+  fillRandom(&m_srcFb);
+  int width = frameRect.getWidth();
+  int height = frameRect.getHeight();
+  for (int i = 0; i < CHECK_RECT_COUNT; i++) {
+    int left = nextRandom() % width;
+    int top = nextRandom() % height;
+    int rectWidth = 1 + nextRandom() % min(width - left, 67);
+    int rectHeight = 1 + nextRandom() % min(height - top, 5);
+    Rect rect(left, top, left + rectWidth, top + rectHeight);
+    sse2Conv->convert(&rect, sse2Fb, &m_srcFb);
+    tableConv->convert(&rect, tableFb, &m_srcFb);
+  }
+  return memcmp(sse2Fb->getBuffer(), tableFb->getBuffer(), bufferSize) == 0;
+}
+
+double PixelConverterBench::measure(const PixelConverter *conv,
+                                    FrameBuffer *dstFb)
+{
+  Rect frameRect = m_srcFb.getDimension().getRect();
+  // The first conversion brings the frames to the cache as it happens
+  // after the screen grabbing.
+  conv->convert(&frameRect, dstFb, &m_srcFb);
+
+  INT64 startTime = getTimerValue();
+  for (int i = 0; i < m_iterations; i++) {
+    conv->convert(&frameRect, dstFb, &m_srcFb);
+  }
+  INT64 elapsed = getTimerValue() - startTime;
+  return (double)elapsed * 1000.0 / (double)getTimerFrequency() /
+         (double)m_iterations;
+}
+
+void PixelConverterBench::reportMismatch(const FrameBuffer *sse2Fb,
+                                         const FrameBuffer *tableFb)
+{
+  Dimension dim = sse2Fb->getDimension();
+  size_t pixelSize = sse2Fb->getBytesPerPixel();
+  const UINT8 *srcPixels = (const UINT8 *)m_srcFb.getBuffer();
+  const UINT8 *sse2Pixels = (const UINT8 *)sse2Fb->getBuffer();
+  const UINT8 *tablePixels = (const UINT8 *)tableFb->getBuffer();
+  for (int y = 0; y < dim.height; y++) {
+    for (int x = 0; x < dim.width; x++) {
+      size_t i = (size_t)y * dim.width + x;
+      if (memcmp(sse2Pixels + i * pixelSize, tablePixels + i * pixelSize,
+                 pixelSize) != 0) {
+        UINT32 src, sse2 = 0, table = 0;
+        memcpy(&src, srcPixels + i * 4, 4);
+        memcpy(&sse2, sse2Pixels + i * pixelSize, pixelSize);
+        memcpy(&table, tablePixels + i * pixelSize, pixelSize);
+        _tprintf(_T("  first difference at (%d, %d): source %08X,")
+                 _T(" SSE2 %08X, table %08X\n"),
+                 x, y, (unsigned int)src, (unsigned int)sse2,
+                 (unsigned int)table);
+        return;
+      }
+    }
+  }
+}
+
+void PixelConverterBench::fillRandom(FrameBuffer *fb)
+{
+  UINT32 *pixels = (UINT32 *)fb->getBuffer();
+  size_t count = fb->getBufferSize() / sizeof(UINT32);
+  for (size_t i = 0; i < count; i++) {
+    pixels[i] = nextRandom();
+  }
+}
+
+UINT32 PixelConverterBench::nextRandom()
+{
+  // A fixed generator, so that a mismatch can be reproduced.
+  m_randomState = m_randomState * 1664525 + 1013904223;
+  return m_randomState ^ (m_randomState >> 16);
+}
+
+INT64 PixelConverterBench::getTimerValue()
+{
+  LARGE_INTEGER value;
+  if (QueryPerformanceCounter(&value) == 0) {
+    return 0;
+  }
+  return value.QuadPart;
+}
+
+INT64 PixelConverterBench::getTimerFrequency()
+{
+  LARGE_INTEGER value;
+  if (QueryPerformanceFrequency(&value) == 0 || value.QuadPart == 0) {
+    return 1;
+  }
+  return value.QuadPart;
+}
@@ -0,0 +1,81 @@
+// Copyright (C) 2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+#pragma once
+
+#include "rfb/FrameBuffer.h"
+#include "rfb/PixelConverter.h"
+
+// Cross-checks the SSE2 conversion of PixelConverter with the table-driven
+// one and measures both on a frame of random pixels in the usual server
+// format. The destination formats are RGB565, RGB555, BGR233 and 32-bit
+// pixels with the opposite byte order.
+class PixelConverterBench
+{
+public:
+  PixelConverterBench(int width, int height, int iterations);
+  virtual ~PixelConverterBench();
+
+  // Checks and measures all the formats and prints the results. Returns
+  // the number of formats for which the two conversions gave different
+  // pixels.
+  int run();
+
+private:
+  // PixelConverter which never uses the SSE2 kernel.
+  class TablePixelConverter : public PixelConverter
+  {
+  public:
+    virtual void setPixelFormats(const PixelFormat *dstPf,
+                                 const PixelFormat *srcPf);
+  };
+
+  // Returns false if the conversions differ.
+  bool runFormat(const TCHAR *name, const PixelFormat *dstPf);
+
+  // Converts the whole frame, then rectangles of random size and position
+  // of a new frame, so that the pixels left at the row ends are checked as
+  // well. Returns false if the two destination frames differ.
+  bool check(PixelConverter *sse2Conv, FrameBuffer *sse2Fb,
+             PixelConverter *tableConv, FrameBuffer *tableFb);
+  // Returns the average time of the whole frame conversion in
+  // milliseconds.
+  double measure(const PixelConverter *conv, FrameBuffer *dstFb);
+
+  // Prints the position of the first differing pixel.
+  void reportMismatch(const FrameBuffer *sse2Fb, const FrameBuffer *tableFb);
+
+  void fillRandom(FrameBuffer *fb);
+  UINT32 nextRandom();
+
+  static INT64 getTimerValue();
+  static INT64 getTimerFrequency();
+
+  FrameBuffer m_srcFb;
+  int m_iterations;
+  UINT32 m_randomState;
+
+  // Number of random rectangles converted by check().
+  static const int CHECK_RECT_COUNT = 2000;
+};
@@ -0,0 +1,58 @@
+// Copyright (C) 2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+#include "PixelConverterBench.h"
+#include "util/Exception.h"
+#include <stdio.h>
+
+// Usage: pixel-converter-bench [width height [iterations]]
+// Returns 0 if the SSE2 and the table-driven conversions gave the same
+// pixels for all the formats.
+int _tmain(int argc, TCHAR *argv[])
+{
+  int width = 1920;
+  int height = 1080;
+  int iterations = 100;
+  if (argc != 1 && argc != 3 && argc != 4) {
+    _ftprintf(stderr, _T("Usage: %s [width height [iterations]]\n"), argv[0]);
+    return 1;
+  }
+  if (argc >= 3) {
+    width = _ttoi(argv[1]);
+    height = _ttoi(argv[2]);
+  }
+  if (argc == 4) {
+    iterations = _ttoi(argv[3]);
+  }
+  try {
+    PixelConverterBench bench(width, height, iterations);
+    if (bench.run() != 0) {
+      return 1;
+    }
+  } catch (Exception &e) {
+    _ftprintf(stderr, _T("Error: %s\n"), e.getMessage());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,421 @@
+// Copyright (C) 2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#include "RegionBench.h"
+#include "util/Exception.h"
+#include <stdio.h>
+
+RegionBench::HeapRegion::HeapRegion()
+{
+  miRegionInit(&m_reg, NULL, 0);
+}
+
+RegionBench::HeapRegion::HeapRegion(const HeapRegion &src)
+{
+  miRegionInit(&m_reg, NULL, 0);
+  miRegionCopy(&m_reg, (RegionPtr)&src.m_reg);
+}
+
+RegionBench::HeapRegion::~HeapRegion()
+{
+  miRegionUninit(&m_reg);
+}
+
+RegionBench::HeapRegion &
+RegionBench::HeapRegion::operator=(const HeapRegion &src)
+{
+  if (this != &src) {
+    miRegionCopy(&m_reg, (RegionPtr)&src.m_reg);
+  }
+  return *this;
+}
+
+void RegionBench::HeapRegion::set(const Region *src)
+{
+  std::vector<Rect> rects;
+  src->getRectVector(&rects);
+  miRegionEmpty(&m_reg);
+  for (size_t i = 0; i < rects.size(); i++) {
+    BoxRec box;
+    box.x1 = rects[i].left;
+    box.y1 = rects[i].top;
+    box.x2 = rects[i].right;
+    box.y2 = rects[i].bottom;
+    RegionRec rectReg;
+    miRegionInit(&rectReg, &box, 0);
+    miUnion(&m_reg, &m_reg, &rectReg);
+    miRegionUninit(&rectReg);
+  }
+}
+
+void RegionBench::HeapRegion::get(Region *dst) const
+{
+  std::vector<Rect> rects;
+  long numRects = REGION_NUM_RECTS(&m_reg);
+  const BoxRec *boxes = REGION_RECTS(&m_reg);
+  for (long i = 0; i < numRects; i++) {
+    rects.push_back(Rect(boxes[i].x1, boxes[i].y1, boxes[i].x2,
+                         boxes[i].y2));
+  }
+  dst->setRects(&rects);
+}
+
+void RegionBench::HeapRegion::add(const HeapRegion *other)
+{
+  miUnion(&m_reg, &m_reg, (RegionPtr)&other->m_reg);
+}
+
+void RegionBench::HeapRegion::subtract(const HeapRegion *other)
+{
+  miSubtract(&m_reg, &m_reg, (RegionPtr)&other->m_reg);
+}
+
+void RegionBench::HeapRegion::intersect(const HeapRegion *other)
+{
+  miIntersect(&m_reg, &m_reg, (RegionPtr)&other->m_reg);
+}
+
+void RegionBench::HeapRegion::crop(const Rect *rect)
+{
+  BoxRec box;
+  box.x1 = rect->left;
+  box.y1 = rect->top;
+  box.x2 = rect->right;
+  box.y2 = rect->bottom;
+  RegionRec rectReg;
+  miRegionInit(&rectReg, &box, 0);
+  miIntersect(&m_reg, &m_reg, &rectReg);
+  miRegionUninit(&rectReg);
+}
+
+RegionBench::RegionBench(int width, int height, int iterations)
+: m_frameRect(0, 0, width, height),
+  m_iterations(iterations),
+  m_randomState(1)
+{
+  if (width <= 0 || height <= 0 || iterations <= 0) {
+    throw Exception(_T("The frame size and the number of iterations")
+                    _T(" should be positive"));
+  }
+}
+
+RegionBench::~RegionBench()
+{
+}
+
+int RegionBench::run()
+{
+  _tprintf(_T("Frame %dx%d, %d iterations\n"), m_frameRect.getWidth(),
+           m_frameRect.getHeight(), m_iterations);
+
+  int failures = 0;
+  failures += runTiles(_T("All tiles"), 100) ? 0 : 1;
+  failures += runTiles(_T("25% of tiles"), 25) ? 0 : 1;
+  failures += runTiles(_T("2% of tiles"), 2) ? 0 : 1;
+
+  std::vector<Rect> rects;
+  makeRuns(&rects);
+  failures += runRects(_T("Block runs"), &rects) ? 0 : 1;
+  makeRandomRects(&rects, 500);
+  failures += runRects(_T("Random rects"), &rects) ? 0 : 1;
+
+  // A typing user: a few small rectangles, all of them fit in the embedded
+  // storage of Region.
+  Region frameReg(&m_frameRect);
+  Region empty;
+  Rect caretRect(100, 200, 108, 216);
+  Rect lineRect(40, 216, 600, 232);
+  Rect titleRect(0, 0, m_frameRect.getWidth(), 24);
+  Region changed(&caretRect);
+  changed.addRect(&lineRect);
+  changed.addRect(&titleRect);
+  failures += runOperations(_T("Typing"), &changed, &empty, &frameReg,
+                            &empty) ? 0 : 1;
+
+  // A video player with a few changes around it.
+  Rect videoRect(m_frameRect.getWidth() / 4, m_frameRect.getHeight() / 4,
+                 m_frameRect.getWidth() * 3 / 4,
+                 m_frameRect.getHeight() * 3 / 4);
+  Region video(&videoRect);
+  Rect controlsRect(videoRect.left, videoRect.bottom, videoRect.right,
+                    videoRect.bottom + 40);
+  changed.addRect(&controlsRect);
+  failures += runOperations(_T("Video"), &changed, &video, &frameReg,
+                            &empty) ? 0 : 1;
+
+  // Scattered changes, a part of the frame requested as a full update.
+  makeTiles(&changed, 25);
+  Rect fullReqRect(0, 0, m_frameRect.getWidth() / 2,
+                   m_frameRect.getHeight() / 2);
+  Region fullReq(&fullReqRect);
+  failures += runOperations(_T("Scattered tiles"), &changed, &empty,
+                            &frameReg, &fullReq) ? 0 : 1;
+
+  // Random changes, only a part of the frame requested.
+  makeRandomRects(&rects, 200);
+  changed.setRects(&rects);
+  Rect incrReqRect(0, 0, m_frameRect.getWidth() / 2,
+                   m_frameRect.getHeight());
+  Region incrReq(&incrReqRect);
+  failures += runOperations(_T("Partial request"), &changed, &video,
+                            &incrReq, &empty) ? 0 : 1;
+  return failures;
+}
+
+template <class R>
+void RegionBench::applyOperations(UpdateRegions<R> *regions,
+                                  const Rect *frameRect)
+{
+  // UpdateSender::sendUpdate() works on a copy of the update container.
+  R changed = regions->changed;
+  R video = regions->video;
+
+  changed.add(&regions->prevVideo);
+  video.subtract(&regions->fullReq);
+  changed.subtract(&video);
+  regions->prevVideo = video;
+  changed.add(&regions->fullReq);
+  video.crop(frameRect);
+  changed.crop(frameRect);
+
+  // UpdateSender::cropUpdContForReqRegions().
+  R combinedReq = regions->incrReq;
+  combinedReq.add(&regions->fullReq);
+  R back = changed;
+  back.add(&video);
+  back.subtract(&combinedReq);
+  changed.intersect(&combinedReq);
+  video.intersect(&combinedReq);
+  regions->back = back;
+
+  // The sent region of UpdateSender::trackLossyAreas().
+  R sent = changed;
+  sent.add(&video);
+  regions->sent = sent;
+}
+
+bool RegionBench::runOperations(const TCHAR *name, const Region *changed,
+                                const Region *video, const Region *incrReq,
+                                const Region *fullReq)
+{
+  UpdateRegions<Region> regions;
+  regions.changed = *changed;
+  regions.video = *video;
+  regions.incrReq = *incrReq;
+  regions.fullReq = *fullReq;
+  UpdateRegions<HeapRegion> heapRegions;
+  heapRegions.changed.set(changed);
+  heapRegions.video.set(video);
+  heapRegions.incrReq.set(incrReq);
+  heapRegions.fullReq.set(fullReq);
+
+  INT64 startTime = getTimerValue();
+  for (int i = 0; i < m_iterations * UPDATES_PER_ITERATION; i++) {
+    applyOperations(&regions, &m_frameRect);
+  }
+  double time = toMilliseconds(getTimerValue() - startTime);
+
+  startTime = getTimerValue();
+  for (int i = 0; i < m_iterations * UPDATES_PER_ITERATION; i++) {
+    applyOperations(&heapRegions, &m_frameRect);
+  }
+  double heapTime = toMilliseconds(getTimerValue() - startTime);
+
+  Region heapBack, heapSent, heapPrevVideo;
+  heapRegions.back.get(&heapBack);
+  heapRegions.sent.get(&heapSent);
+  heapRegions.prevVideo.get(&heapPrevVideo);
+  if (!regions.back.equals(&heapBack) || !regions.sent.equals(&heapSent) ||
+      !regions.prevVideo.equals(&heapPrevVideo)) {
+    _tprintf(_T("%s: MISMATCH\n"), name);
+    return false;
+  }
+  // Both times are of UPDATES_PER_ITERATION updates, print them per update
+  // in microseconds.
+  _tprintf(_T("%s: identical, %u changed rects, heap storage %.3f us,")
+           _T(" Region %.3f us, %.2fx\n"),
+           name, (unsigned int)changed->getCount(),
+           heapTime * 1000.0 / UPDATES_PER_ITERATION,
+           time * 1000.0 / UPDATES_PER_ITERATION,
+           time > 0 ? heapTime / time : 0.0);
+  return true;
+}
+
+bool RegionBench::runTiles(const TCHAR *name, int percent)
+{
+  int tilesPerRow = (m_frameRect.getWidth() + TILE_SIZE - 1) / TILE_SIZE;
+  int tilesPerColumn = (m_frameRect.getHeight() + TILE_SIZE - 1) / TILE_SIZE;
+  std::vector<bool> tileMap((size_t)tilesPerRow * tilesPerColumn);
+  std::vector<Rect> tileRects;
+  for (size_t i = 0; i < tileMap.size(); i++) {
+    if ((int)(nextRandom() % 100) < percent) {
+      tileMap[i] = true;
+      int left = (int)(i % tilesPerRow) * TILE_SIZE;
+      int top = (int)(i / tilesPerRow) * TILE_SIZE;
+      Rect tileRect(left, top, left + TILE_SIZE, top + TILE_SIZE);
+      tileRect = tileRect.intersection(&m_frameRect);
+      tileRects.push_back(tileRect);
+    }
+  }
+
+  Region bulkRegion;
+  INT64 startTime = getTimerValue();
+  for (int i = 0; i < m_iterations; i++) {
+    bulkRegion.setTiles(&tileMap, tilesPerRow, TILE_SIZE, TILE_SIZE,
+                        &m_frameRect);
+  }
+  double bulkTime = toMilliseconds(getTimerValue() - startTime);
+
+  Region incrementalRegion;
+  startTime = getTimerValue();
+  for (int i = 0; i < m_iterations; i++) {
+    incrementalRegion.clear();
+    for (size_t j = 0; j < tileRects.size(); j++) {
+      incrementalRegion.addRect(&tileRects[j]);
+    }
+  }
+  double incrementalTime = toMilliseconds(getTimerValue() - startTime);
+
+  if (!bulkRegion.equals(&incrementalRegion)) {
+    _tprintf(_T("%s: MISMATCH\n"), name);
+    return false;
+  }
+  _tprintf(_T("%s: identical, %u rects, addRect %.3f ms,")
+           _T(" setTiles %.3f ms, %.2fx\n"),
+           name, (unsigned int)bulkRegion.getCount(), incrementalTime,
+           bulkTime, bulkTime > 0 ? incrementalTime / bulkTime : 0.0);
+  return true;
+}
+
+bool RegionBench::runRects(const TCHAR *name, const std::vector<Rect> *rects)
+{
+  Region bulkRegion;
+  INT64 startTime = getTimerValue();
+  for (int i = 0; i < m_iterations; i++) {
+    bulkRegion.setRects(rects);
+  }
+  double bulkTime = toMilliseconds(getTimerValue() - startTime);
+
+  Region incrementalRegion;
+  startTime = getTimerValue();
+  for (int i = 0; i < m_iterations; i++) {
+    incrementalRegion.clear();
+    for (size_t j = 0; j < rects->size(); j++) {
+      incrementalRegion.addRect(&(*rects)[j]);
+    }
+  }
+  double incrementalTime = toMilliseconds(getTimerValue() - startTime);
+
+  if (!bulkRegion.equals(&incrementalRegion)) {
+    _tprintf(_T("%s: MISMATCH\n"), name);
+    return false;
+  }
+  _tprintf(_T("%s: identical, %u rects, addRect %.3f ms,")
+           _T(" setRects %.3f ms, %.2fx\n"),
+           name, (unsigned int)bulkRegion.getCount(), incrementalTime,
+           bulkTime, bulkTime > 0 ? incrementalTime / bulkTime : 0.0);
+  return true;
+}
+
+void RegionBench::makeRuns(std::vector<Rect> *rects)
+{
+  rects->clear();
+  int width = m_frameRect.getWidth();
+  int height = m_frameRect.getHeight();
+  // Changed blocks come in horizontal runs, one rectangle per run of each
+  // block row, as in a scrolled or redrawn window.
+  for (int top = 0; top < height; top += BLOCK_SIZE) {
+    int bottom = min(top + BLOCK_SIZE, height);
+    int left = 0;
+    while (left < width) {
+      int gap = (int)(nextRandom() % 8) * BLOCK_SIZE;
+      int length = (1 + (int)(nextRandom() % 8)) * BLOCK_SIZE;
+      left += gap;
+      if (left >= width) {
+        break;
+      }
+      int right = min(left + length, width);
+      rects->push_back(Rect(left, top, right, bottom));
+      left = right + BLOCK_SIZE;
+    }
+  }
+}
+
+void RegionBench::makeRandomRects(std::vector<Rect> *rects, size_t count)
+{
+  rects->clear();
+  int width = m_frameRect.getWidth();
+  int height = m_frameRect.getHeight();
+  for (size_t i = 0; i < count; i++) {
+    int left = nextRandom() % width;
+    int top = nextRandom() % height;
+    int rectWidth = 1 + nextRandom() % min(width - left, 200);
+    int rectHeight = 1 + nextRandom() % min(height - top, 200);
+    rects->push_back(Rect(left, top, left + rectWidth, top + rectHeight));
+  }
+}
+
+void RegionBench::makeTiles(Region *region, int percent)
+{
+  int tilesPerRow = (m_frameRect.getWidth() + TILE_SIZE - 1) / TILE_SIZE;
+  int tilesPerColumn = (m_frameRect.getHeight() + TILE_SIZE - 1) / TILE_SIZE;
+  std::vector<bool> tileMap((size_t)tilesPerRow * tilesPerColumn);
+  for (size_t i = 0; i < tileMap.size(); i++) {
+    tileMap[i] = (int)(nextRandom() % 100) < percent;
+  }
+  region->setTiles(&tileMap, tilesPerRow, TILE_SIZE, TILE_SIZE,
+                   &m_frameRect);
+}
+
+double RegionBench::toMilliseconds(INT64 elapsed) const
+{
+  return (double)elapsed * 1000.0 / (double)getTimerFrequency() /
+         (double)m_iterations;
+}
+
+UINT32 RegionBench::nextRandom()
+{
+  // A fixed generator, so that a mismatch can be reproduced.
+  m_randomState = m_randomState * 1664525 + 1013904223;
+  return m_randomState ^ (m_randomState >> 16);
+}
+
+INT64 RegionBench::getTimerValue()
+{
+  LARGE_INTEGER value;
+  if (QueryPerformanceCounter(&value) == 0) {
+    return 0;
+  }
+  return value.QuadPart;
+}
+
+INT64 RegionBench::getTimerFrequency()
+{
+  LARGE_INTEGER value;
+  if (QueryPerformanceFrequency(&value) == 0 || value.QuadPart == 0) {
+    return 1;
+  }
+  return value.QuadPart;
+}
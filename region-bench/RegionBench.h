@@ -0,0 +1,136 @@
+// Copyright (C) 2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#pragma once
+
+#include "util/CommonHeader.h"
+#include "region/Region.h"
+
+#include <vector>
+
+// Checks that the regions built in one pass by Region::setTiles() and
+// Region::setRects() equal the ones built by adding the rectangles one by
+// one with Region::addRect(), and measures both ways. The change maps are
+// those of the polling scheduler and the block hash detector on a frame of
+// the given size.
+//
+// Also runs the region operations UpdateSender performs for an update on
+// Region and on a bare X11 region which allocates its rectangles on the
+// heap for every result, and checks that both give the same regions.
+class RegionBench
+{
+public:
+  RegionBench(int width, int height, int iterations);
+  virtual ~RegionBench();
+
+  // Checks and measures all the cases and prints the results. Returns the
+  // number of cases for which the regions differ.
+  int run();
+
+private:
+  // A region keeping its rectangles the way Region did before it got the
+  // embedded and the spare storage: every X11 operation allocates the
+  // rectangles of its result on the heap.
+  class HeapRegion
+  {
+  public:
+    HeapRegion();
+    HeapRegion(const HeapRegion &src);
+    virtual ~HeapRegion();
+
+    HeapRegion &operator=(const HeapRegion &src);
+
+    void set(const Region *src);
+    // Replaces dst with the rectangles of this region.
+    void get(Region *dst) const;
+
+    void add(const HeapRegion *other);
+    void subtract(const HeapRegion *other);
+    void intersect(const HeapRegion *other);
+    void crop(const Rect *rect);
+
+  private:
+    RegionRec m_reg;
+  };
+
+  // The regions of an update container and of the client requests, and
+  // the results of the operations.
+  template <class R> struct UpdateRegions
+  {
+    R changed;
+    R video;
+    R incrReq;
+    R fullReq;
+    R prevVideo;
+    R back;
+    R sent;
+  };
+
+  // Performs the region operations of UpdateSender::sendUpdate() and
+  // UpdateSender::cropUpdContForReqRegions() in the same order.
+  template <class R>
+  static void applyOperations(UpdateRegions<R> *regions,
+                              const Rect *frameRect);
+
+  // Runs the operations on both region kinds. Returns false if the
+  // resulting regions differ.
+  bool runOperations(const TCHAR *name, const Region *changed,
+                     const Region *video, const Region *incrReq,
+                     const Region *fullReq);
+
+  // Marks the given percentage of the tiles as changed and builds the
+  // region of the changed tiles. Returns false if the regions differ.
+  bool runTiles(const TCHAR *name, int percent);
+  // Builds the region of the rectangles. Returns false if the regions
+  // differ.
+  bool runRects(const TCHAR *name, const std::vector<Rect> *rects);
+
+  // Makes rows of changed pixel runs as the block hash detector finds them,
+  // sorted by their top coordinates.
+  void makeRuns(std::vector<Rect> *rects);
+  // Makes rectangles of random size and position.
+  void makeRandomRects(std::vector<Rect> *rects, size_t count);
+  // Makes the region of the given percentage of the tiles.
+  void makeTiles(Region *region, int percent);
+
+  // Returns the average time of an iteration in milliseconds.
+  double toMilliseconds(INT64 elapsed) const;
+
+  UINT32 nextRandom();
+
+  static INT64 getTimerValue();
+  static INT64 getTimerFrequency();
+
+  Rect m_frameRect;
+  int m_iterations;
+  UINT32 m_randomState;
+
+  // The tile size of the polling scheduler.
+  static const int TILE_SIZE = 16;
+  // The block size of the block hash detector.
+  static const int BLOCK_SIZE = 32;
+  // Number of updates processed by runOperations() per iteration.
+  static const int UPDATES_PER_ITERATION = 1000;
+};
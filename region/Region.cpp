@@ -24,14 +24,27 @@
 
 #include "Region.h"
 
+#include <string.h>
+
+// True if the box a contains the box b.
+#define BOX_SUBSUMES(a, b) ((a)->x1 <= (b)->x1 && (a)->x2 >= (b)->x2 && \
+                            (a)->y1 <= (b)->y1 && (a)->y2 >= (b)->y2)
+// True if the boxes overlap.
+#define BOX_OVERLAPS(a, b) ((a)->x1 < (b)->x2 && (b)->x1 < (a)->x2 && \
+                            (a)->y1 < (b)->y2 && (b)->y1 < (a)->y2)
+
 Region::Region()
+: m_spare(0)
 {
+  m_embedded.data.embedded = TRUE;
   miRegionInit(&m_reg, NullBox, 0);
 }
 
 // FIXME: Make BoxRec and Rect identical to get rid of conversions.
 Region::Region(const Rect *rect)
+: m_spare(0)
 {
+  m_embedded.data.embedded = TRUE;
   if (!rect->isEmpty()) {
     BoxRec box;
     box.x1 = rect->left;
@@ -45,7 +58,9 @@ Region::Region(const Rect *rect)
 }
 
 Region::Region(const Region &src)
+: m_spare(0)
 {
+  m_embedded.data.embedded = TRUE;
   miRegionInit(&m_reg, NullBox, 0);
   set(&src);
 }
@@ -53,16 +68,39 @@ Region::Region(const Region &src)
 Region::~Region()
 {
   miRegionUninit(&m_reg);
+  if (m_spare != 0) {
+    xfree(m_spare);
+  }
 }
 
 void Region::clear()
 {
-  miRegionEmpty(&m_reg);
+  releaseStorage();
+  m_reg.extents.x2 = m_reg.extents.x1;
+  m_reg.extents.y2 = m_reg.extents.y1;
+  m_reg.data = &miEmptyData;
 }
 
 void Region::set(const Region *src)
 {
-  miRegionCopy(&m_reg, (RegionPtr)&src->m_reg);
+  if (src == this) {
+    return;
+  }
+  const RegionRec *srcReg = &src->m_reg;
+  if (srcReg->data == 0 || srcReg->data->size == 0 ||
+      srcReg->data->numRects < 2) {
+    // A single rectangle, an empty or a broken region.
+    miRegionCopy(&m_reg, (RegionPtr)srcReg);
+    return;
+  }
+  long numRects = srcReg->data->numRects;
+  BoxPtr boxes = allocBoxes(numRects);
+  if (boxes == 0) {
+    return;
+  }
+  memcpy(boxes, REGION_BOXPTR(srcReg), numRects * sizeof(BoxRec));
+  m_reg.data->numRects = numRects;
+  m_reg.extents = srcReg->extents;
 }
 
 Region & Region::operator=(const Region &src)
@@ -73,9 +111,154 @@ Region & Region::operator=(const Region &src)
 
 void Region::addRect(const Rect *rect)
 {
-  if (!rect->isEmpty()) {
-    Region temp(rect);
-    add(&temp);
+  if (rect->isEmpty()) {
+    return;
+  }
+  RegionRec other;
+  other.extents.x1 = rect->left;
+  other.extents.x2 = rect->right;
+  other.extents.y1 = rect->top;
+  other.extents.y2 = rect->bottom;
+  other.data = 0;
+  if (isEmpty()) {
+    setBox(&other.extents);
+  } else if (m_reg.data == 0 && BOX_SUBSUMES(&m_reg.extents, &other.extents)) {
+    return;
+  } else {
+    apply(miUnion, &other);
+  }
+}
+
+void Region::setRects(const std::vector<Rect> *rects)
+{
+  clear();
+
+  size_t numRects = 0;
+  std::vector<Rect>::const_iterator iRect;
+  for (iRect = rects->begin(); iRect < rects->end(); iRect++) {
+    if (!iRect->isEmpty()) {
+      numRects++;
+    }
+  }
+  if (numRects == 0) {
+    return;
+  }
+  if (numRects == 1) {
+    for (iRect = rects->begin(); iRect->isEmpty(); iRect++) {
+    }
+    Region temp(&(*iRect));
+    set(&temp);
+    return;
+  }
+
+  // Fill the rectangles in as a "bad" region and let miRegionValidate() sort
+  // and merge them, like miRectsToRegion() does.
+  BoxPtr box = allocBoxes((long)numRects);
+  if (box == 0) {
+    return;
+  }
+  for (iRect = rects->begin(); iRect < rects->end(); iRect++) {
+    if (!iRect->isEmpty()) {
+      box->x1 = iRect->left;
+      box->x2 = iRect->right;
+      box->y1 = iRect->top;
+      box->y2 = iRect->bottom;
+      box++;
+    }
+  }
+  m_reg.data->numRects = (long)numRects;
+  m_reg.extents.x1 = m_reg.extents.x2 = 0;
+  Bool overlap; // Ignored.
+  miRegionValidate(&m_reg, &overlap);
+}
+
+void Region::setTiles(const std::vector<bool> *tileMap, int tilesPerRow,
+                      int tileWidth, int tileHeight, const Rect *bounds)
+{
+  std::vector<BoxRec> boxes;
+  // Index of the first box of the previous band, its boxes end at boxes.end().
+  size_t prevBand = 0;
+  size_t numTiles = tileMap->size();
+  int y1 = bounds->top;
+  for (size_t rowStart = 0; rowStart < numTiles && y1 < bounds->bottom;
+       rowStart += tilesPerRow, y1 += tileHeight) {
+    int rowBottom = y1 + tileHeight;
+    short y2 = (short)(rowBottom < bounds->bottom ? rowBottom : bounds->bottom);
+    size_t curBand = boxes.size();
+    int x1 = bounds->left;
+    for (int col = 0; col < tilesPerRow && x1 < bounds->right;
+         col++, x1 += tileWidth) {
+      if (!(*tileMap)[rowStart + col]) {
+        continue;
+      }
+      int tileRight = x1 + tileWidth;
+      short x2 = (short)(tileRight < bounds->right ? tileRight : bounds->right);
+      if (boxes.size() > curBand && boxes.back().x2 == x1) {
+        boxes.back().x2 = x2;
+      } else {
+        BoxRec box = { (short)x1, (short)y1, x2, y2 };
+        boxes.push_back(box);
+      }
+    }
+
+    // Coalesce the band with the previous one if they have the same boxes
+    // and touch each other.
+    size_t numBoxes = boxes.size() - curBand;
+    if (numBoxes == 0) {
+      prevBand = curBand;
+      continue;
+    }
+    bool coalesce = curBand - prevBand == numBoxes &&
+                    boxes[prevBand].y2 == y1;
+    for (size_t i = 0; coalesce && i < numBoxes; i++) {
+      coalesce = boxes[prevBand + i].x1 == boxes[curBand + i].x1 &&
+                 boxes[prevBand + i].x2 == boxes[curBand + i].x2;
+    }
+    if (coalesce) {
+      for (size_t i = prevBand; i < curBand; i++) {
+        boxes[i].y2 = y2;
+      }
+      boxes.resize(curBand);
+    } else {
+      prevBand = curBand;
+    }
+  }
+  setBoxes(&boxes);
+}
+
+void Region::setBoxes(const std::vector<BoxRec> *boxes)
+{
+  clear();
+  if (boxes->empty()) {
+    return;
+  }
+  if (boxes->size() == 1) {
+    Rect rect(boxes->front().x1, boxes->front().y1,
+              boxes->front().x2, boxes->front().y2);
+    Region temp(&rect);
+    set(&temp);
+    return;
+  }
+
+  long numBoxes = (long)boxes->size();
+  BoxPtr dst = allocBoxes(numBoxes);
+  if (dst == 0) {
+    return;
+  }
+  memcpy(dst, &boxes->front(), numBoxes * sizeof(BoxRec));
+  m_reg.data->numRects = numBoxes;
+
+  BoxRec *extents = &m_reg.extents;
+  *extents = boxes->front();
+  extents->y2 = boxes->back().y2;
+  for (std::vector<BoxRec>::const_iterator iBox = boxes->begin();
+       iBox < boxes->end(); iBox++) {
+    if (iBox->x1 < extents->x1) {
+      extents->x1 = iBox->x1;
+    }
+    if (iBox->x2 > extents->x2) {
+      extents->x2 = iBox->x2;
+    }
   }
 }
 
@@ -86,23 +269,72 @@ void Region::translate(int dx, int dy)
 
 void Region::add(const Region *other)
 {
-  miUnion(&m_reg, &m_reg, (RegionPtr)&other->m_reg);
+  if (other == this || other->isEmpty()) {
+    return;
+  }
+  if (isEmpty()) {
+    set(other);
+  } else if (m_reg.data == 0 &&
+             BOX_SUBSUMES(&m_reg.extents, &other->m_reg.extents)) {
+    return;
+  } else {
+    apply(miUnion, &other->m_reg);
+  }
 }
 
 void Region::subtract(const Region *other)
 {
-  miSubtract(&m_reg, &m_reg, (RegionPtr)&other->m_reg);
+  if (other == this) {
+    clear();
+  } else if (!isEmpty() && !other->isEmpty() &&
+             BOX_OVERLAPS(&m_reg.extents, &other->m_reg.extents)) {
+    apply(miSubtract, &other->m_reg);
+  }
 }
 
 void Region::intersect(const Region *other)
 {
-  miIntersect(&m_reg, &m_reg, (RegionPtr)&other->m_reg);
+  if (other != this) {
+    intersect(&other->m_reg);
+  }
 }
 
 void Region::crop(const Rect *rect)
 {
-  Region temp(rect);
-  intersect(&temp);
+  if (rect->isEmpty()) {
+    clear();
+    return;
+  }
+  RegionRec other;
+  other.extents.x1 = rect->left;
+  other.extents.x2 = rect->right;
+  other.extents.y1 = rect->top;
+  other.extents.y2 = rect->bottom;
+  other.data = 0;
+  intersect(&other);
+}
+
+void Region::intersect(const RegionRec *other)
+{
+  if (isEmpty()) {
+    return;
+  }
+  if (REGION_NIL(other) ||
+      !BOX_OVERLAPS(&m_reg.extents, &other->extents)) {
+    clear();
+  } else if (other->data == 0 &&
+             BOX_SUBSUMES(&other->extents, &m_reg.extents)) {
+    return;
+  } else if (m_reg.data == 0 && other->data == 0) {
+    BoxRec box;
+    box.x1 = max(m_reg.extents.x1, other->extents.x1);
+    box.y1 = max(m_reg.extents.y1, other->extents.y1);
+    box.x2 = min(m_reg.extents.x2, other->extents.x2);
+    box.y2 = min(m_reg.extents.y2, other->extents.y2);
+    setBox(&box);
+  } else {
+    apply(miIntersect, other);
+  }
 }
 
 bool Region::isEmpty() const
@@ -165,3 +397,80 @@ Rect Region::getBounds() const
   const BoxRec *boxPtr = REGION_EXTENTS(&m_reg);
   return Rect(boxPtr->x1, boxPtr->y1, boxPtr->x2, boxPtr->y2);
 }
+
+void Region::apply(RegionOperation operation, const RegionRec *other)
+{
+  // miRegionOp() expects at most twice the rectangles of the bigger region.
+  long numRects = 2 * max(REGION_NUM_RECTS(&m_reg), REGION_NUM_RECTS(other));
+  RegionRec result;
+  result.extents = miEmptyBox;
+  result.data = takeStorage(numRects);
+  operation(&result, &m_reg, (RegionPtr)other);
+  releaseStorage();
+  m_reg = result;
+}
+
+RegDataPtr Region::takeStorage(long numRects)
+{
+  if (m_reg.data != &m_embedded.data && numRects <= REGION_EMBEDDED_RECTS) {
+    m_embedded.data.size = REGION_EMBEDDED_RECTS;
+    m_embedded.data.numRects = 0;
+    return &m_embedded.data;
+  }
+  if (m_spare != 0) {
+    RegDataPtr data = m_spare;
+    m_spare = 0;
+    if (data->size >= numRects) {
+      data->numRects = 0;
+      return data;
+    }
+    // Growing the buffer would copy its obsolete contents.
+    xfree(data);
+  }
+  return &miEmptyData;
+}
+
+void Region::releaseStorage()
+{
+  RegDataPtr data = m_reg.data;
+  m_reg.data = 0;
+  if (data == 0 || data->size == 0 || data->embedded) {
+    return;
+  }
+  // Keep the bigger buffer.
+  if (m_spare == 0) {
+    m_spare = data;
+  } else if (m_spare->size < data->size) {
+    xfree(m_spare);
+    m_spare = data;
+  } else {
+    xfree(data);
+  }
+}
+
+BoxPtr Region::allocBoxes(long numRects)
+{
+  releaseStorage();
+  m_reg.extents = miEmptyBox;
+  m_reg.data = takeStorage(numRects);
+  if (m_reg.data->size < numRects) {
+    if (!miRectAlloc(&m_reg, max(numRects, 2))) {
+      return 0;
+    }
+  }
+  m_reg.data->numRects = 0;
+  return REGION_BOXPTR(&m_reg);
+}
+
+void Region::setBox(const BoxRec *box)
+{
+  releaseStorage();
+  m_reg.extents = *box;
+  if (box->x1 < box->x2 && box->y1 < box->y2) {
+    m_reg.data = 0;
+  } else {
+    m_reg.extents.x2 = m_reg.extents.x1;
+    m_reg.extents.y2 = m_reg.extents.y1;
+    m_reg.data = &miEmptyData;
+  }
+}
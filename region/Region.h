@@ -85,6 +85,27 @@ public:
    * @param rect rectangle to add.
    */
   void addRect(const Rect *rect);
+  /**
+   * Replaces this region with the union of the given rectangles. This is
+   * much faster than adding the rectangles one by one with addRect(),
+   * especially if the rectangles are sorted by their top coordinates.
+   * @param rects rectangles to build the region from, may overlap.
+   */
+  void setRects(const std::vector<Rect> *rects);
+  /**
+   * Replaces this region with the union of the tiles of a regular grid
+   * which are marked in a bitmap. The region is built in a single pass.
+   * @param tileMap bitmap of the tiles in row-major order, its size must be
+   *                a multiple of tilesPerRow.
+   * @param tilesPerRow number of tiles in a row of the grid.
+   * @param tileWidth width of a tile.
+   * @param tileHeight height of a tile.
+   * @param bounds rectangle covered by the grid, its top-left corner is
+   *               the top-left corner of the first tile. The tiles are
+   *               clipped to this rectangle.
+   */
+  void setTiles(const std::vector<bool> *tileMap, int tilesPerRow,
+                int tileWidth, int tileHeight, const Rect *bounds);
   /**
    * Adds offset to all rectangles in region.
    * @param dx horizontal offset to add.
@@ -151,10 +172,70 @@ public:
   Rect getBounds() const;
 
 private:
+  /**
+   * Type of the X11 functions which compute unions, intersections and
+   * differences of regions.
+   */
+  typedef Bool (*RegionOperation)(RegionPtr newReg, RegionPtr reg1,
+                                  RegionPtr reg2);
+
+  /**
+   * Replaces this region with the result of the operation on this region and
+   * another region. The result is built in the storage not used by this
+   * region at the moment, so no allocations are needed for small regions
+   * and for repeated operations on the same region.
+   */
+  void apply(RegionOperation operation, const RegionRec *other);
+
+  /**
+   * Replaces this region by its intersection with another X11 region.
+   */
+  void intersect(const RegionRec *other);
+
+  /**
+   * Returns the storage for numRects rectangles not used by m_reg: the
+   * embedded one if they fit in it, otherwise the spare heap buffer if it
+   * is big enough, or miEmptyData to make the X11 code allocate a new one.
+   */
+  RegDataPtr takeStorage(long numRects);
+
+  /**
+   * Detaches the rectangles storage from m_reg keeping a heap buffer as the
+   * spare one. m_reg must be given another data pointer after this call.
+   */
+  void releaseStorage();
+
+  /**
+   * Makes m_reg an empty region with room for numRects rectangles and
+   * returns the pointer to the first rectangle.
+   */
+  BoxPtr allocBoxes(long numRects);
+
+  /**
+   * Replaces this region with the given boxes which must be y-x banded and
+   * coalesced, as required by the X11 region structure.
+   */
+  void setBoxes(const std::vector<BoxRec> *boxes);
+
+  /**
+   * Replaces this region with a single rectangle or makes it empty if the
+   * box is empty.
+   */
+  void setBox(const BoxRec *box);
+
   /**
    * The underlying X11 region structure.
    */
   RegionRec m_reg;
+  /**
+   * Storage for small regions, avoids heap allocations for them.
+   */
+  RegEmbeddedDataRec m_embedded;
+  /**
+   * A heap buffer left from a previous operation, reused for the result of
+   * the next one. It is NULL if there is no such buffer.
+   */
+  RegDataPtr m_spare;
 };
 
 #endif // __REGION_REGION_H_INCLUDED__
@@ -167,8 +167,9 @@ SOFTWARE.
 #define min(a, b) (((a) < (b)) ? (a) : (b))
 #define max(a, b) (((a) > (b)) ? (a) : (b))
 
-#define xallocData(n)    (RegDataPtr)malloc(REGION_SZOF(n))
-#define xfreeData(reg)   if ((reg)->data && (reg)->data->size) \
+#define xallocData(n)    miAllocData(n)
+#define xfreeData(reg)   if ((reg)->data && (reg)->data->size && \
+                             !(reg)->data->embedded) \
                            free((reg)->data)
 
 #define RECTALLOC_BAIL(pReg,n,bail) \
@@ -203,7 +204,8 @@ if (!(pReg)->data || (((pReg)->data->numRects + (n)) > (pReg)->data->size)) \
 
 
 #define DOWNSIZE(reg,numRects)						 \
-if (((numRects) < ((reg)->data->size >> 1)) && ((reg)->data->size > 50)) \
+if (((numRects) < ((reg)->data->size >> 1)) && ((reg)->data->size > 50) && \
+    !(reg)->data->embedded)						 \
 {									 \
     RegDataPtr NewData;							 \
     NewData = (RegDataPtr)xrealloc((reg)->data, REGION_SZOF(numRects));	 \
@@ -216,11 +218,20 @@ if (((numRects) < ((reg)->data->size >> 1)) && ((reg)->data->size > 50)) \
 
 
 BoxRec miEmptyBox = {0, 0, 0, 0};
-RegDataRec miEmptyData = {0, 0};
+RegDataRec miEmptyData = {0, 0, FALSE};
 
-RegDataRec  miBrokenData = {0, 0};
+RegDataRec  miBrokenData = {0, 0, FALSE};
 RegionRec   miBrokenRegion = { { 0, 0, 0, 0 }, &miBrokenData };
 
+static RegDataPtr
+miAllocData(long n)
+{
+    RegDataPtr data = (RegDataPtr)malloc(REGION_SZOF(n));
+    if (data)
+	data->embedded = FALSE;
+    return data;
+}
+
 #ifdef DEBUG
 int
 miPrintRegion(rgn)
@@ -440,9 +451,22 @@ miRectAlloc(
 		n = 250;
 	}
 	n += pRgn->data->numRects;
-	data = (RegDataPtr)xrealloc(pRgn->data, REGION_SZOF(n));
-	if (!data)
-	    return miRegionBreak (pRgn);
+	if (pRgn->data->embedded)
+	{
+	    /* Move the rectangles out of the embedded storage */
+	    data = xallocData(n);
+	    if (!data)
+		return miRegionBreak (pRgn);
+	    data->numRects = pRgn->data->numRects;
+	    memmove((char *)(data + 1), (char *)REGION_BOXPTR(pRgn),
+		    data->numRects * sizeof(BoxRec));
+	}
+	else
+	{
+	    data = (RegDataPtr)xrealloc(pRgn->data, REGION_SZOF(n));
+	    if (!data)
+		return miRegionBreak (pRgn);
+	}
 	pRgn->data = data;
     }
     pRgn->data->size = n;
@@ -872,7 +896,7 @@ miRegionOp(
 	AppendRegions(newReg, r2BandEnd, r2End);
     }
 
-    if (oldData)
+    if (oldData && !oldData->embedded)
 	xfree(oldData);
 
     if (!(numRects = newReg->data->numRects))
@@ -104,9 +104,22 @@ typedef struct _xRectangle {
 typedef struct _RegData {
     long	size;
     long 	numRects;
+    Bool	embedded;	/* stored in a RegEmbeddedDataRec, never freed */
 /*  BoxRec	rects[size];   in memory but not explicitly declared */
 } RegDataRec, *RegDataPtr;
 
+/*
+ * Storage for a few rectangles which the owner of a region can embed into
+ * itself to avoid heap allocations for small regions. The region code never
+ * frees it and moves the rectangles to the heap when they do not fit.
+ */
+#define REGION_EMBEDDED_RECTS 8
+
+typedef struct _RegEmbeddedData {
+    RegDataRec	data;
+    BoxRec	rects[REGION_EMBEDDED_RECTS];
+} RegEmbeddedDataRec;
+
 typedef struct _Region {
     BoxRec 	extents;
     RegDataPtr	data;
@@ -262,6 +275,7 @@ extern void miRegionInit(RegionPtr pReg, BoxPtr rect, int size);
 extern void miRegionDestroy(RegionPtr pReg);
 extern void miRegionUninit(RegionPtr pReg);
 extern Bool miRegionCopy(RegionPtr dst, RegionPtr src);
+extern Bool miRectAlloc(RegionPtr pRgn, int n);
 extern Bool miIntersect(RegionPtr newReg, RegionPtr reg1, RegionPtr reg2);
 extern Bool miUnion(RegionPtr newReg, RegionPtr reg1, RegionPtr reg2);
 extern Bool miRegionAppend(RegionPtr dstrgn, RegionPtr rgn);
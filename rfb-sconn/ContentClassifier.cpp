@@ -0,0 +1,198 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#include "ContentClassifier.h"
+#include <math.h>
+#include <string.h>
+#include <crtdbg.h>
+
+const double ContentClassifier::JPEG_BITS[10] =
+  { 0.25, 0.4, 0.55, 0.7, 0.8, 0.95, 1.1, 1.35, 1.8, 3.0 };
+const double ContentClassifier::JPEG_QUALITY[10] =
+  { 0.3, 0.45, 0.55, 0.65, 0.72, 0.78, 0.84, 0.9, 0.94, 0.97 };
+const double ContentClassifier::PHOTO_LOSSLESS_BITS = 12.0;
+const double ContentClassifier::JPEG_EDGE_BITS = 4.0;
+const double ContentClassifier::EDGE_QUALITY_LOSS = 5.0;
+const double ContentClassifier::SYNTHETIC_QUALITY_FACTOR = 0.5;
+const double ContentClassifier::SYNTHETIC_MIN_FLAT_DENSITY = 0.5;
+
+ContentClassifier::ContentClassifier()
+: m_bytesPerPixel(4),
+  m_bigEndian(false)
+{
+  memset(m_shift, 0, sizeof(m_shift));
+  memset(m_max, 0, sizeof(m_max));
+}
+
+ContentClassifier::~ContentClassifier()
+{
+}
+
+inline void ContentClassifier::getComponents(const UINT8 *ptr, int *rgb) const
+{
+  UINT32 pix;
+  if (m_bytesPerPixel == 4) {
+    pix = m_bigEndian ?
+          ((UINT32)ptr[0] << 24 | (UINT32)ptr[1] << 16 |
+           (UINT32)ptr[2] << 8 | ptr[3]) :
+          ((UINT32)ptr[3] << 24 | (UINT32)ptr[2] << 16 |
+           (UINT32)ptr[1] << 8 | ptr[0]);
+  } else {
+    pix = m_bigEndian ? ((UINT32)ptr[0] << 8 | ptr[1]) :
+                        ((UINT32)ptr[1] << 8 | ptr[0]);
+  }
+  for (int c = 0; c < 3; c++) {
+    int value = (int)(pix >> m_shift[c] & m_max[c]);
+    rgb[c] = m_max[c] == 255 ? value : value * 255 / m_max[c];
+  }
+}
+
+void ContentClassifier::analyze(const Rect *rect, const FrameBufferView *fb,
+                                Metrics *metrics)
+{
+  PixelFormat pf = fb->getPixelFormat();
+  _ASSERT(pf.bitsPerPixel == 16 || pf.bitsPerPixel == 32);
+  m_bytesPerPixel = pf.bitsPerPixel / 8;
+  m_bigEndian = pf.bigEndian;
+  m_shift[0] = pf.redShift;
+  m_shift[1] = pf.greenShift;
+  m_shift[2] = pf.blueShift;
+  m_max[0] = max(pf.redMax, 1);
+  m_max[1] = max(pf.greenMax, 1);
+  m_max[2] = max(pf.blueMax, 1);
+
+  int errorStat[256];
+  memset(errorStat, 0, sizeof(errorStat));
+  int numSamples = 0;
+  int numEdges = 0;
+  int numFlat = 0;
+  int numColors = 0;
+
+  // The first row and the first column have no neighbors to look at.
+  const int w = rect->getWidth() - 1;
+  const int h = rect->getHeight() - 1;
+  if (w > 0 && h > 0) {
+    const int numRows = min(h, (int)MAX_SAMPLE_ROWS);
+    const int numCols = min(w, (int)MAX_SAMPLES_PER_ROW);
+    const int bytesPerRow = fb->getBytesPerRow();
+    for (int i = 0; i < numRows; i++) {
+      int y = rect->top + 1 + i * h / numRows;
+      const UINT8 *row = (const UINT8 *)fb->getBufferPtr(rect->left, y);
+      for (int j = 0; j < numCols; j++) {
+        int x = 1 + j * w / numCols;
+        const UINT8 *ptr = row + x * m_bytesPerPixel;
+        int cur[3], left[3], up[3], upLeft[3];
+        getComponents(ptr, cur);
+        getComponents(ptr - m_bytesPerPixel, left);
+        getComponents(ptr - bytesPerRow, up);
+        getComponents(ptr - bytesPerRow - m_bytesPerPixel, upLeft);
+
+        int leftDiff = 0, upDiff = 0;
+        bool exact = true;
+        for (int c = 0; c < 3; c++) {
+          leftDiff += abs(cur[c] - left[c]);
+          upDiff += abs(cur[c] - up[c]);
+          int predicted = left[c] + up[c] - upLeft[c];
+          predicted = max(0, min(predicted, 255));
+          int error = cur[c] - predicted;
+          errorStat[error & 0xFF]++;
+          exact = exact && error == 0;
+        }
+        if (leftDiff >= EDGE_THRESHOLD || upDiff >= EDGE_THRESHOLD) {
+          numEdges++;
+        }
+        if (exact) {
+          numFlat++;
+        }
+
+        // Count distinct colors till there are too many.
+        if (numColors < MAX_COUNTED_COLORS) {
+          UINT32 color = (UINT32)cur[0] << 16 | (UINT32)cur[1] << 8 | cur[2];
+          int k;
+          for (k = 0; k < numColors && m_colors[k] != color; k++) {
+          }
+          if (k == numColors) {
+            m_colors[numColors++] = color;
+          }
+        }
+        numSamples++;
+      }
+    }
+  }
+
+  metrics->numSamples = numSamples;
+  metrics->numColors = numColors;
+  if (numSamples == 0) {
+    metrics->edgeDensity = 0.0;
+    metrics->flatDensity = 1.0;
+    metrics->losslessBits = 0.0;
+    return;
+  }
+  metrics->edgeDensity = (double)numEdges / numSamples;
+  metrics->flatDensity = (double)numFlat / numSamples;
+
+  // Entropy of the predictor errors of all three components.
+  double entropy = 0.0;
+  const double total = (double)numSamples * 3;
+  for (int i = 0; i < 256; i++) {
+    if (errorStat[i] != 0) {
+      double p = errorStat[i] / total;
+      entropy -= p * log(p);
+    }
+  }
+  metrics->losslessBits = entropy / log(2.0) * 3;
+}
+
+bool ContentClassifier::preferJpeg(const Metrics *metrics, int area,
+                                   int qualityLevel)
+{
+  _ASSERT(qualityLevel >= 0 && qualityLevel <= 9);
+  if (metrics->numSamples == 0) {
+    return false;
+  }
+
+  // Predicted JPEG size. Complex images need more bits with JPEG too.
+  double complexity = metrics->losslessBits / PHOTO_LOSSLESS_BITS;
+  complexity = max(0.25, min(complexity, 2.0));
+  double jpegBits = JPEG_BITS[qualityLevel] * complexity +
+                    JPEG_EDGE_BITS * metrics->edgeDensity;
+  double jpegSize = area * jpegBits / 8 + JPEG_HEADER_SIZE;
+
+  // Predicted JPEG quality.
+  double jpegQuality = JPEG_QUALITY[qualityLevel] *
+                       (1.0 - EDGE_QUALITY_LOSS * metrics->edgeDensity);
+  bool fewColors = metrics->numColors < SYNTHETIC_MAX_COLORS &&
+                   metrics->numColors * 4 < metrics->numSamples;
+  if (fewColors ||
+      metrics->flatDensity >= SYNTHETIC_MIN_FLAT_DENSITY) {
+    jpegQuality *= SYNTHETIC_QUALITY_FACTOR;
+  }
+  if (jpegQuality <= 0.0) {
+    return false;
+  }
+
+  double losslessSize = area * metrics->losslessBits / 8;
+  return jpegSize / jpegQuality < losslessSize;
+}
@@ -0,0 +1,119 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#ifndef __RFB_CONTENT_CLASSIFIER_H_INCLUDED__
+#define __RFB_CONTENT_CLASSIFIER_H_INCLUDED__
+
+#include "rfb/FrameBufferView.h"
+
+// ContentClassifier estimates properties of rectangle pixels from a small
+// sample and predicts whether lossy (JPEG) or lossless compression gives
+// fewer bytes per unit of image quality. It is used by TightEncoder for
+// rectangles having too many colors for a palette.
+//
+// The sample consists of at most MAX_SAMPLE_ROWS rows evenly spread over
+// the rectangle and at most MAX_SAMPLES_PER_ROW pixels in each row, so the
+// cost of the analysis does not depend on the rectangle size. For each
+// sampled pixel, the classifier looks at its left, upper and upper left
+// neighbors.
+class ContentClassifier
+{
+public:
+  // Properties of a rectangle estimated from the sample.
+  struct Metrics
+  {
+    // Number of samples taken.
+    int numSamples;
+    // Number of distinct colors among the samples, not more than
+    // MAX_COUNTED_COLORS.
+    int numColors;
+    // Fraction of samples having a sharp edge with the left or the upper
+    // neighbor. Text and UI elements have many of them, photos have few.
+    double edgeDensity;
+    // Fraction of samples exactly predicted by the gradient predictor
+    // (left + upper - upper left). Flat and smooth synthetic areas have most
+    // samples predicted exactly.
+    double flatDensity;
+    // Entropy of the gradient predictor errors, in bits per pixel. This is
+    // an estimate of the size of losslessly compressed data.
+    double losslessBits;
+  };
+
+  ContentClassifier();
+  virtual ~ContentClassifier();
+
+  // Analyze pixels of the rectangle. fb should have 16 or 32 bits per
+  // pixel.
+  void analyze(const Rect *rect, const FrameBufferView *fb, Metrics *metrics);
+
+  // Return true if JPEG with the given quality level (0..9) is predicted to
+  // give fewer bytes per unit of quality than lossless compression for a
+  // rectangle of `area' pixels with the given metrics. Lossless compression
+  // is considered to have the quality of 1.0, the quality of JPEG goes down
+  // with the quality level, with the density of sharp edges (ringing around
+  // text is very noticeable) and for synthetic images.
+  static bool preferJpeg(const Metrics *metrics, int area, int qualityLevel);
+
+protected:
+  // Read one pixel and convert it into 8-bit color components.
+  inline void getComponents(const UINT8 *ptr, int *rgb) const;
+
+  static const int MAX_SAMPLE_ROWS = 32;
+  static const int MAX_SAMPLES_PER_ROW = 64;
+  static const int MAX_COUNTED_COLORS = 64;
+  // The sum of absolute differences of 8-bit components considered as a
+  // sharp edge.
+  static const int EDGE_THRESHOLD = 192;
+
+  // Parameters of the prediction, see preferJpeg().
+  // JPEG bits per pixel and relative quality for each quality level, for
+  // typical photo-like content.
+  static const double JPEG_BITS[10];
+  static const double JPEG_QUALITY[10];
+  // Lossless bits per pixel of typical photo-like content. JPEG data size
+  // is scaled by the ratio of the actual lossless estimate to this value.
+  static const double PHOTO_LOSSLESS_BITS;
+  // Extra JPEG bits spent per pixel at sharp edges.
+  static const double JPEG_EDGE_BITS;
+  // Size of JPEG headers (quantization and Huffman tables).
+  static const int JPEG_HEADER_SIZE = 600;
+  // Loss of JPEG quality per unit of edge density, and the quality factor
+  // for synthetic images (few colors or mostly flat).
+  static const double EDGE_QUALITY_LOSS;
+  static const double SYNTHETIC_QUALITY_FACTOR;
+  static const int SYNTHETIC_MAX_COLORS = 32;
+  static const double SYNTHETIC_MIN_FLAT_DENSITY;
+
+  // Pixel format shortcuts set by analyze().
+  int m_bytesPerPixel;
+  bool m_bigEndian;
+  int m_shift[3];
+  int m_max[3];
+
+  // Colors counted in the current analysis.
+  UINT32 m_colors[MAX_COUNTED_COLORS];
+};
+
+#endif // __RFB_CONTENT_CLASSIFIER_H_INCLUDED__
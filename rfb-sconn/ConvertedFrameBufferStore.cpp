@@ -0,0 +1,217 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#include "ConvertedFrameBufferStore.h"
+
+#include <crtdbg.h>
+
+#include "thread/AutoLock.h"
+#include "EncodedRectCache.h"
+
+ConvertedFrameBuffer::ConvertedFrameBuffer(const PixelFormat *dstPf,
+                                           const PixelFormat *srcPf,
+                                           const Dimension *dim)
+: m_dim(*dim),
+  m_buffersAllocated(false),
+  m_numUsers(0)
+{
+  m_converter.setPixelFormats(dstPf, srcPf);
+  m_tilesPerRow = (dim->width + TILE_SIZE - 1) / TILE_SIZE;
+  m_tilesPerColumn = (dim->height + TILE_SIZE - 1) / TILE_SIZE;
+  m_rowLocks = new LocalMutex[max(m_tilesPerColumn, 1)];
+}
+
+ConvertedFrameBuffer::~ConvertedFrameBuffer()
+{
+  delete[] m_rowLocks;
+}
+
+bool ConvertedFrameBuffer::prepareSharing()
+{
+  AutoLock l(&m_usersLock);
+  if (m_numUsers <= 1) {
+    return false;
+  }
+  if (!m_buffersAllocated) {
+    PixelFormat dstPf = m_converter.getDstFormat();
+    m_converted.setProperties(&m_dim, &dstPf);
+    size_t numTiles = (size_t)m_tilesPerRow * m_tilesPerColumn;
+    m_tileStamps.assign(numTiles, 0);
+    m_tilePins.assign(numTiles, 0);
+    m_buffersAllocated = true;
+  }
+  return true;
+}
+
+bool ConvertedFrameBuffer::getView(const Rect *rect,
+                                   const FrameBufferSnapshot *snapshot,
+                                   const FrameBuffer *srcFb, Pins *pins,
+                                   FrameBufferView *view)
+{
+  if (rect->isEmpty() || !prepareSharing()) {
+    return false;
+  }
+  _ASSERT(srcFb->getDimension().isEqualTo(&m_dim));
+  _ASSERT(rect->left >= 0 && rect->top >= 0 &&
+          rect->right <= m_dim.width && rect->bottom <= m_dim.height);
+
+  if (pins->m_pinned.size() != m_tilePins.size()) {
+    _ASSERT(pins->m_tiles.empty());
+    pins->m_pinned.assign(m_tilePins.size(), false);
+  }
+
+  int lastRow = (rect->bottom - 1) / TILE_SIZE;
+  int lastColumn = (rect->right - 1) / TILE_SIZE;
+  for (int row = rect->top / TILE_SIZE; row <= lastRow; row++) {
+    AutoLock l(&m_rowLocks[row]);
+    for (int column = rect->left / TILE_SIZE; column <= lastColumn;
+         column++) {
+      int tile = row * m_tilesPerRow + column;
+      if (pins->m_pinned[tile]) {
+        // The tile is already valid for this snapshot.
+        continue;
+      }
+      Rect tileRect(column * TILE_SIZE, row * TILE_SIZE,
+                    min((column + 1) * TILE_SIZE, m_dim.width),
+                    min((row + 1) * TILE_SIZE, m_dim.height));
+      UINT64 stamp = snapshot->getContentStamp(&tileRect);
+      if (stamp == 0) {
+        return false;
+      }
+      if (m_tileStamps[tile] != stamp) {
+        if (m_tilePins[tile] > 0) {
+          // Another client reads pixels of other contents.
+          return false;
+        }
+        m_converter.convert(&tileRect,
+                            m_converted.getBufferPtr(tileRect.left,
+                                                     tileRect.top),
+                            m_dim.width, srcFb);
+        m_tileStamps[tile] = stamp;
+      }
+      m_tilePins[tile]++;
+      pins->m_pinned[tile] = true;
+      pins->m_tiles.push_back(tile);
+    }
+  }
+
+  PixelFormat dstPf = m_converter.getDstFormat();
+  *view = FrameBufferView(m_converted.getBufferPtr(rect->left, rect->top),
+                          rect, m_dim.width, &dstPf);
+  return true;
+}
+
+void ConvertedFrameBuffer::unpinAll(Pins *pins)
+{
+  for (std::vector<int>::iterator it = pins->m_tiles.begin();
+       it != pins->m_tiles.end(); it++) {
+    int tile = *it;
+    AutoLock l(&m_rowLocks[tile / m_tilesPerRow]);
+    _ASSERT(m_tilePins[tile] > 0);
+    m_tilePins[tile]--;
+    pins->m_pinned[tile] = false;
+  }
+  pins->m_tiles.clear();
+}
+
+//--------------------------------------------------------------------------//
+
+bool ConvertedFrameBufferStore::Key::operator<(const Key &other) const
+{
+  if (dim.width != other.dim.width) {
+    return dim.width < other.dim.width;
+  }
+  if (dim.height != other.dim.height) {
+    return dim.height < other.dim.height;
+  }
+  int cmp = EncodedRectCache::comparePixelFormats(&srcFormat,
+                                                  &other.srcFormat);
+  if (cmp != 0) {
+    return cmp < 0;
+  }
+  return EncodedRectCache::comparePixelFormats(&dstFormat,
+                                               &other.dstFormat) < 0;
+}
+
+//--------------------------------------------------------------------------//
+
+ConvertedFrameBufferStore::ConvertedFrameBufferStore()
+{
+}
+
+ConvertedFrameBufferStore::~ConvertedFrameBufferStore()
+{
+  // All the users must have released their objects by now.
+  _ASSERT(m_frameBuffers.empty());
+  for (FrameBufferMap::iterator it = m_frameBuffers.begin();
+       it != m_frameBuffers.end(); it++) {
+    delete it->second;
+  }
+}
+
+ConvertedFrameBuffer *
+ConvertedFrameBufferStore::acquire(const PixelFormat *dstPf,
+                                   const PixelFormat *srcPf,
+                                   const Dimension *dim)
+{
+  Key key;
+  key.dstFormat = *dstPf;
+  key.srcFormat = *srcPf;
+  key.dim = *dim;
+
+  AutoLock l(&m_lock);
+  FrameBufferMap::iterator it = m_frameBuffers.find(key);
+  ConvertedFrameBuffer *convertedFb;
+  if (it != m_frameBuffers.end()) {
+    convertedFb = it->second;
+  } else {
+    convertedFb = new ConvertedFrameBuffer(dstPf, srcPf, dim);
+    m_frameBuffers[key] = convertedFb;
+  }
+  AutoLock ul(&convertedFb->m_usersLock);
+  convertedFb->m_numUsers++;
+  return convertedFb;
+}
+
+void ConvertedFrameBufferStore::release(ConvertedFrameBuffer *convertedFb)
+{
+  AutoLock l(&m_lock);
+  {
+    AutoLock ul(&convertedFb->m_usersLock);
+    _ASSERT(convertedFb->m_numUsers > 0);
+    convertedFb->m_numUsers--;
+    if (convertedFb->m_numUsers > 0) {
+      return;
+    }
+  }
+  for (FrameBufferMap::iterator it = m_frameBuffers.begin();
+       it != m_frameBuffers.end(); it++) {
+    if (it->second == convertedFb) {
+      m_frameBuffers.erase(it);
+      break;
+    }
+  }
+  delete convertedFb;
+}
@@ -0,0 +1,183 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#ifndef __RFB_CONVERTED_FRAME_BUFFER_STORE_H_INCLUDED__
+#define __RFB_CONVERTED_FRAME_BUFFER_STORE_H_INCLUDED__
+
+#include <map>
+#include <vector>
+
+#include "util/CommonHeader.h"
+#include "region/Dimension.h"
+#include "rfb/FrameBuffer.h"
+#include "rfb/FrameBufferView.h"
+#include "rfb/PixelConverter.h"
+#include "rfb/PixelFormat.h"
+#include "desktop/SharedFrameBuffer.h"
+#include "thread/LocalMutex.h"
+
+// ConvertedFrameBuffer keeps the server frame buffer pixels converted to one
+// client pixel format, shared by all clients using that format (a pixel
+// format group). So the same pixels are converted once per pixel format, no
+// matter how many clients receive them.
+//
+// The frame buffer is divided into tiles, the same as the tiles of
+// SharedFrameBuffer. Each tile remembers the content stamp of the pixels it
+// was converted from (see FrameBufferSnapshot::getContentStamp()), so a
+// client finds stale tiles by comparing the stamps of its snapshot, without
+// looking at the pixels. Encoders read the converted pixels right from the
+// shared frame buffer. To keep the pixels unchanged meanwhile, the tiles
+// are pinned by the client; a pinned tile is not converted again from a
+// snapshot with other contents until all its clients unpin it.
+//
+// Only the pixels of shared snapshots can be shared. Pixels of private
+// snapshots (view ports) and of the frame buffers drawn by clients (a
+// cursor, black areas out of a shared application) are converted by the
+// clients themselves, and clients with the server pixel format need no
+// conversion.
+//
+// Each row of tiles is protected by its own mutex, so that different
+// clients may work with different parts of the frame buffer at the same
+// time. All functions are thread-safe.
+class ConvertedFrameBuffer
+{
+public:
+  // Tiles pinned by one client. The object should be given to the
+  // functions of one ConvertedFrameBuffer only.
+  class Pins
+  {
+  public:
+    Pins() {}
+
+  protected:
+    // Flags of the pinned tiles and the list of their numbers.
+    std::vector<bool> m_pinned;
+    std::vector<int> m_tiles;
+
+    friend class ConvertedFrameBuffer;
+  };
+
+  ConvertedFrameBuffer(const PixelFormat *dstPf, const PixelFormat *srcPf,
+                       const Dimension *dim);
+  virtual ~ConvertedFrameBuffer();
+
+  // Bring the converted pixels of `rect' up to date with `srcFb', the frame
+  // buffer of `snapshot', pin the tiles under the rectangle and store a view
+  // of the converted pixels to *view. The view stays valid until the tiles
+  // are unpinned by unpinAll(). The snapshot may not be updated meanwhile.
+  // The dimension and the pixel format of `srcFb' must be identical to the
+  // ones given to the constructor.
+  // Return false if the object is not used by more than one client, if the
+  // snapshot gives no content stamps, or if a tile with other contents is
+  // pinned by another client. The caller should convert the pixels itself
+  // then. The tiles pinned before the failure stay pinned.
+  bool getView(const Rect *rect, const FrameBufferSnapshot *snapshot,
+               const FrameBuffer *srcFb, Pins *pins, FrameBufferView *view);
+
+  // Unpin all the tiles pinned by the client.
+  void unpinAll(Pins *pins);
+
+protected:
+  // Return true if the object is used by more than one client. Buffers are
+  // allocated when this happens for the first time.
+  bool prepareSharing();
+
+  // Size of tiles in pixels, the same as in SharedFrameBuffer, so that
+  // each tile has its own content stamp.
+  static const int TILE_SIZE = 32;
+
+  PixelConverter m_converter;
+  // The converted pixels. The frame buffer is not allocated while the
+  // object has a single user, and is not freed after that until the object
+  // is deleted.
+  Dimension m_dim;
+  FrameBuffer m_converted;
+  bool m_buffersAllocated;
+
+  // Content stamps of the pixels the tiles were converted from (0 if not
+  // converted yet) and numbers of clients pinning the tiles. Tiles go row by
+  // row, each row is protected by the corresponding mutex.
+  int m_tilesPerRow;
+  int m_tilesPerColumn;
+  std::vector<UINT64> m_tileStamps;
+  std::vector<int> m_tilePins;
+  LocalMutex *m_rowLocks;
+
+  // Number of clients using this object, maintained by
+  // ConvertedFrameBufferStore. Protected by m_usersLock, as well as
+  // m_buffersAllocated.
+  int m_numUsers;
+  LocalMutex m_usersLock;
+
+  friend class ConvertedFrameBufferStore;
+
+private:
+  // Do not allow copying objects.
+  ConvertedFrameBuffer(const ConvertedFrameBuffer &other);
+  ConvertedFrameBuffer &operator=(const ConvertedFrameBuffer &other);
+};
+
+// ConvertedFrameBufferStore is a server-wide registry of ConvertedFrameBuffer
+// objects, one per distinct combination of the server and client pixel
+// formats and the frame buffer size. Each client holds a reference to the
+// object matching its current formats (see SharedPixelConverter), objects
+// are deleted when they are not used any more. All functions are
+// thread-safe.
+class ConvertedFrameBufferStore
+{
+public:
+  ConvertedFrameBufferStore();
+  virtual ~ConvertedFrameBufferStore();
+
+  // Return the object for the specified formats and size and increment its
+  // number of users. Each call must be paired with release().
+  ConvertedFrameBuffer *acquire(const PixelFormat *dstPf,
+                                const PixelFormat *srcPf,
+                                const Dimension *dim);
+  // Decrement the number of users and delete the object if it is not used.
+  void release(ConvertedFrameBuffer *convertedFb);
+
+protected:
+  struct Key
+  {
+    bool operator<(const Key &other) const;
+
+    PixelFormat dstFormat;
+    PixelFormat srcFormat;
+    Dimension dim;
+  };
+
+  typedef std::map<Key, ConvertedFrameBuffer *> FrameBufferMap;
+
+  FrameBufferMap m_frameBuffers;
+  LocalMutex m_lock;
+
+private:
+  // Do not allow copying objects.
+  ConvertedFrameBufferStore(const ConvertedFrameBufferStore &other);
+  ConvertedFrameBufferStore &operator=(const ConvertedFrameBufferStore &other);
+};
+
+#endif // __RFB_CONVERTED_FRAME_BUFFER_STORE_H_INCLUDED__
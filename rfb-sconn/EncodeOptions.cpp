@@ -24,6 +24,7 @@
 
 #include "EncodeOptions.h"
 #include "rfb/EncodingDefs.h"
+#include <crtdbg.h>
 
 EncodeOptions::EncodeOptions()
 {
@@ -50,6 +51,9 @@ void EncodeOptions::reset()
   m_enableRichCursor = false;
   m_enablePointerPos = false;
   m_enableDesktopSize = false;
+  m_enableLastRect = false;
+  m_enableFence = false;
+  m_enableContinuousUpdates = false;
 }
 
 void EncodeOptions::setEncodings(std::vector<int> *list)
@@ -81,6 +85,12 @@ void EncodeOptions::setEncodings(std::vector<int> *list)
       m_enablePointerPos = true;
     } else if (code == PseudoEncDefs::DESKTOP_SIZE) {
       m_enableDesktopSize = true;
+    } else if (code == PseudoEncDefs::LAST_RECT) {
+      m_enableLastRect = true;
+    } else if (code == PseudoEncDefs::FENCE) {
+      m_enableFence = true;
+    } else if (code == PseudoEncDefs::CONTINUOUS_UPDATES) {
+      m_enableContinuousUpdates = true;
     } else if (code >= PseudoEncDefs::COMPR_LEVEL_0 &&
                code <= PseudoEncDefs::COMPR_LEVEL_9) {
       int level = code - PseudoEncDefs::COMPR_LEVEL_0;
@@ -131,6 +141,23 @@ bool EncodeOptions::jpegEnabled() const
   return (m_jpegQualityLevel != EO_DEFAULT);
 }
 
+void EncodeOptions::setCompressionLevel(int level)
+{
+  _ASSERT(level >= 0 && level <= 9);
+  m_compressionLevel = level;
+}
+
+void EncodeOptions::setJpegQualityLevel(int level)
+{
+  _ASSERT(level >= 0 && level <= 9);
+  m_jpegQualityLevel = level;
+}
+
+void EncodeOptions::disableJpeg()
+{
+  m_jpegQualityLevel = EO_DEFAULT;
+}
+
 bool EncodeOptions::copyRectEnabled() const
 {
   return m_enableCopyRect;
@@ -151,6 +178,21 @@ bool EncodeOptions::desktopSizeEnabled() const
   return m_enableDesktopSize;
 }
 
+bool EncodeOptions::lastRectEnabled() const
+{
+  return m_enableLastRect;
+}
+
+bool EncodeOptions::fenceEnabled() const
+{
+  return m_enableFence;
+}
+
+bool EncodeOptions::continuousUpdatesEnabled() const
+{
+  return m_enableContinuousUpdates;
+}
+
 bool EncodeOptions::normalEncoding(int code)
 {
   return (code == EncodingDefs::RAW ||
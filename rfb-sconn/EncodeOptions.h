@@ -70,6 +70,16 @@ public:
   // false otherwise.
   bool jpegEnabled() const;
 
+  // Override the compression level and the JPEG quality level requested by
+  // the client, e.g. to adapt them to the connection speed. Levels must be
+  // in the range 0..9.
+  void setCompressionLevel(int level);
+  void setJpegQualityLevel(int level);
+
+  // Forget the JPEG quality level, so that only lossless compression would
+  // be used, as if the client did not request JPEG.
+  void disableJpeg();
+
   //
   // Accessor functions to boolean values.
   //
@@ -78,6 +88,9 @@ public:
   bool richCursorEnabled() const;
   bool pointerPosEnabled() const;
   bool desktopSizeEnabled() const;
+  bool lastRectEnabled() const;
+  bool fenceEnabled() const;
+  bool continuousUpdatesEnabled() const;
 
 protected:
 
@@ -104,6 +117,9 @@ protected:
   bool m_enableRichCursor;
   bool m_enablePointerPos;
   bool m_enableDesktopSize;
+  bool m_enableLastRect;
+  bool m_enableFence;
+  bool m_enableContinuousUpdates;
 };
 
 #endif // __RFB_ENCODE_OPTIONS_H_INCLUDED__
@@ -0,0 +1,202 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+#include "EncodedRectCache.h"
+
+#include "thread/AutoLock.h"
+
+EncodedRect::EncodedRect()
+: streamId(-1),
+  zlibLevel(0)
+{
+}
+
+size_t EncodedRect::getSize() const
+{
+  return prefix.size() + uncompressed.size();
+}
+
+//--------------------------------------------------------------------------//
+
+EncodedRectCache::Key::Key()
+: contentStamp(0),
+  encoding(0),
+  forceJpeg(false),
+  compressionLevel(0),
+  jpegQualityLevel(0)
+{
+}
+
+bool EncodedRectCache::Key::operator<(const Key &other) const
+{
+  if (contentStamp != other.contentStamp) {
+    return contentStamp < other.contentStamp;
+  }
+  if (rect.left != other.rect.left) {
+    return rect.left < other.rect.left;
+  }
+  if (rect.top != other.rect.top) {
+    return rect.top < other.rect.top;
+  }
+  if (rect.right != other.rect.right) {
+    return rect.right < other.rect.right;
+  }
+  if (rect.bottom != other.rect.bottom) {
+    return rect.bottom < other.rect.bottom;
+  }
+  if (encoding != other.encoding) {
+    return encoding < other.encoding;
+  }
+  if (forceJpeg != other.forceJpeg) {
+    return !forceJpeg;
+  }
+  if (compressionLevel != other.compressionLevel) {
+    return compressionLevel < other.compressionLevel;
+  }
+  if (jpegQualityLevel != other.jpegQualityLevel) {
+    return jpegQualityLevel < other.jpegQualityLevel;
+  }
+  int cmp = comparePixelFormats(&serverFormat, &other.serverFormat);
+  if (cmp != 0) {
+    return cmp < 0;
+  }
+  return comparePixelFormats(&clientFormat, &other.clientFormat) < 0;
+}
+
+//--------------------------------------------------------------------------//
+
+EncodedRectCache::EncodedRectCache(size_t maxSize)
+: m_totalSize(0),
+  m_maxSize(maxSize),
+  m_numUsers(0)
+{
+}
+
+EncodedRectCache::~EncodedRectCache()
+{
+}
+
+void EncodedRectCache::addUser()
+{
+  AutoLock l(&m_lock);
+  m_numUsers++;
+}
+
+void EncodedRectCache::removeUser()
+{
+  AutoLock l(&m_lock);
+  _ASSERT(m_numUsers > 0);
+  m_numUsers--;
+  // Nobody will ask for the data any more.
+  if (m_numUsers <= 1) {
+    m_items.clear();
+    m_lruList.clear();
+    m_totalSize = 0;
+  }
+}
+
+bool EncodedRectCache::isActive()
+{
+  AutoLock l(&m_lock);
+  return m_numUsers > 1;
+}
+
+bool EncodedRectCache::find(const Key *key, EncodedRect *data)
+{
+  AutoLock l(&m_lock);
+
+  ItemMap::iterator it = m_items.find(*key);
+  if (it == m_items.end()) {
+    return false;
+  }
+  // Move the key to the head of the LRU list.
+  m_lruList.splice(m_lruList.begin(), m_lruList, it->second.lruPos);
+
+  *data = it->second.data;
+  return true;
+}
+
+void EncodedRectCache::put(const Key *key, const EncodedRect *data)
+{
+  AutoLock l(&m_lock);
+
+  size_t size = data->getSize();
+  if (size > m_maxSize) {
+    return;
+  }
+
+  ItemMap::iterator it = m_items.find(*key);
+  if (it != m_items.end()) {
+    // Another client has encoded the same rectangle at the same time.
+    return;
+  }
+
+  m_lruList.push_front(*key);
+  try {
+    Item &item = m_items[*key];
+    item.data = *data;
+    item.lruPos = m_lruList.begin();
+  } catch (...) {
+    m_items.erase(*key);
+    m_lruList.pop_front();
+    throw;
+  }
+  m_totalSize += size;
+
+  shrink();
+}
+
+void EncodedRectCache::shrink()
+{
+  while (m_totalSize > m_maxSize && !m_lruList.empty()) {
+    ItemMap::iterator it = m_items.find(m_lruList.back());
+    _ASSERT(it != m_items.end());
+    m_totalSize -= it->second.data.getSize();
+    m_items.erase(it);
+    m_lruList.pop_back();
+  }
+}
+
+int EncodedRectCache::comparePixelFormats(const PixelFormat *pf1,
+                                          const PixelFormat *pf2)
+{
+  const unsigned short fields1[] = {
+    pf1->bitsPerPixel, pf1->colorDepth,
+    pf1->redMax, pf1->greenMax, pf1->blueMax,
+    pf1->redShift, pf1->greenShift, pf1->blueShift,
+    pf1->bigEndian ? 1 : 0
+  };
+  const unsigned short fields2[] = {
+    pf2->bitsPerPixel, pf2->colorDepth,
+    pf2->redMax, pf2->greenMax, pf2->blueMax,
+    pf2->redShift, pf2->greenShift, pf2->blueShift,
+    pf2->bigEndian ? 1 : 0
+  };
+  for (size_t i = 0; i < sizeof(fields1) / sizeof(fields1[0]); i++) {
+    if (fields1[i] != fields2[i]) {
+      return fields1[i] < fields2[i] ? -1 : 1;
+    }
+  }
+  return 0;
+}
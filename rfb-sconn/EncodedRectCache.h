@@ -0,0 +1,148 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+#ifndef __RFB_ENCODED_RECT_CACHE_H_INCLUDED__
+#define __RFB_ENCODED_RECT_CACHE_H_INCLUDED__
+
+#include <list>
+#include <map>
+#include <vector>
+
+#include "util/inttypes.h"
+#include "region/Rect.h"
+#include "rfb/PixelFormat.h"
+#include "thread/LocalMutex.h"
+
+// Encoded data of one rectangle which does not depend on the state of a
+// particular encoder. Everything that goes to the output stream as is
+// (control byte, fill color, palette, JPEG data etc.) is kept in `prefix'.
+// Data that should be compressed with zlib before sending is kept in
+// `uncompressed', together with the number of the zlib stream and the
+// compression level to use (streamId is -1 if there is no such data).
+struct EncodedRect
+{
+  EncodedRect();
+
+  // Size of the data in bytes.
+  size_t getSize() const;
+
+  std::vector<char> prefix;
+  std::vector<char> uncompressed;
+  int streamId;
+  int zlibLevel;
+};
+
+// EncodedRectCache is a server-wide storage of EncodedRect objects shared by
+// encoders of all RFB clients. If several clients use the same encoding
+// settings, the pixels of the same rectangle are converted and encoded only
+// once, other clients only have to compress the data with their own zlib
+// streams and send it.
+//
+// Rectangles are identified by their coordinates, the content stamp of
+// their pixels in the server frame buffer, pixel formats and encoding
+// settings (see Key). Stamps are given by the shared frame buffer snapshots
+// (see FrameBufferSnapshot::getContentStamp()), so equal keys mean equal
+// pixels without looking at them, and rectangles of private snapshots (with
+// a drawn cursor etc.) are never cached.
+// The total size of the cached data is limited, the least recently used
+// entries are discarded first. The cache is considered active only while it
+// has more than one user (see addUser()), since a single client would never
+// benefit from it. All functions are thread-safe.
+class EncodedRectCache
+{
+public:
+  struct Key
+  {
+    Key();
+
+    bool operator<(const Key &other) const;
+
+    Rect rect;
+    UINT64 contentStamp;
+    PixelFormat serverFormat;
+    PixelFormat clientFormat;
+    int encoding;
+    bool forceJpeg;
+    int compressionLevel;
+    int jpegQualityLevel;
+  };
+
+  static const size_t DEFAULT_MAX_SIZE = 32 * 1024 * 1024;
+
+  EncodedRectCache(size_t maxSize = DEFAULT_MAX_SIZE);
+  virtual ~EncodedRectCache();
+
+  // Each encoder willing to use the cache should call addUser() on
+  // construction and removeUser() on destruction.
+  void addUser();
+  void removeUser();
+
+  // Return true if the cache has more than one user.
+  bool isActive();
+
+  // Copy the data corresponding to the key to *data and return true. Return
+  // false if there is no such entry.
+  bool find(const Key *key, EncodedRect *data);
+
+  // Store a copy of the data. If the total size of the cached data exceeds
+  // the limit, the least recently used entries are discarded.
+  void put(const Key *key, const EncodedRect *data);
+
+  // Compare pixel formats field by field, return a negative value, zero or a
+  // positive value, like memcmp().
+  static int comparePixelFormats(const PixelFormat *pf1,
+                                 const PixelFormat *pf2);
+
+protected:
+  typedef std::list<Key> KeyList;
+
+  struct Item
+  {
+    EncodedRect data;
+    // Position of the key in m_lruList.
+    KeyList::iterator lruPos;
+  };
+
+  typedef std::map<Key, Item> ItemMap;
+
+  // Remove the least recently used items until the total size fits the
+  // limit.
+  void shrink();
+
+  ItemMap m_items;
+  // Keys of all items, the most recently used go first.
+  KeyList m_lruList;
+  size_t m_totalSize;
+  size_t m_maxSize;
+  int m_numUsers;
+
+  LocalMutex m_lock;
+
+private:
+  // Do not allow copying objects.
+  EncodedRectCache(const EncodedRectCache &other);
+  EncodedRectCache &operator=(const EncodedRectCache &other);
+};
+
+#endif // __RFB_ENCODED_RECT_CACHE_H_INCLUDED__
@@ -51,19 +51,59 @@ void Encoder::sendRectangle(const Rect *rect,
                             const FrameBuffer *serverFb,
                             const EncodeOptions *options)
 {
-  const FrameBuffer *fb = m_pixelConverter->convert(rect, serverFb);
-  int pixelSize = (int)fb->getBytesPerPixel();
-  _ASSERT(pixelSize == fb->getBytesPerPixel());
-
-  UINT8 *buffer = (UINT8 *)fb->getBuffer();
+  int pixelSize = (int)m_pixelConverter->getDstBitsPerPixel() / 8;
   int lineWidth = rect->getWidth();
-  int fbWidth = fb->getDimension().width;
   int lineSizeInBytes = lineWidth * pixelSize;
-  int stride = fbWidth * pixelSize;
-  UINT8 *lineP = &buffer[(rect->top * fbWidth + rect->left) * pixelSize];
 
-  // Send the rectangle as is, line by line.
-  for (int i = rect->top; i < rect->bottom; i++, lineP += stride) {
-    m_output->writeFully((char *)lineP, lineSizeInBytes);
+  // Convert and send the rectangle in bands of a limited size, so that big
+  // rectangles would not require big conversion buffers.
+  int bandHeight = max(RAW_BAND_SIZE / max(lineSizeInBytes, 1), 1);
+  Rect band(rect);
+  for (; band.top < rect->bottom; band.top = band.bottom) {
+    band.bottom = min(band.top + bandHeight, rect->bottom);
+    FrameBufferView fb = m_pixelConverter->convert(&band, serverFb);
+
+    const UINT8 *lineP = (const UINT8 *)fb.getBufferPtr(band.left, band.top);
+    int stride = fb.getBytesPerRow();
+
+    // Send the band as is, line by line.
+    for (int i = band.top; i < band.bottom; i++, lineP += stride) {
+      m_output->writeFully((char *)lineP, lineSizeInBytes);
+    }
   }
 }
+
+void Encoder::sendRectangles(const std::vector<Rect> *rects,
+                             const FrameBuffer *serverFb,
+                             const EncodeOptions *options)
+{
+  std::vector<Rect>::const_iterator i;
+  for (i = rects->begin(); i != rects->end(); i++) {
+    sendRectHeader(&*i);
+    sendRectangle(&*i, serverFb, options);
+  }
+}
+
+void Encoder::setNumThreads(size_t numThreads)
+{
+}
+
+double Encoder::getParallelSpeedup() const
+{
+  return 1.0;
+}
+
+int Encoder::getRectOverhead(const EncodeOptions *options) const
+{
+  int bytesPerPixel = (int)m_pixelConverter->getDstBitsPerPixel() / 8;
+  return RECT_HEADER_SIZE / max(bytesPerPixel, 1);
+}
+
+void Encoder::sendRectHeader(const Rect *rect)
+{
+  m_output->writeUInt16((UINT16)rect->left);
+  m_output->writeUInt16((UINT16)rect->top);
+  m_output->writeUInt16((UINT16)rect->getWidth());
+  m_output->writeUInt16((UINT16)rect->getHeight());
+  m_output->writeInt32(getCode());
+}
@@ -74,7 +74,9 @@ public:
   // it should implement its own splitRectangle() function.
   //
   // UpdateSender calls splitRectangle() for each rectangle of the update
-  // region, then calls sendRectangle() for the same list of rectangles.
+  // region, then calls sendRectangle() for the same list of rectangles. The
+  // region may be processed by parts, so splitRectangle() and
+  // sendRectangle() calls may alternate.
   //
   // The arguments of splitRectangle() are similar to those of
   // sendRectangle(). It's guaranteed that options and serverFb will point to
@@ -91,12 +93,52 @@ public:
   // buffer that can be in arbitrary pixel format natively used by the RFB
   // server. To get relevant pixels in the destination format (client format),
   // encoders must convert the data from *serverFb explicitly, e.g. by calling
-  // m_pixelConverter->convert().
+  // m_pixelConverter->convert(). Converted pixels are stored in a buffer of
+  // the rectangle size, not of the frame buffer size, and should be accessed
+  // via the FrameBufferView returned by the converter.
   virtual void sendRectangle(const Rect *rect,
                              const FrameBuffer *serverFb,
                              const EncodeOptions *options) throw(IOException);
 
+  // Encode and send a list of rectangles, each one preceded by the
+  // rectangle header with the code returned by getCode(). The default
+  // implementation just calls sendRectangle() for each rectangle. Encoders
+  // able to process a number of rectangles at once (e.g. in parallel) may
+  // override this function, but the data written to the output stream
+  // should be the same as if the rectangles were sent one by one.
+  virtual void sendRectangles(const std::vector<Rect> *rects,
+                              const FrameBuffer *serverFb,
+                              const EncodeOptions *options) throw(IOException);
+
+  // Set the number of threads the encoder may use in sendRectangles().
+  // Values 0 and 1 mean that everything should be done in the calling
+  // thread. The default implementation ignores this setting.
+  virtual void setNumThreads(size_t numThreads);
+
+  // Return the ratio of the total time spent by all threads to the elapsed
+  // time of the most recent sendRectangles() call. Encoders working in one
+  // thread always return 1.0.
+  virtual double getParallelSpeedup() const;
+
+  // Return the cost of sending one more rectangle, expressed in pixels: it's
+  // cheaper to encode that many extra (unchanged) pixels within a bigger
+  // rectangle than to send a separate rectangle. UpdateSender uses this
+  // value to merge nearby rectangles before calling splitRectangle(). The
+  // default implementation accounts for the rectangle header only, as the
+  // Raw encoder spends nothing else on a rectangle.
+  virtual int getRectOverhead(const EncodeOptions *options) const;
+
 protected:
+  // Send the rectangle header (position, size and encoding type).
+  void sendRectHeader(const Rect *rect) throw(IOException);
+
+  // Maximum size in bytes of a band of rows converted at once by the Raw
+  // encoder.
+  static const int RAW_BAND_SIZE = 65536;
+
+  // Size in bytes of the rectangle header.
+  static const int RECT_HEADER_SIZE = 12;
+
 
   // PixelConverter is used for converting pixels from the given framebuffer
   // to some other pixel format (typically, the pixel format using by an RFB
@@ -29,11 +29,14 @@
 #include "ZrleEncoder.h"
 #include "TightEncoder.h"
 
-EncoderStore::EncoderStore(PixelConverter *pixelConverter, DataOutputStream *output)
+EncoderStore::EncoderStore(PixelConverter *pixelConverter, DataOutputStream *output,
+                           EncodedRectCache *rectCache)
 : m_encoder(0),
   m_jpegEncoder(0),
   m_pixelConverter(pixelConverter),
-  m_output(output)
+  m_output(output),
+  m_rectCache(rectCache),
+  m_numThreads(1)
 {
 }
 
@@ -60,6 +63,15 @@ JpegEncoder *EncoderStore::getJpegEncoder() const
   return m_jpegEncoder;
 }
 
+TightEncoder *EncoderStore::getTightEncoder() const
+{
+  std::map<int, Encoder *>::const_iterator it = m_map.find(EncodingDefs::TIGHT);
+  if (it == m_map.end()) {
+    return 0;
+  }
+  return (TightEncoder *)it->second;
+}
+
 void EncoderStore::selectEncoder(int encType)
 {
   m_encoder = validateEncoder(encType);
@@ -73,6 +85,18 @@ void EncoderStore::validateJpegEncoder()
   }
 }
 
+void EncoderStore::setNumThreads(size_t numThreads)
+{
+  if (numThreads == m_numThreads) {
+    return;
+  }
+  m_numThreads = numThreads;
+  std::map<int, Encoder *>::iterator it;
+  for (it = m_map.begin(); it != m_map.end(); it++) {
+    it->second->setNumThreads(m_numThreads);
+  }
+}
+
 //---------------------------- Internal methods ----------------------------//
 
 Encoder *EncoderStore::validateEncoder(int encType)
@@ -89,6 +113,7 @@ Encoder *EncoderStore::validateEncoder(int encType)
   // Otherwise, allocate it, store it in m_map and return the pointer to it.
   Encoder *newEncoder = allocateEncoder(encType);
   try {
+    newEncoder->setNumThreads(m_numThreads);
     m_map[encType] = newEncoder;
   } catch (...) {
     delete newEncoder;
@@ -115,7 +140,7 @@ Encoder *EncoderStore::allocateEncoder(int encType) const
 {
   switch (encType) {
   case EncodingDefs::TIGHT:
-    return new TightEncoder(m_pixelConverter, m_output);
+    return new TightEncoder(m_pixelConverter, m_output, m_rectCache);
   case EncodingDefs::ZRLE:
     return new ZrleEncoder(m_pixelConverter, m_output);
   case EncodingDefs::HEXTILE:
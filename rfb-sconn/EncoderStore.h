@@ -29,6 +29,7 @@
 
 #include "Encoder.h"
 #include "JpegEncoder.h"
+#include "EncodedRectCache.h"
 
 // EncoderStore is an object which allocates encoders on demand and serves
 // callers with a pointer to currectly selected encoder. The goal of
@@ -50,7 +51,10 @@ public:
   // will return 0 if called right after the object creation. The caller must
   // call selectEncoder() explicitly to allocate encoders, even if that's Raw
   // encoder (implemented in the base Encoder class).
-  EncoderStore(PixelConverter *pixelConverter, DataOutputStream *output);
+  // `rectCache' is a cache of encoded rectangles shared with other RFB
+  // clients, it may be 0.
+  EncoderStore(PixelConverter *pixelConverter, DataOutputStream *output,
+               EncodedRectCache *rectCache);
   ~EncoderStore();
 
   // Get current (preferred) encoder if it was previously allocated by
@@ -59,10 +63,18 @@ public:
   // Get a pointer to JpegEncoder if it was previously allocated by
   // validateJpegEncoder().
   JpegEncoder *getJpegEncoder() const;
+  // Get a pointer to the Tight encoder (also used by JpegEncoder) if it was
+  // previously allocated, or 0.
+  TightEncoder *getTightEncoder() const;
 
   void selectEncoder(int encType);
   void validateJpegEncoder();
 
+  // Set the number of threads encoders may use (see
+  // Encoder::setNumThreads()). The setting is applied to all encoders
+  // allocated so far and to those that will be allocated later.
+  void setNumThreads(size_t numThreads);
+
 protected:
   // This function makes sure the specified encoder is allocated and stored in
   // m_map. If it's already there, this function returns a pointer to the
@@ -101,6 +113,11 @@ protected:
   PixelConverter *m_pixelConverter;
   // This pointer to DataOutputStream will be used to construct encoders.
   DataOutputStream *m_output;
+  // This pointer to EncodedRectCache will be used to construct encoders.
+  EncodedRectCache *m_rectCache;
+
+  // The number of threads passed to Encoder::setNumThreads().
+  size_t m_numThreads;
 
 private:
   // Do not allow copying objects.
@@ -53,15 +53,13 @@ void HextileEncoder::sendRectangle(const Rect *rect,
                                    const FrameBuffer *serverFb,
                                    const EncodeOptions *options)
 {
-  const FrameBuffer *fb = m_pixelConverter->convert(rect, serverFb);
-
-  size_t bpp = fb->getBitsPerPixel();
+  size_t bpp = m_pixelConverter->getDstBitsPerPixel();
   if (bpp == 8) {
-    hextileFunction<UINT8>(*rect, fb);
+    hextileFunction<UINT8>(*rect, serverFb);
   } else if (bpp == 16) {
-    hextileFunction<UINT16>(*rect, fb);
+    hextileFunction<UINT16>(*rect, serverFb);
   } else if (bpp == 32) {
-    hextileFunction<UINT32>(*rect, fb);
+    hextileFunction<UINT32>(*rect, serverFb);
   } else {
     _ASSERT(0);
   }
@@ -69,11 +67,10 @@ void HextileEncoder::sendRectangle(const Rect *rect,
 
 template <class PIXEL_T>
 void HextileEncoder::hextileFunction(const Rect &r,
-                                     const FrameBuffer *frameBuffer)
+                                     const FrameBuffer *serverFb)
 {
   Rect t;
-  PIXEL_T *buf;
-  FrameBuffer fb;
+  PIXEL_T buf[256];
   PIXEL_T oldBg = 0, oldFg = 0;
   bool oldBgValid = false;
   bool oldFgValid = false;
@@ -85,13 +82,21 @@ void HextileEncoder::hextileFunction(const Rect &r,
 
     t.bottom = min(r.bottom, t.top + 16);
 
+    // Convert one row of tiles to the client pixel format.
+    Rect band(r.left, t.top, r.right, t.bottom);
+    FrameBufferView fb = m_pixelConverter->convert(&band, serverFb);
+
     for (t.left = r.left; t.left < r.right; t.left += 16) {
 
       t.right = min(r.right, t.left + 16);
 
-      fb.setProperties(&t, &frameBuffer->getPixelFormat());
-      fb.copyFrom(frameBuffer, t.left, t.top);
-      buf = (PIXEL_T *)fb.getBuffer();
+      // Copy the tile pixels to a contiguous buffer.
+      const UINT8 *src = (const UINT8 *)fb.getBufferPtr(t.left, t.top);
+      size_t tileRowSize = t.getWidth() * sizeof(PIXEL_T);
+      for (int y = 0; y < t.getHeight(); y++) {
+        memcpy((UINT8 *)buf + y * tileRowSize, src, tileRowSize);
+        src += fb.getBytesPerRow();
+      }
 
       tile.newTile(buf, t.getWidth(), t.getHeight());
       int tileType = tile.getFlags();
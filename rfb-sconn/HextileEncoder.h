@@ -40,9 +40,11 @@ public:
                              const EncodeOptions *options) throw(IOException);
 
 private:
+  // Encode the rectangle tile by tile. Pixels are converted to the client
+  // pixel format one row of tiles at a time.
   template <class PIXEL_T>
     void hextileFunction(const Rect &r,
-                         const FrameBuffer *frameBuffer) throw(IOException);
+                         const FrameBuffer *serverFb) throw(IOException);
 };
 
 #endif // __RFB_HEXTILE_ENCODER_H_INCLUDED__
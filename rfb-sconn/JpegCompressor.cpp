@@ -26,6 +26,12 @@
 
 #include "util/AnsiStringStorage.h"
 #include "util/Exception.h"
+#include "util/CpuFeatures.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+#define JPEG_COMPRESSOR_SSE2
+#include <emmintrin.h>
+#endif
 
 const int StandardJpegCompressor::ALLOC_CHUNK_SIZE = 65536;
 const int StandardJpegCompressor::DEFAULT_JPEG_QUALITY = 75;
@@ -75,7 +81,8 @@ StandardJpegCompressor::StandardJpegCompressor()
     m_newQuality(DEFAULT_JPEG_QUALITY),
     m_outputBuffer(0),
     m_numBytesAllocated(0),
-    m_numBytesReady(0)
+    m_numBytesReady(0),
+    m_useSse2(CpuFeatures::hasSse2())
 {
   // Initialize JPEG compression structure.
   jpeg_create_compress(&m_jpeg.cinfo);
@@ -226,31 +233,34 @@ StandardJpegCompressor::compress(const void *buf,
 
   const char *src = (const char *)buf;
 
-  // We'll pass up to 8 rows to jpeg_write_scanlines().
-  JSAMPLE *rgb = new JSAMPLE[w * 3 * 8];
-  JSAMPROW rowPointer[8];
-  for (int i = 0; i < 8; i++)
-    rowPointer[i] = &rgb[w * 3 * i];
+  // We'll pass up to ROWS_PER_PASS rows to jpeg_write_scanlines().
+  size_t rowBufferSize = (size_t)w * 3 * ROWS_PER_PASS + ROW_BUFFER_PADDING;
+  if (m_rowBuffer.size() < rowBufferSize) {
+    m_rowBuffer.resize(rowBufferSize);
+  }
+  JSAMPROW rowPointer[ROWS_PER_PASS];
+  for (int i = 0; i < ROWS_PER_PASS; i++)
+    rowPointer[i] = &m_rowBuffer[w * 3 * i];
 
   // Feed the pixels to the JPEG library.
   while (m_jpeg.cinfo.next_scanline < m_jpeg.cinfo.image_height) {
     int maxRows = m_jpeg.cinfo.image_height - m_jpeg.cinfo.next_scanline;
-    if (maxRows > 8) {
-      maxRows = 8;
+    if (maxRows > ROWS_PER_PASS) {
+      maxRows = ROWS_PER_PASS;
     }
     for (int dy = 0; dy < maxRows; dy++) {
-      if (useQuickConversion) {
-        convertRow24(rowPointer[dy], src, fmt, w);
-      } else {
+      if (!useQuickConversion) {
         convertRow(rowPointer[dy], src, fmt, w);
+      } else if (m_useSse2) {
+        convertRow24Sse2(rowPointer[dy], src, fmt, w);
+      } else {
+        convertRow24(rowPointer[dy], src, fmt, w);
       }
       src += stride;
     }
     jpeg_write_scanlines(&m_jpeg.cinfo, rowPointer, maxRows);
   }
 
-  delete[] rgb;
-
   jpeg_finish_compress(&m_jpeg.cinfo);
 }
 
@@ -299,3 +309,56 @@ StandardJpegCompressor::convertRow(JSAMPLE *dst, const void *src,
     }
   }
 }
+
+#ifdef JPEG_COMPRESSOR_SSE2
+
+void
+StandardJpegCompressor::convertRow24Sse2(JSAMPLE *dst, const void *src,
+                                         const PixelFormat *fmt,
+                                         int numPixels)
+{
+  const __m128i byteMask = _mm_set1_epi32(0xFF);
+  // Masks of the low 3 and the next 3 bytes of each 64-bit lane.
+  const __m128i lowMask = _mm_set_epi32(0, 0xFFFFFF, 0, 0xFFFFFF);
+  const __m128i highMask = _mm_set_epi32(0xFFFF, 0xFF000000,
+                                         0xFFFF, 0xFF000000);
+  const __m128i redShift = _mm_cvtsi32_si128(fmt->redShift);
+  const __m128i greenShift = _mm_cvtsi32_si128(fmt->greenShift);
+  const __m128i blueShift = _mm_cvtsi32_si128(fmt->blueShift);
+
+  const UINT32 *srcPixels = (const UINT32 *)src;
+  for (; numPixels >= 4; numPixels -= 4, srcPixels += 4, dst += 12) {
+    __m128i pixels = _mm_loadu_si128((const __m128i *)srcPixels);
+    // Make each 32-bit lane hold the R, G and B bytes in the memory order.
+    __m128i red = _mm_and_si128(_mm_srl_epi32(pixels, redShift), byteMask);
+    __m128i green = _mm_and_si128(_mm_srl_epi32(pixels, greenShift), byteMask);
+    __m128i blue = _mm_and_si128(_mm_srl_epi32(pixels, blueShift), byteMask);
+    __m128i rgb = _mm_or_si128(red,
+                  _mm_or_si128(_mm_slli_epi32(green, 8),
+                               _mm_slli_epi32(blue, 16)));
+    // Close the gap between the two pixels of each 64-bit lane, so that
+    // each lane holds 6 bytes of data.
+    __m128i pairs = _mm_or_si128(_mm_and_si128(rgb, lowMask),
+                                 _mm_and_si128(_mm_srli_epi64(rgb, 8),
+                                               highMask));
+    // Put the 6 bytes of the upper lane right after those of the lower one.
+    __m128i packed = _mm_or_si128(_mm_move_epi64(pairs),
+                                  _mm_slli_si128(_mm_srli_si128(pairs, 8), 6));
+    _mm_storeu_si128((__m128i *)dst, packed);
+  }
+  convertRow24(dst, srcPixels, fmt, numPixels);
+}
+
+#else // JPEG_COMPRESSOR_SSE2
+
+// The function below is never called because m_useSse2 is always false.
+
+void
+StandardJpegCompressor::convertRow24Sse2(JSAMPLE *dst, const void *src,
+                                         const PixelFormat *fmt,
+                                         int numPixels)
+{
+  convertRow24(dst, src, fmt, numPixels);
+}
+
+#endif // JPEG_COMPRESSOR_SSE2
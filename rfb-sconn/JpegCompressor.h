@@ -26,6 +26,7 @@
 #define __RFB_JPEG_COMPRESSOR_H_INCLUDED__
 
 #include <stdio.h>
+#include <vector>
 
 #include "util/CommonHeader.h"
 #include "rfb/PixelFormat.h"
@@ -108,6 +109,12 @@ protected:
   static const int ALLOC_CHUNK_SIZE;
   static const int DEFAULT_JPEG_QUALITY;
 
+  // Number of rows converted and passed to jpeg_write_scanlines() at once.
+  static const int ROWS_PER_PASS = 8;
+  // Extra bytes at the end of m_rowBuffer, convertRow24Sse2() may write
+  // that many bytes past the converted pixels.
+  static const int ROW_BUFFER_PADDING = 16;
+
   int m_quality;
   int m_newQuality;
 
@@ -115,6 +122,12 @@ protected:
   size_t m_numBytesAllocated;
   size_t m_numBytesReady;
 
+  // Converted rows, kept between calls to avoid reallocations.
+  std::vector<JSAMPLE> m_rowBuffer;
+
+  // True if convertRow24Sse2() can be used.
+  bool m_useSse2;
+
   // Convert one row (scanline) from the specified pixel format to the format
   // supported by the IJG JPEG library (one byte per one color component).
   void convertRow(JSAMPLE *dst, const void *src,
@@ -127,6 +140,11 @@ protected:
   void convertRow24(JSAMPLE *dst, const void *src,
                     const PixelFormat *fmt, int numPixels);
 
+  // SSE2 version of convertRow24(), converting four pixels at a time. It
+  // may write up to ROW_BUFFER_PADDING bytes past the end of the row.
+  void convertRow24Sse2(JSAMPLE *dst, const void *src,
+                        const PixelFormat *fmt, int numPixels);
+
 private:
   METHODDEF(StringStorage) getMessage(j_common_ptr cinfo);
   METHODDEF(void) errorExit(j_common_ptr cinfo);
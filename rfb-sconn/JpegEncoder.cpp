@@ -45,9 +45,13 @@ void JpegEncoder::splitRectangle(const Rect *rect,
                                  const EncodeOptions *options)
 {
   int maxWidth = 2048;
-  for (int x0 = rect->left; x0 < rect->right; x0 += maxWidth) {
-    int x1 = (x0 + maxWidth <= rect->right) ? x0 + maxWidth : rect->right;
-    rectList->push_back(Rect(x0, rect->top, x1, rect->bottom));
+  int bandHeight = getBandHeight(rect);
+  for (int y0 = rect->top; y0 < rect->bottom; y0 += bandHeight) {
+    int y1 = (y0 + bandHeight <= rect->bottom) ? y0 + bandHeight : rect->bottom;
+    for (int x0 = rect->left; x0 < rect->right; x0 += maxWidth) {
+      int x1 = (x0 + maxWidth <= rect->right) ? x0 + maxWidth : rect->right;
+      rectList->push_back(Rect(x0, y0, x1, y1));
+    }
   }
 }
 
@@ -55,13 +59,49 @@ void JpegEncoder::sendRectangle(const Rect *rect,
                                 const FrameBuffer *serverFb,
                                 const EncodeOptions *options)
 {
-  size_t bppServer = m_pixelConverter->getSrcBitsPerPixel();
-  size_t bppClient = m_pixelConverter->getDstBitsPerPixel();
-  bool goodColorResolution = (bppServer >= 16 && bppClient >= 16);
-
-  if (options->jpegEnabled() && goodColorResolution) {
+  if (shouldForceJpeg(options)) {
     m_tightEncoder->sendJpegRect(rect, serverFb, options);
   } else {
     m_tightEncoder->sendRectangle(rect, serverFb, options);
   }
 }
+
+void JpegEncoder::sendRectangles(const std::vector<Rect> *rects,
+                                 const FrameBuffer *serverFb,
+                                 const EncodeOptions *options)
+{
+  if (m_tightEncoder->shouldUseJobs(rects)) {
+    m_tightEncoder->sendRectangleJobs(rects, serverFb, options,
+                                      shouldForceJpeg(options));
+  } else {
+    m_tightEncoder->m_parallelSpeedup = 1.0;
+    Encoder::sendRectangles(rects, serverFb, options);
+  }
+}
+
+double JpegEncoder::getParallelSpeedup() const
+{
+  return m_tightEncoder->getParallelSpeedup();
+}
+
+int JpegEncoder::getBandHeight(const Rect *rect) const
+{
+  int height = rect->getHeight();
+  WorkerPool *pool = m_tightEncoder->m_workerPool;
+  if (pool == 0 || rect->area() < MIN_BANDED_AREA) {
+    return height;
+  }
+  int numThreads = (int)pool->getNumThreads();
+  int bandHeight = (height + numThreads - 1) / numThreads;
+  bandHeight = (bandHeight + MCU_HEIGHT - 1) / MCU_HEIGHT * MCU_HEIGHT;
+  return max(bandHeight, MIN_BAND_HEIGHT);
+}
+
+bool JpegEncoder::shouldForceJpeg(const EncodeOptions *options) const
+{
+  size_t bppServer = m_pixelConverter->getSrcBitsPerPixel();
+  size_t bppClient = m_pixelConverter->getDstBitsPerPixel();
+  bool goodColorResolution = (bppServer >= 16 && bppClient >= 16);
+
+  return options->jpegEnabled() && goodColorResolution;
+}
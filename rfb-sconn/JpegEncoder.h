@@ -38,8 +38,10 @@ public:
   // Overloaded function calls TightEncoder::getCode().
   virtual int getCode() const;
 
-  // JpegEncoder implements its own splitRectangle() which just makes sure all
-  // rectangles are no wider than 2048 pixels.
+  // JpegEncoder implements its own splitRectangle() which makes sure all
+  // rectangles are no wider than 2048 pixels. If the TightEncoder uses a
+  // number of threads, big rectangles are also cut into horizontal bands,
+  // one per thread, so that the bands would be compressed in parallel.
   virtual void splitRectangle(const Rect *rect,
                               std::vector<Rect> *rectList,
                               const FrameBuffer *serverFb,
@@ -53,7 +55,32 @@ public:
                              const FrameBuffer *serverFb,
                              const EncodeOptions *options);
 
+  // Same as sendRectangle() for a list of rectangles. Uses parallel
+  // encoding and the cache of encoded rectangles if they are enabled in the
+  // TightEncoder.
+  virtual void sendRectangles(const std::vector<Rect> *rects,
+                              const FrameBuffer *serverFb,
+                              const EncodeOptions *options);
+
+  // Overloaded function calls TightEncoder::getParallelSpeedup().
+  virtual double getParallelSpeedup() const;
+
 protected:
+  // Return true if JPEG sub-encoding should be used for all rectangles.
+  bool shouldForceJpeg(const EncodeOptions *options) const;
+
+  // Return the height of the bands the rectangle should be cut into.
+  int getBandHeight(const Rect *rect) const;
+
+  // Rectangles smaller than this (in pixels) are not cut into bands, as
+  // each band costs its own JPEG headers.
+  static const int MIN_BANDED_AREA = 65536;
+  // Band heights are multiples of the JPEG MCU height (with the default
+  // chroma subsampling), so that no band except the last one has padded
+  // MCUs. Bands are not made lower than MIN_BAND_HEIGHT.
+  static const int MCU_HEIGHT = 16;
+  static const int MIN_BAND_HEIGHT = 64;
+
   TightEncoder *m_tightEncoder;
 };
 
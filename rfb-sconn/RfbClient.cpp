@@ -39,6 +39,8 @@ RfbClient::RfbClient(NewConnectionEvents *newConnectionEvents,
                      const ViewPortState *constViewPort,
                      const ViewPortState *dynViewPort,
                      int idleTimeout,
+                     EncodedRectCache *encodedRectCache,
+                     ConvertedFrameBufferStore *convertedFbStore,
                      LogWriter *log)
 : m_socket(socket), // now we own the socket
   m_newConnectionEvents(newConnectionEvents),
@@ -58,6 +60,8 @@ RfbClient::RfbClient(NewConnectionEvents *newConnectionEvents,
   m_constViewPort(constViewPort, log),
   m_dynamicViewPort(dynViewPort, log),
   m_idleTimer(idleTimeout), m_idleTimeout(idleTimeout),
+  m_encodedRectCache(encodedRectCache),
+  m_convertedFbStore(convertedFbStore),
   m_log(log)
 {
   resume();
@@ -221,7 +225,9 @@ void RfbClient::execute()
     // Init modules
     // UpdateSender initialization
     m_updateSender = new UpdateSender(&codeRegtor, m_desktop, this,
-                                      &output, m_id, m_desktop, m_log);
+                                      &output, m_id, m_desktop,
+                                      m_encodedRectCache,
+                                      m_convertedFbStore, m_log);
     m_log->debug(_T("UpdateSender has been created"));
     PixelFormat pf;
     Dimension fbDim;
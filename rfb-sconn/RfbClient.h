@@ -65,6 +65,8 @@ public:
             const ViewPortState *constViewPort,
             const ViewPortState *dynViewPort,
             int idleTimeout,
+            EncodedRectCache *encodedRectCache,
+            ConvertedFrameBufferStore *convertedFbStore,
             LogWriter *log);
   virtual ~RfbClient();
 
@@ -152,6 +154,13 @@ private:
   // and resets on mouse or keyboard event
   DemandTimer m_idleTimer;
   int m_idleTimeout;
+
+  // Cache of encoded rectangles shared by all clients, passed to
+  // UpdateSender.
+  EncodedRectCache *m_encodedRectCache;
+  // Pixels converted to client pixel formats, shared by all clients, passed
+  // to UpdateSender.
+  ConvertedFrameBufferStore *m_convertedFbStore;
 };
 
 #endif // __RFBCLIENT_H__
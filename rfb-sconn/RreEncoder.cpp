@@ -57,16 +57,16 @@ void RreEncoder::sendRectangle(const Rect *rect,
                                const FrameBuffer *serverFb,
                                const EncodeOptions *options)
 {
-  const FrameBuffer *fb = m_pixelConverter->convert(rect, serverFb);
+  FrameBufferView fb = m_pixelConverter->convert(rect, serverFb);
 
-  size_t bpp = fb->getBitsPerPixel();
+  size_t bpp = fb.getBitsPerPixel();
   // Choose size of pixel according to options.
   if (bpp == 8) {
-    rreEncode<UINT8>(rect, fb);
+    rreEncode<UINT8>(rect, &fb);
   } else if (bpp == 16) {
-    rreEncode<UINT16>(rect, fb);
+    rreEncode<UINT16>(rect, &fb);
   } else if (bpp == 32) {
-    rreEncode<UINT32>(rect, fb);
+    rreEncode<UINT32>(rect, &fb);
   } else {
     _ASSERT(0);
   }
@@ -74,17 +74,18 @@ void RreEncoder::sendRectangle(const Rect *rect,
 
 template <class PIXEL_T>
 void RreEncoder::rreEncode(const Rect *r,
-                           const FrameBuffer *frameBuffer)
+                           const FrameBufferView *frameBuffer)
 {
-  PIXEL_T *buffer = (PIXEL_T *)frameBuffer->getBuffer();
-  int fbWidth = frameBuffer->getDimension().width;
+  const PIXEL_T *buffer = (const PIXEL_T *)frameBuffer->getBufferPtr(r->left,
+                                                                     r->top);
+  int fbWidth = frameBuffer->getStride();
   PixelFormat pxFormat = frameBuffer->getPixelFormat();
   // Mask for cutting rubbish bits.
   PIXEL_T mask = pxFormat.redMax << pxFormat.redShift |
                  pxFormat.greenMax << pxFormat.greenShift |
                  pxFormat.blueMax << pxFormat.blueShift;
   
-  PIXEL_T backgroundPixelValue = buffer[r->top * fbWidth + r->left] & mask;
+  PIXEL_T backgroundPixelValue = buffer[0] & mask;
   
   // Clear the cache with m_rects.
   m_rects.resize(0);
@@ -92,15 +93,16 @@ void RreEncoder::rreEncode(const Rect *r,
   vector<PIXEL_T> subrectPixelValue;
 
   // Find lines with the same pixel values.
-  for (int i = r->top; i < r->bottom; i++) {
-    for (int j = r->left; j < r->right; j++) {
+  // Here, i and j are relative to the upper left corner of the rectangle.
+  for (int i = 0; i < r->getHeight(); i++) {
+    for (int j = 0; j < r->getWidth(); j++) {
       if ((buffer[i * fbWidth + j] & mask) != backgroundPixelValue) {
         if (subrectPixelValue.empty() ||
             (buffer[i * fbWidth + j] & mask) != (buffer[i * fbWidth + j - 1] & mask) ||
-            m_rects.back().top != (i - r->top)) {
+            m_rects.back().top != i) {
           subrectPixelValue.push_back(buffer[i * fbWidth + j] & mask);
           Rect rect(1, 1);
-          rect.setLocation(j - r->left, i - r->top);
+          rect.setLocation(j, i);
           m_rects.push_back(rect);
         } else {
           ++m_rects.back().right;
@@ -48,7 +48,7 @@ public:
 private:
   template <class PIXEL_T>
     void rreEncode(const Rect *r,
-                   const FrameBuffer *frameBuffer) throw(IOException);
+                   const FrameBufferView *frameBuffer) throw(IOException);
 
   // Coordinates of subrectangles.
   std::vector<Rect> m_rects;
@@ -0,0 +1,133 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#include "SharedPixelConverter.h"
+
+SharedPixelConverter::SharedPixelConverter(ConvertedFrameBufferStore *store)
+: m_store(store),
+  m_convertedFb(0),
+  m_sharedFb(0),
+  m_snapshot(0),
+  m_snapshotFb(0)
+{
+}
+
+SharedPixelConverter::~SharedPixelConverter()
+{
+  releaseConvertedFb();
+}
+
+FrameBufferView SharedPixelConverter::convert(const Rect *rect,
+                                              const FrameBuffer *srcFb)
+{
+  FrameBufferView view;
+  if (getConvertedView(rect, srcFb, &view)) {
+    return view;
+  }
+  return PixelConverter::convert(rect, srcFb);
+}
+
+void SharedPixelConverter::setPixelFormats(const PixelFormat *dstPf,
+                                           const PixelFormat *srcPf)
+{
+  if (!srcPf->isEqualTo(&m_srcFormat) || !dstPf->isEqualTo(&m_dstFormat)) {
+    releaseConvertedFb();
+  }
+  PixelConverter::setPixelFormats(dstPf, srcPf);
+}
+
+bool SharedPixelConverter::getContentStamp(const Rect *rect,
+                                           const FrameBuffer *srcFb,
+                                           UINT64 *stamp) const
+{
+  if (m_snapshot == 0 || srcFb != m_snapshotFb) {
+    return false;
+  }
+  *stamp = m_snapshot->getContentStamp(rect);
+  return *stamp != 0;
+}
+
+bool SharedPixelConverter::getConvertedView(const Rect *rect,
+                                            const FrameBuffer *srcFb,
+                                            FrameBufferView *view)
+{
+  if (m_convertedFb == 0 || srcFb != m_sharedFb ||
+      !srcFb->getDimension().isEqualTo(&m_sharedDim)) {
+    return false;
+  }
+  return m_convertedFb->getView(rect, m_snapshot, srcFb, &m_pins, view);
+}
+
+void SharedPixelConverter::setSnapshot(FrameBufferSnapshot *snapshot)
+{
+  releaseSharedPixels();
+  m_snapshot = snapshot;
+  m_snapshotFb = snapshot->getFrameBuffer();
+  const FrameBuffer *srcFb = m_snapshotFb;
+  if (srcFb == 0) {
+    releaseConvertedFb();
+    return;
+  }
+
+  Dimension dim = srcFb->getDimension();
+  PixelFormat srcPf = srcFb->getPixelFormat();
+  if (m_convertedFb != 0 &&
+      (!dim.isEqualTo(&m_sharedDim) || !srcPf.isEqualTo(&m_srcFormat))) {
+    releaseConvertedFb();
+  }
+  // Nothing to share if no conversion is needed. Pixels of a private
+  // snapshot are not shared either, but the ConvertedFrameBuffer is kept for
+  // the next snapshots.
+  if (m_store == 0 || m_convertMode == NO_CONVERT ||
+      !srcPf.isEqualTo(&m_srcFormat) || snapshot->isPrivate()) {
+    return;
+  }
+  if (m_convertedFb == 0) {
+    m_convertedFb = m_store->acquire(&m_dstFormat, &m_srcFormat, &dim);
+    m_sharedDim = dim;
+  }
+  m_sharedFb = srcFb;
+}
+
+void SharedPixelConverter::releaseSharedPixels()
+{
+  if (m_convertedFb != 0) {
+    m_convertedFb->unpinAll(&m_pins);
+  }
+  m_sharedFb = 0;
+  m_snapshot = 0;
+  m_snapshotFb = 0;
+}
+
+void SharedPixelConverter::releaseConvertedFb()
+{
+  if (m_convertedFb != 0) {
+    m_convertedFb->unpinAll(&m_pins);
+    m_pins = ConvertedFrameBuffer::Pins();
+    m_store->release(m_convertedFb);
+    m_convertedFb = 0;
+  }
+  m_sharedFb = 0;
+}
@@ -0,0 +1,106 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#ifndef __RFB_SHARED_PIXEL_CONVERTER_H_INCLUDED__
+#define __RFB_SHARED_PIXEL_CONVERTER_H_INCLUDED__
+
+#include "rfb/PixelConverter.h"
+#include "desktop/SharedFrameBuffer.h"
+#include "ConvertedFrameBufferStore.h"
+
+// SharedPixelConverter is a PixelConverter which takes the pixels converted
+// from one particular frame buffer (normally, the frame buffer snapshot of
+// the update sender) from a ConvertedFrameBuffer shared with other clients
+// using the same pixel formats. Pixels of other frame buffers and of private
+// snapshots are converted as usual. Content stamps are given for the pixels
+// of the snapshot.
+//
+// Views of the shared pixels point right into the ConvertedFrameBuffer and
+// stay valid until the next setSnapshot() or releaseSharedPixels() call,
+// longer than the views returned by PixelConverter::convert(). Until then,
+// other clients cannot change these pixels, so the pixels should be
+// released as soon as an update is sent.
+//
+// Like the PixelConverter, the object should be used by one thread.
+// The const functions may be called by several threads at the same time.
+class SharedPixelConverter : public PixelConverter
+{
+public:
+  // If store is 0, the object will work like a plain PixelConverter.
+  SharedPixelConverter(ConvertedFrameBufferStore *store);
+  virtual ~SharedPixelConverter();
+
+  using PixelConverter::convert;
+
+  // Returns a view of the shared pixels if possible.
+  virtual FrameBufferView convert(const Rect *rect, const FrameBuffer *srcFb);
+
+  virtual void setPixelFormats(const PixelFormat *dstPf,
+                               const PixelFormat *srcPf);
+
+  // Returns the stamp given by the snapshot for its frame buffer.
+  virtual bool getContentStamp(const Rect *rect, const FrameBuffer *srcFb,
+                               UINT64 *stamp) const;
+
+  // Returns a view of the shared pixels converted from the frame buffer of
+  // the snapshot.
+  virtual bool getConvertedView(const Rect *rect, const FrameBuffer *srcFb,
+                                FrameBufferView *view);
+
+  // Start sharing pixels converted from the frame buffer of the snapshot.
+  // Should be called after setPixelFormats() and after each update of the
+  // snapshot. The snapshot should not be updated or destroyed before the
+  // next call of this function or destruction of the object.
+  void setSnapshot(FrameBufferSnapshot *snapshot);
+
+  // Let other clients change the shared pixels viewed since the last
+  // setSnapshot() call and forget the snapshot. Views of the shared pixels
+  // become invalid.
+  void releaseSharedPixels();
+
+protected:
+  void releaseConvertedFb();
+
+  ConvertedFrameBufferStore *m_store;
+  // The object where the converted pixels are stored, the frame buffer they
+  // are converted from and the tiles pinned by views of the pixels.
+  // m_convertedFb is 0 if pixels are not shared. m_sharedFb is 0 if the
+  // pixels of the current snapshot cannot be shared.
+  ConvertedFrameBuffer *m_convertedFb;
+  const FrameBuffer *m_sharedFb;
+  Dimension m_sharedDim;
+  ConvertedFrameBuffer::Pins m_pins;
+  // The snapshot given by setSnapshot(), it is not 0 even if pixels are not
+  // shared (until releaseSharedPixels() is called).
+  const FrameBufferSnapshot *m_snapshot;
+  const FrameBuffer *m_snapshotFb;
+
+private:
+  // Do not allow copying objects.
+  SharedPixelConverter(const SharedPixelConverter &other);
+  SharedPixelConverter &operator=(const SharedPixelConverter &other);
+};
+
+#endif // __RFB_SHARED_PIXEL_CONVERTER_H_INCLUDED__
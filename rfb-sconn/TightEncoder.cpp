@@ -24,18 +24,38 @@
 
 #include "TightEncoder.h"
 
-#include "io-lib/ByteArrayOutputStream.h"
-
-TightEncoder::TightEncoder(PixelConverter *conv, DataOutputStream *output)
-: Encoder(conv, output)
+#include "thread/AutoLock.h"
+
+TightEncoder::TightEncoder(PixelConverter *conv, DataOutputStream *output,
+                           EncodedRectCache *rectCache)
+: Encoder(conv, output),
+  m_rectCache(rectCache),
+  m_workerPool(0),
+  m_numJobs(0),
+  m_nextJob(0),
+  m_jobServerFb(0),
+  m_jobOptions(0),
+  m_jobForceJpeg(false),
+  m_jobUseCache(false),
+  m_jobPass(PASS_ENCODE),
+  m_parallelSpeedup(1.0),
+  m_deferredJob(0)
 {
   for (int i = 0; i < NUM_ZLIB_STREAMS; i++) {
     m_zsActive[i] = false;
   }
+  if (m_rectCache != 0) {
+    m_rectCache->addUser();
+  }
 }
 
 TightEncoder::~TightEncoder()
 {
+  destroyWorkers();
+  if (m_rectCache != 0) {
+    m_rectCache->removeUser();
+  }
+
   for (int i = 0; i < NUM_ZLIB_STREAMS; i++) {
     if (m_zsActive[i]) {
       deflateEnd(&m_zsStruct[i]);
@@ -52,6 +72,28 @@ void TightEncoder::splitRectangle(const Rect *rect,
                                   std::vector<Rect> *rectList,
                                   const FrameBuffer *serverFb,
                                   const EncodeOptions *options)
+{
+  // Solid areas are detected in the server pixel format. Pixels of the same
+  // color remain the same after conversion to the client format.
+  size_t bpp = serverFb->getBitsPerPixel();
+  switch (bpp) {
+  case 8:
+    splitSolidAreas<UINT8>(rect, rectList, serverFb, options);
+    break;
+  case 16:
+    splitSolidAreas<UINT16>(rect, rectList, serverFb, options);
+    break;
+  case 32:
+    splitSolidAreas<UINT32>(rect, rectList, serverFb, options);
+    break;
+  default:
+    splitToTiles(rect, rectList, options);
+  }
+}
+
+void TightEncoder::splitToTiles(const Rect *rect,
+                                std::vector<Rect> *rectList,
+                                const EncodeOptions *options)
 {
   int maxSize = getConf(options).maxRectSize;
   int rectWidth = rect->getWidth();
@@ -84,9 +126,417 @@ void TightEncoder::sendRectangle(const Rect *rect,
                                  const EncodeOptions *options)
 {
   // First, convert pixels to client format.
-  const FrameBuffer *clientFb = m_pixelConverter->convert(rect, serverFb);
+  FrameBufferView clientFb = m_pixelConverter->convert(rect, serverFb);
+
+  sendConvertedRect(rect, serverFb, &clientFb, options, false);
+}
+
+void TightEncoder::sendRectangles(const std::vector<Rect> *rects,
+                                  const FrameBuffer *serverFb,
+                                  const EncodeOptions *options)
+{
+  if (shouldUseJobs(rects)) {
+    sendRectangleJobs(rects, serverFb, options, false);
+  } else {
+    m_parallelSpeedup = 1.0;
+    Encoder::sendRectangles(rects, serverFb, options);
+  }
+}
+
+void TightEncoder::setNumThreads(size_t numThreads)
+{
+  size_t currentNumThreads = 1;
+  if (m_workerPool != 0) {
+    currentNumThreads = m_workerPool->getNumThreads();
+  }
+  if (numThreads < 1) {
+    numThreads = 1;
+  }
+  if (numThreads == currentNumThreads) {
+    return;
+  }
+
+  destroyWorkers();
+  if (numThreads > 1) {
+    try {
+      for (size_t i = 0; i < numThreads; i++) {
+        m_lanes.push_back(new EncodingLane(this));
+      }
+      m_workerPool = new WorkerPool(numThreads);
+    } catch (...) {
+      destroyWorkers();
+      throw;
+    }
+  }
+}
+
+double TightEncoder::getParallelSpeedup() const
+{
+  return m_parallelSpeedup;
+}
+
+int TightEncoder::getRectOverhead(const EncodeOptions *options) const
+{
+  return getConf(options).rectOverhead;
+}
+
+TightEncoder::Statistics::Statistics()
+: classifiedRects(0),
+  classifiedJpegRects(0)
+{
+  for (int i = 0; i < NUM_SUBENC_TYPES; i++) {
+    rects[i] = 0;
+    pixels[i] = 0;
+  }
+}
+
+void TightEncoder::Statistics::add(const Statistics *other)
+{
+  for (int i = 0; i < NUM_SUBENC_TYPES; i++) {
+    rects[i] += other->rects[i];
+    pixels[i] += other->pixels[i];
+  }
+  classifiedRects += other->classifiedRects;
+  classifiedJpegRects += other->classifiedJpegRects;
+}
+
+void TightEncoder::getStatistics(Statistics *stats) const
+{
+  *stats = m_statistics;
+}
+
+void TightEncoder::takeLossyRects(std::vector<Rect> *rects)
+{
+  rects->insert(rects->end(), m_lossyRects.begin(), m_lossyRects.end());
+  m_lossyRects.clear();
+}
+
+//--------------------------------------------------------------------------//
+
+TightEncoder::EncodingLane::EncodingLane(TightEncoder *owner)
+: m_owner(owner),
+  m_output(&m_buffer),
+  m_encoder(0)
+{
+  // The pixel converter is never used by the lane encoder, pixels are
+  // converted by the owner in advance.
+  m_encoder = new TightEncoder(owner->m_pixelConverter, &m_output);
+}
+
+TightEncoder::EncodingLane::~EncodingLane()
+{
+  delete m_encoder;
+}
+
+void TightEncoder::EncodingLane::run()
+{
+  RectJob *job;
+  while ((job = m_owner->getNextJob()) != 0) {
+    if (m_owner->m_jobPass == PASS_LOOKUP) {
+      job->cacheable = m_owner->makeCacheKey(job, &job->cacheKey);
+      job->cached = job->cacheable &&
+                    m_owner->m_rectCache->find(&job->cacheKey, &job->encoded);
+      continue;
+    }
+
+    m_buffer.reset();
+    job->encoded.streamId = -1;
+    m_encoder->m_deferredJob = job;
+    try {
+      m_encoder->sendConvertedRect(&job->rect,
+                                   m_owner->m_jobServerFb,
+                                   &job->clientFb,
+                                   m_owner->m_jobOptions,
+                                   m_owner->m_jobForceJpeg);
+    } catch (...) {
+      m_encoder->m_deferredJob = 0;
+      throw;
+    }
+    m_encoder->m_deferredJob = 0;
+
+    const char *data = m_buffer.toByteArray();
+    job->encoded.prefix.assign(data, data + m_buffer.size());
+
+    if (job->cacheable) {
+      m_owner->m_rectCache->put(&job->cacheKey, &job->encoded);
+    }
+  }
+}
+
+void TightEncoder::EncodingLane::takeStatistics(Statistics *stats)
+{
+  stats->add(&m_encoder->m_statistics);
+  m_encoder->m_statistics = Statistics();
+}
+
+TightEncoder::CompressionTask::CompressionTask(TightEncoder *owner,
+                                               int streamId)
+: m_owner(owner),
+  m_streamId(streamId)
+{
+}
+
+void TightEncoder::CompressionTask::run()
+{
+  for (size_t i = 0; i < m_owner->m_numJobs; i++) {
+    RectJob *job = &m_owner->m_jobs[i];
+    if (job->encoded.streamId == m_streamId) {
+      job->compressedLength =
+        m_owner->compressData(&job->encoded.uncompressed.front(),
+                              job->encoded.uncompressed.size(),
+                              job->encoded.streamId, job->encoded.zlibLevel,
+                              &job->compressed);
+    }
+  }
+}
+
+bool TightEncoder::shouldUseJobs(const std::vector<Rect> *rects) const
+{
+  if (m_workerPool != 0 && rects->size() > 1) {
+    return true;
+  }
+  return m_rectCache != 0 && m_rectCache->isActive();
+}
+
+void TightEncoder::sendRectangleJobs(const std::vector<Rect> *rects,
+                                     const FrameBuffer *serverFb,
+                                     const EncodeOptions *options,
+                                     bool forceJpeg)
+{
+  INT64 startTime = WorkerPool::getTimerValue();
+
+  if (m_lanes.empty()) {
+    m_lanes.push_back(new EncodingLane(this));
+  }
+
+  // Prepare jobs.
+  m_numJobs = rects->size();
+  if (m_jobs.size() < m_numJobs) {
+    m_jobs.resize(m_numJobs);
+  }
+  for (size_t i = 0; i < m_numJobs; i++) {
+    m_jobs[i].rect = (*rects)[i];
+    m_jobs[i].cacheable = false;
+    m_jobs[i].cached = false;
+    m_jobs[i].sharedPixels = false;
+  }
+  m_jobServerFb = serverFb;
+  m_jobOptions = options;
+  m_jobForceJpeg = forceJpeg;
+  m_jobUseCache = m_rectCache != 0 && m_rectCache->isActive();
+
+  INT64 busyTime = 0;
+  INT64 poolTime = 0;
+
+  try {
+    std::vector<WorkerTask *> tasks(m_lanes.begin(), m_lanes.end());
+
+    // Pass 0: look for rectangles encoded by other encoders.
+    if (m_jobUseCache) {
+      m_jobPass = PASS_LOOKUP;
+      m_nextJob = 0;
+      runTasks(&tasks, &busyTime, &poolTime);
+    }
+
+    // Convert pixels to client format. This is done in this thread because
+    // PixelConverter may not be used by several threads at once.
+    convertJobPixels();
+
+    // Pass 1: analyze, filter and JPEG-compress rectangles.
+    m_jobPass = PASS_ENCODE;
+    m_nextJob = 0;
+    runTasks(&tasks, &busyTime, &poolTime);
+
+    // Converted pixels are not needed any more. Do not keep a big buffer
+    // after a big update.
+    if (m_jobPixels.size() > MAX_KEPT_JOB_PIXELS_SIZE) {
+      std::vector<UINT8>().swap(m_jobPixels);
+    }
+
+    // Pass 2: compress the data, one task per zlib stream in use.
+    std::vector<CompressionTask> compressionTasks;
+    compressionTasks.reserve(NUM_ZLIB_STREAMS);
+    for (int streamId = 0; streamId < NUM_ZLIB_STREAMS; streamId++) {
+      for (size_t i = 0; i < m_numJobs; i++) {
+        if (m_jobs[i].encoded.streamId == streamId) {
+          compressionTasks.push_back(CompressionTask(this, streamId));
+          break;
+        }
+      }
+    }
+    if (!compressionTasks.empty()) {
+      tasks.clear();
+      for (size_t i = 0; i < compressionTasks.size(); i++) {
+        tasks.push_back(&compressionTasks[i]);
+      }
+      runTasks(&tasks, &busyTime, &poolTime);
+    }
+  } catch (IOException &) {
+    throw;
+  } catch (Exception &e) {
+    throw IOException(e.getMessage());
+  }
+
+  // Collect the statistics of rectangles encoded by the lanes.
+  for (size_t i = 0; i < m_lanes.size(); i++) {
+    m_lanes[i]->takeStatistics(&m_statistics);
+  }
+
+  // Pass 3: write everything in the original order of rectangles.
+  for (size_t i = 0; i < m_numJobs; i++) {
+    const RectJob *job = &m_jobs[i];
+    const EncodedRect *encoded = &job->encoded;
+    sendRectHeader(&job->rect);
+    if (!encoded->prefix.empty()) {
+      m_output->writeFully(&encoded->prefix.front(), encoded->prefix.size());
+      // The prefix starts with the compression control byte, which tells
+      // JPEG rectangles (including cached ones) from lossless ones.
+      if ((UINT8)encoded->prefix[0] == SUBENCODING_JPEG) {
+        m_lossyRects.push_back(job->rect);
+      }
+    }
+    if (encoded->streamId >= 0) {
+      sendCompactLength(job->compressedLength);
+      m_output->writeFully(&job->compressed.front(), job->compressedLength);
+    }
+  }
+
+  // The time spent outside the worker pool was spent by one thread.
+  INT64 elapsedTime = WorkerPool::getTimerValue() - startTime;
+  if (elapsedTime > 0) {
+    m_parallelSpeedup = (double)(busyTime + elapsedTime - poolTime) /
+                        (double)elapsedTime;
+  } else {
+    m_parallelSpeedup = 1.0;
+  }
+}
+
+void TightEncoder::runTasks(std::vector<WorkerTask *> *tasks,
+                            INT64 *busyTime, INT64 *elapsedTime)
+{
+  if (m_workerPool != 0) {
+    m_workerPool->run(tasks);
+    *busyTime += m_workerPool->getLastBusyTime();
+    *elapsedTime += m_workerPool->getLastElapsedTime();
+  } else {
+    INT64 startTime = WorkerPool::getTimerValue();
+    for (size_t i = 0; i < tasks->size(); i++) {
+      (*tasks)[i]->run();
+    }
+    INT64 taskTime = WorkerPool::getTimerValue() - startTime;
+    *busyTime += taskTime;
+    *elapsedTime += taskTime;
+  }
+}
 
-  // Now call an encoder function corresponding to the client's pixel size.
+bool TightEncoder::makeCacheKey(const RectJob *job,
+                                EncodedRectCache::Key *key) const
+{
+  if (!m_pixelConverter->getContentStamp(&job->rect, m_jobServerFb,
+                                         &key->contentStamp)) {
+    return false;
+  }
+  key->rect = job->rect;
+  key->serverFormat = m_pixelConverter->getSrcFormat();
+  key->clientFormat = m_pixelConverter->getDstFormat();
+  key->encoding = getCode();
+  key->forceJpeg = m_jobForceJpeg;
+  key->compressionLevel =
+    m_jobOptions->getCompressionLevel(DEFAULT_COMPRESSION_LEVEL);
+  key->jpegQualityLevel = m_jobOptions->getJpegQualityLevel();
+  return true;
+}
+
+void TightEncoder::convertJobPixels()
+{
+  // JPEG compression works with the server pixel format.
+  if (m_jobForceJpeg) {
+    return;
+  }
+
+  PixelFormat srcPf = m_pixelConverter->getSrcFormat();
+  PixelFormat dstPf = m_pixelConverter->getDstFormat();
+  if (srcPf.isEqualTo(&dstPf)) {
+    // No conversion needed, encode right from the server frame buffer.
+    for (size_t i = 0; i < m_numJobs; i++) {
+      m_jobs[i].clientFb = FrameBufferView(m_jobServerFb, &m_jobs[i].rect);
+    }
+    return;
+  }
+
+  // Pixels already converted by the pixel converter (e.g. shared with other
+  // clients) are used in place. The others are converted to one buffer,
+  // each rectangle with its own stride equal to its width.
+  size_t pixelSize = dstPf.bitsPerPixel / 8;
+  size_t totalSize = 0;
+  for (size_t i = 0; i < m_numJobs; i++) {
+    RectJob *job = &m_jobs[i];
+    job->sharedPixels = !job->cached &&
+                        m_pixelConverter->getConvertedView(&job->rect,
+                                                           m_jobServerFb,
+                                                           &job->clientFb);
+    if (!job->cached && !job->sharedPixels) {
+      totalSize += (size_t)job->rect.area() * pixelSize;
+    }
+  }
+  if (m_jobPixels.size() < totalSize) {
+    m_jobPixels.resize(totalSize);
+  }
+
+  size_t offset = 0;
+  for (size_t i = 0; i < m_numJobs; i++) {
+    RectJob *job = &m_jobs[i];
+    if (!job->cached && !job->sharedPixels) {
+      size_t size = (size_t)job->rect.area() * pixelSize;
+      UINT8 *buffer = size != 0 ? &m_jobPixels[offset] : 0;
+      int width = job->rect.getWidth();
+      if (size != 0) {
+        m_pixelConverter->convert(&job->rect, buffer, width, m_jobServerFb);
+      }
+      job->clientFb = FrameBufferView(buffer, &job->rect, width, &dstPf);
+      offset += size;
+    }
+  }
+}
+
+TightEncoder::RectJob *TightEncoder::getNextJob()
+{
+  AutoLock l(&m_jobLock);
+  while (m_nextJob < m_numJobs) {
+    RectJob *job = &m_jobs[m_nextJob++];
+    // Rectangles found in the cache are not encoded again.
+    if (m_jobPass != PASS_ENCODE || !job->cached) {
+      return job;
+    }
+  }
+  return 0;
+}
+
+void TightEncoder::destroyWorkers()
+{
+  // Threads of the pool should be stopped before the lanes are deleted.
+  if (m_workerPool != 0) {
+    delete m_workerPool;
+    m_workerPool = 0;
+  }
+  for (size_t i = 0; i < m_lanes.size(); i++) {
+    delete m_lanes[i];
+  }
+  m_lanes.clear();
+}
+
+void TightEncoder::sendConvertedRect(const Rect *rect,
+                                     const FrameBuffer *serverFb,
+                                     const FrameBufferView *clientFb,
+                                     const EncodeOptions *options,
+                                     bool forceJpeg)
+{
+  if (forceJpeg) {
+    sendJpegRect(rect, serverFb, options);
+    return;
+  }
+
+  // Call an encoder function corresponding to the client's pixel size.
   size_t bpp = clientFb->getBitsPerPixel();
   switch (bpp) {
   case 8:
@@ -105,12 +555,189 @@ void TightEncoder::sendRectangle(const Rect *rect,
 
 //--------------------------------------------------------------------------//
 
+template <class PIXEL_T>
+void TightEncoder::splitSolidAreas(const Rect *rect,
+                                   std::vector<Rect> *rectList,
+                                   const FrameBuffer *serverFb,
+                                   const EncodeOptions *options)
+{
+  if (rect->area() < MIN_SPLIT_RECT_SIZE) {
+    splitToTiles(rect, rectList, options);
+    return;
+  }
+
+  Rect tile;
+  for (tile.top = rect->top; tile.top < rect->bottom;
+       tile.top += SPLIT_TILE_SIZE) {
+    tile.bottom = min(tile.top + SPLIT_TILE_SIZE, rect->bottom);
+    for (tile.left = rect->left; tile.left < rect->right;
+         tile.left += SPLIT_TILE_SIZE) {
+      tile.right = min(tile.left + SPLIT_TILE_SIZE, rect->right);
+
+      UINT32 color;
+      if (!checkSolidTile<PIXEL_T>(&tile, serverFb, &color, false)) {
+        continue;
+      }
+
+      // Get dimensions of the solid-color area starting at this tile.
+      Rect searchRect(tile.left, tile.top, rect->right, rect->bottom);
+      Rect best;
+      findBestSolidArea<PIXEL_T>(&searchRect, color, serverFb, &best);
+
+      // Make sure the solid area is large enough (or the whole rectangle is
+      // of the same color).
+      if (best.area() != rect->area() &&
+          best.area() < MIN_SOLID_SUBRECT_SIZE) {
+        continue;
+      }
+
+      // Try to extend the solid area to its maximum size.
+      extendSolidArea<PIXEL_T>(rect, color, serverFb, &best);
+
+      // The area above the solid rectangle does not contain solid tiles
+      // (otherwise, we would have found them earlier).
+      if (best.top != rect->top) {
+        Rect above(rect->left, rect->top, rect->right, best.top);
+        splitToTiles(&above, rectList, options);
+      }
+      if (best.left != rect->left) {
+        Rect left(rect->left, best.top, best.left, best.bottom);
+        splitSolidAreas<PIXEL_T>(&left, rectList, serverFb, options);
+      }
+
+      // The solid-color rectangle is sent as a whole.
+      rectList->push_back(best);
+
+      // Process the remaining parts (at right and below).
+      if (best.right != rect->right) {
+        Rect right(best.right, best.top, rect->right, best.bottom);
+        splitSolidAreas<PIXEL_T>(&right, rectList, serverFb, options);
+      }
+      if (best.bottom != rect->bottom) {
+        Rect below(rect->left, best.bottom, rect->right, rect->bottom);
+        splitSolidAreas<PIXEL_T>(&below, rectList, serverFb, options);
+      }
+      return;
+    }
+  }
+
+  // No suitable solid-color areas found.
+  splitToTiles(rect, rectList, options);
+}
+
+template <class PIXEL_T>
+void TightEncoder::findBestSolidArea(const Rect *rect, UINT32 color,
+                                     const FrameBuffer *fb, Rect *bestRect)
+{
+  int bestWidth = 0;
+  int bestHeight = 0;
+  int prevRight = rect->right;
+
+  Rect tile;
+  for (tile.top = rect->top; tile.top < rect->bottom;
+       tile.top += SPLIT_TILE_SIZE) {
+    tile.bottom = min(tile.top + SPLIT_TILE_SIZE, rect->bottom);
+
+    // Go to the right until a tile of another color is found, but not
+    // further than in the previous row of tiles.
+    for (tile.left = rect->left; tile.left < prevRight;
+         tile.left = tile.right) {
+      tile.right = min(tile.left + SPLIT_TILE_SIZE, prevRight);
+      if (!checkSolidTile<PIXEL_T>(&tile, fb, &color, true)) {
+        break;
+      }
+    }
+    if (tile.left == rect->left) {
+      break;
+    }
+    prevRight = tile.left;
+
+    int width = prevRight - rect->left;
+    int height = tile.bottom - rect->top;
+    if (width * height > bestWidth * bestHeight) {
+      bestWidth = width;
+      bestHeight = height;
+    }
+  }
+
+  bestRect->setRect(rect->left, rect->top,
+                    rect->left + bestWidth, rect->top + bestHeight);
+}
+
+template <class PIXEL_T>
+void TightEncoder::extendSolidArea(const Rect *bounds, UINT32 color,
+                                   const FrameBuffer *fb, Rect *area)
+{
+  Rect line;
+
+  // Try to extend the area upwards.
+  line.setRect(area->left, area->top - 1, area->right, area->top);
+  while (line.top >= bounds->top &&
+         checkSolidTile<PIXEL_T>(&line, fb, &color, true)) {
+    line.move(0, -1);
+  }
+  area->top = line.bottom;
+
+  // ... downwards.
+  line.setRect(area->left, area->bottom, area->right, area->bottom + 1);
+  while (line.bottom <= bounds->bottom &&
+         checkSolidTile<PIXEL_T>(&line, fb, &color, true)) {
+    line.move(0, 1);
+  }
+  area->bottom = line.top;
+
+  // ... to the left.
+  line.setRect(area->left - 1, area->top, area->left, area->bottom);
+  while (line.left >= bounds->left &&
+         checkSolidTile<PIXEL_T>(&line, fb, &color, true)) {
+    line.move(-1, 0);
+  }
+  area->left = line.right;
+
+  // ... to the right.
+  line.setRect(area->right, area->top, area->right + 1, area->bottom);
+  while (line.right <= bounds->right &&
+         checkSolidTile<PIXEL_T>(&line, fb, &color, true)) {
+    line.move(1, 0);
+  }
+  area->right = line.left;
+}
+
+template <class PIXEL_T>
+bool TightEncoder::checkSolidTile(const Rect *rect, const FrameBuffer *fb,
+                                  UINT32 *color, bool needSameColor)
+{
+  const PIXEL_T *src = (const PIXEL_T *)fb->getBufferPtr(rect->left, rect->top);
+  const int w = rect->getWidth();
+  const int h = rect->getHeight();
+  const int fbStride = fb->getBytesPerRow() / sizeof(PIXEL_T);
+
+  const PIXEL_T colorValue = *src;
+  if (needSameColor && colorValue != (PIXEL_T)*color) {
+    return false;
+  }
+
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      if (src[x] != colorValue) {
+        return false;
+      }
+    }
+    src += fbStride;
+  }
+
+  if (!needSameColor) {
+    *color = colorValue;
+  }
+  return true;
+}
+
 // FIXME: Is it really necessary to pass both frame buffers in arguments?
 // FIXME: Make a special version for the case when PIXEL_T is UINT8.
 template <class PIXEL_T>
 void TightEncoder::sendAnyRect(const Rect *rect,
                                const FrameBuffer *serverFb,
-                               const FrameBuffer *clientFb,
+                               const FrameBufferView *clientFb,
                                const EncodeOptions *options)
 {
   // Compute maximum number of colors to be allowed in the palette.
@@ -124,8 +751,8 @@ void TightEncoder::sendAnyRect(const Rect *rect,
     }
   }
 
-  // Fill in the palette (m_pal).
-  fillPalette<PIXEL_T>(rect, clientFb, maxColors);
+  // Fill in the palette (m_pal) and map pixels to palette indices.
+  m_pal.fill(rect, clientFb, maxColors, true);
 
   // If that was a solid-color rectangle, sent it.
   int numColors = m_pal.getNumColors();
@@ -140,15 +767,41 @@ void TightEncoder::sendAnyRect(const Rect *rect,
              serverFb->getBitsPerPixel() >= 16 &&
              rect->area() >= JPEG_MIN_RECT_SIZE &&
              rect->getWidth() >= JPEG_MIN_RECT_WIDTH &&
-             rect->getHeight() >= JPEG_MIN_RECT_HEIGHT) {
+             rect->getHeight() >= JPEG_MIN_RECT_HEIGHT &&
+             classifyAsJpeg(rect, clientFb, options)) {
     sendJpegRect(rect, serverFb, options);
+  } else if (sizeof(PIXEL_T) > 1 &&
+             detectSmoothImage<PIXEL_T>(rect, clientFb, options)) {
+    sendGradientRect<PIXEL_T>(rect, clientFb, options);
   } else {
     sendFullColorRect<PIXEL_T>(rect, clientFb, options);
   }
 }
 
-void TightEncoder::sendSolidRect(const Rect *r, const FrameBuffer *fb)
+bool TightEncoder::classifyAsJpeg(const Rect *rect,
+                                  const FrameBufferView *clientFb,
+                                  const EncodeOptions *options)
+{
+  ContentClassifier::Metrics metrics;
+  m_classifier.analyze(rect, clientFb, &metrics);
+  bool jpeg = ContentClassifier::preferJpeg(&metrics, rect->area(),
+                                            options->getJpegQualityLevel());
+  m_statistics.classifiedRects++;
+  if (jpeg) {
+    m_statistics.classifiedJpegRects++;
+  }
+  return jpeg;
+}
+
+void TightEncoder::countRect(SubencodingType type, const Rect *rect)
+{
+  m_statistics.rects[type]++;
+  m_statistics.pixels[type] += rect->area();
+}
+
+void TightEncoder::sendSolidRect(const Rect *r, const FrameBufferView *fb)
 {
+  countRect(SUBENC_FILL, r);
   PixelFormat pf = fb->getPixelFormat();
   size_t pixelSize = pf.bitsPerPixel / 8;
 
@@ -167,22 +820,17 @@ void TightEncoder::sendSolidRect(const Rect *r, const FrameBuffer *fb)
 
 template <class PIXEL_T>
 void TightEncoder::sendMonoRect(const Rect *rect,
-                                const FrameBuffer *fb,
+                                const FrameBufferView *fb,
                                 const EncodeOptions *options)
 {
+  countRect(SUBENC_MONO, rect);
+
   // Send control info.
   const int zlibStreamId = ZLIB_STREAM_MONO;
   m_output->writeUInt8(EXPLICIT_FILTER | zlibStreamId << 4);
   m_output->writeUInt8(FILTER_PALETTE);
   m_output->writeUInt8(1); // the number of colors minus 1
 
-  // Prepare output buffer.
-  int dataLen = (rect->getWidth() + 7) / 8;
-  dataLen *= rect->getHeight();
-  // FIXME: Optimize, use char[] instead of ByteArrayOutputStream.
-  ByteArrayOutputStream encoded(dataLen);
-  DataOutputStream encodedData(&encoded);
-
   // Send the palette.
   PIXEL_T palette[2] = {
     (PIXEL_T)m_pal.getEntry(0),
@@ -196,20 +844,23 @@ void TightEncoder::sendMonoRect(const Rect *rect,
   }
   m_output->writeFully(palette, pixelSize * 2);
 
-  // Convert image to indexed colors.
-  encodeMonoRect<PIXEL_T>(rect, fb, &encodedData);
-  _ASSERT(encoded.size() == dataLen);
+  // Convert image to a bitmap.
+  size_t dataLen = ((rect->getWidth() + 7) / 8) * rect->getHeight();
+  UINT8 *bitmap = getScratchBuffer(dataLen);
+  encodeMonoRect(rect, bitmap);
 
   // Compress and send.
   int zlibLevel = getConf(options).monoZlibLevel;
-  sendCompressed(encoded.toByteArray(), dataLen, zlibStreamId, zlibLevel);
+  sendCompressed((const char *)bitmap, dataLen, zlibStreamId, zlibLevel);
 }
 
 template <class PIXEL_T>
 void TightEncoder::sendIndexedRect(const Rect *rect,
-                                   const FrameBuffer *fb,
+                                   const FrameBufferView *fb,
                                    const EncodeOptions *options)
 {
+  countRect(SUBENC_INDEXED, rect);
+
   // Send control info.
   const int zlibStreamId = ZLIB_STREAM_IDX;
   m_output->writeUInt8(EXPLICIT_FILTER | zlibStreamId << 4);
@@ -217,12 +868,6 @@ void TightEncoder::sendIndexedRect(const Rect *rect,
   int numColors = m_pal.getNumColors();
   m_output->writeUInt8((UINT8)(numColors - 1));
 
-  // Prepare output buffer.
-  int dataLen = rect->getWidth() * rect->getHeight();
-  // FIXME: Optimize, use char[] instead of ByteArrayOutputStream.
-  ByteArrayOutputStream encoded(dataLen);
-  DataOutputStream encodedData(&encoded);
-
   // Send the palette.
   PIXEL_T palette[256];
   for (int i = 0; i < numColors; i++) {
@@ -236,44 +881,67 @@ void TightEncoder::sendIndexedRect(const Rect *rect,
   }
   m_output->writeFully(palette, pixelSize * numColors);
 
-  // Convert image to indexed colors.
-  encodeIndexedRect<PIXEL_T>(rect, fb, &encodedData);
-  _ASSERT(encoded.size() == dataLen);
-
-  // Compress and send.
+  // Compress and send the index map built with the palette, which is
+  // exactly the indexed image.
   int zlibLevel = getConf(options).idxZlibLevel;
-  sendCompressed(encoded.toByteArray(), dataLen, zlibStreamId, zlibLevel);
+  sendCompressed((const char *)m_pal.getIndexMap(), rect->area(),
+                 zlibStreamId, zlibLevel);
 }
 
 template <class PIXEL_T>
 void TightEncoder::sendFullColorRect(const Rect *rect,
-                                     const FrameBuffer *fb,
+                                     const FrameBufferView *fb,
                                      const EncodeOptions *options)
 {
+  countRect(SUBENC_FULL_COLOR, rect);
+
   // Send control info.
   const int zlibStreamId = ZLIB_STREAM_RAW;
   m_output->writeUInt8(zlibStreamId << 4);
 
-  // Prepare output buffer.
-  int dataLen = rect->area() * sizeof(PIXEL_T);
-  // FIXME: Use char[] instead?
-  std::vector<UINT8> rgbData(dataLen);
-
   // Get pixels from the frame buffer.
-  copyPixels<PIXEL_T>(rect, fb, &rgbData.front());
-  _ASSERT(rgbData.size() == dataLen);
+  size_t dataLen = rect->area() * sizeof(PIXEL_T);
+  UINT8 *rgbData = getScratchBuffer(dataLen);
+  copyPixels<PIXEL_T>(rect, fb, rgbData);
 
   // Pack pixels into 24-bit samples if necessary.
   PixelFormat pf = fb->getPixelFormat();
   if (shouldPackPixels(&pf)) {
-    packPixels(&rgbData.front(), rect->area(), &pf);
-    rgbData.resize(rect->area() * 3);
+    packPixels(rgbData, rect->area(), &pf);
+    dataLen = rect->area() * 3;
   }
 
   // Compress and send.
   int zlibLevel = getConf(options).rawZlibLevel;
   // FIXME: Get rid of explicit conversions between chars and bytes.
-  sendCompressed((const char *)&rgbData.front(), rgbData.size(),
+  sendCompressed((const char *)rgbData, dataLen, zlibStreamId, zlibLevel);
+}
+
+template <class PIXEL_T>
+void TightEncoder::sendGradientRect(const Rect *rect,
+                                    const FrameBufferView *fb,
+                                    const EncodeOptions *options)
+{
+  countRect(SUBENC_GRADIENT, rect);
+
+  // Send control info.
+  const int zlibStreamId = ZLIB_STREAM_GRADIENT;
+  m_output->writeUInt8(EXPLICIT_FILTER | zlibStreamId << 4);
+  m_output->writeUInt8(FILTER_GRADIENT);
+
+  // Prepare output buffer.
+  PixelFormat pf = fb->getPixelFormat();
+  bool pack24 = shouldPackPixels(&pf);
+  size_t pixelSize = pack24 ? 3 : sizeof(PIXEL_T);
+  size_t dataLen = rect->area() * pixelSize;
+  UINT8 *filteredData = getScratchBuffer(dataLen);
+
+  // Get filtered pixels from the frame buffer.
+  filterGradient<PIXEL_T>(rect, fb, filteredData, pack24);
+
+  // Compress and send.
+  int zlibLevel = getConf(options).gradientZlibLevel;
+  sendCompressed((const char *)filteredData, dataLen,
                  zlibStreamId, zlibLevel);
 }
 
@@ -281,6 +949,12 @@ void TightEncoder::sendJpegRect(const Rect *rect,
                                 const FrameBuffer *serverFb,
                                 const EncodeOptions *options)
 {
+  countRect(SUBENC_JPEG, rect);
+  // Rectangles encoded by lanes are registered by the owner on writing.
+  if (m_deferredJob == 0) {
+    m_lossyRects.push_back(*rect);
+  }
+
   _ASSERT(options->jpegEnabled());
 
   // Set proper JPEG quality level in the compressor. The default value 6
@@ -342,48 +1016,183 @@ void TightEncoder::packPixels(UINT8 *buf, int count, const PixelFormat *pf)
 }
 
 template <class PIXEL_T>
-void TightEncoder::fillPalette(const Rect *r, const FrameBuffer *fb, int maxColors)
+bool TightEncoder::detectSmoothImage(const Rect *rect,
+                                     const FrameBufferView *fb,
+                                     const EncodeOptions *options)
 {
-  // Clear the palette.
-  m_pal.reset();
-  m_pal.setMaxColors(maxColors);
+  const int w = rect->getWidth();
+  const int h = rect->getHeight();
+  if (w < DETECT_MIN_WIDTH || h < DETECT_MIN_HEIGHT ||
+      rect->area() < getConf(options).gradientMinRectSize) {
+    return false;
+  }
 
   // Shortcuts.
-  const PIXEL_T *pixels = (const PIXEL_T *)fb->getBuffer();
-  int stride = fb->getDimension().width;
-  UINT32 pixel = pixels[r->top * stride + r->left];
-  UINT32 oldPixel = 0;
-  UINT32 runLength = 0;
-
-  for (int y = r->top; y < r->bottom; y++) {
-    for (int x = r->left; x < r->right; x++) {
-      pixel = pixels[y * stride + x];
-
-      if (oldPixel != pixel) {
-        if (m_pal.insert(oldPixel, runLength) == 0) {
-          return;
+  PixelFormat pf = fb->getPixelFormat();
+  const bool pack24 = shouldPackPixels(&pf);
+  const int maxColor[3] = { pf.redMax, pf.greenMax, pf.blueMax };
+  const int shiftBits[3] = { pf.redShift, pf.greenShift, pf.blueShift };
+  const PIXEL_T *pixels = (const PIXEL_T *)fb->getBufferPtr(rect->left, rect->top);
+  const int stride = fb->getStride();
+
+  // For 24-bit color, differences are counted for each color component
+  // separately. Otherwise, absolute differences of all three components
+  // are summed up for each pixel.
+  int diffStat[256];
+  memset(diffStat, 0, sizeof(diffStat));
+  int pixelCount = 0;
+  int left[3];
+
+  // Walk along the diagonals of square areas covering the rectangle, and
+  // examine a short row of pixels starting at each diagonal point.
+  int x = 0, y = 0;
+  while (y < h && x < w) {
+    for (int d = 0; d < h - y && d < w - x - DETECT_SUBROW_WIDTH; d++) {
+      const PIXEL_T *src = &pixels[(y + d) * stride + x + d];
+      UINT32 pix = pf.bigEndian ? swapBytes(*src) : *src;
+      for (int c = 0; c < 3; c++) {
+        left[c] = (int)(pix >> shiftBits[c] & maxColor[c]);
+      }
+      for (int dx = 1; dx <= DETECT_SUBROW_WIDTH; dx++) {
+        pix = pf.bigEndian ? swapBytes(src[dx]) : src[dx];
+        int sum = 0;
+        for (int c = 0; c < 3; c++) {
+          int sample = (int)(pix >> shiftBits[c] & maxColor[c]);
+          if (pack24) {
+            diffStat[abs(sample - left[c])]++;
+          } else {
+            sum += abs(sample - left[c]);
+          }
+          left[c] = sample;
+        }
+        if (!pack24) {
+          diffStat[min(sum, 255)]++;
+        }
+        pixelCount++;
+      }
+    }
+    if (w > h) {
+      x += h;
+      y = 0;
+    } else {
+      x = 0;
+      y += w;
+    }
+  }
+
+  // Images with mostly equal neighbors compress well without filtering.
+  int numSamples = pack24 ? pixelCount * 3 : pixelCount;
+  if (numSamples == 0) {
+    return false;
+  }
+  if (pack24 && diffStat[0] * 100 / numSamples >= 95) {
+    return false;
+  }
+  if (!pack24 && (diffStat[0] + diffStat[1]) * 100 / numSamples >= 90) {
+    return false;
+  }
+
+  // Smooth images should show decreasing frequencies of small differences.
+  unsigned long avgError = 0;
+  int c;
+  for (c = 1; c < 8; c++) {
+    avgError += (unsigned long)diffStat[c] * (unsigned long)(c * c);
+    if (diffStat[c] == 0 || diffStat[c] > diffStat[c - 1] * 2) {
+      return false;
+    }
+  }
+  for (; c < 256; c++) {
+    avgError += (unsigned long)diffStat[c] * (unsigned long)(c * c);
+  }
+  avgError /= (unsigned long)(numSamples - diffStat[0]);
+
+  const Conf &conf = getConf(options);
+  int threshold = pack24 ? conf.gradientThreshold24 : conf.gradientThreshold;
+  return avgError < (unsigned long)threshold;
+}
+
+template <class PIXEL_T>
+void TightEncoder::filterGradient(const Rect *rect,
+                                  const FrameBufferView *fb,
+                                  UINT8 *dst, bool pack24)
+{
+  const int w = rect->getWidth();
+  const int h = rect->getHeight();
+
+  PixelFormat pf = fb->getPixelFormat();
+  const int maxColor[3] = { pf.redMax, pf.greenMax, pf.blueMax };
+  const int shiftBits[3] = { pf.redShift, pf.greenShift, pf.blueShift };
+  const PIXEL_T *src = (const PIXEL_T *)fb->getBufferPtr(rect->left, rect->top);
+  const int fbStride = fb->getStride();
+
+  // Color components of the current and the previous rows. The first
+  // element of each row corresponds to an imaginary pixel to the left of
+  // the rectangle which is always zero.
+  const int rowLength = (w + 1) * 3;
+  std::vector<int> rows(rowLength * 2, 0);
+  int *prevRow = &rows.front();
+  int *thisRow = &rows[rowLength];
+
+  PIXEL_T *dstPixels = (PIXEL_T *)dst;
+
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      UINT32 pix = pf.bigEndian ? swapBytes(src[x]) : src[x];
+      UINT32 diff = 0;
+      for (int c = 0; c < 3; c++) {
+        int predicted = prevRow[(x + 1) * 3 + c] + thisRow[x * 3 + c] -
+                        prevRow[x * 3 + c];
+        if (predicted < 0) {
+          predicted = 0;
+        } else if (predicted > maxColor[c]) {
+          predicted = maxColor[c];
+        }
+        int sample = (int)(pix >> shiftBits[c] & maxColor[c]);
+        thisRow[(x + 1) * 3 + c] = sample;
+        if (pack24) {
+          *dst++ = (UINT8)(sample - predicted);
+        } else {
+          diff |= (UINT32)((sample - predicted) & maxColor[c]) << shiftBits[c];
         }
-        oldPixel = pixel;
-        runLength = 1;
-      } else {
-        runLength++;
+      }
+      if (!pack24) {
+        *dstPixels++ = pf.bigEndian ? swapBytes((PIXEL_T)diff) : (PIXEL_T)diff;
       }
     }
+    int *tmp = prevRow;
+    prevRow = thisRow;
+    thisRow = tmp;
+    src += fbStride;
   }
-  if (m_pal.insert(oldPixel, runLength) == 0) {
-			return;
-	}
+}
+
+UINT8 TightEncoder::swapBytes(UINT8 pixel)
+{
+  return pixel;
+}
+
+UINT16 TightEncoder::swapBytes(UINT16 pixel)
+{
+  return (UINT16)(pixel << 8 | pixel >> 8);
+}
+
+UINT32 TightEncoder::swapBytes(UINT32 pixel)
+{
+  return pixel << 24 |
+         (pixel & 0xFF00) << 8 |
+         (pixel >> 8 & 0xFF00) |
+         pixel >> 24;
 }
 
 template <class PIXEL_T>
-void TightEncoder::copyPixels(const Rect *rect, const FrameBuffer *fb,
+void TightEncoder::copyPixels(const Rect *rect, const FrameBufferView *fb,
                               UINT8 *dst)
 {
   const int rectWidth = rect->getWidth();
   const int rectHeight = rect->getHeight();
 
   const PIXEL_T *src = (const PIXEL_T *)fb->getBufferPtr(rect->left, rect->top);
-  const int fbStride = fb->getDimension().width;
+  const int fbStride = fb->getStride();
   const int bytesPerRow = rectWidth * sizeof(PIXEL_T);
 
   for (int y = 0; y < rectHeight; y++) {
@@ -393,77 +1202,40 @@ void TightEncoder::copyPixels(const Rect *rect, const FrameBuffer *fb,
   }
 }
 
-template <class PIXEL_T>
-void TightEncoder::encodeMonoRect(const Rect *rect, const FrameBuffer *fb,
-                                  DataOutputStream *out)
+void TightEncoder::encodeMonoRect(const Rect *rect, UINT8 *dst)
 {
-  const PIXEL_T *src = (const PIXEL_T *)fb->getBufferPtr(rect->left, rect->top);
+  const UINT8 *src = m_pal.getIndexMap();
   const int w = rect->getWidth();
   const int h = rect->getHeight();
-  const PIXEL_T bg = (PIXEL_T)m_pal.getEntry(0);
-
-  unsigned int value, mask;
-  int x, y, bits;
   const int alignedWidth = w - w % 8;
-  const int skipPixels = fb->getDimension().width - w;
 
-  for (y = 0; y < h; y++) {
+  // Indices are 0 for the background and 1 for the foreground, so they are
+  // the bits to be sent.
+  for (int y = 0; y < h; y++) {
+    int x;
     for (x = 0; x < alignedWidth; x += 8) {
-      for (bits = 0; bits < 8; bits++) {
-        if (*src++ != bg)
-          break;
-      }
-      if (bits == 8) {
-        out->writeUInt8(0);
-        continue;
-      }
-      mask = 0x80 >> bits;
-      value = mask;
-      for (bits++; bits < 8; bits++) {
-        mask >>= 1;
-        if (*src++ != bg) {
-          value |= mask;
-        }
-      }
-      out->writeUInt8((UINT8)value);
+      *dst++ = (UINT8)(src[0] << 7 | src[1] << 6 | src[2] << 5 | src[3] << 4 |
+                       src[4] << 3 | src[5] << 2 | src[6] << 1 | src[7]);
+      src += 8;
     }
     if (x < w) {
-      mask = 0x80;
-      value = 0;
-      do {
-        if (*src++ != bg) {
-          value |= mask;
-        }
-        mask >>= 1;
-      } while (++x < w);
-      out->writeUInt8((UINT8)value);
+      unsigned int value = 0;
+      for (int shift = 7; x < w; x++, shift--) {
+        value |= (unsigned int)*src++ << shift;
+      }
+      *dst++ = (UINT8)value;
     }
-    src += skipPixels;
   }
 }
 
-template <class PIXEL_T>
-void TightEncoder::encodeIndexedRect(const Rect *rect, const FrameBuffer *fb,
-                                     DataOutputStream *out)
+UINT8 *TightEncoder::getScratchBuffer(size_t size)
 {
-  const PIXEL_T *src = (const PIXEL_T *)fb->getBufferPtr(rect->left, rect->top);
-  const int w = rect->getWidth();
-  const int h = rect->getHeight();
-  const int skipPixels = fb->getDimension().width - w;
-
-  UINT8 index = m_pal.getIndex(*src);
-  PIXEL_T oldColor = 0;
-  for (int y = 0; y < h; y++) {
-    for (int x = 0; x < w; x++) {
-      if (oldColor != *src) {
-        index = m_pal.getIndex(*src);
-        oldColor = *src;
-      }
-      *src++;
-      out->writeUInt8(index);
-    }
-    src += skipPixels;
+  // The buffer only grows, so it is not reallocated (or cleared) for each
+  // rectangle.
+  if (m_scratch.size() < size) {
+    m_scratch.resize(size);
   }
+  return &m_scratch.front();
 }
 
 void TightEncoder::sendCompressed(const char *data, size_t dataLen,
@@ -474,6 +1246,24 @@ void TightEncoder::sendCompressed(const char *data, size_t dataLen,
     return;
   }
 
+  if (m_deferredJob != 0) {
+    EncodedRect *encoded = &m_deferredJob->encoded;
+    encoded->uncompressed.assign(data, data + dataLen);
+    encoded->streamId = streamId;
+    encoded->zlibLevel = zlibLevel;
+    return;
+  }
+
+  size_t compressedLength = compressData(data, dataLen, streamId, zlibLevel,
+                                         &m_compressedData);
+  sendCompactLength(compressedLength);
+  m_output->writeFully(&m_compressedData.front(), compressedLength);
+}
+
+size_t TightEncoder::compressData(const char *data, size_t dataLen,
+                                  int streamId, int zlibLevel,
+                                  std::vector<char> *compressed)
+{
   z_streamp pz = &m_zsStruct[streamId];
 
   // Initialize compression stream if needed.
@@ -495,8 +1285,10 @@ void TightEncoder::sendCompressed(const char *data, size_t dataLen,
   // Prepare buffers.
   size_t compressedBufferSize = dataLen + dataLen / 100 + 16;
 
-  std::vector<char> charBuff(compressedBufferSize);
-  char *compressedData = &charBuff.front();
+  if (compressed->size() < compressedBufferSize) {
+    compressed->resize(compressedBufferSize);
+  }
+  char *compressedData = &compressed->front();
 
   _ASSERT((unsigned int)dataLen == dataLen);
   _ASSERT((unsigned int)compressedBufferSize == compressedBufferSize);
@@ -520,13 +1312,7 @@ void TightEncoder::sendCompressed(const char *data, size_t dataLen,
       throw IOException(_T("Zlib compression failed in Tight encoder"));
   }
 
-  try {
-    size_t compressedLength = compressedBufferSize - pz->avail_out;
-    sendCompactLength(compressedLength);
-    m_output->writeFully(compressedData, compressedLength);
-  } catch (...) {
-    throw;
-  }
+  return compressedBufferSize - pz->avail_out;
 }
 
 void TightEncoder::sendCompactLength(size_t dataLen)
@@ -554,17 +1340,24 @@ void TightEncoder::sendCompactLength(size_t dataLen)
 //        intentionally made small because we do not implement algorithms to
 //        detect areas to be compressed with JPEG yet and thus we would like
 //        to divide areas to avoid compressing too much with JPEG.
+//
+// Gradient filter parameters come from the TightVNC 1.3 Unix server. The
+// filter is effectively disabled for compression levels 0..4 where speed is
+// more important than compression ratio.
+//
+// The rectangle overhead grows with the compression level, since extra
+// pixels compress better and rectangles take more time to analyze.
 const TightEncoder::Conf TightEncoder::m_conf[10] = {
-  {   512,   32,   6, 0, 0, 0,  4 },
-  {  2048,   64,   6, 1, 1, 1,  8 },
-  {  6144,  128,   8, 3, 3, 2, 24 },
-  {  8192,  128,  12, 5, 5, 3, 32 },
-  {  8192,  128,  12, 6, 6, 4, 32 },
-  {  8192,  128,  12, 7, 7, 5, 32 },
-  {  8192,  128,  16, 7, 7, 6, 48 },
-  { 16384,  256,  16, 8, 8, 7, 64 },
-  { 16384,  256,  32, 9, 9, 8, 64 },
-  { 32768,  256,  32, 9, 9, 9, 96 }
+  {   512,   32,   6, 0, 0, 0,  4, 65536, 0,   0,   0,  64 },
+  {  2048,   64,   6, 1, 1, 1,  8, 65536, 0,   0,   0,  96 },
+  {  6144,  128,   8, 3, 3, 2, 24, 65536, 0,   0,   0, 128 },
+  {  8192,  128,  12, 5, 5, 3, 32, 65536, 0,   0,   0, 192 },
+  {  8192,  128,  12, 6, 6, 4, 32, 65536, 0,   0,   0, 192 },
+  {  8192,  128,  12, 7, 7, 5, 32,  4096, 4, 150, 380, 256 },
+  {  8192,  128,  16, 7, 7, 6, 48,  4096, 4, 170, 420, 256 },
+  { 16384,  256,  16, 8, 8, 7, 64,  4096, 5, 180, 450, 320 },
+  { 16384,  256,  32, 9, 9, 8, 64,  8192, 6, 190, 475, 384 },
+  { 32768,  256,  32, 9, 9, 9, 96,  8192, 6, 200, 500, 384 }
 };
 
 const TightEncoder::Conf &
@@ -31,19 +31,29 @@
 #include "Encoder.h"
 #include "TightPalette.h"
 #include "JpegCompressor.h"
+#include "ContentClassifier.h"
+#include "EncodedRectCache.h"
+#include "io-lib/ByteArrayOutputStream.h"
+#include "thread/LocalMutex.h"
+#include "thread/WorkerPool.h"
 
 class TightEncoder : public Encoder
 {
   friend class JpegEncoder;
 
 public:
-  TightEncoder(PixelConverter *conv, DataOutputStream *output);
+  // If rectCache is not 0, the encoder will share results of encoding with
+  // other encoders via that cache (see EncodedRectCache).
+  TightEncoder(PixelConverter *conv, DataOutputStream *output,
+               EncodedRectCache *rectCache = 0);
   virtual ~TightEncoder();
 
   virtual int getCode() const;
 
   // Splits big rectangles according to the configuration setings (m_conf)
-  // corresponding to the compression level set in EncodeOptions.
+  // corresponding to the compression level set in EncodeOptions. Before
+  // splitting, big solid-color areas are detected and added to the list as
+  // whole rectangles, so that each of them is sent as a single fill.
   virtual void splitRectangle(const Rect *rect,
                               std::vector<Rect> *rectList,
                               const FrameBuffer *serverFb,
@@ -53,35 +63,252 @@ public:
                              const FrameBuffer *serverFb,
                              const EncodeOptions *options) throw(IOException);
 
+  // If more than one thread is allowed or the cache of encoded rectangles
+  // is active, sendRectangles() works via sendRectangleJobs().
+  virtual void sendRectangles(const std::vector<Rect> *rects,
+                              const FrameBuffer *serverFb,
+                              const EncodeOptions *options) throw(IOException);
+
+  virtual void setNumThreads(size_t numThreads);
+
+  virtual double getParallelSpeedup() const;
+
+  // Besides the header, each rectangle costs a zlib flush and the analysis
+  // of its colors, while extra pixels next to changed ones usually compress
+  // well. The value depends on the compression level (see m_conf).
+  virtual int getRectOverhead(const EncodeOptions *options) const;
+
+  // Tight subencodings, as counted in Statistics.
+  enum SubencodingType {
+    SUBENC_FILL,
+    SUBENC_MONO,
+    SUBENC_INDEXED,
+    SUBENC_FULL_COLOR,
+    SUBENC_GRADIENT,
+    SUBENC_JPEG,
+    NUM_SUBENC_TYPES
+  };
+
+  // Numbers of rectangles and pixels encoded with each subencoding since
+  // the encoder creation, and decisions of the content classifier.
+  // Rectangles taken from the cache of encoded rectangles are not counted.
+  struct Statistics
+  {
+    Statistics();
+    void add(const Statistics *other);
+
+    UINT64 rects[NUM_SUBENC_TYPES];
+    UINT64 pixels[NUM_SUBENC_TYPES];
+    // Rectangles analyzed by the content classifier, and those of them it
+    // has chosen to send with JPEG.
+    UINT64 classifiedRects;
+    UINT64 classifiedJpegRects;
+  };
+
+  // Return the statistics, including rectangles encoded by worker threads.
+  void getStatistics(Statistics *stats) const;
+
+  // Append to *rects the rectangles sent with JPEG (by this encoder or by
+  // JpegEncoder using it) since the previous call, and forget them. Such
+  // rectangles are the only lossy ones produced by the encoder.
+  void takeLossyRects(std::vector<Rect> *rects);
+
 protected:
+  // A rectangle being encoded by sendRectangleJobs(). The data to be
+  // compressed is compressed later by the zlib stream encoded.streamId, so
+  // that each zlib stream would see the data in the same order as in the
+  // single-threaded mode.
+  struct RectJob
+  {
+    Rect rect;
+    EncodedRect encoded;
+    // Compressed data, the buffer may be longer than compressedLength.
+    std::vector<char> compressed;
+    size_t compressedLength;
+    // Key of the rectangle in the cache, a flag indicating that the key is
+    // valid and a flag indicating that the encoded data was taken from the
+    // cache.
+    EncodedRectCache::Key cacheKey;
+    bool cacheable;
+    bool cached;
+    // Pixels of the rectangle in the client pixel format and a flag
+    // indicating that they are viewed in the pixel converter instead of
+    // being copied to m_jobPixels.
+    FrameBufferView clientFb;
+    bool sharedPixels;
+  };
+
+  // Passes of sendRectangleJobs() performed by EncodingLane tasks.
+  enum JobPass {
+    PASS_LOOKUP,
+    PASS_ENCODE
+  };
+
+  // A worker task encoding rectangles with its own TightEncoder object
+  // (having its own palette and JPEG compressor). It takes jobs from the
+  // owner one by one until there are no more jobs left. Jobs found in the
+  // cache of encoded rectangles are not encoded again.
+  class EncodingLane : public WorkerTask
+  {
+  public:
+    EncodingLane(TightEncoder *owner);
+    virtual ~EncodingLane();
+
+    virtual void run();
+
+    // Add the statistics of the lane encoder to *stats and reset them.
+    void takeStatistics(Statistics *stats);
+
+  protected:
+    TightEncoder *m_owner;
+    ByteArrayOutputStream m_buffer;
+    DataOutputStream m_output;
+    TightEncoder *m_encoder;
+  };
+
+  // A worker task compressing the pending data of one zlib stream.
+  class CompressionTask : public WorkerTask
+  {
+  public:
+    CompressionTask(TightEncoder *owner, int streamId);
+
+    virtual void run();
+
+  protected:
+    TightEncoder *m_owner;
+    int m_streamId;
+  };
+
+  // Return true if sendRectangles() should encode the given rectangles via
+  // sendRectangleJobs().
+  bool shouldUseJobs(const std::vector<Rect> *rects) const;
+
+  // Encode rectangles in three passes. First, the rectangles are analyzed
+  // and encoded by a number of EncodingLane tasks, except for zlib
+  // compression. Then, the data of different zlib streams is compressed.
+  // Finally, the results are written to the output stream in the original
+  // order of rectangles. The first two passes are run in parallel if the
+  // worker pool exists. If forceJpeg is true, all rectangles are encoded
+  // with JPEG, as done in JpegEncoder.
+  void sendRectangleJobs(const std::vector<Rect> *rects,
+                         const FrameBuffer *serverFb,
+                         const EncodeOptions *options,
+                         bool forceJpeg) throw(IOException);
+
+  // Run the tasks in the worker pool or, if there is no pool, in the
+  // calling thread. Add the time spent in tasks to *busyTime and the
+  // elapsed time to *elapsedTime.
+  void runTasks(std::vector<WorkerTask *> *tasks,
+                INT64 *busyTime, INT64 *elapsedTime) throw(Exception);
+
+  // Fill in the key identifying the job in the cache of encoded rectangles.
+  // Return false if the rectangle may not be cached, because the pixel
+  // converter cannot give a content stamp for its pixels.
+  bool makeCacheKey(const RectJob *job, EncodedRectCache::Key *key) const;
+
+  // Convert pixels of the jobs not found in the cache to the client pixel
+  // format, into m_jobPixels. If the formats are the same, the jobs refer
+  // to the server frame buffer directly.
+  void convertJobPixels();
+
+  // Return the next job not taken by any EncodingLane yet, or 0 if all jobs
+  // are taken. Jobs found in the cache are skipped in the PASS_ENCODE pass.
+  RectJob *getNextJob();
+
+  // Free the worker pool and all the lanes.
+  void destroyWorkers();
+
+  // Send a rectangle which was already converted to the client pixel format
+  // and is available via clientFb. If forceJpeg is true, JPEG sub-encoding is
+  // used unconditionally.
+  void sendConvertedRect(const Rect *rect,
+                         const FrameBuffer *serverFb,
+                         const FrameBufferView *clientFb,
+                         const EncodeOptions *options,
+                         bool forceJpeg) throw(IOException);
+
+  // Split the rectangle into pieces not exceeding the maximum rectangle size
+  // and width from the configuration table, without any analysis of pixel
+  // data.
+  void splitToTiles(const Rect *rect,
+                    std::vector<Rect> *rectList,
+                    const EncodeOptions *options);
+
+  // Find a big solid-color area within the rectangle, add it to the list as
+  // is and process the remaining parts recursively. The rest of each
+  // rectangle is split via splitToTiles(). Pixels are analyzed in the server
+  // pixel format (PIXEL_T should correspond to serverFb).
+  template <class PIXEL_T>
+    void splitSolidAreas(const Rect *rect,
+                         std::vector<Rect> *rectList,
+                         const FrameBuffer *serverFb,
+                         const EncodeOptions *options);
+
+  // Find the biggest solid-color area of the given color whose upper left
+  // corner matches the upper left corner of the rectangle. The area is
+  // searched in units of SPLIT_TILE_SIZE and returned in bestRect.
+  template <class PIXEL_T>
+    void findBestSolidArea(const Rect *rect, UINT32 color,
+                           const FrameBuffer *fb, Rect *bestRect);
+
+  // Try to extend the solid-color area in `area' to all four directions,
+  // not going outside the borders of `bounds'.
+  template <class PIXEL_T>
+    void extendSolidArea(const Rect *bounds, UINT32 color,
+                         const FrameBuffer *fb, Rect *area);
+
+  // Return true if all pixels in the rectangle are of the same color. If
+  // needSameColor is true, that color should be equal to *color, otherwise
+  // the color found is stored in *color.
+  template <class PIXEL_T>
+    bool checkSolidTile(const Rect *rect, const FrameBuffer *fb,
+                        UINT32 *color, bool needSameColor);
+
   // An implementation of sendRectangle() for the given pixel size.
   template <class PIXEL_T>
     void sendAnyRect(const Rect *rect,
                      const FrameBuffer *serverFb,
-                     const FrameBuffer *clientFb,
+                     const FrameBufferView *clientFb,
                      const EncodeOptions *options) throw(IOException);
 
+  // Decide if a rectangle having too many colors for a palette should be
+  // sent with JPEG, using the content classifier.
+  bool classifyAsJpeg(const Rect *rect,
+                      const FrameBufferView *clientFb,
+                      const EncodeOptions *options);
+
+  // Count the rectangle in m_statistics.
+  void countRect(SubencodingType type, const Rect *rect);
+
   // Send a solid-color rectangle.
-  void sendSolidRect(const Rect *r, const FrameBuffer *fb) throw(IOException);
+  void sendSolidRect(const Rect *r,
+                     const FrameBufferView *fb) throw(IOException);
 
   // Send a two-color rectangle (1 bit per pixel).
   template <class PIXEL_T>
     void sendMonoRect(const Rect *rect,
-                      const FrameBuffer *fb,
+                      const FrameBufferView *fb,
                       const EncodeOptions *options) throw(IOException);
 
   // Send an indexed-color rectangle (1 byte per pixel).
   template <class PIXEL_T>
     void sendIndexedRect(const Rect *rect,
-                         const FrameBuffer *fb,
+                         const FrameBufferView *fb,
                          const EncodeOptions *options) throw(IOException);
 
   // Send a true color rectangle.
   template <class PIXEL_T>
     void sendFullColorRect(const Rect *rect,
-                           const FrameBuffer *fb,
+                           const FrameBufferView *fb,
                            const EncodeOptions *options) throw(IOException);
 
+  // Send a true color rectangle pre-processed with the "gradient" filter.
+  // Should be used only when PIXEL_T is UINT16 or UINT32.
+  template <class PIXEL_T>
+    void sendGradientRect(const Rect *rect,
+                          const FrameBufferView *fb,
+                          const EncodeOptions *options) throw(IOException);
+
   // Send a rectangle encoded with JPEG.
   void sendJpegRect(const Rect *rect,
                     const FrameBuffer *serverFb,
@@ -96,36 +323,56 @@ protected:
   // and blueMax are all 255.
   static void packPixels(UINT8 *buf, int count, const PixelFormat *pf);
 
-  // Fill in the palette (m_pal) assuming that pixels have the type PIXEL_T
-  // (where PIXEL_T can be UINT8, UINT16 or UINT32). Do not allow more than
-  // maxColors in the palette, reset the palette size to 0 if actual number of
-  // colors exceeds this limitation.
+  // Estimate if the "gradient" filter would improve compression of the
+  // given rectangle. A number of short pixel rows along the diagonals of
+  // the rectangle are examined, and the distribution of differences between
+  // neighboring pixels is analyzed. Return true if the image looks smooth
+  // (photo-like) enough, false otherwise.
   template <class PIXEL_T>
-    void fillPalette(const Rect *r, const FrameBuffer *fb, int maxColors);
+    bool detectSmoothImage(const Rect *rect, const FrameBufferView *fb,
+                           const EncodeOptions *options);
 
-  // Copy pixel data from the frame buffer to a byte array.
+  // Apply the "gradient" filter to pixel data from the frame buffer and put
+  // the result to a byte array. If pack24 is true, color samples are
+  // written as 24-bit sequences, as done by packPixels(). The destination
+  // array should be large enough to hold the filtered data.
   template <class PIXEL_T>
-    void copyPixels(const Rect *rect, const FrameBuffer *fb, UINT8 *dst);
+    void filterGradient(const Rect *rect, const FrameBufferView *fb,
+                        UINT8 *dst, bool pack24);
 
-  // Encode a two-color rectangle using m_pal as a palette, produce a bitmap
-  // where one pixel is represented by one bit. Each line is padded with
-  // zeroes to the byte boundary.
-  // FIXME: Do not use DataOutputStream, do not throw IOException.
-  template <class PIXEL_T>
-    void encodeMonoRect(const Rect *rect, const FrameBuffer *fb,
-                        DataOutputStream *out) throw(IOException);
+  // Reverse the byte order of a pixel value (UINT8 values are returned
+  // unchanged).
+  static UINT8 swapBytes(UINT8 pixel);
+  static UINT16 swapBytes(UINT16 pixel);
+  static UINT32 swapBytes(UINT32 pixel);
 
-  // Encode a rectangle using m_pal as a palette, produce a pixmap where one
-  // pixel is represented by one byte which is its index in the palette.
-  // FIXME: Do not use DataOutputStream, do not throw IOException.
+  // Copy pixel data from the frame buffer to a byte array.
   template <class PIXEL_T>
-    void encodeIndexedRect(const Rect *rect, const FrameBuffer *fb,
-                           DataOutputStream *out) throw(IOException);
+    void copyPixels(const Rect *rect, const FrameBufferView *fb, UINT8 *dst);
+
+  // Encode a two-color rectangle from the index map of m_pal, produce a
+  // bitmap where one pixel is represented by one bit. Each line is padded
+  // with zeroes to the byte boundary. The dst buffer should be big enough
+  // to hold ((width + 7) / 8) * height bytes.
+  void encodeMonoRect(const Rect *rect, UINT8 *dst);
+
+  // Return m_scratch enlarged to at least the given size if needed.
+  UINT8 *getScratchBuffer(size_t size);
 
+  // Compress and send the data. If m_deferredJob is set, data that should
+  // be compressed is saved in that job instead.
   // FIXME: Throw ZlibException instead.
   void sendCompressed(const char *data, size_t dataLen,
                       int streamId, int zlibLevel) throw(IOException);
 
+  // Compress the data with the given zlib stream and put the result to the
+  // beginning of *compressed, which is enlarged if needed but never shrunk.
+  // Returns the length of the compressed data.
+  // FIXME: Throw ZlibException instead.
+  size_t compressData(const char *data, size_t dataLen,
+                    int streamId, int zlibLevel,
+                    std::vector<char> *compressed) throw(IOException);
+
   // Send the number of the compressed bytes following. The number (dataLen)
   // is represented by a variable-length code (1..3 bytes).
   void sendCompactLength(size_t dataLen) throw(IOException);
@@ -140,6 +387,11 @@ protected:
     int monoZlibLevel;
     int rawZlibLevel;
     int idxMaxColorsDivisor;
+    int gradientMinRectSize;
+    int gradientZlibLevel;
+    int gradientThreshold;
+    int gradientThreshold24;
+    int rectOverhead;
   } m_conf[10];
 
   // Select a record from the m_conf array which corresponds to the
@@ -151,23 +403,41 @@ protected:
   static const UINT8 SUBENCODING_JPEG = 0x90;
   static const UINT8 EXPLICIT_FILTER = 0x40;
   static const UINT8 FILTER_PALETTE = 0x01;
+  static const UINT8 FILTER_GRADIENT = 0x02;
 
   // Changing this will break compatibility with Tight decoders.
   static const int TIGHT_MIN_TO_COMPRESS = 12;
 
   // The parameters below may be adjusted.
   static const int DEFAULT_COMPRESSION_LEVEL = 6;
-  static const int JPEG_MIN_RECT_SIZE = 4096;
+  // Rectangles smaller than this are never sent with JPEG, bigger ones are
+  // sent with JPEG if the content classifier finds it worthwhile.
+  static const int JPEG_MIN_RECT_SIZE = 256;
   static const int JPEG_MIN_RECT_WIDTH = 8;
   static const int JPEG_MIN_RECT_HEIGHT = 8;
 
+  // Parameters of the solid-color area detection, see splitSolidAreas().
+  // Rectangles smaller than MIN_SPLIT_RECT_SIZE are not analyzed, solid
+  // areas are searched in tiles of SPLIT_TILE_SIZE x SPLIT_TILE_SIZE
+  // pixels, and solid areas smaller than MIN_SOLID_SUBRECT_SIZE are not
+  // separated from their neighbors.
+  static const int MIN_SPLIT_RECT_SIZE = 4096;
+  static const int MIN_SOLID_SUBRECT_SIZE = 2048;
+  static const int SPLIT_TILE_SIZE = 16;
+
+  // Parameters of the smooth image detection, see detectSmoothImage().
+  static const int DETECT_SUBROW_WIDTH = 7;
+  static const int DETECT_MIN_WIDTH = 8;
+  static const int DETECT_MIN_HEIGHT = 8;
+
   // The number of zlib streams used by TightEncoder (it cannot exceed 4).
-  static const int NUM_ZLIB_STREAMS = 3;
+  static const int NUM_ZLIB_STREAMS = 4;
 
   // Indexes of individual zlib streams.
   static const int ZLIB_STREAM_RAW = 0;
   static const int ZLIB_STREAM_MONO = 1;
   static const int ZLIB_STREAM_IDX = 2;
+  static const int ZLIB_STREAM_GRADIENT = 3;
 
   // The array of zlib stream structures.
   z_stream m_zsStruct[NUM_ZLIB_STREAMS];
@@ -183,6 +453,63 @@ protected:
 
   // JPEG compressor working via the IJG JPEG library.
   StandardJpegCompressor m_compressor;
+
+  // Classifier choosing between JPEG and lossless compression.
+  ContentClassifier m_classifier;
+
+  // Statistics of this encoder, not including the lanes.
+  Statistics m_statistics;
+
+  // Rectangles written to the output with JPEG, see takeLossyRects().
+  std::vector<Rect> m_lossyRects;
+
+  // Buffer for compressed data, reused between rectangles.
+  std::vector<char> m_compressedData;
+
+  // Buffer for data to be compressed (mono bitmaps, raw and filtered
+  // pixels), reused between rectangles.
+  std::vector<UINT8> m_scratch;
+
+  //
+  // Parallel encoding and caching (see sendRectangleJobs()).
+  //
+
+  // Cache of encoded rectangles shared with other encoders, may be 0.
+  EncodedRectCache *m_rectCache;
+
+  // Pool of threads, 0 if encoding is done in one thread.
+  WorkerPool *m_workerPool;
+  // One lane per thread of the pool, or one lane if there is no pool.
+  std::vector<EncodingLane *> m_lanes;
+
+  // Jobs of the current sendRectangleJobs() call. The vector is not
+  // cleared between calls so that its buffers would be reused.
+  std::vector<RectJob> m_jobs;
+  size_t m_numJobs;
+  size_t m_nextJob;
+  LocalMutex m_jobLock;
+
+  // Converted pixels of all jobs, see convertJobPixels(). The buffer is
+  // freed after encoding if it is bigger than MAX_KEPT_JOB_PIXELS_SIZE.
+  std::vector<UINT8> m_jobPixels;
+  static const size_t MAX_KEPT_JOB_PIXELS_SIZE = 1024 * 1024;
+
+  // Arguments of the current sendRectangleJobs() call.
+  const FrameBuffer *m_jobServerFb;
+  const EncodeOptions *m_jobOptions;
+  bool m_jobForceJpeg;
+  // True if the cache of encoded rectangles is used by the current call.
+  bool m_jobUseCache;
+  // Current pass of the EncodingLane tasks.
+  JobPass m_jobPass;
+
+  // Ratio of the total time spent by all threads to the elapsed time of the
+  // most recent sendRectangles() call.
+  double m_parallelSpeedup;
+
+  // If not 0, sendCompressed() saves data to be compressed in this job
+  // instead of compressing and sending it. Used by EncodingLane.
+  RectJob *m_deferredJob;
 };
 
 #endif // __RFB_TIGHT_ENCODER_H_INCLUDED__
@@ -27,17 +27,37 @@
 //
 
 #include "TightPalette.h"
+#include "util/CpuFeatures.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+#define TIGHT_PALETTE_SSE2
+#include <emmintrin.h>
+#endif
 
 TightPalette::TightPalette(int maxColors)
+: m_numColors(0),
+  m_stamp(0),
+  m_useSse2(CpuFeatures::hasSse2())
 {
+  memset(m_slotStamp, 0, sizeof(m_slotStamp));
   setMaxColors(maxColors);
   reset();
 }
 
+TightPalette::~TightPalette()
+{
+}
+
 void TightPalette::reset()
 {
   m_numColors = 0;
-  memset(m_hash, 0, 256 * sizeof(TightColorList *));
+
+  // Invalidate all slots at once. The table is cleared only when the
+  // stamp wraps around.
+  if (++m_stamp == 0) {
+    memset(m_slotStamp, 0, sizeof(m_slotStamp));
+    m_stamp = 1;
+  }
 }
 
 void TightPalette::setMaxColors(int maxColors)
@@ -52,63 +72,285 @@ void TightPalette::setMaxColors(int maxColors)
 
 int TightPalette::insert(UINT32 rgb, int numPixels)
 {
-  TightColorList *pnode;
-  TightColorList *prev_pnode = NULL;
-  int hash_key, idx, new_idx, count;
-
-  hash_key = hashFunc(rgb);
-
-  pnode = m_hash[hash_key];
-
-  while (pnode != NULL) {
-    if (pnode->rgb == rgb) {
-      // Such palette entry already exists.
-      new_idx = idx = pnode->idx;
-      count = m_entry[idx].numPixels + numPixels;
-      if (new_idx && m_entry[new_idx-1].numPixels < count) {
-        do {
-          m_entry[new_idx] = m_entry[new_idx-1];
-          m_entry[new_idx].listNode->idx = new_idx;
-          new_idx--;
-        }
-        while (new_idx && m_entry[new_idx-1].numPixels < count);
+  int slot = findSlot(rgb);
+  int idx;
 
-        m_entry[new_idx].listNode = pnode;
-        pnode->idx = new_idx;
-      }
-      m_entry[new_idx].numPixels = count;
-      return m_numColors;
+  if (isSlotUsed(slot)) {
+    // Such palette entry already exists.
+    idx = m_slotIndex[slot];
+    int count = m_entry[idx].numPixels + numPixels;
+    while (idx > 0 && m_entry[idx-1].numPixels < count) {
+      m_entry[idx] = m_entry[idx-1];
+      m_slotIndex[m_entry[idx].slot] = (UINT8)idx;
+      idx--;
     }
-    prev_pnode = pnode;
-    pnode = pnode->next;
+    m_entry[idx].rgb = rgb;
+    m_entry[idx].numPixels = count;
+    m_entry[idx].slot = slot;
+    m_slotIndex[slot] = (UINT8)idx;
+    return m_numColors;
   }
 
   // Check if the palette is full.
-  if (m_numColors == 256 || m_numColors == m_maxColors) {
+  if (m_numColors == m_maxColors) {
     m_numColors = 0;
     return 0;
   }
 
   // Move palette entries with lesser pixel counts.
-  for ( idx = m_numColors;
-        idx > 0 && m_entry[idx-1].numPixels < numPixels;
-        idx-- ) {
+  for (idx = m_numColors;
+       idx > 0 && m_entry[idx-1].numPixels < numPixels;
+       idx--) {
     m_entry[idx] = m_entry[idx-1];
-    m_entry[idx].listNode->idx = idx;
+    m_slotIndex[m_entry[idx].slot] = (UINT8)idx;
   }
 
-  // Add new palette entry into the freed slot.
-  pnode = &m_list[m_numColors];
-  if (prev_pnode != NULL) {
-    prev_pnode->next = pnode;
-  } else {
-    m_hash[hash_key] = pnode;
-  }
-  pnode->next = NULL;
-  pnode->idx = idx;
-  pnode->rgb = rgb;
-  m_entry[idx].listNode = pnode;
+  // Add new palette entry into the freed position.
+  m_entry[idx].rgb = rgb;
   m_entry[idx].numPixels = numPixels;
+  m_entry[idx].slot = slot;
+  m_slotStamp[slot] = m_stamp;
+  m_slotColor[slot] = rgb;
+  m_slotIndex[slot] = (UINT8)idx;
 
   return ++m_numColors;
 }
+
+int TightPalette::fill(const Rect *rect, const FrameBufferView *fb,
+                       int maxColors, bool buildIndexMap)
+{
+  reset();
+  setMaxColors(maxColors);
+
+  const int width = rect->getWidth();
+  const int height = rect->getHeight();
+  const int area = width * height;
+  if (area <= 0 || m_maxColors == 0) {
+    return 0;
+  }
+
+  UINT8 *indexMap = 0;
+  if (buildIndexMap) {
+    // The map only grows, so it is not reallocated for every rectangle.
+    if (m_indexMap.size() < (size_t)area) {
+      m_indexMap.resize(area);
+    }
+    indexMap = &m_indexMap.front();
+  }
+
+  const void *pixels = fb->getBufferPtr(rect->left, rect->top);
+  const int stride = fb->getStride();
+
+  switch (fb->getBitsPerPixel()) {
+  case 8:
+    fillAny((const UINT8 *)pixels, width, height, stride, indexMap);
+    break;
+  case 16:
+    fillAny((const UINT16 *)pixels, width, height, stride, indexMap);
+    break;
+  default:
+    // Rectangles of one or two colors (solid areas, text, window frames)
+    // are very common and are recognized much faster without hashing.
+    if (!m_useSse2 ||
+        !fillTwoColors32((const UINT32 *)pixels, width, height, stride,
+                         indexMap)) {
+      reset();
+      fillAny((const UINT32 *)pixels, width, height, stride, indexMap);
+    }
+    break;
+  }
+  return m_numColors;
+}
+
+inline int TightPalette::append(UINT32 rgb, int slot)
+{
+  if (m_numColors == m_maxColors) {
+    return -1;
+  }
+  int idx = m_numColors++;
+  m_entry[idx].rgb = rgb;
+  m_entry[idx].numPixels = 0;
+  m_entry[idx].slot = slot;
+  m_slotStamp[slot] = m_stamp;
+  m_slotColor[slot] = rgb;
+  m_slotIndex[slot] = (UINT8)idx;
+  return idx;
+}
+
+bool TightPalette::sortEntries()
+{
+  // Insertion sort is stable and does almost nothing for the typical case
+  // when colors appear in the order of their frequency.
+  bool changed = false;
+  for (int i = 1; i < m_numColors; i++) {
+    Entry entry = m_entry[i];
+    int j = i;
+    while (j > 0 && m_entry[j-1].numPixels < entry.numPixels) {
+      m_entry[j] = m_entry[j-1];
+      j--;
+    }
+    if (j != i) {
+      m_entry[j] = entry;
+      changed = true;
+    }
+  }
+  if (!changed) {
+    return false;
+  }
+
+  for (int i = 0; i < m_numColors; i++) {
+    int slot = m_entry[i].slot;
+    m_remap[m_slotIndex[slot]] = (UINT8)i;
+    m_slotIndex[slot] = (UINT8)i;
+  }
+  return true;
+}
+
+template <class PIXEL_T>
+void TightPalette::fillAny(const PIXEL_T *pixels, int width, int height,
+                           int stride, UINT8 *indexMap)
+{
+  PIXEL_T color = pixels[0];
+  int idx = append(color, findSlot(color));
+  int runLength = 0;
+  UINT8 *map = indexMap;
+
+  for (int y = 0; y < height; y++) {
+    const PIXEL_T *row = pixels + y * stride;
+    for (int x = 0; x < width; x++) {
+      if (row[x] != color) {
+        m_entry[idx].numPixels += runLength;
+        runLength = 0;
+        color = row[x];
+        int slot = findSlot(color);
+        if (isSlotUsed(slot)) {
+          idx = m_slotIndex[slot];
+        } else if ((idx = append(color, slot)) < 0) {
+          m_numColors = 0;
+          return;
+        }
+      }
+      runLength++;
+      if (map != 0) {
+        *map++ = (UINT8)idx;
+      }
+    }
+  }
+  m_entry[idx].numPixels += runLength;
+
+  if (sortEntries() && indexMap != 0) {
+    for (UINT8 *p = indexMap; p != map; p++) {
+      *p = m_remap[*p];
+    }
+  }
+}
+
+#ifdef TIGHT_PALETTE_SSE2
+
+bool TightPalette::fillTwoColors32(const UINT32 *pixels, int width,
+                                   int height, int stride, UINT8 *indexMap)
+{
+  // Map a four-bit comparison mask to four index bytes (stored in memory
+  // order, the processor is little-endian) and to the number of set bits.
+  static const UINT32 MASK_TO_INDICES[16] = {
+    0x00000000, 0x00000001, 0x00000100, 0x00000101,
+    0x00010000, 0x00010001, 0x00010100, 0x00010101,
+    0x01000000, 0x01000001, 0x01000100, 0x01000101,
+    0x01010000, 0x01010001, 0x01010100, 0x01010101
+  };
+  static const int BIT_COUNT[16] = {
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
+  };
+
+  const UINT32 color0 = pixels[0];
+  UINT32 color1 = color0;
+  bool haveColor1 = false;
+  int count1 = 0;
+  const __m128i vColor0 = _mm_set1_epi32((int)color0);
+  __m128i vColor1 = vColor0;
+  UINT8 *map = indexMap;
+
+  for (int y = 0; y < height; y++) {
+    const UINT32 *row = pixels + y * stride;
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(row + x));
+      int mask0 = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, vColor0)));
+      int mask1 = 0;
+      if (haveColor1) {
+        mask1 = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, vColor1)));
+      }
+      if ((mask0 | mask1) != 0xF) {
+        if (haveColor1) {
+          return false;
+        }
+        // The first pixel of the second color.
+        int i = 0;
+        while (mask0 & (1 << i)) {
+          i++;
+        }
+        color1 = row[x + i];
+        haveColor1 = true;
+        vColor1 = _mm_set1_epi32((int)color1);
+        mask1 = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, vColor1)));
+        if ((mask0 | mask1) != 0xF) {
+          return false;
+        }
+      }
+      count1 += BIT_COUNT[mask1];
+      if (map != 0) {
+        memcpy(map, &MASK_TO_INDICES[mask1], 4);
+        map += 4;
+      }
+    }
+    for (; x < width; x++) {
+      UINT32 px = row[x];
+      UINT8 idx = 0;
+      if (px != color0) {
+        if (!haveColor1) {
+          color1 = px;
+          haveColor1 = true;
+          vColor1 = _mm_set1_epi32((int)color1);
+        } else if (px != color1) {
+          return false;
+        }
+        count1++;
+        idx = 1;
+      }
+      if (map != 0) {
+        *map++ = idx;
+      }
+    }
+  }
+
+  if (append(color0, findSlot(color0)) < 0) {
+    m_numColors = 0;
+    return true;
+  }
+  m_entry[0].numPixels = width * height - count1;
+  if (haveColor1) {
+    if (append(color1, findSlot(color1)) < 0) {
+      m_numColors = 0;
+      return true;
+    }
+    m_entry[1].numPixels = count1;
+    if (sortEntries() && indexMap != 0) {
+      for (UINT8 *p = indexMap; p != map; p++) {
+        *p ^= 1;
+      }
+    }
+  }
+  return true;
+}
+
+#else // TIGHT_PALETTE_SSE2
+
+// The function below is never called because m_useSse2 is always false.
+
+bool TightPalette::fillTwoColors32(const UINT32 *pixels, int width,
+                                   int height, int stride, UINT8 *indexMap)
+{
+  return false;
+}
+
+#endif // TIGHT_PALETTE_SSE2
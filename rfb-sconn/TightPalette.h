@@ -28,36 +28,47 @@
 // is a list where colors are always sorted by these counts (more
 // frequent first).
 //
+// The hash is an open-addressed table with twice as many slots as there
+// may be colors, so a lookup normally costs one or two probes. Slots are
+// marked with a generation number, so reset() does not have to clear the
+// table and the palette can be refilled for every rectangle or tile
+// without noticeable cost.
+//
+// The palette may be filled either color by color with insert(), or from
+// a rectangle of pixels with fill() which can also build an index map,
+// that is, the palette index of every pixel, so the encoders do not need
+// to look up colors once more when producing indexed data.
+//
 
 #ifndef __RFB_TIGHTPALETTE_H_INCLUDED__
 #define __RFB_TIGHTPALETTE_H_INCLUDED__
 
 #include <string.h>
+#include <vector>
 #include "util/inttypes.h"
-
-struct TightColorList {
-  TightColorList *next;
-  int idx;
-  UINT32 rgb;
-};
-
-struct TightPaletteEntry {
-  TightColorList *listNode;
-  int numPixels;
-};
+#include "region/Rect.h"
+#include "rfb/FrameBufferView.h"
 
 class TightPalette {
 
 protected:
 
-  // FIXME: Bigger hash table? Better hash function?
+  static const int MAX_COLORS = 256;
+
+  // The number of slots in the hash table, must be a power of two.
+  static const int HASH_BITS = 9;
+  static const int HASH_SIZE = 1 << HASH_BITS;
+
+  // Multiplicative (Fibonacci) hashing mixes all bits of a color into the
+  // top bits of the product, so similar colors do not cluster.
   inline static int hashFunc(UINT32 rgb) {
-    return (rgb ^ (rgb >> 13)) & 0xFF;
+    return (int)((rgb * 2654435761U) >> (32 - HASH_BITS));
   }
 
 public:
 
   TightPalette(int maxColors = 254);
+  virtual ~TightPalette();
 
   //
   // Re-initialize the object. This does not change maximum number
@@ -80,6 +91,17 @@ public:
   //
   int insert(UINT32 rgb, int numPixels);
 
+  //
+  // Reset the palette and fill it with the colors of the specified
+  // rectangle, taking pixels of the size given by the pixel format of the
+  // view (8, 16 or 32 bits). Returns the number of colors, or zero if
+  // there are more than maxColors colors. If buildIndexMap is true and
+  // the colors fit in the palette, getIndexMap() then returns the index of
+  // every pixel of the rectangle.
+  //
+  int fill(const Rect *rect, const FrameBufferView *fb, int maxColors,
+           bool buildIndexMap);
+
   //
   // Return the number of colors in the palette. If the palette is full,
   // this function returns 0.
@@ -92,7 +114,7 @@ public:
   // Return the color specified by its index in the palette.
   //
   inline UINT32 getEntry(int i) const {
-    return (i < m_numColors) ? m_entry[i].listNode->rgb : (UINT32)-1;
+    return (i < m_numColors) ? m_entry[i].rgb : (UINT32)-1;
   }
 
   //
@@ -106,24 +128,81 @@ public:
   // Return the index of a specified color.
   //
   inline UINT8 getIndex(UINT32 rgb) const {
-    TightColorList *pnode = m_hash[hashFunc(rgb)];
-    while (pnode != NULL) {
-      if (pnode->rgb == rgb) {
-        return (UINT8)pnode->idx;
-      }
-      pnode = pnode->next;
-    }
-    return 0xFF;  // no such color
+    int slot = findSlot(rgb);
+    return isSlotUsed(slot) ? m_slotIndex[slot] : 0xFF;  // 0xFF if no such color
+  }
+
+  //
+  // Return palette indices of the pixels of the rectangle passed to the
+  // last fill() call, row by row without gaps between rows. Valid only if
+  // fill() was asked to build the map and returned a non-zero value.
+  //
+  inline const UINT8 *getIndexMap() const {
+    return &m_indexMap.front();
   }
 
 protected:
 
+  struct Entry {
+    UINT32 rgb;
+    int numPixels;
+    int slot;
+  };
+
+  // Return the slot holding the specified color, or the free slot where
+  // the color should be placed.
+  inline int findSlot(UINT32 rgb) const {
+    int slot = hashFunc(rgb);
+    while (isSlotUsed(slot) && m_slotColor[slot] != rgb) {
+      slot = (slot + 1) & (HASH_SIZE - 1);
+    }
+    return slot;
+  }
+
+  inline bool isSlotUsed(int slot) const {
+    return m_slotStamp[slot] == m_stamp;
+  }
+
+  // Append a color which is not yet in the palette, without keeping the
+  // entries sorted. Returns the index of the new entry, or -1 if the
+  // palette is full.
+  inline int append(UINT32 rgb, int slot);
+
+  // Sort entries appended by fill() by their counts, more frequent first.
+  // The order of colors with equal counts is kept. Returns true if the
+  // order of entries has changed, in which case the new index of the entry
+  // which was at position i is stored in m_remap[i].
+  bool sortEntries();
+
+  // Collect colors of any rectangle, one hash lookup per run of equal
+  // pixels.
+  template <class PIXEL_T>
+    void fillAny(const PIXEL_T *pixels, int width, int height, int stride,
+                 UINT8 *indexMap);
+
+  // Check with SSE2 instructions if the 32-bit pixels of a rectangle have
+  // no more than two colors, and if so, put them in the palette. The scan
+  // stops as soon as the third color is found, and then false is returned
+  // leaving the palette in an undefined state.
+  bool fillTwoColors32(const UINT32 *pixels, int width, int height,
+                       int stride, UINT8 *indexMap);
+
   int m_maxColors;
   int m_numColors;
 
-  TightPaletteEntry m_entry[256];
-  TightColorList *m_hash[256];
-  TightColorList m_list[256];
+  Entry m_entry[MAX_COLORS];
+
+  // Slots of the hash table. A slot is used if its stamp is equal to
+  // m_stamp, which changes on every reset().
+  UINT32 m_slotStamp[HASH_SIZE];
+  UINT32 m_slotColor[HASH_SIZE];
+  UINT8 m_slotIndex[HASH_SIZE];
+  UINT32 m_stamp;
+
+  UINT8 m_remap[MAX_COLORS];
+  std::vector<UINT8> m_indexMap;
+
+  bool m_useSse2;
 
 };
 
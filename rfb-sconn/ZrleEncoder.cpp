@@ -23,6 +23,7 @@
 //
 
 #include "ZrleEncoder.h"
+#include "thread/AutoLock.h"
 
 ZrleEncoder::ZrleEncoder(PixelConverter *conv, DataOutputStream *output)
 : Encoder(conv, output),
@@ -33,12 +34,20 @@ ZrleEncoder::ZrleEncoder(PixelConverter *conv, DataOutputStream *output)
   m_monoZlibLevel(ZLIB_MONO_LEVEL_DEFAULT),
   m_rawZlibLevel(ZLIB_RAW_LEVEL_DEFAULT),
   m_bytesPerPixel(0),
-  m_numberFirstByte(0)
+  m_numberFirstByte(0),
+  m_workerPool(0),
+  m_numTileJobs(0),
+  m_nextTileJob(0),
+  m_jobFb(0),
+  m_poolBusyTime(0),
+  m_poolElapsedTime(0),
+  m_parallelSpeedup(1.0)
 {
 }
 
 ZrleEncoder::~ZrleEncoder()
 {
+  destroyWorkers();
 }
 
 int ZrleEncoder::getCode() const
@@ -54,6 +63,120 @@ void ZrleEncoder::splitRectangle(const Rect *rect,
   rectList->push_back(*rect);
 }
 
+int ZrleEncoder::getRectOverhead(const EncodeOptions *options) const
+{
+  return RECT_OVERHEAD;
+}
+
+void ZrleEncoder::sendRectangles(const std::vector<Rect> *rects,
+                                 const FrameBuffer *serverFb,
+                                 const EncodeOptions *options)
+{
+  m_poolBusyTime = 0;
+  m_poolElapsedTime = 0;
+  INT64 startTime = WorkerPool::getTimerValue();
+
+  Encoder::sendRectangles(rects, serverFb, options);
+
+  // The time spent outside the worker pool was spent by one thread.
+  INT64 elapsedTime = WorkerPool::getTimerValue() - startTime;
+  if (elapsedTime > 0) {
+    m_parallelSpeedup = (double)(m_poolBusyTime + elapsedTime -
+                                 m_poolElapsedTime) / (double)elapsedTime;
+  } else {
+    m_parallelSpeedup = 1.0;
+  }
+}
+
+void ZrleEncoder::setNumThreads(size_t numThreads)
+{
+  size_t currentNumThreads = 1;
+  if (m_workerPool != 0) {
+    currentNumThreads = m_workerPool->getNumThreads();
+  }
+  if (numThreads < 1) {
+    numThreads = 1;
+  }
+  if (numThreads == currentNumThreads) {
+    return;
+  }
+
+  destroyWorkers();
+  if (numThreads > 1) {
+    try {
+      for (size_t i = 0; i < numThreads; i++) {
+        m_lanes.push_back(new TileLane(this));
+      }
+      m_workerPool = new WorkerPool(numThreads);
+    } catch (...) {
+      destroyWorkers();
+      throw;
+    }
+  }
+}
+
+double ZrleEncoder::getParallelSpeedup() const
+{
+  return m_parallelSpeedup;
+}
+
+void ZrleEncoder::destroyWorkers()
+{
+  // Threads of the pool should be stopped before the lanes are deleted.
+  if (m_workerPool != 0) {
+    delete m_workerPool;
+    m_workerPool = 0;
+  }
+  for (size_t i = 0; i < m_lanes.size(); i++) {
+    delete m_lanes[i];
+  }
+  m_lanes.clear();
+}
+
+//--------------------------------------------------------------------------//
+
+ZrleEncoder::TileLane::TileLane(ZrleEncoder *owner)
+: m_owner(owner),
+  m_encoder(0)
+{
+  // The pixel converter and the output stream are never used by the lane
+  // encoder, it only serializes tiles of pixels converted by the owner.
+  m_encoder = new ZrleEncoder(owner->m_pixelConverter, owner->m_output);
+}
+
+ZrleEncoder::TileLane::~TileLane()
+{
+  delete m_encoder;
+}
+
+void ZrleEncoder::TileLane::run()
+{
+  // Write tiles in the same pixel format as the owner.
+  m_encoder->m_pxFormat = m_owner->m_pxFormat;
+  m_encoder->m_bytesPerPixel = m_owner->m_bytesPerPixel;
+  m_encoder->m_numberFirstByte = m_owner->m_numberFirstByte;
+
+  std::vector<UINT8> *rgbData = &m_encoder->m_rgbData;
+  TileJob *job;
+  while ((job = m_owner->getNextTileJob()) != 0) {
+    // Write the tile directly to the buffer of the job.
+    rgbData->swap(job->data);
+    rgbData->clear();
+    switch (m_encoder->m_pxFormat.bitsPerPixel) {
+    case 8:
+      m_encoder->writeTile<UINT8>(&job->rect, m_owner->m_jobFb);
+      break;
+    case 16:
+      m_encoder->writeTile<UINT16>(&job->rect, m_owner->m_jobFb);
+      break;
+    default:
+      m_encoder->writeTile<UINT32>(&job->rect, m_owner->m_jobFb);
+      break;
+    }
+    rgbData->swap(job->data);
+  }
+}
+
 void ZrleEncoder::sendRectangle(const Rect *rect,
                                 const FrameBuffer *serverFb,
                                 const EncodeOptions *options)
@@ -64,9 +187,8 @@ void ZrleEncoder::sendRectangle(const Rect *rect,
   // Used for futher work with CPIXELs.
   m_bytesPerPixel = 0;
   m_numberFirstByte = 0;
-  const FrameBuffer *clientFb = m_pixelConverter->convert(rect, serverFb);
   //client pixel format
-  m_pxFormat = clientFb->getPixelFormat();
+  m_pxFormat = m_pixelConverter->getDstFormat();
   //server pixel format
   PixelFormat serverPxFormat = serverFb->getPixelFormat();
   bool bigEndianDiffs = m_pxFormat.bigEndian != serverPxFormat.bigEndian;
@@ -100,14 +222,13 @@ void ZrleEncoder::sendRectangle(const Rect *rect,
   // If vector will be small it will be resized automatically.
   m_rgbData.reserve(rect->area() * 3);
   
-  m_fbWidth = clientFb->getDimension().width;
-  size_t bpp = clientFb->getBitsPerPixel();
+  size_t bpp = m_pxFormat.bitsPerPixel;
   if (bpp == 8) {
-    sendRect<UINT8>(rect, serverFb, clientFb, options);
+    sendRect<UINT8>(rect, serverFb, options);
   } else if (bpp == 16) {
-    sendRect<UINT16>(rect, serverFb, clientFb, options);
+    sendRect<UINT16>(rect, serverFb, options);
   } else if (bpp == 32) {
-    sendRect<UINT32>(rect, serverFb, clientFb, options);
+    sendRect<UINT32>(rect, serverFb, options);
   } else {
     _ASSERT(0);
   }
@@ -116,86 +237,36 @@ void ZrleEncoder::sendRectangle(const Rect *rect,
 template <class PIXEL_T>
 void ZrleEncoder::sendRect(const Rect *rect,
                            const FrameBuffer *serverFb,
-                           const FrameBuffer *clientFb,
                            const EncodeOptions *options)
 {
   m_rgbData.resize(0);
-  const PIXEL_T *buffer = static_cast<const PIXEL_T *>(clientFb->getBuffer());
-  
-  Rect tileRect;
-  for (tileRect.top = rect->top; tileRect.top < rect->bottom; tileRect.top += TILE_SIZE) {
 
-    tileRect.bottom = min(rect->bottom, tileRect.top + TILE_SIZE);
+  // Without a worker pool, pixels are converted one row of tiles at a time.
+  int batchHeight = TILE_SIZE;
+  if (m_workerPool != 0) {
+    int tilesPerRow = (rect->getWidth() + TILE_SIZE - 1) / TILE_SIZE;
+    int minTiles = (int)m_workerPool->getNumThreads() * MIN_TILES_PER_THREAD;
+    batchHeight *= (minTiles + tilesPerRow - 1) / tilesPerRow;
+  }
 
-    for (tileRect.left = rect->left; tileRect.left < rect->right; tileRect.left += TILE_SIZE) {
+  Rect batch(rect->left, rect->top, rect->right, rect->top);
+  for (; batch.top < rect->bottom; batch.top = batch.bottom) {
+    batch.bottom = min(rect->bottom, batch.top + batchHeight);
 
-      tileRect.right = min(rect->right, tileRect.left + TILE_SIZE);
+    // Convert the batch to the client pixel format.
+    FrameBufferView clientFb = m_pixelConverter->convert(&batch, serverFb);
 
-      // Clear sizes and vector with plain RLE tile.
-      m_rawTileSize = 0;
-      m_paletteTileSize = 0;
-      m_paletteRleTileSize = 0;
-      m_plainRleTile.clear();
+    if (m_workerPool != 0) {
+      writeTilesInParallel(&batch, &clientFb);
+      continue;
+    }
 
-      fillPalette<PIXEL_T>(&tileRect, clientFb);
-      int numColors = m_pal.getNumColors();
-      m_oldSize = m_rgbData.size();
-      
-      // If number of colors is 1 the tile with minimal size is solid.
-      if (numColors == 1) {
-        writeSolidTile();
-      // Else calculate sizes of tile with other encodings
-      // and choose encoding type when size is the minimal.
-      } else {
-        // Calculate size of packed pixels in palette.
-        if (numColors == 2) {
-          m_mSize = ((tileRect.getWidth() + 7) / 8) * tileRect.getHeight();
-        } else if (numColors == 3 || numColors == 4) {
-          m_mSize = ((tileRect.getWidth() + 3) / 4) * tileRect.getHeight();
-        } else {
-          m_mSize = ((tileRect.getWidth() + 1) / 2) * tileRect.getHeight();
-        }
-        
-        //TODO: Test this code
-        // Size of raw tile is (1 + width * height * pixelSize).
-        m_rawTileSize = 1 + tileRect.area() * m_bytesPerPixel;
-        // Size of palette tile.
-        if (numColors > 1 && numColors <= 16) {
-          m_paletteTileSize = 1 + numColors * m_bytesPerPixel + m_mSize;
-        } else {
-          m_paletteTileSize = THIS_TYPE_OF_TILE_IS_NOT_POSSIBLE;
-        }
-        // Size of palette RLE tile.
-        if (numColors > 16 && numColors <= 127) {
-          m_paletteRleTileSize += numColors * m_bytesPerPixel;
-        } else {
-          m_paletteRleTileSize = THIS_TYPE_OF_TILE_IS_NOT_POSSIBLE;
-        }
-        // Choose the size of the min tile.
-        size_t minSizeOfTile = m_rawTileSize;
-        if (m_paletteTileSize < minSizeOfTile) {
-          minSizeOfTile = m_paletteTileSize;
-        }
-        if (m_plainRleTile.size() < minSizeOfTile) {
-          minSizeOfTile = m_plainRleTile.size();
-        }
-        if (m_paletteRleTileSize < minSizeOfTile) {
-          minSizeOfTile = m_paletteRleTileSize;
-        }
-
-        // Write the tile with the min size.
-        if (minSizeOfTile == m_rawTileSize) {
-          writeRawTile<PIXEL_T>(&tileRect, clientFb);
-        } else if (minSizeOfTile == m_paletteTileSize) {
-          writePackedPaletteTile<PIXEL_T>(&tileRect, clientFb);
-        } else if (minSizeOfTile == m_plainRleTile.size()) {
-          m_rgbData.resize(m_oldSize + m_plainRleTile.size());
-          memcpy(&m_rgbData[m_oldSize],
-                 &m_plainRleTile.front(),
-                 m_plainRleTile.size());
-        } else if (minSizeOfTile == m_paletteRleTileSize) {
-          writePaletteRleTile<PIXEL_T>(&tileRect, clientFb);
-        }
+    Rect tileRect;
+    for (tileRect.top = batch.top; tileRect.top < batch.bottom; tileRect.top += TILE_SIZE) {
+      tileRect.bottom = min(batch.bottom, tileRect.top + TILE_SIZE);
+      for (tileRect.left = batch.left; tileRect.left < batch.right; tileRect.left += TILE_SIZE) {
+        tileRect.right = min(batch.right, tileRect.left + TILE_SIZE);
+        writeTile<PIXEL_T>(&tileRect, &clientFb);
       }
     }
   }
@@ -214,9 +285,121 @@ void ZrleEncoder::sendRect(const Rect *rect,
   }
 }
 
+template <class PIXEL_T>
+void ZrleEncoder::writeTile(const Rect *tileRect,
+                            const FrameBufferView *fb)
+{
+  // Clear sizes and vector with plain RLE tile.
+  m_rawTileSize = 0;
+  m_paletteTileSize = 0;
+  m_paletteRleTileSize = 0;
+  m_plainRleTile.clear();
+
+  fillPalette<PIXEL_T>(tileRect, fb);
+  int numColors = m_pal.getNumColors();
+  m_oldSize = m_rgbData.size();
+  
+  // If number of colors is 1 the tile with minimal size is solid.
+  if (numColors == 1) {
+    writeSolidTile();
+  // Else calculate sizes of tile with other encodings
+  // and choose encoding type when size is the minimal.
+  } else {
+    // Calculate size of packed pixels in palette.
+    if (numColors == 2) {
+      m_mSize = ((tileRect->getWidth() + 7) / 8) * tileRect->getHeight();
+    } else if (numColors == 3 || numColors == 4) {
+      m_mSize = ((tileRect->getWidth() + 3) / 4) * tileRect->getHeight();
+    } else {
+      m_mSize = ((tileRect->getWidth() + 1) / 2) * tileRect->getHeight();
+    }
+    
+    //TODO: Test this code
+    // Size of raw tile is (1 + width * height * pixelSize).
+    m_rawTileSize = 1 + tileRect->area() * m_bytesPerPixel;
+    // Size of palette tile.
+    if (numColors > 1 && numColors <= 16) {
+      m_paletteTileSize = 1 + numColors * m_bytesPerPixel + m_mSize;
+    } else {
+      m_paletteTileSize = THIS_TYPE_OF_TILE_IS_NOT_POSSIBLE;
+    }
+    // Size of palette RLE tile.
+    if (numColors > 16 && numColors <= 127) {
+      m_paletteRleTileSize += numColors * m_bytesPerPixel;
+    } else {
+      m_paletteRleTileSize = THIS_TYPE_OF_TILE_IS_NOT_POSSIBLE;
+    }
+    // Choose the size of the min tile.
+    size_t minSizeOfTile = m_rawTileSize;
+    if (m_paletteTileSize < minSizeOfTile) {
+      minSizeOfTile = m_paletteTileSize;
+    }
+    if (m_plainRleTile.size() < minSizeOfTile) {
+      minSizeOfTile = m_plainRleTile.size();
+    }
+    if (m_paletteRleTileSize < minSizeOfTile) {
+      minSizeOfTile = m_paletteRleTileSize;
+    }
+
+    // Write the tile with the min size.
+    if (minSizeOfTile == m_rawTileSize) {
+      writeRawTile<PIXEL_T>(tileRect, fb);
+    } else if (minSizeOfTile == m_paletteTileSize) {
+      writePackedPaletteTile(tileRect);
+    } else if (minSizeOfTile == m_plainRleTile.size()) {
+      m_rgbData.resize(m_oldSize + m_plainRleTile.size());
+      memcpy(&m_rgbData[m_oldSize],
+             &m_plainRleTile.front(),
+             m_plainRleTile.size());
+    } else if (minSizeOfTile == m_paletteRleTileSize) {
+      writePaletteRleTile(tileRect);
+    }
+  }
+}
+
+void ZrleEncoder::writeTilesInParallel(const Rect *batch,
+                                       const FrameBufferView *fb)
+{
+  // Make a job for each tile.
+  m_numTileJobs = 0;
+  Rect tileRect;
+  for (tileRect.top = batch->top; tileRect.top < batch->bottom; tileRect.top += TILE_SIZE) {
+    tileRect.bottom = min(batch->bottom, tileRect.top + TILE_SIZE);
+    for (tileRect.left = batch->left; tileRect.left < batch->right; tileRect.left += TILE_SIZE) {
+      tileRect.right = min(batch->right, tileRect.left + TILE_SIZE);
+      if (m_numTileJobs == m_tileJobs.size()) {
+        m_tileJobs.push_back(TileJob());
+      }
+      m_tileJobs[m_numTileJobs++].rect = tileRect;
+    }
+  }
+  m_nextTileJob = 0;
+  m_jobFb = fb;
+
+  std::vector<WorkerTask *> tasks(m_lanes.begin(), m_lanes.end());
+  m_workerPool->run(&tasks);
+  m_poolBusyTime += m_workerPool->getLastBusyTime();
+  m_poolElapsedTime += m_workerPool->getLastElapsedTime();
+
+  // Put the tiles together in their original order.
+  for (size_t i = 0; i < m_numTileJobs; i++) {
+    const std::vector<UINT8> *data = &m_tileJobs[i].data;
+    m_rgbData.insert(m_rgbData.end(), data->begin(), data->end());
+  }
+}
+
+ZrleEncoder::TileJob *ZrleEncoder::getNextTileJob()
+{
+  AutoLock l(&m_jobLock);
+  if (m_nextTileJob < m_numTileJobs) {
+    return &m_tileJobs[m_nextTileJob++];
+  }
+  return 0;
+}
+
 template <class PIXEL_T>
 void ZrleEncoder::writeRawTile(const Rect *tileRect,
-                               const FrameBuffer *fb)
+                               const FrameBufferView *fb)
 {
   m_oldSize = m_rgbData.size();
   m_rgbData.resize(m_oldSize + tileRect->area() * m_bytesPerPixel + 1);
@@ -237,9 +420,7 @@ void ZrleEncoder::writeSolidTile() throw(IOException)
   memcpy(&m_rgbData[m_oldSize + 1], &colorPixel + m_numberFirstByte, m_bytesPerPixel);
 }
 
-template <class PIXEL_T>
-void ZrleEncoder::writePackedPaletteTile(const Rect *tileRect,
-                                         const FrameBuffer *fb)
+void ZrleEncoder::writePackedPaletteTile(const Rect *tileRect)
 {
   int numColors = m_pal.getNumColors();
   m_oldSize = m_rgbData.size();
@@ -268,16 +449,14 @@ void ZrleEncoder::writePackedPaletteTile(const Rect *tileRect,
   }
 
   // Pack pixels.
-  const PIXEL_T *buffer = static_cast<const PIXEL_T *>(fb->getBuffer());
+  const UINT8 *indices = m_pal.getIndexMap();
   UINT8 packedByte = 0;
   int indexOfM = 0;
   int offset = 8;
 
-  Rect rect;
-  for (rect.top = tileRect->top; rect.top < tileRect->bottom; rect.top++) {
-    for (rect.left = tileRect->left; rect.left < tileRect->right; rect.left++) {
-      PIXEL_T px = buffer[rect.top * m_fbWidth + rect.left];
-      UINT8 indexOfColor = m_pal.getIndex(px);
+  for (int y = 0; y < tileRect->getHeight(); y++) {
+    for (int x = 0; x < tileRect->getWidth(); x++) {
+      UINT8 indexOfColor = *indices++;
       if (offset != 0) {
         packedByte = packedByte << deltaOffset;
         packedByte = packedByte | indexOfColor;
@@ -320,9 +499,7 @@ void ZrleEncoder::pushRunLengthPaletteRle(int runLength,
   } while (runLength >= 0);
 }
 
-template <class PIXEL_T>
-void ZrleEncoder::writePaletteRleTile(const Rect *tileRect,
-                                      const FrameBuffer *fb)
+void ZrleEncoder::writePaletteRleTile(const Rect *tileRect)
 {
   int numColors = m_pal.getNumColors();
   std::vector<UINT8> paletteRleData;
@@ -339,12 +516,10 @@ void ZrleEncoder::writePaletteRleTile(const Rect *tileRect,
              m_bytesPerPixel);
   }
 
-  const PIXEL_T *buffer = static_cast<const PIXEL_T *>(fb->getBuffer());
-  PixelFormat pxFormat = fb->getPixelFormat();
+  const UINT8 *indices = m_pal.getIndexMap();
 
   // There is the first iteration of loop below.
-  PIXEL_T px = buffer[tileRect->top * m_fbWidth + tileRect->left];
-  UINT8 indexOfColor = m_pal.getIndex(px);
+  UINT8 indexOfColor = indices[0];
 
   // Processing of the first pixel.
   paletteRleData.push_back(indexOfColor);
@@ -352,14 +527,7 @@ void ZrleEncoder::writePaletteRleTile(const Rect *tileRect,
   
   int runLength = 0;
   for (int i = 1; i < tileRect->area(); ++i) {
-    // FIXME: This variant may be not the most optimal.
-    // One of the possible variant is double for loops.
-    int x = tileRect->left + i % tileRect->getWidth();
-    int y = tileRect->top + i / tileRect->getWidth();
-
-    px = buffer[y * m_fbWidth + x];
-
-    indexOfColor = m_pal.getIndex(px);
+    indexOfColor = indices[i];
     if (indexOfColor != previousIndexOfColor) {
       if (runLength > 0) {
         pushRunLengthPaletteRle(runLength, &paletteRleData);
@@ -408,14 +576,15 @@ void ZrleEncoder::writePixelToPlainRleTile(const PIXEL_T px,
 
 template <class PIXEL_T>
 void ZrleEncoder::fillPalette(const Rect *tileRect,
-                              const FrameBuffer *fb)
+                              const FrameBufferView *fb)
 {
-  // Clear the palette.
-  m_pal.reset();
-  m_pal.setMaxColors(MAX_NUMBER_OF_COLORS_IN_PALETTE);
-  int tryInsertPx = 1;
+  // Fill the palette and map pixels to palette indices for the palette
+  // tile types.
+  m_pal.fill(tileRect, fb, MAX_NUMBER_OF_COLORS_IN_PALETTE, true);
 
-  const PIXEL_T *buffer = (const PIXEL_T *)fb->getBuffer();
+  const PIXEL_T *buffer =
+    static_cast<const PIXEL_T *>(fb->getBufferPtr(tileRect->left, tileRect->top));
+  const int fbStride = fb->getStride();
   PixelFormat pxFormat = fb->getPixelFormat();
 
   // Mask for cutting rubbish bits.
@@ -426,12 +595,8 @@ void ZrleEncoder::fillPalette(const Rect *tileRect,
   // There is the first iteration of loop below.
   // Pixel for adding to plainRleTile
   PIXEL_T previousPx;
-  PIXEL_T px = buffer[tileRect->top * m_fbWidth + tileRect->left];
+  PIXEL_T px = buffer[0];
 
-  // Pixel for adding to palette
-  PIXEL_T oldPixel = px;
-  int palLength = 1;
-  
   // Fill RLE tile vector.
   px &= mask;
   // Write type of subencoding.
@@ -444,49 +609,34 @@ void ZrleEncoder::fillPalette(const Rect *tileRect,
   // Increase the size of palette RLE tile.
   m_paletteRleTileSize++;
 
+  const int width = tileRect->getWidth();
+  const int height = tileRect->getHeight();
   int runLength = 0;
-  for (int i = 1; i < tileRect->area(); ++i) {
-    // FIXME: This variant may be not the most optimal.
-    // One of the possible variant is double for loops.
-    int x = tileRect->left + i % tileRect->getWidth();
-    int y = tileRect->top + i / tileRect->getWidth();
-
-    px = buffer[y * m_fbWidth + x];
-    
-    // Fill palette
-    if (tryInsertPx && oldPixel != px) {
-      tryInsertPx = m_pal.insert(oldPixel, palLength);
-      oldPixel = px;
-      palLength = 1;
-    } else {
-      palLength++;
-    }
-    
-    // Fill RLE tile vector.
-    px &= mask;
-    if (px != previousPx) {
-      pushRunLengthRle(runLength);
-      runLength = 0;
-      writePixelToPlainRleTile<PIXEL_T>(px, &previousPx);
-    } else {
-      runLength++;
+  for (int y = 0; y < height; y++) {
+    const PIXEL_T *row = buffer + y * fbStride;
+    for (int x = (y == 0) ? 1 : 0; x < width; x++) {
+      px = row[x] & mask;
+      if (px != previousPx) {
+        pushRunLengthRle(runLength);
+        runLength = 0;
+        writePixelToPlainRleTile<PIXEL_T>(px, &previousPx);
+      } else {
+        runLength++;
+      }
     }
   }
-  if (tryInsertPx) {
-    m_pal.insert(oldPixel, palLength);
-  }
   pushRunLengthRle(runLength);
 }
 
 template <class PIXEL_T>
 void ZrleEncoder::copyPixels(const Rect *rect,
-                             const FrameBuffer *fb,
+                             const FrameBufferView *fb,
                              UINT8 *dst)
 {
   const int rectHeight = rect->getHeight();
   const int rectWidth = rect->getWidth();
   const PIXEL_T *src = static_cast<const PIXEL_T *>(fb->getBufferPtr(rect->left, rect->top));
-  const int fbStride = fb->getDimension().width;
+  const int fbStride = fb->getStride();
   const size_t bytesPerRow = rect->getWidth() * m_bytesPerPixel;
 
   for (int y = 0; y < rectHeight; y++) {
@@ -497,13 +647,13 @@ void ZrleEncoder::copyPixels(const Rect *rect,
 }
 
 void ZrleEncoder::copyCPixels(const Rect *rect,
-                              const FrameBuffer *fb,
+                              const FrameBufferView *fb,
                               UINT8 *dst)
 {
   const int rectHeight = rect->getHeight();
   const int rectWidth = rect->getWidth();
   const UINT8 *src = static_cast<const UINT8 *>(fb->getBufferPtr(rect->left, rect->top));
-  const int fbStride = fb->getDimension().width;
+  const int fbStride = fb->getStride();
   
   for (int y = 0; y < rectHeight; y++) {
     for (int x = 0; x < rectWidth; x++) {
@@ -28,6 +28,8 @@
 #include "Encoder.h"
 #include "TightPalette.h"
 #include "util/Deflater.h"
+#include "thread/LocalMutex.h"
+#include "thread/WorkerPool.h"
 
 class ZrleEncoder : public Encoder
 {
@@ -47,31 +49,84 @@ public:
                              const FrameBuffer *serverFb,
                              const EncodeOptions *options) throw(IOException);
 
+  virtual void sendRectangles(const std::vector<Rect> *rects,
+                              const FrameBuffer *serverFb,
+                              const EncodeOptions *options) throw(IOException);
+
+  // With more than one thread, tiles are analyzed and serialized in
+  // parallel, while the zlib stream is still fed by the calling thread.
+  virtual void setNumThreads(size_t numThreads);
+
+  virtual double getParallelSpeedup() const;
+
+  // Each rectangle costs its data length, a zlib flush and partial tiles
+  // at its edges, while unchanged pixels inside a tile are almost free with
+  // RLE, so ZRLE prefers bigger rectangles than Tight does.
+  virtual int getRectOverhead(const EncodeOptions *options) const;
+
 private:
-  // Determine the class of rectangle and call necessary function for this type.
+  // A tile to be serialized by a TileLane. The data vector is not cleared
+  // between calls, so its buffer is reused.
+  struct TileJob
+  {
+    Rect rect;
+    std::vector<UINT8> data;
+  };
+
+  // A worker task serializing tiles with its own ZrleEncoder object (having
+  // its own palette and buffers). It takes tiles from the owner one by one
+  // until there are no more tiles left.
+  class TileLane : public WorkerTask
+  {
+  public:
+    TileLane(ZrleEncoder *owner);
+    virtual ~TileLane();
+
+    virtual void run();
+
+  protected:
+    ZrleEncoder *m_owner;
+    ZrleEncoder *m_encoder;
+  };
+
+  // Convert pixels to the client pixel format by batches of tile rows and
+  // serialize all tiles to m_rgbData, then compress and send it.
   template <class PIXEL_T>
     void sendRect(const Rect *rect,
                   const FrameBuffer *serverFb,
-                  const FrameBuffer *clientFb,
                   const EncodeOptions *options) throw(IOException);
 
+  // Determine the class of tile and append it to m_rgbData using the
+  // function for this type.
+  template <class PIXEL_T>
+    void writeTile(const Rect *tileRect,
+                   const FrameBufferView *fb) throw(IOException);
+
+  // Serialize all tiles of the batch with the lanes and append them to
+  // m_rgbData in order.
+  void writeTilesInParallel(const Rect *batch,
+                            const FrameBufferView *fb) throw(IOException);
+
+  // Return the next tile to be serialized by a lane, or 0 if there are no
+  // more tiles.
+  TileJob *getNextTileJob();
+
+  // Free the worker pool and all the lanes.
+  void destroyWorkers();
+
   // Send raw tile.
   template <class PIXEL_T>
     void writeRawTile(const Rect *tileRect,
-                      const FrameBuffer *fb) throw(IOException);
+                      const FrameBufferView *fb) throw(IOException);
 
   // Send a solid-color tile.
     void writeSolidTile() throw(IOException);
   
-  // Send packed palette tile.
-  template <class PIXEL_T>
-    void writePackedPaletteTile(const Rect *tileRect,
-                                const FrameBuffer *fb) throw(IOException);
+  // Send packed palette tile, using the index map of m_pal.
+  void writePackedPaletteTile(const Rect *tileRect) throw(IOException);
 
-  // Send palette RLE tile.
-  template <class PIXEL_T>
-    void writePaletteRleTile(const Rect *tileRect,
-                             const FrameBuffer *fb) throw(IOException);
+  // Send palette RLE tile, using the index map of m_pal.
+  void writePaletteRleTile(const Rect *tileRect) throw(IOException);
 
   // Write data from runLength (used in plain Rle encoding).
   void pushRunLengthRle(int runLength);
@@ -85,20 +140,21 @@ private:
     void writePixelToPlainRleTile(const PIXEL_T px,
                                   PIXEL_T *previousPx);
 
-  // Fill palette (m_pal), create m_plainRleTile vector and calculate size of data in palette RLE tile.
+  // Fill palette (m_pal) together with its index map, create m_plainRleTile
+  // vector and calculate size of data in palette RLE tile.
   template <class PIXEL_T>
     void fillPalette(const Rect *tileRect,
-                     const FrameBuffer *fb);
+                     const FrameBufferView *fb);
 
   // Copy ordinary PIXELs.
   template <class PIXEL_T>
     void copyPixels(const Rect *rect,
-                    const FrameBuffer *fb,
+                    const FrameBufferView *fb,
                     UINT8 *dst);
   
   // Copy CPIXELs.
   void copyCPixels(const Rect *rect,
-                   const FrameBuffer *fb,
+                   const FrameBufferView *fb,
                    UINT8 *dst);
 
   // Vector for storing all tiles for the future zlib compression.
@@ -106,9 +162,6 @@ private:
   // Size of m_rgbData before writing information in it.
   size_t m_oldSize;
 
-  // Size of stride.
-  int m_fbWidth;
-
   // Size of packed pixels in palette.
   int m_mSize;
   
@@ -136,10 +189,40 @@ private:
   // vector for storing plain RLE tile data
   std::vector<UINT8> m_plainRleTile;
 
+  //
+  // Parallel tile encoding (see writeTilesInParallel()).
+  //
+
+  // Pool of threads, 0 if encoding is done in one thread.
+  WorkerPool *m_workerPool;
+  // One lane per thread of the pool.
+  std::vector<TileLane *> m_lanes;
+
+  // Tiles of the current batch. The vector is not shrunk between batches
+  // so that the buffers of the jobs would be reused.
+  std::vector<TileJob> m_tileJobs;
+  size_t m_numTileJobs;
+  size_t m_nextTileJob;
+  const FrameBufferView *m_jobFb;
+  LocalMutex m_jobLock;
+
+  // Time spent in the worker pool during the current sendRectangles() call,
+  // see WorkerPool::getLastBusyTime() and getLastElapsedTime().
+  INT64 m_poolBusyTime;
+  INT64 m_poolElapsedTime;
+  double m_parallelSpeedup;
+
 private:
   // Tile size in ZRLE encoding by default.
   static const int TILE_SIZE = 64;
 
+  // With a worker pool, pixels are converted by batches having at least
+  // this number of tiles per thread, so that all threads would be busy.
+  static const int MIN_TILES_PER_THREAD = 4;
+
+  // Value returned by getRectOverhead(), in pixels.
+  static const int RECT_OVERHEAD = 512;
+
   // Default values for zlib settings.
   static const int ZLIB_IDX_LEVEL_DEFAULT = 7;
   static const int ZLIB_MONO_LEVEL_DEFAULT = 7;
@@ -38,3 +38,5 @@ const char *const PseudoEncDefs::SIG_POINTER_POS = "POINTPOS";
 const char *const PseudoEncDefs::SIG_LAST_RECT = "LASTRECT";
 const char *const PseudoEncDefs::SIG_DESKTOP_SIZE = "NEWFBSIZ";
 const char *const PseudoEncDefs::SIG_QUALITY_LEVEL = "JPEGQLVL";
+const char *const PseudoEncDefs::SIG_CONTINUOUS_UPDATES = "CONTUPDT";
+const char *const PseudoEncDefs::SIG_FENCE = "FENCE___";
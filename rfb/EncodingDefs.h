@@ -54,6 +54,9 @@ public:
 class PseudoEncDefs
 {
 public:
+  static const int CONTINUOUS_UPDATES = -313;
+  static const int FENCE = -312;
+
   static const int COMPR_LEVEL_0 = -256;
   static const int COMPR_LEVEL_1 = -255;
   static const int COMPR_LEVEL_2 = -254;
@@ -90,6 +93,8 @@ public:
   static const char *const SIG_LAST_RECT;
   static const char *const SIG_DESKTOP_SIZE;
   static const char *const SIG_QUALITY_LEVEL;
+  static const char *const SIG_CONTINUOUS_UPDATES;
+  static const char *const SIG_FENCE;
 };
 
 #endif // __RFB_ENCODING_DEFS_H_INCLUDED__
@@ -0,0 +1,51 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+#include "FrameBufferView.h"
+
+FrameBufferView::FrameBufferView()
+: m_buffer(0),
+  m_stride(0),
+  m_bytesPerPixel(0)
+{
+}
+
+FrameBufferView::FrameBufferView(const FrameBuffer *fb, const Rect *rect)
+: m_buffer((const UINT8 *)fb->getBufferPtr(rect->left, rect->top)),
+  m_rect(rect),
+  m_stride(fb->getBytesPerRow() / fb->getBytesPerPixel()),
+  m_bytesPerPixel(fb->getBytesPerPixel()),
+  m_pixelFormat(fb->getPixelFormat())
+{
+}
+
+FrameBufferView::FrameBufferView(const void *buffer, const Rect *rect,
+                                 int stride, const PixelFormat *pf)
+: m_buffer((const UINT8 *)buffer),
+  m_rect(rect),
+  m_stride(stride),
+  m_bytesPerPixel(pf->bitsPerPixel / 8),
+  m_pixelFormat(*pf)
+{
+}
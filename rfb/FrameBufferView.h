@@ -0,0 +1,91 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+#ifndef __RFB_FRAME_BUFFER_VIEW_H_INCLUDED__
+#define __RFB_FRAME_BUFFER_VIEW_H_INCLUDED__
+
+#include "FrameBuffer.h"
+
+// FrameBufferView gives read-only access to the pixels of a rectangular
+// area which may be stored either in a FrameBuffer or in a separate buffer
+// of the area size, with its own row length (stride). Pixels are addressed
+// by the frame buffer coordinates in both cases, so the code working with
+// the view does not depend on where the pixels are actually stored.
+//
+// The view does not own the pixel data, the data should remain relevant
+// while the view is used. Views are cheap to copy.
+class FrameBufferView
+{
+public:
+  // Construct an empty view.
+  FrameBufferView();
+
+  // Construct a view of `rect' in the frame buffer. The pixels are accessed
+  // via FrameBuffer::getBufferPtr() and getBytesPerRow(), so frame buffers
+  // keeping only a part of the pixels (see PatchFrameBuffer) are supported.
+  FrameBufferView(const FrameBuffer *fb, const Rect *rect);
+
+  // Construct a view of `rect' where the upper left pixel of the rectangle
+  // is stored at `buffer' and rows are `stride' pixels long.
+  FrameBufferView(const void *buffer, const Rect *rect, int stride,
+                  const PixelFormat *pf);
+
+  // Return a pointer to the pixel specified by its coordinates in the frame
+  // buffer. The pixel must be within the area returned by getRect(), this
+  // is not checked.
+  inline const void *getBufferPtr(int x, int y) const
+  {
+    return m_buffer +
+           ((y - m_rect.top) * m_stride + (x - m_rect.left)) * m_bytesPerPixel;
+  }
+
+  // Return the area covered by the view, in frame buffer coordinates.
+  inline Rect getRect() const { return m_rect; }
+
+  // Return the distance between the beginnings of adjacent rows, in pixels
+  // and in bytes.
+  inline int getStride() const { return m_stride; }
+  inline int getBytesPerRow() const { return m_stride * m_bytesPerPixel; }
+
+  inline PixelFormat getPixelFormat() const { return m_pixelFormat; }
+
+  // Return the number of bits occupied by one pixel (can be 8, 16 or 32).
+  inline UINT8 getBitsPerPixel() const
+  {
+    return (UINT8)m_pixelFormat.bitsPerPixel;
+  }
+
+  // Return the number of bytes occupied by one pixel (can be 1, 2 or 4).
+  inline UINT8 getBytesPerPixel() const { return (UINT8)m_bytesPerPixel; }
+
+protected:
+  // Pointer to the upper left pixel of m_rect.
+  const UINT8 *m_buffer;
+  Rect m_rect;
+  int m_stride;
+  int m_bytesPerPixel;
+  PixelFormat m_pixelFormat;
+};
+
+#endif // __RFB_FRAME_BUFFER_VIEW_H_INCLUDED__
@@ -0,0 +1,228 @@
+// Copyright (C) 2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#include "PatchFrameBuffer.h"
+#include "util/Exception.h"
+
+PatchFrameBuffer::PatchFrameBuffer()
+{
+}
+
+PatchFrameBuffer::~PatchFrameBuffer()
+{
+}
+
+void PatchFrameBuffer::setProperties(const Rect *patchRect,
+                                     const Dimension *newDim,
+                                     const PixelFormat *pixelFormat)
+{
+  m_dim = *newDim;
+  m_patchRect = newDim->getRect().intersection(patchRect);
+
+  // The buffer is reallocated only if the size of the patch changes, so
+  // a patch of a moving cursor reuses the memory.
+  Dimension patchDim(&m_patchRect);
+  if (!patchDim.isEqualTo(&m_patch.getDimension()) ||
+      !pixelFormat->isEqualTo(&m_patch.getPixelFormat())) {
+    m_patch.setProperties(&patchDim, pixelFormat);
+  }
+}
+
+Rect PatchFrameBuffer::getPatchRect() const
+{
+  return m_patchRect;
+}
+
+void PatchFrameBuffer::fillRect(const Rect *dstRect, UINT32 color)
+{
+  Rect rect(dstRect);
+  rect.move(-m_patchRect.left, -m_patchRect.top);
+  m_patch.fillRect(&rect, color);
+}
+
+bool PatchFrameBuffer::copyFrom(const Rect *dstRect,
+                                const FrameBuffer *srcFrameBuffer,
+                                int srcX, int srcY)
+{
+  Rect rect(dstRect);
+  rect.move(-m_patchRect.left, -m_patchRect.top);
+  return m_patch.copyFrom(&rect, srcFrameBuffer, srcX, srcY);
+}
+
+bool PatchFrameBuffer::overlay(const Rect *dstRect,
+                               const FrameBuffer *srcFrameBuffer,
+                               int srcX, int srcY, const char *andMask)
+{
+  Rect rect(dstRect);
+  rect.move(-m_patchRect.left, -m_patchRect.top);
+  return m_patch.overlay(&rect, srcFrameBuffer, srcX, srcY, andMask);
+}
+
+Dimension PatchFrameBuffer::getDimension() const
+{
+  return m_dim;
+}
+
+PixelFormat PatchFrameBuffer::getPixelFormat() const
+{
+  return m_patch.getPixelFormat();
+}
+
+UINT8 PatchFrameBuffer::getBitsPerPixel() const
+{
+  return m_patch.getBitsPerPixel();
+}
+
+UINT8 PatchFrameBuffer::getBytesPerPixel() const
+{
+  return m_patch.getBytesPerPixel();
+}
+
+void *PatchFrameBuffer::getBufferPtr(int x, int y) const
+{
+  return m_patch.getBufferPtr(x - m_patchRect.left, y - m_patchRect.top);
+}
+
+int PatchFrameBuffer::getBytesPerRow() const
+{
+  return m_patch.getBytesPerRow();
+}
+
+bool PatchFrameBuffer::assignProperties(const FrameBuffer *srcFrameBuffer)
+{
+  throw Exception(_T("Wrong: You shouldn't use the PatchFrameBuffer::assignProperties() function."));
+}
+
+bool PatchFrameBuffer::clone(const FrameBuffer *srcFrameBuffer)
+{
+  throw Exception(_T("Wrong: You shouldn't use the PatchFrameBuffer::clone() function."));
+}
+
+void PatchFrameBuffer::setColor(UINT8 red, UINT8 green, UINT8 blue)
+{
+  throw Exception(_T("Wrong: You shouldn't use the PatchFrameBuffer::setColor() function."));
+}
+
+bool PatchFrameBuffer::isEqualTo(const FrameBuffer *frameBuffer)
+{
+  throw Exception(_T("Wrong: You shouldn't use the PatchFrameBuffer::isEqualTo() function."));
+}
+
+bool PatchFrameBuffer::copyFrom(const FrameBuffer *srcFrameBuffer,
+                                int srcX, int srcY)
+{
+  throw Exception(_T("Wrong: You shouldn't use this variant of the PatchFrameBuffer::copyFrom() function."));
+}
+
+bool PatchFrameBuffer::copyFromRotated90(const Rect *dstRect,
+                                         const FrameBuffer *srcFrameBuffer,
+                                         int srcX, int srcY)
+{
+  throw Exception(_T("Wrong: You shouldn't use the PatchFrameBuffer::copyFromRotated90() function."));
+}
+
+bool PatchFrameBuffer::copyFromRotated180(const Rect *dstRect,
+                                          const FrameBuffer *srcFrameBuffer,
+                                          int srcX, int srcY)
+{
+  throw Exception(_T("Wrong: You shouldn't use the PatchFrameBuffer::copyFromRotated180() function."));
+}
+
+bool PatchFrameBuffer::copyFromRotated270(const Rect *dstRect,
+                                          const FrameBuffer *srcFrameBuffer,
+                                          int srcX, int srcY)
+{
+  throw Exception(_T("Wrong: You shouldn't use the PatchFrameBuffer::copyFromRotated270() function."));
+}
+
+void PatchFrameBuffer::move(const Rect *dstRect, const int srcX, const int srcY)
+{
+  throw Exception(_T("Wrong: You shouldn't use the PatchFrameBuffer::move() function."));
+}
+
+bool PatchFrameBuffer::cmpFrom(const Rect *dstRect,
+                               const FrameBuffer *srcFrameBuffer,
+                               const int srcX, const int srcY)
+{
+  throw Exception(_T("Wrong: You shouldn't use the PatchFrameBuffer::cmpFrom() function."));
+}
+
+bool PatchFrameBuffer::setDimension(const Dimension *newDim)
+{
+  throw Exception(_T("Wrong: You shouldn't use the PatchFrameBuffer::setDimension() function."));
+}
+
+bool PatchFrameBuffer::setDimension(const Rect *rect)
+{
+  throw Exception(_T("Wrong: You shouldn't use the PatchFrameBuffer::setDimension() function."));
+}
+
+void PatchFrameBuffer::setEmptyDimension(const Rect *dimByRect)
+{
+  throw Exception(_T("This function is deprecated"));
+}
+
+void PatchFrameBuffer::setEmptyPixelFmt(const PixelFormat *pf)
+{
+  throw Exception(_T("This function is deprecated"));
+}
+
+void PatchFrameBuffer::setPropertiesWithoutResize(const Dimension *newDim,
+                                                  const PixelFormat *pf)
+{
+  throw Exception(_T("Wrong: You shouldn't use the PatchFrameBuffer::setPropertiesWithoutResize() function."));
+}
+
+bool PatchFrameBuffer::setPixelFormat(const PixelFormat *pixelFormat)
+{
+  throw Exception(_T("Wrong: You shouldn't use the PatchFrameBuffer::setPixelFormat() function."));
+}
+
+bool PatchFrameBuffer::setProperties(const Dimension *newDim,
+                                     const PixelFormat *pixelFormat)
+{
+  throw Exception(_T("Wrong: You shouldn't use this variant of the PatchFrameBuffer::setProperties() function."));
+}
+
+bool PatchFrameBuffer::setProperties(const Rect *dimByRect,
+                                     const PixelFormat *pixelFormat)
+{
+  throw Exception(_T("Wrong: You shouldn't use this variant of the PatchFrameBuffer::setProperties() function."));
+}
+
+void PatchFrameBuffer::setBuffer(void *newBuffer)
+{
+  throw Exception(_T("Wrong: You shouldn't use the PatchFrameBuffer::setBuffer() function."));
+}
+
+void *PatchFrameBuffer::getBuffer() const
+{
+  throw Exception(_T("Wrong: You shouldn't use the PatchFrameBuffer::getBuffer() function."));
+}
+
+int PatchFrameBuffer::getBufferSize() const
+{
+  throw Exception(_T("Wrong: You shouldn't use the PatchFrameBuffer::getBufferSize() function."));
+}
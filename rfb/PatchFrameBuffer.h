@@ -0,0 +1,122 @@
+// Copyright (C) 2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#ifndef __RFB_PATCH_FRAME_BUFFER_H_INCLUDED__
+#define __RFB_PATCH_FRAME_BUFFER_H_INCLUDED__
+
+#include "FrameBuffer.h"
+
+// PatchFrameBuffer keeps the pixels of a rectangular part (a patch) of a
+// bigger frame buffer. The pixels are addressed by the coordinates of the
+// bigger frame buffer and getDimension() returns its dimension, so the
+// object may be given to encoders instead of the bigger frame buffer for
+// the rectangles lying within the patch. That way a client may put its own
+// pixels (e.g. a cursor image) over a frame buffer shared with other
+// clients, copying only the pixels under the patch.
+//
+// Only the pixels within the patch rectangle exist. getBytesPerRow() gives
+// the distance between the rows of the patch, and getBuffer() is not
+// available, so pixels should be accessed via getBufferPtr(). The functions
+// of FrameBuffer which are not overridden here throw an Exception.
+class PatchFrameBuffer : public FrameBuffer
+{
+public:
+  PatchFrameBuffer();
+  virtual ~PatchFrameBuffer();
+
+  // Sets the dimension and the pixel format of the bigger frame buffer and
+  // the patch rectangle, which is cropped by the frame buffer bounds. The
+  // pixels of the patch are undefined after the call.
+  void setProperties(const Rect *patchRect, const Dimension *newDim,
+                     const PixelFormat *pixelFormat);
+
+  // Returns the patch rectangle in the frame buffer coordinates.
+  Rect getPatchRect() const;
+
+  // These functions change the pixels of the patch only, rectangles are
+  // given in the coordinates of the bigger frame buffer.
+  virtual void fillRect(const Rect *dstRect, UINT32 color);
+  virtual bool copyFrom(const Rect *dstRect, const FrameBuffer *srcFrameBuffer,
+                        int srcX, int srcY);
+  virtual bool overlay(const Rect *dstRect, const FrameBuffer *srcFrameBuffer,
+                       int srcX, int srcY, const char *andMask);
+
+  virtual Dimension getDimension() const;
+  virtual PixelFormat getPixelFormat() const;
+
+  virtual UINT8 getBitsPerPixel() const;
+  virtual UINT8 getBytesPerPixel() const;
+
+  // The pixel must be within the patch rectangle, this is not checked.
+  virtual void *getBufferPtr(int x, int y) const;
+  virtual int getBytesPerRow() const;
+
+private:
+  // The FrameBuffer functions which cannot be used with a patch.
+  virtual bool assignProperties(const FrameBuffer *srcFrameBuffer);
+  virtual bool clone(const FrameBuffer *srcFrameBuffer);
+  virtual void setColor(UINT8 red, UINT8 green, UINT8 blue);
+  virtual bool isEqualTo(const FrameBuffer *frameBuffer);
+  virtual bool copyFrom(const FrameBuffer *srcFrameBuffer,
+                        int srcX, int srcY);
+  virtual bool copyFromRotated90(const Rect *dstRect,
+                                 const FrameBuffer *srcFrameBuffer,
+                                 int srcX, int srcY);
+  virtual bool copyFromRotated180(const Rect *dstRect,
+                                  const FrameBuffer *srcFrameBuffer,
+                                  int srcX, int srcY);
+  virtual bool copyFromRotated270(const Rect *dstRect,
+                                  const FrameBuffer *srcFrameBuffer,
+                                  int srcX, int srcY);
+  virtual void move(const Rect *dstRect, const int srcX, const int srcY);
+  virtual bool cmpFrom(const Rect *dstRect, const FrameBuffer *srcFrameBuffer,
+                       const int srcX, const int srcY);
+  virtual bool setDimension(const Dimension *newDim);
+  virtual bool setDimension(const Rect *rect);
+  virtual void setEmptyDimension(const Rect *dimByRect);
+  virtual void setEmptyPixelFmt(const PixelFormat *pf);
+  virtual void setPropertiesWithoutResize(const Dimension *newDim,
+                                          const PixelFormat *pf);
+  virtual bool setPixelFormat(const PixelFormat *pixelFormat);
+  virtual bool setProperties(const Dimension *newDim,
+                             const PixelFormat *pixelFormat);
+  virtual bool setProperties(const Rect *dimByRect,
+                             const PixelFormat *pixelFormat);
+  virtual void setBuffer(void *newBuffer);
+  virtual void *getBuffer() const;
+  virtual int getBufferSize() const;
+
+  // Pixels of the patch, with the upper left corner of the patch at (0, 0).
+  FrameBuffer m_patch;
+  Rect m_patchRect;
+  // Dimension of the bigger frame buffer.
+  Dimension m_dim;
+
+  // Do not allow copying objects.
+  PatchFrameBuffer(const PatchFrameBuffer &other);
+  PatchFrameBuffer &operator=(const PatchFrameBuffer &other);
+};
+
+#endif // __RFB_PATCH_FRAME_BUFFER_H_INCLUDED__
@@ -25,10 +25,11 @@
 #include "PixelConverter.h"
 #include "util/inttypes.h"
 #include <crtdbg.h>
+#include <string.h>
 
 PixelConverter::PixelConverter(void)
 : m_convertMode(NO_CONVERT),
-  m_dstFrameBuffer(0)
+  m_useSse2(false)
 {
 }
 
@@ -43,24 +44,38 @@ void PixelConverter::convert(const Rect *rect, FrameBuffer *dstFb,
   if (m_convertMode == NO_CONVERT) {
     dstFb->copyFrom(rect, srcFb, rect->left, rect->top);
   } else {
-    int rectHeight = rect->getHeight();
-    int rectWidth = rect->getWidth();
-    int fbWidth = dstFb->getDimension().width;
-    PixelFormat dstPf = dstFb->getPixelFormat();
-    PixelFormat srcPf = srcFb->getPixelFormat();
-
-    UINT32 dstPixelSize = dstPf.bitsPerPixel / 8;
-    UINT32 srcPixelSize = srcPf.bitsPerPixel / 8;
-
-    // FIXME: Make FrameBuffer do the math.
-    UINT8 *dstPixP = (UINT8 *)dstFb->getBuffer() +
-                     (fbWidth * rect->top + rect->left) * dstPixelSize;
-    UINT8 *srcPixP = (UINT8 *)srcFb->getBuffer() +
-                     (fbWidth * rect->top + rect->left) * srcPixelSize;
+    convert(rect, dstFb->getBufferPtr(rect->left, rect->top),
+            dstFb->getDimension().width, srcFb);
+  }
+}
+
+void PixelConverter::convert(const Rect *rect, void *dstBuffer, int dstStride,
+                             const FrameBuffer *srcFb) const
+{
+  int rectHeight = rect->getHeight();
+  int rectWidth = rect->getWidth();
+  int srcStride = srcFb->getBytesPerRow() / srcFb->getBytesPerPixel();
+
+  UINT32 dstPixelSize = m_dstFormat.bitsPerPixel / 8;
+  UINT32 srcPixelSize = m_srcFormat.bitsPerPixel / 8;
+
+  UINT8 *dstPixP = (UINT8 *)dstBuffer;
+  UINT8 *srcPixP = (UINT8 *)srcFb->getBufferPtr(rect->left, rect->top);
+
+  if (m_convertMode == NO_CONVERT) {
+    for (int i = 0; i < rectHeight; i++,
+         dstPixP += dstStride * dstPixelSize,
+         srcPixP += srcStride * srcPixelSize) {
+      memcpy(dstPixP, srcPixP, rectWidth * dstPixelSize);
+    }
+  } else {
+    PixelFormat dstPf = m_dstFormat;
+    PixelFormat srcPf = m_srcFormat;
+
     if (m_convertMode == CONVERT_FROM_16) {
       for (int i = 0; i < rectHeight; i++,
-           dstPixP += (fbWidth - rectWidth) * dstPixelSize,
-           srcPixP += (fbWidth - rectWidth) * srcPixelSize) {
+           dstPixP += (dstStride - rectWidth) * dstPixelSize,
+           srcPixP += (srcStride - rectWidth) * srcPixelSize) {
         for (int j = 0; j < rectWidth; j++,
                                        dstPixP += dstPixelSize,
                                        srcPixP += srcPixelSize) {
@@ -81,11 +96,19 @@ void PixelConverter::convert(const Rect *rect, FrameBuffer *dstFb,
       UINT32 srcBluMax = srcPf.blueMax;
 
       for (int i = 0; i < rectHeight; i++,
-           dstPixP += (fbWidth - rectWidth) * dstPixelSize,
-           srcPixP += (fbWidth - rectWidth) * srcPixelSize) {
-        for (int j = 0; j < rectWidth; j++,
-                                       dstPixP += dstPixelSize,
-                                       srcPixP += srcPixelSize) {
+           dstPixP += (dstStride - rectWidth) * dstPixelSize,
+           srcPixP += (srcStride - rectWidth) * srcPixelSize) {
+        // Convert the most part of the row with SSE2 instructions if
+        // possible, the rest is converted via the tables.
+        int j = 0;
+        if (m_useSse2) {
+          j = m_sse2.convertRow(srcPixP, dstPixP, rectWidth);
+          dstPixP += j * dstPixelSize;
+          srcPixP += j * srcPixelSize;
+        }
+        for (; j < rectWidth; j++,
+                              dstPixP += dstPixelSize,
+                              srcPixP += srcPixelSize) {
           UINT32 dstPixel = m_redTable[*(UINT32 *)srcPixP >>
                                        srcPf.redShift & srcRedMax] |
                             m_grnTable[*(UINT32 *)srcPixP >>
@@ -114,46 +137,44 @@ void PixelConverter::convert(const Rect *rect, FrameBuffer *dstFb,
   }
 }
 
-const FrameBuffer *
+FrameBufferView
 PixelConverter::convert(const Rect *rect, const FrameBuffer *srcFb)
 {
   if (m_convertMode == NO_CONVERT) {
-    return srcFb;
+    return FrameBufferView(srcFb, rect);
   }
 
-  const Dimension fbSize = srcFb->getDimension();
-  if (m_dstFrameBuffer == 0) {
-    // No frame buffer allocated - construct new one from the scratch.
-    m_dstFrameBuffer = new FrameBuffer;
-    m_dstFrameBuffer->setProperties(&fbSize, &m_dstFormat);
-  } else if (!m_dstFrameBuffer->getDimension().isEqualTo(&fbSize)) {
-    // Frame buffer is allocated but its size it wrong - just resize it.
-    // Note that if the frame buffer is allocated, its pixel format is
-    // guaranteed to be relevant, because setPixelFormats() always calls
-    // reset() if at least one pixel format has been changed.
-    m_dstFrameBuffer->setDimension(&fbSize);
+  int width = rect->getWidth();
+  size_t size = (size_t)rect->area() * (m_dstFormat.bitsPerPixel / 8);
+  if (m_scratchBuffer.size() > SCRATCH_MIN_SHRINK_SIZE &&
+      m_scratchBuffer.size() > size * SCRATCH_SHRINK_RATIO) {
+    std::vector<UINT8>().swap(m_scratchBuffer);
+  }
+  if (m_scratchBuffer.size() < size) {
+    m_scratchBuffer.resize(size);
   }
 
   // Finally, convert pixels.
-  convert(rect, m_dstFrameBuffer, srcFb);
-  return m_dstFrameBuffer;
+  UINT8 *buffer = m_scratchBuffer.empty() ? 0 : &m_scratchBuffer.front();
+  if (size != 0) {
+    convert(rect, buffer, width, srcFb);
+  }
+  return FrameBufferView(buffer, rect, width, &m_dstFormat);
 }
 
 void PixelConverter::reset()
 {
-  // Deallocate the framebuffer.
-  if (m_dstFrameBuffer != 0) {
-    delete m_dstFrameBuffer;
-    m_dstFrameBuffer = 0;
-  }
+  // Deallocate the scratch buffer.
+  std::vector<UINT8>().swap(m_scratchBuffer);
 }
 
 void PixelConverter::setPixelFormats(const PixelFormat *dstPf,
                                      const PixelFormat *srcPf)
 {
   if (!srcPf->isEqualTo(&m_srcFormat) || !dstPf->isEqualTo(&m_dstFormat)) {
-    // Reset both translation tables and the internal frame buffer.
+    // Reset both translation tables and the scratch buffer.
     reset();
+    m_useSse2 = false;
 
     if (srcPf->isEqualTo(dstPf)) {
       m_convertMode = NO_CONVERT;
@@ -163,6 +184,11 @@ void PixelConverter::setPixelFormats(const PixelFormat *dstPf,
     } else if (srcPf->bitsPerPixel == 32) { // 32 bit -> N
       m_convertMode = CONVERT_FROM_32;
       fill32BitsTable(dstPf, srcPf);
+      // Use the SSE2 code for common formats if the processor supports it.
+      m_useSse2 = PixelConverterSse2::isApplicable(dstPf, srcPf);
+      if (m_useSse2) {
+        m_sse2.setPixelFormats(dstPf, srcPf);
+      }
     }
 
     m_srcFormat = *srcPf;
@@ -180,6 +206,30 @@ size_t PixelConverter::getDstBitsPerPixel() const
   return m_dstFormat.bitsPerPixel;
 }
 
+PixelFormat PixelConverter::getSrcFormat() const
+{
+  return m_srcFormat;
+}
+
+PixelFormat PixelConverter::getDstFormat() const
+{
+  return m_dstFormat;
+}
+
+bool PixelConverter::getContentStamp(const Rect *rect,
+                                     const FrameBuffer *srcFb,
+                                     UINT64 *stamp) const
+{
+  return false;
+}
+
+bool PixelConverter::getConvertedView(const Rect *rect,
+                                      const FrameBuffer *srcFb,
+                                      FrameBufferView *view)
+{
+  return false;
+}
+
 void PixelConverter::fillHexBitsTable(const PixelFormat *dstPf,
                                       const PixelFormat *srcPf)
 {
@@ -26,6 +26,8 @@
 #define __RFB_PIXEL_CONVERTER_H_INCLUDED__
 
 #include "FrameBuffer.h"
+#include "FrameBufferView.h"
+#include "PixelConverterSse2.h"
 #include "region/Point.h"
 
 class PixelConverter
@@ -42,19 +44,24 @@ public:
   virtual void convert(const Rect *rect, FrameBuffer *dstFb,
                        const FrameBuffer *srcFb) const;
 
-  // Convert pixels for the specified `rect' from `srcFb' to the internal
-  // PixelConverter's frame buffer and return a pointer to that frame buffer.
-  // If the source and destination formats are the same, then no translation
-  // will happen and srcFb will be returned.
+  // Convert pixels for the specified `rect' from `srcFb' to an arbitrary
+  // buffer. The upper left pixel of the rectangle is written at `dstBuffer',
+  // and rows are `dstStride' pixels apart. The buffer must be large enough
+  // to hold the rectangle in the destination pixel format. Other
+  // requirements are the same as in the function above.
+  virtual void convert(const Rect *rect, void *dstBuffer, int dstStride,
+                       const FrameBuffer *srcFb) const;
+
+  // Convert pixels for the specified `rect' from `srcFb' and return a view
+  // of the converted pixels. The pixels are stored in a buffer of the
+  // rectangle size maintained by the PixelConverter, the view remains valid
+  // until the next call of this function or setPixelFormats(). If the source
+  // and destination formats are the same, then no translation will happen
+  // and a view of the rectangle in srcFb will be returned.
   // The pixel format of `srcFb' must be identical to the source format set by
   // the most recent setPixelFormats() call. The entire rectangle referenced
   // by `rect' must be within the frame buffer boundaries.
-  // This function will work efficiently only if the frame buffer size does
-  // not vary from call to call. It checks if the frame buffer size has
-  // changed since the previous call and reallocates the frame buffer if
-  // necessary.
-  virtual const FrameBuffer *convert(const Rect *rect,
-                                     const FrameBuffer *srcFb);
+  virtual FrameBufferView convert(const Rect *rect, const FrameBuffer *srcFb);
 
   // FIXME: Review the argument order for each function of PixelConverter.
   // FIXME: Review the argument names for each function of PixelConverter.
@@ -67,6 +74,26 @@ public:
   // Return the number of bits per pixel from the destination pixel format.
   virtual size_t getDstBitsPerPixel() const;
 
+  // Return the source and the destination pixel formats.
+  virtual PixelFormat getSrcFormat() const;
+  virtual PixelFormat getDstFormat() const;
+
+  // Store a stamp of the pixels of `rect' in `srcFb' to *stamp and return
+  // true, if the converter knows where the pixels come from. Rectangles with
+  // equal stamps have equal pixels, so the stamp may be used to identify the
+  // pixels instead of comparing them. The implementation of this class
+  // always returns false. May be called by several threads at once.
+  virtual bool getContentStamp(const Rect *rect, const FrameBuffer *srcFb,
+                               UINT64 *stamp) const;
+
+  // Store a view of the pixels of `rect' in `srcFb' converted beforehand to
+  // *view and return true, if the converter keeps such pixels. Unlike the
+  // views returned by convert(), the view stays valid after further
+  // conversions, for as long as the converter defines. The implementation
+  // of this class always returns false.
+  virtual bool getConvertedView(const Rect *rect, const FrameBuffer *srcFb,
+                                FrameBufferView *view);
+
 protected:
   void reset();
 
@@ -87,12 +114,24 @@ protected:
   std::vector<UINT32> m_grnTable;
   std::vector<UINT32> m_bluTable;
 
+  // SSE2 implementation of CONVERT_FROM_32 for the most common pixel
+  // formats, used if m_useSse2 is true.
+  PixelConverterSse2 m_sse2;
+  bool m_useSse2;
+
   PixelFormat m_srcFormat;
   PixelFormat m_dstFormat;
 
-  // An internally maintained frame buffer used by the two-argument version of
-  // the convert() function.
-  FrameBuffer *m_dstFrameBuffer;
+  // An internally maintained buffer used by the two-argument version of the
+  // convert() function. It is as big as the biggest rectangle converted
+  // recently, not as the whole frame buffer.
+  std::vector<UINT8> m_scratchBuffer;
+
+  // The scratch buffer is freed if it is larger than this size and more
+  // than SCRATCH_SHRINK_RATIO times larger than necessary, so that a single
+  // big rectangle would not keep the memory forever.
+  static const size_t SCRATCH_MIN_SHRINK_SIZE = 1024 * 1024;
+  static const size_t SCRATCH_SHRINK_RATIO = 4;
 };
 
 #endif // __RFB_PIXEL_CONVERTER_H_INCLUDED__
@@ -0,0 +1,209 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+#include "PixelConverterSse2.h"
+#include "util/CpuFeatures.h"
+
+#include <crtdbg.h>
+
+#if defined(_M_IX86) || defined(_M_X64)
+#define PIXEL_CONVERTER_SSE2
+#include <emmintrin.h>
+#endif
+
+PixelConverterSse2::PixelConverterSse2()
+: m_dstPixelSize(0),
+  m_swapBytes(false),
+  m_srcRedShift(0), m_srcGrnShift(0), m_srcBluShift(0),
+  m_dstRedMax(0), m_dstGrnMax(0), m_dstBluMax(0),
+  m_dstRedShift(0), m_dstGrnShift(0), m_dstBluShift(0)
+{
+}
+
+bool PixelConverterSse2::isApplicable(const PixelFormat *dstPf,
+                                      const PixelFormat *srcPf)
+{
+  // The source pixels should consist of three 8-bit color components.
+  if (srcPf->bitsPerPixel != 32 ||
+      srcPf->redMax != 255 || srcPf->greenMax != 255 ||
+      srcPf->blueMax != 255 ||
+      srcPf->redShift > 24 || srcPf->greenShift > 24 ||
+      srcPf->blueShift > 24) {
+    return false;
+  }
+  // Destination color components should not be wider than 8 bits and
+  // should fit in the destination pixel.
+  if (dstPf->bitsPerPixel != 8 && dstPf->bitsPerPixel != 16 &&
+      dstPf->bitsPerPixel != 32) {
+    return false;
+  }
+  if (dstPf->redMax == 0 || dstPf->redMax > 255 ||
+      dstPf->greenMax == 0 || dstPf->greenMax > 255 ||
+      dstPf->blueMax == 0 || dstPf->blueMax > 255) {
+    return false;
+  }
+  UINT32 dstMask = (UINT32)dstPf->redMax << dstPf->redShift |
+                   (UINT32)dstPf->greenMax << dstPf->greenShift |
+                   (UINT32)dstPf->blueMax << dstPf->blueShift;
+  if (dstPf->bitsPerPixel < 32 && dstMask >> dstPf->bitsPerPixel != 0) {
+    return false;
+  }
+  return CpuFeatures::hasSse2();
+}
+
+void PixelConverterSse2::setPixelFormats(const PixelFormat *dstPf,
+                                         const PixelFormat *srcPf)
+{
+  _ASSERT(isApplicable(dstPf, srcPf));
+
+  m_dstPixelSize = dstPf->bitsPerPixel / 8;
+  m_swapBytes = dstPf->bigEndian != srcPf->bigEndian;
+
+  m_srcRedShift = srcPf->redShift;
+  m_srcGrnShift = srcPf->greenShift;
+  m_srcBluShift = srcPf->blueShift;
+
+  m_dstRedMax = dstPf->redMax;
+  m_dstGrnMax = dstPf->greenMax;
+  m_dstBluMax = dstPf->blueMax;
+
+  m_dstRedShift = dstPf->redShift;
+  m_dstGrnShift = dstPf->greenShift;
+  m_dstBluShift = dstPf->blueShift;
+}
+
+#ifdef PIXEL_CONVERTER_SSE2
+
+// Scale 8-bit color components (stored in 32-bit lanes) to the range
+// 0..max with rounding, like (c * max + 127) / 255 does. The division by
+// 255 is exact for all possible arguments: x / 255 == (x + 1 + (x >> 8)) >> 8
+// while x < 65535.
+static inline __m128i scaleComponent(__m128i c, __m128i max)
+{
+  __m128i x = _mm_add_epi16(_mm_mullo_epi16(c, max), _mm_set1_epi16(127));
+  x = _mm_add_epi16(x, _mm_add_epi16(_mm_set1_epi16(1), _mm_srli_epi16(x, 8)));
+  return _mm_srli_epi16(x, 8);
+}
+
+// Parameters of the conversion in the form suitable for SSE2 instructions.
+struct Sse2Params
+{
+  __m128i srcRedShift, srcGrnShift, srcBluShift;
+  __m128i dstRedMax, dstGrnMax, dstBluMax;
+  __m128i dstRedShift, dstGrnShift, dstBluShift;
+};
+
+// Convert four pixels, return them as 32-bit values.
+static inline __m128i convert4(__m128i src, const Sse2Params *p)
+{
+  const __m128i mask = _mm_set1_epi32(0xFF);
+
+  __m128i r = _mm_and_si128(_mm_srl_epi32(src, p->srcRedShift), mask);
+  __m128i g = _mm_and_si128(_mm_srl_epi32(src, p->srcGrnShift), mask);
+  __m128i b = _mm_and_si128(_mm_srl_epi32(src, p->srcBluShift), mask);
+
+  r = _mm_sll_epi32(scaleComponent(r, p->dstRedMax), p->dstRedShift);
+  g = _mm_sll_epi32(scaleComponent(g, p->dstGrnMax), p->dstGrnShift);
+  b = _mm_sll_epi32(scaleComponent(b, p->dstBluMax), p->dstBluShift);
+
+  return _mm_or_si128(r, _mm_or_si128(g, b));
+}
+
+// Pack 32-bit values which fit in 16 bits into 16-bit values. The sign
+// extension makes signed saturation in _mm_packs_epi32() harmless.
+static inline __m128i pack32To16(__m128i lo, __m128i hi)
+{
+  lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+  hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+  return _mm_packs_epi32(lo, hi);
+}
+
+static inline __m128i swapBytes16(__m128i x)
+{
+  return _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+}
+
+static inline __m128i swapBytes32(__m128i x)
+{
+  x = swapBytes16(x);
+  x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+  return _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+}
+
+int PixelConverterSse2::convertRow(const UINT8 *src, UINT8 *dst,
+                                   int width) const
+{
+  Sse2Params p;
+  p.srcRedShift = _mm_cvtsi32_si128(m_srcRedShift);
+  p.srcGrnShift = _mm_cvtsi32_si128(m_srcGrnShift);
+  p.srcBluShift = _mm_cvtsi32_si128(m_srcBluShift);
+  p.dstRedMax = _mm_set1_epi32(m_dstRedMax);
+  p.dstGrnMax = _mm_set1_epi32(m_dstGrnMax);
+  p.dstBluMax = _mm_set1_epi32(m_dstBluMax);
+  p.dstRedShift = _mm_cvtsi32_si128(m_dstRedShift);
+  p.dstGrnShift = _mm_cvtsi32_si128(m_dstGrnShift);
+  p.dstBluShift = _mm_cvtsi32_si128(m_dstBluShift);
+
+  int x = 0;
+  if (m_dstPixelSize == 4) {
+    for (; x + 4 <= width; x += 4, src += 16, dst += 16) {
+      __m128i pixels = convert4(_mm_loadu_si128((const __m128i *)src), &p);
+      if (m_swapBytes) {
+        pixels = swapBytes32(pixels);
+      }
+      _mm_storeu_si128((__m128i *)dst, pixels);
+    }
+  } else if (m_dstPixelSize == 2) {
+    for (; x + 8 <= width; x += 8, src += 32, dst += 16) {
+      __m128i lo = convert4(_mm_loadu_si128((const __m128i *)src), &p);
+      __m128i hi = convert4(_mm_loadu_si128((const __m128i *)(src + 16)), &p);
+      __m128i pixels = pack32To16(lo, hi);
+      if (m_swapBytes) {
+        pixels = swapBytes16(pixels);
+      }
+      _mm_storeu_si128((__m128i *)dst, pixels);
+    }
+  } else if (m_dstPixelSize == 1) {
+    for (; x + 16 <= width; x += 16, src += 64, dst += 16) {
+      __m128i p0 = convert4(_mm_loadu_si128((const __m128i *)src), &p);
+      __m128i p1 = convert4(_mm_loadu_si128((const __m128i *)(src + 16)), &p);
+      __m128i p2 = convert4(_mm_loadu_si128((const __m128i *)(src + 32)), &p);
+      __m128i p3 = convert4(_mm_loadu_si128((const __m128i *)(src + 48)), &p);
+      __m128i pixels = _mm_packus_epi16(pack32To16(p0, p1),
+                                        pack32To16(p2, p3));
+      _mm_storeu_si128((__m128i *)dst, pixels);
+    }
+  }
+  return x;
+}
+
+#else // PIXEL_CONVERTER_SSE2
+
+int PixelConverterSse2::convertRow(const UINT8 *src, UINT8 *dst,
+                                   int width) const
+{
+  return 0;
+}
+
+#endif // PIXEL_CONVERTER_SSE2
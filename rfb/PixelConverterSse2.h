@@ -0,0 +1,78 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+#ifndef __RFB_PIXEL_CONVERTER_SSE2_H_INCLUDED__
+#define __RFB_PIXEL_CONVERTER_SSE2_H_INCLUDED__
+
+#include "util/inttypes.h"
+#include "PixelFormat.h"
+
+// SSE2 version of the conversion of 32-bit pixels with 8-bit color
+// components (the usual server pixel format) to 8, 16 or 32-bit pixels. It
+// covers the formats used by most clients with non-native pixel formats,
+// like RGB565, RGB555, BGR233 or 32-bit pixels with a different byte order.
+// The results are exactly the same as produced by the table-driven
+// conversion in PixelConverter, pixel-converter-bench checks that and
+// compares the speed of the two.
+//
+// This class is used by PixelConverter only. On processors without SSE2
+// and on platforms other than x86 and x64, isApplicable() always returns
+// false.
+class PixelConverterSse2
+{
+public:
+  PixelConverterSse2();
+
+  // Return true if the conversion between the specified pixel formats can
+  // be performed by this class on this computer.
+  static bool isApplicable(const PixelFormat *dstPf, const PixelFormat *srcPf);
+
+  // Prepare the conversion parameters. Should be called only if
+  // isApplicable() returned true for the same pixel formats.
+  void setPixelFormats(const PixelFormat *dstPf, const PixelFormat *srcPf);
+
+  // Convert the pixels of one row, processing them in blocks of 4, 8 or 16
+  // pixels depending on the destination pixel size. Return the number of
+  // pixels converted, the remaining pixels should be converted by the
+  // caller.
+  int convertRow(const UINT8 *src, UINT8 *dst, int width) const;
+
+protected:
+  int m_dstPixelSize;
+  bool m_swapBytes;
+
+  int m_srcRedShift;
+  int m_srcGrnShift;
+  int m_srcBluShift;
+
+  int m_dstRedMax;
+  int m_dstGrnMax;
+  int m_dstBluMax;
+
+  int m_dstRedShift;
+  int m_dstGrnShift;
+  int m_dstBluShift;
+};
+
+#endif // __RFB_PIXEL_CONVERTER_SSE2_H_INCLUDED__
@@ -0,0 +1,224 @@
+// Copyright (C) 2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#include "ScrollDetectorTest.h"
+#include "util/Exception.h"
+#include <stdio.h>
+
+ScrollDetectorTest::ScrollDetectorTest(int width, int height)
+: m_randomState(1)
+{
+  // The window cases need room for ten windows side by side.
+  if (width < 1000 || height < ScrollDetector::MAX_LINES_PER_CALL / 8 + 100) {
+    throw Exception(_T("The frame is too small for the test cases"));
+  }
+  PixelFormat pf;
+  pf.bitsPerPixel = 32;
+  pf.colorDepth = 24;
+  pf.redMax = pf.greenMax = pf.blueMax = 255;
+  pf.redShift = 16;
+  pf.greenShift = 8;
+  pf.blueShift = 0;
+  pf.bigEndian = false;
+
+  Dimension dim(width, height);
+  if (!m_oldFb.setProperties(&dim, &pf) ||
+      !m_newFb.setProperties(&dim, &pf)) {
+    throw Exception(_T("Cannot allocate the frame buffers"));
+  }
+}
+
+ScrollDetectorTest::~ScrollDetectorTest()
+{
+}
+
+int ScrollDetectorTest::run()
+{
+  Dimension dim = m_oldFb.getDimension();
+  _tprintf(_T("Frame %dx%d\n"), dim.width, dim.height);
+
+  Rect window(100, 80, 900, 680);
+  int failures = 0;
+  failures += testScroll(_T("Scroll down"), &window, 0, 37) ? 0 : 1;
+  failures += testScroll(_T("Scroll up"), &window, 0, -120) ? 0 : 1;
+  failures += testScroll(_T("Scroll right"), &window, 50, 0) ? 0 : 1;
+  failures += testScroll(_T("Scroll left"), &window, -3, 0) ? 0 : 1;
+  failures += testNoScroll(_T("New content"), &window, 0) ? 0 : 1;
+  // Too big to be taken for scrolling.
+  Rect frameRect = dim.getRect();
+  failures += testNoScroll(_T("Full screen shift"), &frameRect, 10) ? 0 : 1;
+  failures += testLineBudget() ? 0 : 1;
+  return failures;
+}
+
+bool ScrollDetectorTest::testScroll(const TCHAR *name, const Rect *window,
+                                    int dx, int dy)
+{
+  resetFrames();
+  scrollWindow(window, dx, dy);
+
+  Region changed(window);
+  std::vector<CopyMove> moves;
+  m_detector.detect(&changed, &m_newFb, &m_oldFb, &moves);
+
+  // The window without the exposed strip.
+  Rect expectedRect(window->left + max(0, -dx), window->top + max(0, -dy),
+                    window->right - max(0, dx), window->bottom - max(0, dy));
+  Region expected(&expectedRect);
+  if (moves.size() != 1) {
+    _tprintf(_T("%s: FAILED, %d moves found instead of one\n"), name,
+             (int)moves.size());
+    return false;
+  }
+  if (moves[0].srcOffset.x != dx || moves[0].srcOffset.y != dy) {
+    _tprintf(_T("%s: FAILED, offset (%d, %d) instead of (%d, %d)\n"), name,
+             moves[0].srcOffset.x, moves[0].srcOffset.y, dx, dy);
+    return false;
+  }
+  if (!moves[0].dstRegion.equals(&expected)) {
+    Rect bounds = moves[0].dstRegion.getBounds();
+    _tprintf(_T("%s: FAILED, moved %d rects bounded by (%d, %d, %d, %d)\n"),
+             name, (int)moves[0].dstRegion.getCount(), bounds.left,
+             bounds.top, bounds.right, bounds.bottom);
+    return false;
+  }
+  if (!checkMoves(&moves)) {
+    _tprintf(_T("%s: FAILED, the moved pixels differ\n"), name);
+    return false;
+  }
+  _tprintf(_T("%s: passed\n"), name);
+  return true;
+}
+
+bool ScrollDetectorTest::testNoScroll(const TCHAR *name,
+                                      const Rect *changedRect, int dy)
+{
+  resetFrames();
+  if (dy != 0) {
+    scrollWindow(changedRect, 0, dy);
+  } else {
+    fillRandom(&m_newFb, changedRect);
+  }
+
+  Region changed(changedRect);
+  std::vector<CopyMove> moves;
+  m_detector.detect(&changed, &m_newFb, &m_oldFb, &moves);
+  if (!moves.empty()) {
+    _tprintf(_T("%s: FAILED, %d moves found\n"), name, (int)moves.size());
+    return false;
+  }
+  _tprintf(_T("%s: passed\n"), name);
+  return true;
+}
+
+bool ScrollDetectorTest::testLineBudget()
+{
+  resetFrames();
+
+  // Ten windows, each with a quarter of the budget rows, so that the first
+  // two passes over each window take half of them. All windows are in the
+  // same band of the region, so they are processed left to right.
+  const int windowCount = 10;
+  const int windowHeight = ScrollDetector::MAX_LINES_PER_CALL / 8;
+  Region changed;
+  for (int i = 0; i < windowCount; i++) {
+    Rect window(i * 100, 50, i * 100 + 90, 50 + windowHeight);
+    scrollWindow(&window, 0, 20);
+    changed.addRect(&window);
+  }
+  std::vector<CopyMove> moves;
+  m_detector.detect(&changed, &m_newFb, &m_oldFb, &moves);
+
+  // A vertical shift is found by the row pass, so each window costs its
+  // height only.
+  size_t expectedCount = ScrollDetector::MAX_LINES_PER_CALL / windowHeight;
+  if (moves.size() != expectedCount) {
+    _tprintf(_T("Line budget: FAILED, %d moves found instead of %d\n"),
+             (int)moves.size(), (int)expectedCount);
+    return false;
+  }
+  if (!checkMoves(&moves)) {
+    _tprintf(_T("Line budget: FAILED, the moved pixels differ\n"));
+    return false;
+  }
+  _tprintf(_T("Line budget: passed\n"));
+  return true;
+}
+
+bool ScrollDetectorTest::checkMoves(const std::vector<CopyMove> *moves)
+{
+  std::vector<Rect> rects;
+  for (size_t i = 0; i < moves->size(); i++) {
+    const CopyMove *move = &(*moves)[i];
+    rects.clear();
+    move->getOrderedRects(&rects);
+    for (size_t j = 0; j < rects.size(); j++) {
+      Point src = move->getSource(&rects[j]);
+      m_oldFb.move(&rects[j], src.x, src.y);
+    }
+  }
+  for (size_t i = 0; i < moves->size(); i++) {
+    (*moves)[i].dstRegion.getRectVector(&rects);
+    for (size_t j = 0; j < rects.size(); j++) {
+      if (!m_oldFb.cmpFrom(&rects[j], &m_newFb, rects[j].left,
+                           rects[j].top)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void ScrollDetectorTest::resetFrames()
+{
+  Rect frameRect = m_oldFb.getDimension().getRect();
+  fillRandom(&m_oldFb, &frameRect);
+  m_newFb.copyFrom(&m_oldFb, 0, 0);
+}
+
+void ScrollDetectorTest::scrollWindow(const Rect *window, int dx, int dy)
+{
+  fillRandom(&m_newFb, window);
+  Rect dstRect(window->left + max(0, -dx), window->top + max(0, -dy),
+               window->right - max(0, dx), window->bottom - max(0, dy));
+  m_newFb.copyFrom(&dstRect, &m_oldFb, dstRect.left + dx, dstRect.top + dy);
+}
+
+void ScrollDetectorTest::fillRandom(FrameBuffer *fb, const Rect *rect)
+{
+  for (int y = rect->top; y < rect->bottom; y++) {
+    UINT32 *pixels = (UINT32 *)fb->getBufferPtr(rect->left, y);
+    for (int x = 0; x < rect->getWidth(); x++) {
+      pixels[x] = nextRandom();
+    }
+  }
+}
+
+UINT32 ScrollDetectorTest::nextRandom()
+{
+  // A fixed generator, so that a failure can be reproduced.
+  m_randomState = m_randomState * 1664525 + 1013904223;
+  return m_randomState ^ (m_randomState >> 16);
+}
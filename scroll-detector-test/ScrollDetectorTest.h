@@ -0,0 +1,74 @@
+// Copyright (C) 2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#pragma once
+
+#include "rfb/FrameBuffer.h"
+#include "desktop/ScrollDetector.h"
+
+// Runs ScrollDetector on synthetic frame buffers. The old frame is random
+// pixels, and the new one is the same frame with the content of a window
+// shifted and random pixels in the exposed strip. Checks that the moves
+// found reproduce the shifted content, and that nothing is found where
+// there is no scrolling or where the detector should not look.
+class ScrollDetectorTest
+{
+public:
+  ScrollDetectorTest(int width, int height);
+  virtual ~ScrollDetectorTest();
+
+  // Runs all the cases and prints the results. Returns the number of the
+  // failed cases.
+  int run();
+
+private:
+  // Shifts the content of the window by the source offset and checks that
+  // a single move with this offset covers the whole window except the
+  // exposed strip.
+  bool testScroll(const TCHAR *name, const Rect *window, int dx, int dy);
+  // Shifts the content of the rectangle vertically by dy, or fills it with
+  // new random pixels if dy is zero, and checks that no moves are found.
+  bool testNoScroll(const TCHAR *name, const Rect *changedRect, int dy);
+  // Scrolls more windows than the row budget of one call allows and
+  // checks that the detector stops at the budget.
+  bool testLineBudget();
+
+  // Applies the moves to m_oldFb and checks that the destination regions
+  // match m_newFb then.
+  bool checkMoves(const std::vector<CopyMove> *moves);
+
+  // Makes both frame buffers equal and filled with random pixels.
+  void resetFrames();
+  // Copies the content of the window from m_oldFb to m_newFb shifted by
+  // the source offset and fills the exposed strip with random pixels.
+  void scrollWindow(const Rect *window, int dx, int dy);
+  void fillRandom(FrameBuffer *fb, const Rect *rect);
+  UINT32 nextRandom();
+
+  FrameBuffer m_oldFb;
+  FrameBuffer m_newFb;
+  ScrollDetector m_detector;
+  UINT32 m_randomState;
+};
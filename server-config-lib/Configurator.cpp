@@ -635,6 +635,24 @@ bool Configurator::saveServerConfig(SettingsManager *sm)
   if (!sm->setUINT(_T("IdleTimeout"), (UINT)m_serverConfig.getIdleTimeout())) {
     saveResult = false;
   }
+  if (!sm->setUINT(_T("EncoderThreads"), m_serverConfig.getEncoderThreads())) {
+    saveResult = false;
+  }
+  if (!sm->setBoolean(_T("AutoEncodingTuning"), m_serverConfig.isAutoEncodingTuningEnabled())) {
+    saveResult = false;
+  }
+  if (!sm->setUINT(_T("TargetUpdateLatency"), m_serverConfig.getTargetUpdateLatency())) {
+    saveResult = false;
+  }
+  if (!sm->setBoolean(_T("AutoVideoDetection"), m_serverConfig.isAutoVideoDetectionEnabled())) {
+    saveResult = false;
+  }
+  if (!sm->setBoolean(_T("ScrollDetection"), m_serverConfig.isScrollDetectionEnabled())) {
+    saveResult = false;
+  }
+  if (!sm->setUINT(_T("LosslessRefinementDelay"), m_serverConfig.getLosslessRefinementDelay())) {
+    saveResult = false;
+  }
   return saveResult;
 }
 
@@ -802,6 +820,42 @@ bool Configurator::loadServerConfig(SettingsManager *sm, ServerConfig *config)
     m_isConfigLoadedPartly = true;
     m_serverConfig.setIdleTimeout((int)uintVal);
   }
+  if (!sm->getUINT(_T("EncoderThreads"), &uintVal)) {
+    loadResult = false;
+  } else {
+    m_isConfigLoadedPartly = true;
+    m_serverConfig.setEncoderThreads(uintVal);
+  }
+  if (!sm->getBoolean(_T("AutoEncodingTuning"), &boolVal)) {
+    loadResult = false;
+  } else {
+    m_isConfigLoadedPartly = true;
+    m_serverConfig.enableAutoEncodingTuning(boolVal);
+  }
+  if (!sm->getUINT(_T("TargetUpdateLatency"), &uintVal)) {
+    loadResult = false;
+  } else {
+    m_isConfigLoadedPartly = true;
+    m_serverConfig.setTargetUpdateLatency(uintVal);
+  }
+  if (!sm->getBoolean(_T("AutoVideoDetection"), &boolVal)) {
+    loadResult = false;
+  } else {
+    m_isConfigLoadedPartly = true;
+    m_serverConfig.enableAutoVideoDetection(boolVal);
+  }
+  if (!sm->getBoolean(_T("ScrollDetection"), &boolVal)) {
+    loadResult = false;
+  } else {
+    m_isConfigLoadedPartly = true;
+    m_serverConfig.enableScrollDetection(boolVal);
+  }
+  if (!sm->getUINT(_T("LosslessRefinementDelay"), &uintVal)) {
+    loadResult = false;
+  } else {
+    m_isConfigLoadedPartly = true;
+    m_serverConfig.setLosslessRefinementDelay(uintVal);
+  }
   if (!sm->getBoolean(_T("GrabTransparentWindows"), &boolVal)) {
     loadResult = false;
   } else {
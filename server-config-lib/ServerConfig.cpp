@@ -45,7 +45,13 @@ ServerConfig::ServerConfig()
   m_videoRecognitionInterval(3000), m_grabTransparentWindows(true),
   m_saveLogToAllUsersPath(false), m_hasControlPassword(false),
   m_showTrayIcon(true),
-  m_idleTimeout(0)
+  m_idleTimeout(0),
+  m_encoderThreads(1),
+  m_autoEncodingTuning(false),
+  m_targetUpdateLatency(100),
+  m_autoVideoDetection(true),
+  m_scrollDetection(true),
+  m_losslessRefinementDelay(2000)
 {
   memset(m_primaryPassword,  0, sizeof(m_primaryPassword));
   memset(m_readonlyPassword, 0, sizeof(m_readonlyPassword));
@@ -119,6 +125,12 @@ void ServerConfig::serialize(DataOutputStream *output)
   output->writeInt8(m_hasReadOnlyPassword ? 1 : 0);
   output->writeInt8(m_hasControlPassword ? 1 : 0);
   output->writeInt8(m_showTrayIcon ? 1 : 0);
+  output->writeUInt32(m_encoderThreads);
+  output->writeInt8(m_autoEncodingTuning ? 1 : 0);
+  output->writeUInt32(m_targetUpdateLatency);
+  output->writeInt8(m_autoVideoDetection ? 1 : 0);
+  output->writeInt8(m_scrollDetection ? 1 : 0);
+  output->writeUInt32(m_losslessRefinementDelay);
 
   output->writeUTF8(m_logFilePath.getString());
 }
@@ -187,6 +199,12 @@ void ServerConfig::deserialize(DataInputStream *input)
   m_hasReadOnlyPassword = input->readInt8() == 1;
   m_hasControlPassword = input->readInt8() == 1;
   m_showTrayIcon = input->readInt8() == 1;
+  m_encoderThreads = input->readUInt32();
+  m_autoEncodingTuning = input->readInt8() == 1;
+  m_targetUpdateLatency = input->readUInt32();
+  m_autoVideoDetection = input->readInt8() == 1;
+  m_scrollDetection = input->readInt8() == 1;
+  m_losslessRefinementDelay = input->readUInt32();
 
   input->readUTF8(&m_logFilePath);
 }
@@ -694,6 +712,88 @@ void ServerConfig::setVideoRecognitionInterval(unsigned int interval)
   m_videoRecognitionInterval = interval;
 }
 
+unsigned int ServerConfig::getEncoderThreads()
+{
+  AutoLock lock(&m_objectCS);
+  return m_encoderThreads;
+}
+
+void ServerConfig::setEncoderThreads(unsigned int count)
+{
+  AutoLock lock(&m_objectCS);
+
+  if (count > MAXIMAL_ENCODER_THREADS) {
+    m_encoderThreads = MAXIMAL_ENCODER_THREADS;
+  } else {
+    m_encoderThreads = count;
+  }
+}
+
+bool ServerConfig::isAutoEncodingTuningEnabled()
+{
+  AutoLock lock(&m_objectCS);
+  return m_autoEncodingTuning;
+}
+
+void ServerConfig::enableAutoEncodingTuning(bool enabled)
+{
+  AutoLock lock(&m_objectCS);
+  m_autoEncodingTuning = enabled;
+}
+
+unsigned int ServerConfig::getTargetUpdateLatency()
+{
+  AutoLock lock(&m_objectCS);
+  return m_targetUpdateLatency;
+}
+
+void ServerConfig::setTargetUpdateLatency(unsigned int latency)
+{
+  AutoLock lock(&m_objectCS);
+
+  if (latency < MINIMAL_TARGET_UPDATE_LATENCY) {
+    m_targetUpdateLatency = MINIMAL_TARGET_UPDATE_LATENCY;
+  } else {
+    m_targetUpdateLatency = latency;
+  }
+}
+
+bool ServerConfig::isAutoVideoDetectionEnabled()
+{
+  AutoLock lock(&m_objectCS);
+  return m_autoVideoDetection;
+}
+
+void ServerConfig::enableAutoVideoDetection(bool enabled)
+{
+  AutoLock lock(&m_objectCS);
+  m_autoVideoDetection = enabled;
+}
+
+bool ServerConfig::isScrollDetectionEnabled()
+{
+  AutoLock lock(&m_objectCS);
+  return m_scrollDetection;
+}
+
+void ServerConfig::enableScrollDetection(bool enabled)
+{
+  AutoLock lock(&m_objectCS);
+  m_scrollDetection = enabled;
+}
+
+unsigned int ServerConfig::getLosslessRefinementDelay()
+{
+  AutoLock lock(&m_objectCS);
+  return m_losslessRefinementDelay;
+}
+
+void ServerConfig::setLosslessRefinementDelay(unsigned int delay)
+{
+  AutoLock lock(&m_objectCS);
+  m_losslessRefinementDelay = delay;
+}
+
 std::vector<Rect> *ServerConfig::getVideoRects()
 {
   return &m_videoRects;
@@ -47,6 +47,8 @@ public:
   static const unsigned int MINIMAL_POLLING_INTERVAL = 30;
   static const unsigned int MINIMAL_LOCAL_INPUT_PRIORITY_TIMEOUT = 1;
   static const unsigned int MINIMAL_QUERY_TIMEOUT = 1;
+  static const unsigned int MAXIMAL_ENCODER_THREADS = 16;
+  static const unsigned int MINIMAL_TARGET_UPDATE_LATENCY = 10;
 
   //
   // Enum defines server action when last client disconnects
@@ -262,6 +264,38 @@ public:
   unsigned int getVideoRecognitionInterval();
   void setVideoRecognitionInterval(unsigned int interval);
 
+  // Number of threads used to encode rectangles of one framebuffer update.
+  // Values 0 and 1 mean that encoding is done in the update sender thread
+  // only.
+  unsigned int getEncoderThreads();
+  void setEncoderThreads(unsigned int count);
+
+  // If automatic encoding tuning is enabled, compression level, JPEG
+  // quality and video handling are chosen for each client from its link
+  // estimates instead of the values requested by the viewer, so that
+  // updates reach the client within the target latency (in milliseconds).
+  bool isAutoEncodingTuningEnabled();
+  void enableAutoEncodingTuning(bool enabled);
+  unsigned int getTargetUpdateLatency();
+  void setTargetUpdateLatency(unsigned int latency);
+
+  // If automatic video detection is enabled, screen areas that change
+  // frequently and look like photos are handled as video regions, in
+  // addition to the windows of the video classes.
+  bool isAutoVideoDetectionEnabled();
+  void enableAutoVideoDetection(bool enabled);
+
+  // If scroll detection is enabled, screen content found shifted since the
+  // previous update is sent as CopyRect instead of being encoded again.
+  bool isScrollDetectionEnabled();
+  void enableScrollDetection(bool enabled);
+
+  // Areas sent to a client with lossy compression (JPEG) are sent again
+  // losslessly after they have not changed for this number of
+  // milliseconds. Zero disables such refinement.
+  unsigned int getLosslessRefinementDelay();
+  void setLosslessRefinementDelay(unsigned int delay);
+
   int  getIdleTimeout();
   void setIdleTimeout(int timeout);
 
@@ -398,6 +432,22 @@ protected:
   unsigned int m_videoRecognitionInterval;
   bool m_grabTransparentWindows;
 
+  // Number of threads used to encode one framebuffer update.
+  unsigned int m_encoderThreads;
+
+  // Automatic encoding tuning.
+  bool m_autoEncodingTuning;
+  unsigned int m_targetUpdateLatency;
+
+  // Automatic video detection.
+  bool m_autoVideoDetection;
+
+  // Detection of scrolled content.
+  bool m_scrollDetection;
+
+  // Delay of the lossless refinement of lossy areas, in milliseconds.
+  unsigned int m_losslessRefinementDelay;
+
   // Socket timeout to disconnect inactive clients, in seconds
   int m_idleTimeout;
 
@@ -0,0 +1,223 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+#include "WorkerPool.h"
+
+#include "AutoLock.h"
+
+WorkerTask::~WorkerTask()
+{
+}
+
+WorkerPool::WorkerThread::WorkerThread(WorkerPool *pool)
+: m_pool(pool)
+{
+}
+
+WorkerPool::WorkerThread::~WorkerThread()
+{
+}
+
+void WorkerPool::WorkerThread::wakeUp()
+{
+  m_startEvent.notify();
+}
+
+void WorkerPool::WorkerThread::execute()
+{
+  while (!isTerminating()) {
+    m_startEvent.waitForEvent();
+    if (isTerminating()) {
+      break;
+    }
+    m_pool->processTasks();
+    m_pool->onWorkerFinished();
+  }
+}
+
+void WorkerPool::WorkerThread::onTerminate()
+{
+  m_startEvent.notify();
+}
+
+//--------------------------------------------------------------------------//
+
+WorkerPool::WorkerPool(size_t numThreads)
+: m_tasks(0),
+  m_nextTask(0),
+  m_numRunning(0),
+  m_failed(false),
+  m_busyTime(0),
+  m_elapsedTime(0)
+{
+  try {
+    for (size_t i = 1; i < numThreads; i++) {
+      WorkerThread *thread = new WorkerThread(this);
+      m_threads.push_back(thread);
+      thread->resume();
+    }
+  } catch (...) {
+    for (size_t i = 0; i < m_threads.size(); i++) {
+      m_threads[i]->terminate();
+      m_threads[i]->wait();
+      delete m_threads[i];
+    }
+    throw;
+  }
+}
+
+WorkerPool::~WorkerPool()
+{
+  for (size_t i = 0; i < m_threads.size(); i++) {
+    m_threads[i]->terminate();
+  }
+  for (size_t i = 0; i < m_threads.size(); i++) {
+    m_threads[i]->wait();
+    delete m_threads[i];
+  }
+}
+
+size_t WorkerPool::getNumThreads() const
+{
+  return m_threads.size() + 1;
+}
+
+void WorkerPool::run(std::vector<WorkerTask *> *tasks)
+{
+  INT64 startTime = getTimerValue();
+  {
+    AutoLock l(&m_lock);
+    m_tasks = tasks;
+    m_nextTask = 0;
+    m_failed = false;
+    m_busyTime = 0;
+  }
+
+  // There is no point in waking up more threads than there are tasks.
+  size_t numHelpers = 0;
+  if (tasks->size() > 1) {
+    numHelpers = min(m_threads.size(), tasks->size() - 1);
+  }
+  {
+    AutoLock l(&m_lock);
+    m_numRunning = numHelpers;
+  }
+  for (size_t i = 0; i < numHelpers; i++) {
+    m_threads[i]->wakeUp();
+  }
+
+  processTasks();
+
+  // Wait for the other threads. The done event is auto-reset and may be left
+  // signalled by a previous run, so the counter is checked each time.
+  while (true) {
+    {
+      AutoLock l(&m_lock);
+      if (m_numRunning == 0) {
+        break;
+      }
+    }
+    m_doneEvent.waitForEvent();
+  }
+
+  AutoLock l(&m_lock);
+  m_tasks = 0;
+  m_elapsedTime = getTimerValue() - startTime;
+  if (m_failed) {
+    throw Exception(m_errorMessage.getString());
+  }
+}
+
+INT64 WorkerPool::getLastBusyTime() const
+{
+  return m_busyTime;
+}
+
+INT64 WorkerPool::getLastElapsedTime() const
+{
+  return m_elapsedTime;
+}
+
+INT64 WorkerPool::getTimerValue()
+{
+  LARGE_INTEGER value;
+  if (QueryPerformanceCounter(&value) == 0) {
+    return 0;
+  }
+  return value.QuadPart;
+}
+
+INT64 WorkerPool::getTimerFrequency()
+{
+  LARGE_INTEGER value;
+  if (QueryPerformanceFrequency(&value) == 0 || value.QuadPart == 0) {
+    return 1;
+  }
+  return value.QuadPart;
+}
+
+void WorkerPool::processTasks()
+{
+  while (true) {
+    WorkerTask *task;
+    {
+      AutoLock l(&m_lock);
+      if (m_tasks == 0 || m_nextTask >= m_tasks->size()) {
+        return;
+      }
+      task = (*m_tasks)[m_nextTask++];
+    }
+
+    INT64 taskStart = getTimerValue();
+    bool failed = false;
+    StringStorage errorMessage;
+    try {
+      task->run();
+    } catch (Exception &e) {
+      failed = true;
+      errorMessage.setString(e.getMessage());
+    } catch (...) {
+      // Nothing may escape a pool thread, report it as a task failure.
+      failed = true;
+      errorMessage.setString(_T("Unknown error in a worker task"));
+    }
+    INT64 taskTime = getTimerValue() - taskStart;
+
+    AutoLock l(&m_lock);
+    m_busyTime += taskTime;
+    if (failed && !m_failed) {
+      m_failed = true;
+      m_errorMessage.setString(errorMessage.getString());
+    }
+  }
+}
+
+void WorkerPool::onWorkerFinished()
+{
+  AutoLock l(&m_lock);
+  _ASSERT(m_numRunning > 0);
+  if (--m_numRunning == 0) {
+    m_doneEvent.notify();
+  }
+}
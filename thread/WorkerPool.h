@@ -0,0 +1,132 @@
+// Copyright (C) 2009,2010,2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+#ifndef __WORKERPOOL_H__
+#define __WORKERPOOL_H__
+
+#include "util/CommonHeader.h"
+#include "util/Exception.h"
+#include "Thread.h"
+#include "LocalMutex.h"
+#include "win-system/WindowsEvent.h"
+#include <vector>
+
+// A piece of work to be executed by WorkerPool.
+class WorkerTask
+{
+public:
+  virtual ~WorkerTask();
+
+  // Do the work. This function is called from one of the pool threads, so
+  // it should not touch any data shared with other tasks of the same run
+  // without proper locking.
+  virtual void run() = 0;
+};
+
+// WorkerPool executes lists of tasks in a fixed set of threads. The thread
+// calling run() takes part in the work as well, so a pool created for N
+// threads starts N - 1 additional threads. All threads are created in the
+// constructor and stay idle between run() calls.
+class WorkerPool
+{
+public:
+  // Creates a pool of numThreads threads (including the calling thread).
+  // Zero is treated as one, in which case no additional threads are started
+  // and run() executes all tasks in the calling thread.
+  WorkerPool(size_t numThreads);
+  // Terminates all the threads and waits until they finish.
+  virtual ~WorkerPool();
+
+  // Returns the number of threads including the calling thread.
+  size_t getNumThreads() const;
+
+  // Executes all tasks from the list and returns after all of them are
+  // finished. Tasks are started in the order of the list but may finish in
+  // any order. If a task throws an Exception, other tasks are executed
+  // anyway, then an Exception with the same message is thrown from run().
+  // Other kinds of exceptions are reported the same way, with a generic
+  // message.
+  // This function must not be called from several threads at once.
+  void run(std::vector<WorkerTask *> *tasks) throw(Exception);
+
+  // Time statistics of the most recent run() call, in units of the
+  // performance counter (see getTimerFrequency()). Busy time is the time
+  // spent in WorkerTask::run() summed over all threads, elapsed time is
+  // the wall-clock time of the whole run() call.
+  INT64 getLastBusyTime() const;
+  INT64 getLastElapsedTime() const;
+
+  // Returns the current value of the high-resolution performance counter.
+  static INT64 getTimerValue();
+  // Returns the number of performance counter units per second.
+  static INT64 getTimerFrequency();
+
+protected:
+  class WorkerThread : public Thread
+  {
+  public:
+    WorkerThread(WorkerPool *pool);
+    virtual ~WorkerThread();
+
+    // Wakes up the thread to take part in the current run.
+    void wakeUp();
+
+  protected:
+    virtual void execute();
+    virtual void onTerminate();
+
+    WorkerPool *m_pool;
+    WindowsEvent m_startEvent;
+  };
+
+  // Picks tasks one by one from the current list and executes them until
+  // the list is exhausted.
+  void processTasks();
+
+  // Called by a worker thread when it has nothing more to do in the current
+  // run.
+  void onWorkerFinished();
+
+  std::vector<WorkerThread *> m_threads;
+
+  // Protects all the members below.
+  LocalMutex m_lock;
+  std::vector<WorkerTask *> *m_tasks;
+  size_t m_nextTask;
+  size_t m_numRunning;
+  bool m_failed;
+  StringStorage m_errorMessage;
+  INT64 m_busyTime;
+  INT64 m_elapsedTime;
+
+  // Signalled by the last worker finishing its part of a run.
+  WindowsEvent m_doneEvent;
+
+private:
+  // Do not allow copying objects.
+  WorkerPool(const WorkerPool &other);
+  WorkerPool &operator=(const WorkerPool &other);
+};
+
+#endif // __WORKERPOOL_H__
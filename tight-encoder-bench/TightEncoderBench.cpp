@@ -0,0 +1,246 @@
+// Copyright (C) 2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#include "TightEncoderBench.h"
+#include "rfb-sconn/TightEncoder.h"
+#include "rfb/EncodingDefs.h"
+#include "util/Exception.h"
+#include <stdio.h>
+
+TightEncoderBench::DigestOutputStream::DigestOutputStream()
+: m_size(0),
+  m_digest(0xCBF29CE484222325ULL)
+{
+}
+
+TightEncoderBench::DigestOutputStream::~DigestOutputStream()
+{
+}
+
+size_t TightEncoderBench::DigestOutputStream::write(const void *buffer,
+                                                    size_t len)
+{
+  // 64-bit FNV-1a.
+  const UINT8 *bytes = (const UINT8 *)buffer;
+  for (size_t i = 0; i < len; i++) {
+    m_digest = (m_digest ^ bytes[i]) * 0x100000001B3ULL;
+  }
+  m_size += len;
+  return len;
+}
+
+UINT64 TightEncoderBench::DigestOutputStream::getSize() const
+{
+  return m_size;
+}
+
+UINT64 TightEncoderBench::DigestOutputStream::getDigest() const
+{
+  return m_digest;
+}
+
+bool TightEncoderBench::DigestOutputStream::equals(
+  const DigestOutputStream *other) const
+{
+  return m_size == other->m_size && m_digest == other->m_digest;
+}
+
+TightEncoderBench::TightEncoderBench(int width, int height, int iterations,
+                                     int maxThreads)
+: m_iterations(iterations),
+  m_maxThreads(maxThreads),
+  m_randomState(1)
+{
+  if (width <= 0 || height <= 0 || iterations <= 0 || maxThreads <= 0) {
+    throw Exception(_T("The frame size, the number of iterations and")
+                    _T(" the number of threads should be positive"));
+  }
+  // The usual server pixel format.
+  PixelFormat pf;
+  pf.bitsPerPixel = 32;
+  pf.colorDepth = 24;
+  pf.redMax = pf.greenMax = pf.blueMax = 255;
+  pf.redShift = 16;
+  pf.greenShift = 8;
+  pf.blueShift = 0;
+  pf.bigEndian = false;
+
+  Dimension dim(width, height);
+  if (!m_frameBuffer.setProperties(&dim, &pf)) {
+    throw Exception(_T("Cannot allocate the frame buffer"));
+  }
+  drawFrame();
+}
+
+TightEncoderBench::~TightEncoderBench()
+{
+}
+
+int TightEncoderBench::run()
+{
+  Dimension dim = m_frameBuffer.getDimension();
+  _tprintf(_T("Frame %dx%d, %d iterations, up to %d threads\n"),
+           dim.width, dim.height, m_iterations, m_maxThreads);
+
+  std::vector<int> encodings;
+  encodings.push_back(EncodingDefs::TIGHT);
+  EncodeOptions options;
+  options.setEncodings(&encodings);
+  options.setCompressionLevel(6);
+
+  int failures = 0;
+  options.disableJpeg();
+  failures += runOptions(_T("Lossless"), &options);
+  options.setJpegQualityLevel(6);
+  failures += runOptions(_T("JPEG"), &options);
+  return failures;
+}
+
+int TightEncoderBench::runOptions(const TCHAR *name,
+                                  const EncodeOptions *options)
+{
+  DigestOutputStream serialOutput;
+  double speedup;
+  double serialTime = encode(options, 1, &serialOutput, &speedup);
+  _tprintf(_T("%s: 1 thread %.3f ms, %u bytes per update\n"), name,
+           serialTime,
+           (unsigned int)(serialOutput.getSize() / (m_iterations + 1)));
+
+  int failures = 0;
+  for (int numThreads = 2; numThreads <= m_maxThreads; numThreads *= 2) {
+    DigestOutputStream output;
+    double time = encode(options, numThreads, &output, &speedup);
+    if (!output.equals(&serialOutput)) {
+      _tprintf(_T("%s: %d threads: MISMATCH\n"), name, numThreads);
+      failures++;
+      continue;
+    }
+    _tprintf(_T("%s: %d threads: identical, %.3f ms, %.2fx,")
+             _T(" encoder speedup %.2f\n"),
+             name, numThreads, time, time > 0 ? serialTime / time : 0.0,
+             speedup);
+  }
+  return failures;
+}
+
+double TightEncoderBench::encode(const EncodeOptions *options,
+                                 size_t numThreads,
+                                 DigestOutputStream *output,
+                                 double *speedup)
+{
+  PixelConverter converter;
+  PixelFormat pf = m_frameBuffer.getPixelFormat();
+  converter.setPixelFormats(&pf, &pf);
+  DataOutputStream dataOutput(output);
+  TightEncoder encoder(&converter, &dataOutput);
+  encoder.setNumThreads(numThreads);
+
+  // The whole frame is changed, as on a full update request.
+  Rect frameRect = m_frameBuffer.getDimension().getRect();
+  std::vector<Rect> rects;
+  encoder.splitRectangle(&frameRect, &rects, &m_frameBuffer, options);
+
+  // The first update is not measured, it brings the frame to the cache and
+  // lets the encoder allocate its buffers. Its data is compared as well.
+  encoder.sendRectangles(&rects, &m_frameBuffer, options);
+
+  INT64 startTime = getTimerValue();
+  for (int i = 0; i < m_iterations; i++) {
+    encoder.sendRectangles(&rects, &m_frameBuffer, options);
+  }
+  INT64 elapsed = getTimerValue() - startTime;
+  *speedup = encoder.getParallelSpeedup();
+  return (double)elapsed * 1000.0 / (double)getTimerFrequency() /
+         (double)m_iterations;
+}
+
+void TightEncoderBench::drawFrame()
+{
+  Dimension dim = m_frameBuffer.getDimension();
+  int halfWidth = dim.width / 2;
+  int halfHeight = dim.height / 2;
+  UINT32 *pixels = (UINT32 *)m_frameBuffer.getBuffer();
+
+  for (int y = 0; y < dim.height; y++) {
+    UINT32 *row = pixels + (size_t)y * dim.width;
+    for (int x = 0; x < dim.width; x++) {
+      UINT32 pixel;
+      if (y < halfHeight && x < halfWidth) {
+        // Text: dark strokes on white, in lines of 16 rows.
+        bool stroke = y % 16 < 11 && (x / 3 + y / 16) % 7 != 0 &&
+                      (nextRandom() & 3) == 0;
+        pixel = stroke ? 0x202020 + (UINT32)(y / 16 % 3) * 0x300000
+                       : 0xFFFFFF;
+      } else if (y < halfHeight) {
+        // Solid blocks of a few colors.
+        static const UINT32 colors[4] = {
+          0x3A6EA5, 0xD4D0C8, 0x008080, 0xFFFFE1
+        };
+        pixel = colors[(x / 200 + y / 150) % 4];
+      } else if (x < halfWidth) {
+        // A smooth gradient.
+        pixel = ((UINT32)(x * 255 / dim.width) << 16) |
+                ((UINT32)(y * 255 / dim.height) << 8) |
+                (UINT32)((x + y) * 255 / (dim.width + dim.height));
+      } else {
+        // A photo: smooth waves of color with some noise.
+        int dx = x - halfWidth;
+        int dy = y - halfHeight;
+        UINT32 noise = nextRandom();
+        UINT32 r = 64 + (dx * dx / 97 + dy * 3) % 128 + (noise & 15);
+        UINT32 g = 64 + (dy * dy / 89 + dx * 2) % 128 + ((noise >> 4) & 15);
+        UINT32 b = 64 + ((dx + dy) * (dx - dy) / 101 % 128 + 128) % 128 +
+                   ((noise >> 8) & 15);
+        pixel = (r << 16) | (g << 8) | b;
+      }
+      row[x] = pixel;
+    }
+  }
+}
+
+UINT32 TightEncoderBench::nextRandom()
+{
+  // A fixed generator, so that a mismatch can be reproduced.
+  m_randomState = m_randomState * 1664525 + 1013904223;
+  return m_randomState ^ (m_randomState >> 16);
+}
+
+INT64 TightEncoderBench::getTimerValue()
+{
+  LARGE_INTEGER value;
+  if (QueryPerformanceCounter(&value) == 0) {
+    return 0;
+  }
+  return value.QuadPart;
+}
+
+INT64 TightEncoderBench::getTimerFrequency()
+{
+  LARGE_INTEGER value;
+  if (QueryPerformanceFrequency(&value) == 0 || value.QuadPart == 0) {
+    return 1;
+  }
+  return value.QuadPart;
+}
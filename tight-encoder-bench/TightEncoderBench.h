@@ -0,0 +1,91 @@
+// Copyright (C) 2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#pragma once
+
+#include "rfb/FrameBuffer.h"
+#include "rfb-sconn/EncodeOptions.h"
+#include "io-lib/OutputStream.h"
+
+// Encodes a synthetic frame with TightEncoder, first in one thread, then
+// with more and more worker threads, and measures the time of a full
+// update. The frame has text-like, solid, gradient and photo-like areas, so
+// that all the Tight subencodings take part. The data written by the
+// parallel encoder must be the same as in the single-threaded mode, which
+// is checked by its length and a 64-bit hash.
+class TightEncoderBench
+{
+public:
+  TightEncoderBench(int width, int height, int iterations, int maxThreads);
+  virtual ~TightEncoderBench();
+
+  // Encodes the frame without and with JPEG and prints the results.
+  // Returns the number of the thread counts for which the encoded data
+  // differed from the single-threaded one.
+  int run();
+
+private:
+  // Counts and hashes the data written to it instead of keeping it, so
+  // that the encoded data of long runs can be compared without buffering.
+  class DigestOutputStream : public OutputStream
+  {
+  public:
+    DigestOutputStream();
+    virtual ~DigestOutputStream();
+
+    virtual size_t write(const void *buffer, size_t len);
+
+    UINT64 getSize() const;
+    UINT64 getDigest() const;
+
+    bool equals(const DigestOutputStream *other) const;
+
+  private:
+    UINT64 m_size;
+    UINT64 m_digest;
+  };
+
+  // Returns the number of the thread counts which gave different data.
+  int runOptions(const TCHAR *name, const EncodeOptions *options);
+
+  // Sends the frame m_iterations + 1 times as full updates via a new
+  // encoder using numThreads threads. The encoded data is written to
+  // output.
+  // Returns the average time of an update in milliseconds and sets
+  // speedup to the parallel speedup the encoder reported for the last one.
+  double encode(const EncodeOptions *options, size_t numThreads,
+                DigestOutputStream *output, double *speedup);
+
+  void drawFrame();
+  UINT32 nextRandom();
+
+  static INT64 getTimerValue();
+  static INT64 getTimerFrequency();
+
+  FrameBuffer m_frameBuffer;
+  int m_iterations;
+  int m_maxThreads;
+  UINT32 m_randomState;
+};
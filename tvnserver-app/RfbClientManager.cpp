@@ -390,6 +390,8 @@ void RfbClientManager::addNewConnection(SocketIPv6 *socket,
                                               constViewPort,
                                               &m_dynViewPort,
                                               timeout,
+                                              &m_encodedRectCache,
+                                              &m_convertedFbStore,
                                               m_log));
   m_nextClientId++;
 }
@@ -27,6 +27,8 @@
 
 #include "util/ListenerContainer.h"
 #include "rfb-sconn/RfbClient.h"
+#include "rfb-sconn/EncodedRectCache.h"
+#include "rfb-sconn/ConvertedFrameBufferStore.h"
 #include "thread/AutoLock.h"
 #include "thread/Thread.h"
 #include "thread/LocalMutex.h"
@@ -151,6 +153,12 @@ private:
   // Inforamtion
   unsigned int m_nextClientId;
 
+  // Encoded rectangles shared by update senders of all clients.
+  EncodedRectCache m_encodedRectCache;
+  // Pixels converted to client pixel formats, shared by update senders of
+  // all clients.
+  ConvertedFrameBufferStore m_convertedFbStore;
+
   NewConnectionEvents *m_newConnectionEvents;
 
   LogWriter *m_log;
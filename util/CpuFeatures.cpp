@@ -0,0 +1,44 @@
+// Copyright (C) 2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#include "CpuFeatures.h"
+
+#ifdef _M_IX86
+#include <intrin.h>
+#endif
+
+bool CpuFeatures::hasSse2()
+{
+#if defined(_M_X64)
+  // All x64 processors support SSE2.
+  return true;
+#elif defined(_M_IX86)
+  int cpuInfo[4];
+  __cpuid(cpuInfo, 1);
+  return (cpuInfo[3] & (1 << 26)) != 0;
+#else
+  return false;
+#endif
+}
@@ -0,0 +1,43 @@
+// Copyright (C) 2011,2012 GlavSoft LLC.
+// All rights reserved.
+//
+//-------------------------------------------------------------------------
+// This file is part of the TightVNC software.  Please visit our Web site:
+//
+//                       http://www.tightvnc.com/
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//-------------------------------------------------------------------------
+//
+
+
+#ifndef __CPUFEATURES_H__
+#define __CPUFEATURES_H__
+
+// CpuFeatures tells which optional instruction sets the processor
+// supports, so that code using them can fall back to plain C++ when they
+// are not available.
+class CpuFeatures
+{
+public:
+  // Returns true if SSE2 instructions can be used: always on x64, on x86
+  // if CPUID reports them. Returns false on other platforms.
+  static bool hasSse2();
+
+private:
+  CpuFeatures();
+};
+
+#endif // __CPUFEATURES_H__